@@ -10,16 +10,25 @@
 
 #include "i2c_busio.h"
 
-#define VERSION         "1.1"          ///< Software revision number (x.x)
-#define RELDATE         "11/22/2024"   ///< Software revision date (MM/DD/YYYY)
+#define VERSION         "1.2"          ///< Software revision number (x.x)
+#define RELDATE         "10/16/2026"   ///< Software revision date (MM/DD/YYYY)
 
 // Constructor with initialization
-I2C::I2C(TwoWire *tw, PinNumber scl, PinNumber sda, uint32_t clock) {
+I2C::I2C(TwoWire *tw, PinNumber scl, PinNumber sda, uint32_t clock) : wire_port(tw) {
     i2c = tw;
     scl_gpio = scl;
     sda_gpio = sda;
     clock_freq = clock;
 
+    // Empty transaction queue using the default transport
+    port = &wire_port;
+    memset(queue, 0, sizeof(queue));
+    memset(&urgent, 0, sizeof(urgent));
+    memset(&stats, 0, sizeof(stats));
+    head = 0;
+    count = 0;
+    staged = nullptr;
+
     // Configure the underlying TwoWire device
     i2c->setClock(clock);
     i2c->setSCL(scl);
@@ -39,6 +48,7 @@ bool I2C::reserved_addr(uint8_t addr) {
 
 // Check connection to a device
 bool I2C::connected(uint8_t address) {
+    flush();
     i2c->beginTransmission(address);
     return (i2c->endTransmission() == 0);
 }
@@ -47,6 +57,7 @@ bool I2C::connected(uint8_t address) {
 uint I2C::scan(bool *addresses_found, bool verbose) {
     uint number_found = 0; // Number of addresses found
 
+    flush();
     for (uint8_t addr = 0; addr < 128; addr++) {
         // Skip over any reserved addresses.
         if (reserved_addr(addr)) {
@@ -83,7 +94,10 @@ uint I2C::scan(bool *addresses_found, bool verbose) {
 // Read from a device at specified address into a buffer
 uint I2C::readfrom(uint8_t address, uint8_t *buffer, size_t len, bool nostop) {
     int bytes_coming;
-    int bytes_read = 0;;
+    int bytes_read = 0;
+
+    // Let queued transactions finish first
+    flush();
     
     // Request bytes from device
     bytes_coming = i2c->requestFrom(address, len, !nostop);
@@ -104,6 +118,9 @@ uint I2C::writeto(uint8_t address, uint8_t *buffer, size_t len, bool nostop) {
     int bytes_written;
     int rv;
 
+    // Let queued transactions finish first
+    flush();
+
     i2c->beginTransmission(address);
     bytes_written = i2c->write(buffer, len);
     rv = i2c->endTransmission(!nostop);
@@ -124,9 +141,12 @@ uint I2C::writeto_then_readfrom(uint8_t address,
                                size_t in_len) {
     int bytes_written;
     int bytes_coming;
-    int bytes_read;
+    int bytes_read = 0;
     int rv;
 
+    // Let queued transactions finish first
+    flush();
+
     // Write with no stop bit to keep control of the bus
     i2c->beginTransmission(address);
     bytes_written = i2c->write(out_buffer, out_len);
@@ -151,6 +171,290 @@ uint I2C::writeto_then_readfrom(uint8_t address,
     return bytes_read;
 };
 
+// Queue a transaction to run in the background
+bool I2C::submit(uint8_t address, const uint8_t *out_buffer, size_t out_len,
+                 uint8_t *in_buffer, size_t in_len, 
+                 i2c_callback_t callback, void *context, bool priority) {
+    i2c_txn_t *txn;
+
+    if ((out_len > I2C_TXN_BUFFER_SIZE) || (in_len > 255)) {
+        return false;
+    }
+
+    if (priority) {
+        // Supersede a waiting priority transaction to the same device,
+        // otherwise wait for the priority slot to free up
+        if ((urgent.status == I2C_TXN_QUEUED) && (urgent.address == address)) {
+            stats.replaced++;
+        } else {
+            while (urgent.status != I2C_TXN_FREE) {
+                wait();
+            }
+        }
+        txn = &urgent;
+    } else {
+        txn = claim();
+    }
+
+    txn->address = address;
+    txn->phase = 0;
+    txn->out_len = out_len;
+    memcpy(txn->out, out_buffer, out_len);
+    txn->in = in_buffer;
+    txn->in_len = in_len;
+    txn->callback = callback;
+    txn->context = context;
+    txn->queued_us = micros();
+    txn->status = I2C_TXN_QUEUED;
+
+    // Get it onto the bus right away if the bus is free
+    service();
+    return true;
+}
+
+// Start building a queued write transaction
+void I2C::queue_begin(uint8_t address) {
+    if (staged) {
+        queue_end();
+    }
+    staged = claim();
+    staged->address = address;
+    staged->phase = 0;
+    staged->out_len = 0;
+    staged->in = nullptr;
+    staged->in_len = 0;
+    staged->callback = nullptr;
+    staged->context = nullptr;
+}
+
+// Add a byte to the write transaction being built
+bool I2C::queue_write(uint8_t byte) {
+    if ((staged == nullptr) || (staged->out_len >= I2C_TXN_BUFFER_SIZE)) {
+        return false;
+    }
+    staged->out[staged->out_len++] = byte;
+    return true;
+}
+
+// Queue the write transaction being built
+void I2C::queue_end(void) {
+    if (staged) {
+        staged->queued_us = micros();
+        staged->status = I2C_TXN_QUEUED;
+        staged = nullptr;
+        service();
+    }
+}
+
+// Advance queued transactions
+void I2C::service(void) {
+    i2c_txn_t *txn;
+
+    while (true) {
+        // Check on the transaction in progress
+        txn = nullptr;
+        if (urgent.status == I2C_TXN_ACTIVE) {
+            txn = &urgent;
+        } else if (count && (queue[head].status == I2C_TXN_ACTIVE)) {
+            txn = &queue[head];
+        }
+        if (txn) {
+            uint8_t rv = port->poll(txn);
+            if (rv == I2C_PORT_BUSY) {
+                return;
+            }
+            complete(txn, (rv == I2C_PORT_DONE));
+        }
+
+        // Start the next transaction, priority slot first
+        if (urgent.status == I2C_TXN_QUEUED) {
+            txn = &urgent;
+        } else if (count && (queue[head].status == I2C_TXN_QUEUED)) {
+            txn = &queue[head];
+        } else {
+            return;
+        }
+        txn->status = I2C_TXN_ACTIVE;
+        txn->start_us = micros();
+        if (!port->start(txn)) {
+            complete(txn, false);
+        }
+    }
+}
+
+// Service the queue and wait on the transfer still in progress
+void I2C::wait(void) {
+    service();
+    if (urgent.status == I2C_TXN_ACTIVE) {
+        port->wait(&urgent);
+    } else if (count && (queue[head].status == I2C_TXN_ACTIVE)) {
+        port->wait(&queue[head]);
+    }
+}
+
+// Wait for all queued transactions to complete
+void I2C::flush(void) {
+    while (pending()) {
+        wait();
+    }
+}
+
+// Wait for the priority transaction to complete
+void I2C::flush_priority(void) {
+    while (urgent.status != I2C_TXN_FREE) {
+        wait();
+    }
+}
+
+// Number of transactions queued or in progress
+uint I2C::pending(void) {
+    uint n = count;
+
+    if (staged) {
+        n--;
+    }
+    if (urgent.status != I2C_TXN_FREE) {
+        n++;
+    }
+    return n;
+}
+
+// Replace the transport used for queued transactions
+void I2C::set_port(I2C_Port *new_port) {
+    flush();
+    port = (new_port) ? new_port : &wire_port;
+}
+
+// Claim the next free queue slot
+i2c_txn_t *I2C::claim(void) {
+    if (count == I2C_QUEUE_SIZE) {
+        stats.stalls++;
+        while (count == I2C_QUEUE_SIZE) {
+            wait();
+        }
+    }
+
+    i2c_txn_t *txn = &queue[(head + count) % I2C_QUEUE_SIZE];
+    txn->status = I2C_TXN_STAGED;
+    count++;
+    if (count > stats.max_depth) {
+        stats.max_depth = count;
+    }
+    return txn;
+}
+
+// Finish a transaction and run its callback
+void I2C::complete(i2c_txn_t *txn, bool ok) {
+    i2c_txn_t done = *txn;
+    uint32_t latency = micros() - txn->queued_us;
+
+    // Release the slot before the callback, which may queue more work
+    txn->status = I2C_TXN_FREE;
+    if (txn != &urgent) {
+        head = (head + 1) % I2C_QUEUE_SIZE;
+        count--;
+    }
+
+    if (ok) {
+        stats.completed++;
+    } else {
+        stats.errors++;
+    }
+    if (latency > stats.max_latency_us) {
+        stats.max_latency_us = latency;
+    }
+    if ((txn == &urgent) && (latency > stats.max_priority_latency_us)) {
+        stats.max_priority_latency_us = latency;
+    }
+
+    if (done.callback) {
+        done.status = (ok) ? I2C_TXN_DONE : I2C_TXN_ERROR;
+        done.callback(&done);
+    }
+}
+
+#if defined(ARDUINO_ARCH_STM32)
+
+// Start an interrupt-driven transfer using the HAL sequential transfer
+// functions.  A write-then-read transaction holds the bus between the
+// two phases with a repeated start.
+bool I2C_Wire_Port::start(i2c_txn_t *txn) {
+    I2C_HandleTypeDef *handle = &(i2c->getHandle()->handle);
+    uint16_t addr = txn->address << 1;
+
+    if (txn->out_len == 0) {
+        // Read only
+        txn->phase = 1;
+        return (HAL_I2C_Master_Seq_Receive_IT(handle, addr, txn->in, txn->in_len,
+                                              I2C_FIRST_AND_LAST_FRAME) == HAL_OK);
+    }
+
+    txn->phase = 0;
+    uint32_t options = (txn->in_len) ? I2C_FIRST_FRAME : I2C_FIRST_AND_LAST_FRAME;
+    return (HAL_I2C_Master_Seq_Transmit_IT(handle, addr, txn->out, txn->out_len,
+                                           options) == HAL_OK);
+}
+
+// Check progress of the interrupt-driven transfer
+uint8_t I2C_Wire_Port::poll(i2c_txn_t *txn) {
+    I2C_HandleTypeDef *handle = &(i2c->getHandle()->handle);
+
+    if (HAL_I2C_GetState(handle) != HAL_I2C_STATE_READY) {
+        if ((micros() - txn->start_us) > I2C_TXN_TIMEOUT_US) {
+            HAL_I2C_Master_Abort_IT(handle, txn->address << 1);
+            return I2C_PORT_ERROR;
+        }
+        return I2C_PORT_BUSY;
+    }
+
+    if (HAL_I2C_GetError(handle) != HAL_I2C_ERROR_NONE) {
+        return I2C_PORT_ERROR;
+    }
+
+    if ((txn->phase == 0) && txn->in_len) {
+        // Write phase done, read the reply after a repeated start
+        txn->phase = 1;
+        if (HAL_I2C_Master_Seq_Receive_IT(handle, txn->address << 1, txn->in, txn->in_len,
+                                          I2C_LAST_FRAME) != HAL_OK) {
+            return I2C_PORT_ERROR;
+        }
+        return I2C_PORT_BUSY;
+    }
+
+    return I2C_PORT_DONE;
+}
+
+#else
+
+// Carry out the transfer with the blocking TwoWire calls
+bool I2C_Wire_Port::start(i2c_txn_t *txn) {
+    failed = false;
+
+    if (txn->out_len) {
+        i2c->beginTransmission(txn->address);
+        i2c->write(txn->out, txn->out_len);
+        failed = (i2c->endTransmission(txn->in_len == 0) != 0);
+    }
+
+    if (!failed && txn->in_len) {
+        uint8_t n = i2c->requestFrom(txn->address, (size_t)txn->in_len, true);
+        for (uint8_t i = 0; i < n; i++) {
+            txn->in[i] = i2c->read();
+        }
+        failed = (n != txn->in_len);
+    }
+
+    return true;
+}
+
+// Blocking transfers are complete as soon as they start
+uint8_t I2C_Wire_Port::poll(i2c_txn_t *txn) {
+    (void)txn;
+    return (failed) ? I2C_PORT_ERROR : I2C_PORT_DONE;
+}
+
+#endif
+
 // Get software revision number
 void I2C::version(char *buffer, size_t buffer_size) {
   strncpy(buffer, VERSION, buffer_size);
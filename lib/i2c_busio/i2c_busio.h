@@ -20,6 +20,117 @@
 
 typedef uint32_t PinNumber;                 ///< GPIO pin number
 
+#define I2C_QUEUE_SIZE          8           ///< Queued transaction slots
+#define I2C_TXN_BUFFER_SIZE     16          ///< Outgoing bytes held per transaction
+#define I2C_TXN_TIMEOUT_US      10000       ///< Abort transactions active longer than this
+
+/// @brief Queued transaction status
+enum I2C_TXN_STATUS {
+    I2C_TXN_FREE = 0,                       ///< Slot is unused
+    I2C_TXN_STAGED,                         ///< Being filled by `queue_write()`
+    I2C_TXN_QUEUED,                         ///< Waiting for the bus
+    I2C_TXN_ACTIVE,                         ///< Transfer in progress
+    I2C_TXN_DONE,                           ///< Completed successfully
+    I2C_TXN_ERROR,                          ///< Failed (NACK, bus error or timeout)
+};
+
+/// @brief Transfer progress reported by `I2C_Port::poll()`
+enum I2C_PORT_STATUS {
+    I2C_PORT_BUSY = 0,                      ///< Transfer still in progress
+    I2C_PORT_DONE,                          ///< Transfer completed
+    I2C_PORT_ERROR,                         ///< Transfer failed
+};
+
+struct i2c_txn_t;
+
+/// @brief Transaction completion callback
+typedef void (*i2c_callback_t)(i2c_txn_t *txn);
+
+/**
+ *  @brief Queued I2C transaction
+ *  @note Outgoing bytes are copied into the transaction, so the caller's
+ *        buffer may be reused as soon as it is submitted.  The incoming
+ *        buffer must remain valid until the callback has run.
+ */
+struct i2c_txn_t {
+    uint8_t address;                        ///< 7-bit I2C address
+    uint8_t status;                         ///< `I2C_TXN_STATUS` value
+    uint8_t phase;                          ///< Port-specific transfer phase
+    uint8_t out_len;                        ///< Number of bytes to write
+    uint8_t out[I2C_TXN_BUFFER_SIZE];       ///< Bytes to write
+    uint8_t *in;                            ///< Buffer for bytes read (nullptr=write only)
+    uint8_t in_len;                         ///< Number of bytes to read
+    uint32_t queued_us;                     ///< Time the transaction was queued
+    uint32_t start_us;                      ///< Time the transfer was started
+    i2c_callback_t callback;                ///< Completion callback (nullptr=none)
+    void *context;                          ///< Caller data passed to the callback
+};
+
+/**
+ *  @brief I2C queue statistics
+ */
+struct i2c_queue_stats_t {
+    uint32_t completed;                     ///< Transactions completed successfully
+    uint32_t errors;                        ///< Transactions that failed
+    uint32_t replaced;                      ///< Priority transactions superseded before starting
+    uint32_t stalls;                        ///< Submissions that waited for a free slot
+    uint32_t max_latency_us;                ///< Longest time from queued to completed
+    uint32_t max_priority_latency_us;       ///< Longest time for a priority transaction
+    uint8_t max_depth;                      ///< Most transactions waiting at once
+};
+
+/**
+ *  @brief Transport used by the I2C class to move queued transactions.
+ *  @details A port starts a transfer and then reports its progress when
+ *           polled, so the CPU is free while the bytes are on the bus.
+ */
+class I2C_Port {
+public:
+    /**
+     *  @brief Start transferring a transaction
+     *  @param txn: Transaction to transfer
+     *  @returns true=transfer started, false=could not start
+     */
+    virtual bool start(i2c_txn_t *txn) = 0;
+
+    /**
+     *  @brief Check progress of the transaction being transferred
+     *  @param txn: Transaction passed to `start()`
+     *  @returns `I2C_PORT_STATUS` value
+     */
+    virtual uint8_t poll(i2c_txn_t *txn) = 0;
+
+    /**
+     *  @brief Called while the queue has nothing to do but wait for the
+     *         transfer in progress (e.g. queue full or flushing)
+     *  @param txn: Transaction passed to `start()`
+     */
+    virtual void wait(i2c_txn_t *txn) { (void)txn; }
+};
+
+/**
+ *  @brief Default port for the `TwoWire` device.
+ *  @details On STM32 targets the transfer is started with the interrupt-driven
+ *           HAL sequential transfer functions and completes in the background.
+ *           Elsewhere the transfer is carried out by `start()` using the
+ *           blocking `TwoWire` calls.
+ */
+class I2C_Wire_Port : public I2C_Port {
+public:
+    /**
+     *  @brief Create a port for a `TwoWire` device
+     *  @param tw: Wire device used to access the I2C bus
+     */
+    I2C_Wire_Port(TwoWire *tw) : i2c(tw) {}
+
+    bool start(i2c_txn_t *txn) override;
+    uint8_t poll(i2c_txn_t *txn) override;
+
+private:
+    TwoWire *i2c;                           // I2C bus
+    bool failed = false;                    // Last blocking transfer failed
+};
+
 /**
  *  @brief The I2C bus I/O class provides a simpler higher-level
  *         interface to access the I2C buses available on an
@@ -109,6 +220,88 @@ public:
                               uint8_t *in_buffer,
                               size_t in_len);
 
+    /**
+     *  @brief Queue a transaction to run in the background.
+     *  @param address: I2C address
+     *  @param out_buffer: Bytes to be written (copied into the queue)
+     *  @param out_len: Number of bytes to be written (max I2C_TXN_BUFFER_SIZE)
+     *  @param in_buffer: Buffer for bytes to be read (nullptr=write only)
+     *  @param in_len: Number of bytes to be read
+     *  @param callback: Function called from `service()` when the transaction
+     *                   completes or fails (nullptr=none)
+     *  @param context: Caller data made available to the callback
+     *  @param priority: true=run ahead of all queued transactions
+     *  @returns true=transaction queued, false=too many bytes to write
+     *  @note If the queue is full, the bus is serviced until a slot frees up.
+     *  @note Only one priority transaction waits at a time.  A newer priority
+     *        transaction to the same address replaces one that has not yet
+     *        started, so only the latest value (e.g. a DAC level) is sent.
+     */
+    bool submit(uint8_t address,
+                const uint8_t *out_buffer,
+                size_t out_len,
+                uint8_t *in_buffer = nullptr,
+                size_t in_len = 0,
+                i2c_callback_t callback = nullptr,
+                void *context = nullptr,
+                bool priority = false);
+
+    /**
+     *  @brief Start building a queued write transaction byte by byte.
+     *  @param address: I2C address
+     *  @note Mirrors `TwoWire::beginTransmission()` for drivers that stream
+     *        their output one byte at a time.
+     */
+    void queue_begin(uint8_t address);
+
+    /**
+     *  @brief Add a byte to the write transaction being built.
+     *  @param byte: Byte to be written
+     *  @returns true=byte added, false=transaction is full
+     */
+    bool queue_write(uint8_t byte);
+
+    /**
+     *  @brief Queue the write transaction being built.
+     */
+    void queue_end(void);
+
+    /**
+     *  @brief Advance queued transactions
+     *  @note Starts the next transaction when the bus is free and runs the
+     *        completion callbacks.  Call frequently from the main loop.
+     */
+    void service(void);
+
+    /**
+     *  @brief Wait for all queued transactions to complete.
+     */
+    void flush(void);
+
+    /**
+     *  @brief Wait for the priority transaction, if any, to complete.
+     *  @note Only waits on the transfer in progress and the priority slot,
+     *        not the rest of the queue.
+     */
+    void flush_priority(void);
+
+    /**
+     *  @brief Number of transactions queued or in progress
+     */
+    uint pending(void);
+
+    /**
+     *  @brief Replace the transport used for queued transactions
+     *  @param port: Port to use (nullptr=default `TwoWire` port)
+     *  @note The queue is flushed before the port is changed.
+     */
+    void set_port(I2C_Port *port);
+
+    /**
+     *  @brief Get the queue statistics
+     */
+    const i2c_queue_stats_t &queue_stats(void) { return stats; }
+
     /**
      *  @brief Retrieve software revision date as a string.
      *  @param buffer: Buffer to copy revision date string into (MM/DD/YYYY)
@@ -134,6 +327,34 @@ private:
     PinNumber scl_gpio;                     // GPIO port for SCL
     uint32_t clock_freq;                    // Requested clock frequency
 
+    I2C_Wire_Port wire_port;                // Default transport
+    I2C_Port *port;                         // Transport for queued transactions
+    i2c_txn_t queue[I2C_QUEUE_SIZE];        // Transaction slots (ring)
+    uint8_t head;                           // Oldest slot
+    uint8_t count;                          // Slots in use
+    i2c_txn_t urgent;                       // Priority transaction slot
+    i2c_txn_t *staged;                      // Slot being filled by queue_write()
+    i2c_queue_stats_t stats;                // Queue statistics
+
+    /**
+     *  @brief Service the queue, then let the port wait on the transfer
+     *         still in progress
+     */
+    void wait(void);
+
+    /**
+     *  @brief Claim the next free queue slot, waiting for one if necessary
+     *  @returns Claimed slot (status I2C_TXN_STAGED)
+     */
+    i2c_txn_t *claim(void);
+
+    /**
+     *  @brief Finish a transaction and run its callback
+     *  @param txn: Transaction that completed or failed
+     *  @param ok: true=transfer completed, false=transfer failed
+     */
+    void complete(i2c_txn_t *txn, bool ok);
+
     /** 
      *  @brief Indentify I2C reserved addresses
      *  @param Address to check
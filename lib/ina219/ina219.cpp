@@ -9,11 +9,14 @@
  */
 #include "ina219.h"
 
-#define VERSION		"1.1"          ///< Software revision number (x.x)
-#define RELDATE		"11/20/2024"   ///< Software revision date (MM/DD/YYYY)
+#define VERSION		"1.2"          ///< Software revision number (x.x)
+#define RELDATE		"10/16/2026"   ///< Software revision date (MM/DD/YYYY)
 
 // Default constructor
 INA219::INA219() {
+	_calibration = 0;
+	_cal_check_time = 0;
+	_i2c_bytes = 0;
 }
 
 // Initializator
@@ -106,6 +109,7 @@ void INA219::set_calibration(uint16_t calibration_value,
 	// Program calibration register and cache value
 	write_register(INA219_CALIBRATION_REG, calibration_value);
 	_calibration = calibration_value;
+	_cal_check_time = millis();
 
 	// Set scaling factors for easy conversion
 	_current_divider_mA = 1000U/i_lsb;
@@ -172,11 +176,12 @@ uint16_t INA219::get_current_raw() {
 		return 0;
 	}
 
-	// To avoid risk of device reset during sharp load, re-apply
-	// the calibration as a precaution
-	write_register(INA219_CALIBRATION_REG, _calibration);
-
+	// A zero reading may mean the device was reset during a sharp load
+	// and lost its calibration, re-apply it and read again if so
 	current_raw = read_register(INA219_CURRENT_REG);
+	if ((current_raw == 0) && restore_calibration()) {
+		current_raw = read_register(INA219_CURRENT_REG);
+	}
 	return current_raw;
 }
 
@@ -210,11 +215,60 @@ uint32_t INA219::get_power_mW() {
 		return 0;
 	}
 
-	// Risk of device reset during sharp load, re-apply the calibration by precaution
-	write_register(INA219_CALIBRATION_REG, _calibration);
+	// Read power register, re-applying the calibration if the device was
+	// reset during a sharp load
+	uint16_t power_raw = read_register(INA219_POWER_REG);
+	if ((power_raw == 0) && restore_calibration()) {
+		power_raw = read_register(INA219_POWER_REG);
+	}
 
-	// Read power register and calculate power value
-	return (read_register(INA219_POWER_REG) * _power_multiplier_uW)/1000U;
+	// Calculate power value
+	return (power_raw * _power_multiplier_uW)/1000U;
+}
+
+// Read several measurement registers in one pass
+bool INA219::read_all(ina219_snapshot_t &snapshot, uint8_t registers) {
+	bool ok;
+
+	memset(&snapshot, 0, sizeof(snapshot));
+	_i2c_bytes = 0;
+
+	if (registers & INA219_SNAPSHOT_SHUNT) {
+		snapshot.shunt_raw = (int16_t)read_register(INA219_SHUNT_REG);
+	}
+	if (registers & INA219_SNAPSHOT_BUS) {
+		snapshot.bus_raw = read_register(INA219_BUS_REG);
+	}
+	if (registers & INA219_SNAPSHOT_POWER) {
+		snapshot.power_raw = read_register(INA219_POWER_REG);
+	}
+	if (registers & INA219_SNAPSHOT_CURRENT) {
+		snapshot.current_raw = read_register(INA219_CURRENT_REG);
+	}
+	ok = (_i2c_bytes == 3 * __builtin_popcount(registers & INA219_SNAPSHOT_ALL));
+
+	// A zero current reading with current flowing through the shunt means
+	// the calibration was lost, re-apply it and refresh the dependent registers
+	if ((registers & INA219_SNAPSHOT_CURRENT) && (snapshot.current_raw == 0) &&
+			!((registers & INA219_SNAPSHOT_SHUNT) && (snapshot.shunt_raw == 0)) &&
+			restore_calibration()) {
+		snapshot.current_raw = read_register(INA219_CURRENT_REG);
+		if (registers & INA219_SNAPSHOT_POWER) {
+			snapshot.power_raw = read_register(INA219_POWER_REG);
+		}
+	}
+
+	// Scale the readings
+	snapshot.shunt_voltage_uV = snapshot.shunt_raw * 10;
+	snapshot.bus_voltage_mV = (snapshot.bus_raw >> 3) * 4;
+	snapshot.overflow = (snapshot.bus_raw & 1);
+	if (_calibration) {
+		snapshot.current_mA = snapshot.current_raw/_current_divider_mA;
+		snapshot.power_mW = (snapshot.power_raw * _power_multiplier_uW)/1000U;
+	}
+	snapshot.i2c_bytes = _i2c_bytes;
+
+	return ok;
 }
 
 // Get software revision number
@@ -231,16 +285,16 @@ void INA219::reldate(char *buffer, size_t buffer_size) {
 
 // Reads 16-bit register value from sensor register
 // Value is read as two bytes in MSB, LSB order
+// Register pointer is set and the value read back in a single transaction
+// using a repeated start.
 uint16_t INA219::read_register(uint8_t reg_addr) {
-	uint8_t buffer_in[2];
-	uint8_t buffer_out[1];
+	uint8_t buffer_in[2] = { 0, 0 };
+	uint8_t buffer_out[1] = { reg_addr };
 
-	// Set register pointer
-	buffer_out[0] = reg_addr;
-	i2c_bus->writeto(i2c_addr, buffer_out, 1, false);
-
-	// Read two-byte register
-	i2c_bus->readfrom(i2c_addr, buffer_in, 2, false);
+	uint n = i2c_bus->writeto_then_readfrom(i2c_addr, buffer_out, 1, buffer_in, 2);
+	if (n) {
+		_i2c_bytes += 1 + n;
+	}
 	return ((buffer_in[0] << 8) + buffer_in[1]);
 }
 
@@ -251,5 +305,20 @@ void INA219::write_register(uint8_t reg_addr, uint16_t val) {
 	uint8_t buffer_out[3] = { reg_addr, (uint8_t)(val >> 8), (uint8_t)(val & 0xFF) };
 
 	// Write to indicated register pointer
-	i2c_bus->writeto(i2c_addr, buffer_out, 3, false);
+	_i2c_bytes += i2c_bus->writeto(i2c_addr, buffer_out, 3, false);
+}
+
+// Re-apply the calibration value if the sensor has lost it
+// A zero reading is also what no current gives, so the register is only
+// read back on a slow timer rather than for every zero reading
+bool INA219::restore_calibration(void) {
+	if (!_calibration || (millis() - _cal_check_time < INA219_CAL_CHECK_MS)) {
+		return false;
+	}
+	_cal_check_time = millis();
+	if (read_register(INA219_CALIBRATION_REG) != _calibration) {
+		write_register(INA219_CALIBRATION_REG, _calibration);
+		return true;
+	}
+	return false;
 }
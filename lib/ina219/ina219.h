@@ -39,6 +39,10 @@ const uint16_t INA219_CAL = 10240;		///< 0.1 ohm shunt, 32V bus, PGA=/8, 40uA LS
 const uint16_t INA219_ILSB = 40;			///< Shunt current LSB in uAmp
 const uint16_t INA219_PLSB = 20*INA219_ILSB;	///< Power LSB in uWatts
 
+/// Shortest time between reads of the calibration register to check it
+/// hasn't been lost (ms)
+const uint32_t INA219_CAL_CHECK_MS = 1000;
+
 //
 // Configuration register manipulation
 //
@@ -117,6 +121,32 @@ enum INA219_OPERATION_MODE {
 	SANDBVOLT_CONTINUOUS = 0x07,	///< shunt and bus voltage continuous
 };
 
+/// @brief Register selection flags for `INA219::read_all()`
+enum INA219_SNAPSHOT_REGS {
+	INA219_SNAPSHOT_SHUNT = 0x01,		///< Shunt voltage register
+	INA219_SNAPSHOT_BUS = 0x02,			///< Bus voltage register
+	INA219_SNAPSHOT_POWER = 0x04,		///< Power register
+	INA219_SNAPSHOT_CURRENT = 0x08,	///< Current register
+	INA219_SNAPSHOT_ALL = 0x0F,			///< All measurement registers
+};
+
+/**
+ *  @brief Set of measurement register readings taken in one pass.
+ *  @note Fields for registers that were not selected are left at zero.
+ */
+struct ina219_snapshot_t {
+	int16_t shunt_raw;					///< Shunt voltage register (10 uV/LSB)
+	uint16_t bus_raw;						///< Bus voltage register (4 mV/LSB in bits 15:3)
+	uint16_t power_raw;					///< Power register
+	uint16_t current_raw;				///< Current register
+	uint32_t shunt_voltage_uV;	///< Shunt voltage in microvolts
+	uint32_t bus_voltage_mV;		///< Bus voltage in millivolts
+	uint32_t power_mW;					///< Power in milliwatts
+	uint32_t current_mA;				///< Current in milliamperes
+	bool overflow;							///< Math overflow flag from the bus voltage register
+	uint16_t i2c_bytes;					///< I2C data bytes moved to take the snapshot
+};
+
 /**
  *  @brief Class for interfacing with a TI INA219x current/power sensor.
  */
@@ -277,6 +307,20 @@ public:
 	 */
 	uint32_t get_power_mW(void);
 
+	/**
+	 *  @brief Read several measurement registers in one pass.
+	 *  @param snapshot: Structure to receive the raw and scaled readings
+	 *  @param registers: `INA219_SNAPSHOT_REGS` flags selecting the registers
+	 *                    to read (default is all four measurement registers)
+	 *  @returns true=all selected registers were read, false=I2C error
+	 *  @note Each register is fetched with a single write-then-read I2C
+	 *        transaction.  The calibration register is only re-checked when
+	 *        the current register reads zero, which is how a sensor reset
+	 *        during a sharp load step shows up, and at most every
+	 *        `INA219_CAL_CHECK_MS`, as it also reads zero with no current.
+	 */
+	bool read_all(ina219_snapshot_t &snapshot, uint8_t registers = INA219_SNAPSHOT_ALL);
+
 	/** 
 	 *  @brief Read the overflow flag from the bus voltage A/D register.
 	 *  @returns true=overflow flag was set, false=overflow flag was clear.
@@ -325,9 +369,12 @@ private:
 	INA219_PGA_GAIN _gain;						// Cached PGA gain
 
 	uint16_t _calibration; 						// Cached calibration register value
+	uint32_t _cal_check_time;					// millis() time the calibration was last checked
 	uint16_t _current_divider_mA;			// Divide current register value to get mA
 	uint16_t _power_multiplier_uW;		// Multiply power register value to get uW
 
+	uint16_t _i2c_bytes;							// I2C data bytes moved since last cleared
+
 	/**
 	 * @brief Writes 16-bit value to a device register.
 	 *        The value is transmitted as two bytes in MSB, LSB order.
@@ -342,6 +389,17 @@ private:
 	 *  @returns Value read from register
 	 */
 	uint16_t read_register(uint8_t reg_addr);
+
+	/**
+	 *  @brief Re-apply the cached calibration value if the sensor has lost it.
+	 *  @returns true=calibration was restored, false=calibration was intact
+	 *           or not checked
+	 *  @note A brown-out reset of the sensor during a sharp load step clears
+	 *        the calibration register, which makes the current and power
+	 *        registers read zero.  The register is read back at most every
+	 *        `INA219_CAL_CHECK_MS`.
+	 */
+	bool restore_calibration(void);
 };
 
 #endif
@@ -9,8 +9,8 @@
  */
 #include "mcp4726.h"
 
-#define VERSION		"1.1"          ///< Software revision number (x.x)
-#define RELDATE		"11/21/2024"   ///< Software revision date (MM/DD/YYYY)
+#define VERSION		"1.2"          ///< Software revision number (x.x)
+#define RELDATE		"10/16/2026"   ///< Software revision date (MM/DD/YYYY)
 
 // Default constructor
 MCP4726::MCP4726() {
@@ -94,6 +94,21 @@ bool MCP4726::set_level(uint16_t level) {
   return i2c_bus->writeto(i2c_addr, buffer, sizeof(buffer));
 }
 
+// Queue a DAC output level update
+bool MCP4726::queue_level(uint16_t level) {
+  uint8_t buffer[2];
+
+  // Same Write Volatile DAC Register command as set_level()
+  buffer[0] = (uint8_t)(MCP4726_CMD_VOLDAC | MCP4726_AWAKE | ((level >> 8) & 0xF));
+  buffer[1] = (uint8_t)(level & 0xFF);
+  return i2c_bus->submit(i2c_addr, buffer, sizeof(buffer), nullptr, 0, nullptr, nullptr, true);
+}
+
+// Wait for a queued output level update to reach the DAC
+void MCP4726::flush_level(void) {
+  i2c_bus->flush_priority();
+}
+
 // Power-down the DAC and set VOUT pull-down resistor level
 bool MCP4726::power_down(uint8_t pwrdn) {
     // Update the pwrdn bits in the volatile config register
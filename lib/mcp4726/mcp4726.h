@@ -157,6 +157,23 @@ public:
      */
     bool set_level(uint16_t level);
 
+    /**
+     * @brief Queue a DAC output level update to be sent in the background
+     * @param Output level (0-4095)
+     * @returns true=Update queued, false=Error occurred
+     * @note Uses the I2C bus priority slot, so the update goes out ahead
+     *       of other queued traffic.  A newer level replaces one that has
+     *       not yet been sent.
+     */
+    bool queue_level(uint16_t level);
+
+    /**
+     * @brief Wait for a queued output level update to reach the DAC
+     * @note Only waits on the I2C bus priority slot, so other queued
+     *       traffic isn't held up.
+     */
+    void flush_level(void);
+
     /**
      * @brief Power-down the DAC and set VOUT pull-down resistor level
      * @param pwrdn: Power-down selection bit setting
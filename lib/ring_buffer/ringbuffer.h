@@ -3,10 +3,10 @@
  * @brief Arduino ring buffer class
  *
  * Copyright(c) 2025  John Glynn
- * 
+ *
  * This code is licensed under the MIT License.
  * See the LICENSE file for the full license text.
- * 
+ *
  * @details This library provides support for circular (aka ring) buffers
  * that store data in a continuous loop for up to the maximum allocated
  * size of the buffer.  See the README.md file for additional details.
@@ -23,47 +23,107 @@
 #endif
 #include <assert.h>
 #include <string.h>
+#include <type_traits>
 
 /**
- *  @brief Ring buffer class for holding 16-bit unsigned integer entries.
+ *  @brief Library version information shared by all ring buffers
  */
-class RingBuffer16 {
+class RingBuffer_Base {
 public:
     /**
-     *  @brief Default constructor
+     *  @brief Retrieve software revision date as a string.
+     *  @param buffer: Buffer to copy revision date string into (MM/DD/YYYY)
+     *  @param buffer_size: Size of buffer to hold version number string
+     *  @note Buffer should be at least eleven characters in size to hold
+     *        the full date string (e.g. 'MM/DD/YYYY\0')
      */
-    RingBuffer16(void);
+    void reldate(char *buffer, size_t buffer_size);
 
     /**
-     *  @brief Constructor with initialization
-     *  @param entries: Number of entries in the ring buffer
+     *  @brief Retrieve software revision number as a string.
+     *  @param buffer: Buffer to copy revision number string into (x.y)
+     *  @param buffer_size: Size of buffer to hold version number string
+     *  @note Buffer should be at least five characters in size to hold
+     *        a typical revision string (e.g. 'xx.x\0').
      */
-    RingBuffer16(uint entries);
+    void version(char *buffer, size_t buffer_size);
+};
+
+/**
+ *  @brief Buffer offset arithmetic for a ring buffer of `N` entries
+ *  @note Specialised below for power-of-two sizes, where wrapping an
+ *        offset is a mask rather than a compare or a division.
+ */
+template <uint N, bool POW2 = ((N & (N - 1)) == 0)>
+struct RingBuffer_Index {
+    /// @brief Offset following `i` (i < N)
+    static inline uint next(uint i) { return (i + 1 >= N) ? 0 : i + 1; }
+    /// @brief Offset `i` wrapped into the buffer (i < 2N)
+    static inline uint wrap(uint i) { return (i >= N) ? i - N : i; }
+};
+
+/// @brief Buffer offset arithmetic for power-of-two sizes
+template <uint N>
+struct RingBuffer_Index<N, true> {
+    static inline uint next(uint i) { return (i + 1) & (N - 1); }
+    static inline uint wrap(uint i) { return i & (N - 1); }
+};
+
+/**
+ *  @brief Fixed-capacity ring buffer class
+ *  @tparam T: Entry type (8 or 16-bit integer)
+ *  @tparam N: Number of entries in the ring buffer
+ *  @tparam EXTREMES: true=track minimum and maximum values (default=false)
+ *  @note The entries are part of the object, so a global ring buffer
+ *        lives in static storage and no heap is used.  Power-of-two
+ *        sizes use masks in place of compares when wrapping.
+ */
+template <typename T, uint N, bool EXTREMES = false>
+class RingBuffer : public RingBuffer_Base {
+    static_assert(std::is_integral<T>::value && (sizeof(T) <= 2),
+                  "Ring buffer entries must be 8 or 16-bit integers");
+    static_assert((N > 0) && (N <= 0x10000), "Ring buffer size must be 1-65536 entries");
+
+public:
+    /// @brief Type of the running sum of the entries
+    typedef typename std::conditional<std::is_signed<T>::value, int32_t, uint32_t>::type sum_t;
 
     /**
-     * @brief Default destructor
+     *  @brief Default constructor
      */
-    ~RingBuffer16(void);
+    RingBuffer(void) {
+        clear();
+    }
 
+    /**
+     *  @brief Remove all entries and clear the overflow flag
+     */
+    void clear(void);
 
     /**
-     *  @brief Initialize the ring buffer object
-     *  @param entries: Number of entries in the ring buffer
+     *  @brief Get the maximum number of entries in the ring buffer
+     *  @returns Ring buffer size in entries
      */
-    void init(uint entries);
+    static constexpr uint capacity(void) {
+        return N;
+    }
 
     /**
      *  @brief Get the number of elements in the ring buffer
      *         available for getting or peeking at.
      *  @returns Number of elements in the ring buffer
      */
-    uint available(void);
+    uint available(void) {
+        return count;
+    }
 
     /**
      *  @brief Append an entry to the ring buffer
      *  @param entry: Entry to be appended to end of the buffer
+     *  @note When the buffer is full, the oldest entry is overwritten
+     *        and the overflow flag is set.
      */
-    void append(uint16_t entry);
+    void append(T entry);
 
     /**
      *  @brief Get the oldest entry from the ring buffer
@@ -72,7 +132,7 @@ public:
      *        buffer entries without modifying it, see the peek()
      *        method.
      */
-    uint16_t get(void);
+    T get(void);
 
     /**
      *  @brief Peek at the oldest entry in the ring buffer
@@ -82,17 +142,19 @@ public:
      *        If there is no data in the buffer, the method will return a
      *        zero value.
      */
-    uint16_t peek(void);
+    T peek(void) {
+        return count ? buffer[tail] : 0;
+    }
 
     /**
      *  @brief Copies the ring buffer entries to an external buffer in order
      *  @param outbuffer: Output buffer to receive the ring buffer data
      *  @param outbuffer_size: Size of the output buffer in entries
      *  @returns Number of entries copied into the external buffer
-     *  @note The ring buffer is not modified by this method.  Entries are 
+     *  @note The ring buffer is not modified by this method.  Entries are
      *        copied to the external buffer from oldest to newest order.
      */
-    size_t copy(uint16_t *outbuffer, size_t outbuffer_size);
+    size_t copy(T *outbuffer, size_t outbuffer_size);
 
     /**
      *  @brief Check and clear the status of buffer overflow flag
@@ -102,35 +164,274 @@ public:
 
     /**
      *  @brief Get the average of all elements in the ring buffer
-     *  @returns Average value
+     *  @returns Average value (0 if the buffer is empty)
+     *  @note Constant-time, using a running sum kept by `append()`
+     *        and `get()`.
      */
-    uint16_t average(void);
+    T average(void) {
+        return count ? (T)(total / (sum_t)count) : 0;
+    }
 
     /**
-     *  @brief Retrieve software revision date as a string.
-     *  @param buffer: Buffer to copy revision date string into (MM/DD/YYYY)
-     *  @param buffer_size: Size of buffer to hold version number string
-     *  @note Buffer should be at least eleven characters in size to hold
-     *        the full date string (e.g. 'MM/DD/YYYY\0')
+     *  @brief Get the sum of all elements in the ring buffer
+     *  @returns Sum of the entries
      */
-    void reldate(char *buffer, size_t buffer_size);
+    sum_t sum(void) {
+        return total;
+    }
 
     /**
-     *  @brief Retrieve software revision number as a string.
-     *  @param buffer: Buffer to copy revision number string into (x.y)
-     *  @param buffer_size: Size of buffer to hold version number string
-     *  @note Buffer should be at least five characters in size to hold
-     *        a typical revision string (e.g. 'xx.x\0').
+     *  @brief Get the smallest element in the ring buffer
+     *  @returns Minimum value (0 if the buffer is empty)
+     *  @note Constant-time when extremes are tracked, otherwise the
+     *        entries are scanned.
      */
-    void version(char *buffer, size_t buffer_size);
+    T minimum(void);
+
+    /**
+     *  @brief Get the largest element in the ring buffer
+     *  @returns Maximum value (0 if the buffer is empty)
+     *  @note Constant-time when extremes are tracked, otherwise the
+     *        entries are scanned.
+     */
+    T maximum(void);
 
+    /**
+     *  @brief Get the (population) variance of the elements in the ring buffer
+     *  @returns Variance in squared entry units
+     *  @note Constant-time, using running sums kept by `append()`
+     *        and `get()`.
+     */
+    uint32_t variance(void);
 
 private:
-  uint head;                ///< Buffer offset pointing to empty slot
+  typedef RingBuffer_Index<N> index;
+
+  uint64_t total_sq;        ///< Running sum of the squared entries
+  sum_t total;              ///< Running sum of the entries
   uint tail;                ///< Buffer offset pointing to oldest data
-  uint buffer_size;         ///< Size of the buffer in elements
-  uint16_t *buffer;         ///< Dynamically allocated buffer
+  uint count;               ///< Number of entries in the buffer
+  uint min_front;           ///< Oldest minimum candidate
+  uint min_count;           ///< Number of minimum candidates
+  uint max_front;           ///< Oldest maximum candidate
+  uint max_count;           ///< Number of maximum candidates
+  T buffer[N];              ///< Buffer entries
+  uint16_t min_queue[EXTREMES ? N : 1]; ///< Offsets of ascending minimum candidates
+  uint16_t max_queue[EXTREMES ? N : 1]; ///< Offsets of descending maximum candidates
   bool buffer_overflow;     ///< Overflow flag indicating data has been overwritten
+
+  /**
+   *  @brief Account for an entry leaving the buffer
+   *  @param pos: Buffer offset of the entry (the oldest entry)
+   */
+  void remove_stats(uint pos);
+
+  /**
+   *  @brief Account for an entry added to the buffer
+   *  @param pos: Buffer offset of the entry (the newest entry)
+   */
+  void add_stats(uint pos);
+
+  /**
+   *  @brief Square an entry
+   *  @param entry: Entry
+   *  @returns entry^2, squared as an unsigned magnitude so 16-bit entries
+   *           can't overflow
+   */
+  static uint32_t square(T entry) {
+    uint32_t magnitude = (entry < 0) ? (uint32_t)(-(int32_t)entry) : (uint32_t)entry;
+    return magnitude * magnitude;
+  }
+
+  /**
+   *  @brief Scan the entries for the smallest or largest value
+   *  @param largest: true=find the largest value, false=the smallest
+   *  @returns Smallest or largest value
+   */
+  T scan(bool largest);
 };
 
+/**
+ *  @brief Ring buffer for holding 16-bit unsigned integer entries.
+ *  @note Retained for compatibility with earlier releases, where the
+ *        size was passed to the constructor rather than the template.
+ */
+template <uint N, bool EXTREMES = false>
+using RingBuffer16 = RingBuffer<uint16_t, N, EXTREMES>;
+
+// Remove all entries and clear the overflow flag
+template <typename T, uint N, bool EXTREMES>
+void RingBuffer<T, N, EXTREMES>::clear(void) {
+  tail = 0;
+  count = 0;
+  buffer_overflow = false;
+  total = 0;
+  total_sq = 0;
+  min_front = 0;
+  min_count = 0;
+  max_front = 0;
+  max_count = 0;
+}
+
+// Append an entry to the ring buffer
+template <typename T, uint N, bool EXTREMES>
+void RingBuffer<T, N, EXTREMES>::append(T entry) {
+  if (count == N) {
+    // Overflow condition
+    // Move tail position to allow overwrite of the oldest data
+    // Set overflow flag so user can detect the condition if needed
+    remove_stats(tail);
+    tail = index::next(tail);
+    count--;
+    buffer_overflow = true;
+  }
+
+  uint head = index::wrap(tail + count);
+  buffer[head] = entry;
+  add_stats(head);
+  count++;
+}
+
+// Get the oldest entry from the ring buffer
+template <typename T, uint N, bool EXTREMES>
+T RingBuffer<T, N, EXTREMES>::get(void) {
+  if (!count) {
+    return 0;
+  }
+
+  T entry = buffer[tail];
+  remove_stats(tail);
+  tail = index::next(tail);
+  count--;
+  return entry;
+}
+
+// Copy ring buffer entries into external buffer
+template <typename T, uint N, bool EXTREMES>
+size_t RingBuffer<T, N, EXTREMES>::copy(T *outbuffer, size_t outbuffer_size) {
+  // Determine the number of valid entries to copy
+  size_t n_to_copy = std::min((size_t)count, outbuffer_size);
+
+  // Copy entries in order until either the output buffer is full or
+  // we've copied all of the available entries in the ring buffer.
+  uint ptr = tail;
+  for (size_t n = 0; n < n_to_copy; n++) {
+    outbuffer[n] = buffer[ptr];
+    ptr = index::next(ptr);
+  }
+
+  // Return number of entries copied
+  return n_to_copy;
+}
+
+// Check and clear the status of buffer overflow flag
+template <typename T, uint N, bool EXTREMES>
+bool RingBuffer<T, N, EXTREMES>::overflow(void) {
+  if (buffer_overflow) {
+    buffer_overflow = false;
+    return true;
+  } else {
+    return false;
+  }
+}
+
+// Get the smallest element in the ring buffer
+template <typename T, uint N, bool EXTREMES>
+T RingBuffer<T, N, EXTREMES>::minimum(void) {
+  if (!count) {
+    return 0;
+  }
+
+  // Oldest candidate is the minimum when tracked
+  if (EXTREMES) {
+    return buffer[min_queue[min_front]];
+  }
+  return scan(false);
+}
+
+// Get the largest element in the ring buffer
+template <typename T, uint N, bool EXTREMES>
+T RingBuffer<T, N, EXTREMES>::maximum(void) {
+  if (!count) {
+    return 0;
+  }
+
+  // Oldest candidate is the maximum when tracked
+  if (EXTREMES) {
+    return buffer[max_queue[max_front]];
+  }
+  return scan(true);
+}
+
+// Get the variance of the elements in the ring buffer
+template <typename T, uint N, bool EXTREMES>
+uint32_t RingBuffer<T, N, EXTREMES>::variance(void) {
+  if (!count) {
+    return 0;
+  }
+
+  // Var = (sum(x^2) - sum(x)^2/n) / n
+  // The sum is squared as a magnitude, so N x 65535 doesn't overflow
+  uint64_t magnitude = (total < 0) ? (uint64_t)(-(int64_t)total) : (uint64_t)total;
+  uint64_t total_2 = magnitude * magnitude;
+  return (uint32_t)((total_sq - total_2 / count) / count);
+}
+
+// Account for an entry leaving the buffer
+template <typename T, uint N, bool EXTREMES>
+void RingBuffer<T, N, EXTREMES>::remove_stats(uint pos) {
+  total -= buffer[pos];
+  total_sq -= square(buffer[pos]);
+
+  // Candidates are kept oldest first, so a departing entry can
+  // only be at the front of the candidate queues
+  if (EXTREMES) {
+    if (min_count && (min_queue[min_front] == pos)) {
+      min_front = index::next(min_front);
+      min_count--;
+    }
+    if (max_count && (max_queue[max_front] == pos)) {
+      max_front = index::next(max_front);
+      max_count--;
+    }
+  }
+}
+
+// Account for an entry added to the buffer
+template <typename T, uint N, bool EXTREMES>
+void RingBuffer<T, N, EXTREMES>::add_stats(uint pos) {
+  T entry = buffer[pos];
+
+  total += entry;
+  total_sq += square(entry);
+
+  // Newer entries make older candidates that can't beat them redundant,
+  // so each queue stays sorted and its front holds the current extreme
+  if (EXTREMES) {
+    while (min_count && (buffer[min_queue[index::wrap(min_front + min_count - 1)]] >= entry)) {
+      min_count--;
+    }
+    min_queue[index::wrap(min_front + min_count++)] = pos;
+
+    while (max_count && (buffer[max_queue[index::wrap(max_front + max_count - 1)]] <= entry)) {
+      max_count--;
+    }
+    max_queue[index::wrap(max_front + max_count++)] = pos;
+  }
+}
+
+// Scan the entries for the smallest or largest value
+template <typename T, uint N, bool EXTREMES>
+T RingBuffer<T, N, EXTREMES>::scan(bool largest) {
+  T value = buffer[tail];
+  uint ptr = tail;
+  for (uint i = 1; i < count; i++) {
+    ptr = index::next(ptr);
+    if (largest ? (buffer[ptr] > value) : (buffer[ptr] < value)) {
+      value = buffer[ptr];
+    }
+  }
+  return value;
+}
+
 #endif
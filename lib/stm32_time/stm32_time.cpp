@@ -9,8 +9,8 @@
  */
 #include "stm32_time.h"
 
-#define VERSION         "1.0"          ///< Software revision number (x.x)
-#define RELDATE         "11/22/2024"   ///< Software revision date (MM/DD/YYYY)
+#define VERSION         "2.0"          ///< Software revision number (x.x)
+#define RELDATE         "10/16/2026"   ///< Software revision date (MM/DD/YYYY)
 
 //== Alarm ====================================================================
 
@@ -19,9 +19,10 @@
 Alarm::Alarm(void) {      
     id = -1;             
     period = 0;
-    timer = 0;
+    start = 0;
     handler = nullptr;
     data = nullptr;
+    owner = nullptr;
 }
 
 // Constructor with initialization
@@ -29,57 +30,41 @@ Alarm::Alarm(alarm_id_t alarm_id, uint32_t period_ms, alarm_callback_t alarm_han
              void *user_data) {
     id = alarm_id;
     period = period_ms;
-    timer = period_ms;
+    start = millis();
     handler = alarm_handler;
     data = user_data;
+    owner = nullptr;
 }
 
 // Cancel an alarm
 // Does not call the user handler
 void Alarm::cancel(void) {
-    period = 0;
-    timer = 0;
-}
-
-// Decrement timer count by one
-// Calls the user handler if zero is reached
-void Alarm::dec(void) {
-    if (timer) {
-        // Decrement timer
-        timer--;
-        // Call user handler if we reached zero now
-        if ((timer == 0) & (handler != nullptr)) {
-            // Capture alarm trigger time 
-            uint32_t alarm_triggered = millis();
-            int handler_rtn = handler(id, data);
-            // Reschedule alarm if handler returns a non-zero response
-            if (handler_rtn) {
-                if (handler_rtn > 0) {
-                    // Pos value - reschedule alarm from now
-                    set(period);
-                } else {
-                   // Neg value - reschedule alarm from trigger time
-                   set(period+millis()-alarm_triggered);
-                }
-            }
-        }
-    }
+    set(0);
 }
 
 // Get time remaining before alarm is triggered (ms)
 uint32_t Alarm::get(void) {
-    return timer;
+    uint32_t since = millis() - start;
+    return (since < period) ? (period - since) : 0;
 }
 
 // Get elapsed time since start of alarm (ms)
 uint32_t Alarm::elapsed(void) {
-    return (period - timer);
+    return (period - get());
 }
 
 // Set timer period (ms)
+// The pool queues the alarm if it has a handler to call
 void Alarm::set(uint32_t period_ms) {
-    timer = period_ms;
-    period = period_ms;
+    if (owner != nullptr) {
+        noInterrupts();
+        owner->arm(*this, millis(), period_ms);
+        owner->schedule();
+        interrupts();
+    } else {
+        start = millis();
+        period = period_ms;
+    }
 }
 
 // Set alarm ID
@@ -94,16 +79,11 @@ alarm_id_t Alarm::get_id(void) {
 
 //== Alarm Pool ===============================================================
 
-// Define the static variables used within the Alarm_Pool class
-// Required to avoid compilation errors
-// uint32_t Alarm_Pool::entries = 0;               // Number of alarms in the pool
-// Alarm Alarm_Pool::pool[STM32_TIME_MAX_ALARMS];  // Pool of alarms
-// HardwareTimer *Alarm_Pool::hwtimer;             // Hardware timer object
-
 // Default constructor
 Alarm_Pool::Alarm_Pool(void) {
     initialized = false;
     entries = 0;
+    queued = 0;
     hwinstance = nullptr;
     hwtimer = nullptr;
     hwtimer_int_handler = nullptr;
@@ -112,16 +92,23 @@ Alarm_Pool::Alarm_Pool(void) {
 // Setup Alarm_Pool
 void Alarm_Pool::setup(TIM_TypeDef *timx, callback_function_t handler) {
 
-    // Create and initialize hardware timer to generate 1 ms. interrupts
+    // Create and initialize hardware timer as a free-running 16-bit
+    // count of 1 ms. ticks, with a compare channel for the next deadline
     hwtimer = new HardwareTimer(timx);
-    hwtimer->setOverflow(1000, MICROSEC_FORMAT);    // 1 ms.
-    hwtimer->attachInterrupt(handler);
+    hwtimer->setPrescaleFactor(hwtimer->getTimerClkFreq() / 1000);
+    hwtimer->setOverflow(0x10000, TICK_FORMAT);
+    hwtimer->setMode(STM32_TIME_HW_CHANNEL, TIMER_OUTPUT_COMPARE);   // Interrupt only, no pin
     hwtimer->resume();
 
     // Configure object settings
     hwinstance = timx;
     hwtimer_int_handler = handler;
     initialized = true;
+
+    // Alarms may have been added before setup
+    noInterrupts();
+    schedule();
+    interrupts();
 }
 
 // Add new alarm to the pool
@@ -129,9 +116,10 @@ alarm_id_t Alarm_Pool::add(uint32_t period_ms,
                            alarm_callback_t handler, void *user_data) {
     if (entries < STM32_TIME_MAX_ALARMS) {
         // Create alarm object and return entry number as alarm ID
-        Alarm *alarm = new Alarm(entries+1, period_ms, handler, user_data);
-        pool[entries] = *alarm;
+        pool[entries] = Alarm(entries+1, 0, handler, user_data);
+        pool[entries].owner = this;
         entries++;
+        pool[entries-1].set(period_ms);
         return entries;
     } else {
         // Error, no alarm slots available in the pool
@@ -165,11 +153,94 @@ void Alarm_Pool::set(alarm_id_t id, uint32_t period_ms) {
     pool[id-1].set(period_ms);
 }
 
-// Decrement all active alarm timer counts
-void Alarm_Pool::dec(void) {
-    for (uint32_t i=0; i<entries; i++) {
-        pool[i].dec();
+// Get number of alarms waiting to call a handler
+uint32_t Alarm_Pool::pending(void) {
+    return queued;
+}
+
+// Call the handlers of alarms that are due
+// Runs from the timer compare interrupt
+void Alarm_Pool::service(void) {
+    uint32_t now = millis();
+
+    while (queued && ((int32_t)(pool[queue[0]].deadline() - now) <= 0)) {
+        Alarm &alarm = pool[queue[0]];
+        uint32_t triggered = alarm.deadline();
+        dequeue(alarm);
+
+        int handler_rtn = alarm.handler(alarm.id, alarm.data);
+        // Reschedule alarm if handler returns a non-zero response, unless
+        // the handler has already set it again
+        if (handler_rtn && (alarm.deadline() == triggered)) {
+            if (handler_rtn > 0) {
+                // Pos value - reschedule alarm from now
+                arm(alarm, millis(), alarm.period);
+            } else {
+                // Neg value - reschedule alarm from trigger time
+                arm(alarm, triggered, alarm.period);
+            }
+        }
+        now = millis();
     }
+
+    schedule();
+}
+
+// Start (or stop) an alarm and update the deadline queue
+void Alarm_Pool::arm(Alarm &alarm, uint32_t start_ms, uint32_t period_ms) {
+    dequeue(alarm);
+    alarm.start = start_ms;
+    alarm.period = period_ms;
+    if ((period_ms == 0) || (alarm.handler == nullptr)) {
+        // Nothing to call, get() and elapsed() just follow millis()
+        return;
+    }
+
+    // Insert in deadline order, after any alarms due at the same time
+    uint32_t pos = queued;
+    while ((pos > 0) && ((int32_t)(pool[queue[pos-1]].deadline() - alarm.deadline()) > 0)) {
+        queue[pos] = queue[pos-1];
+        pos--;
+    }
+    queue[pos] = (uint8_t)(&alarm - pool);
+    queued++;
+}
+
+// Remove an alarm from the deadline queue
+void Alarm_Pool::dequeue(Alarm &alarm) {
+    uint8_t offset = (uint8_t)(&alarm - pool);
+
+    for (uint32_t i=0; i<queued; i++) {
+        if (queue[i] == offset) {
+            queued--;
+            memmove(&queue[i], &queue[i+1], queued-i);
+            return;
+        }
+    }
+}
+
+// Set the timer compare for the earliest deadline
+void Alarm_Pool::schedule(void) {
+    if (!initialized) {
+        return;
+    }
+    if (!queued) {
+        hwtimer->detachInterrupt(STM32_TIME_HW_CHANNEL);
+        return;
+    }
+
+    // Timer ticks aren't aligned with millis(), so allow one more tick
+    // to avoid waking just before the deadline.  Distant deadlines
+    // take several compares, each within half the 16-bit count.
+    int32_t remaining = (int32_t)(pool[queue[0]].deadline() - millis());
+    uint32_t wait_ms = (remaining > 0) ? (uint32_t)remaining + 1 : 1;
+    if (wait_ms > STM32_TIME_MAX_WAIT_MS) {
+        wait_ms = STM32_TIME_MAX_WAIT_MS;
+    }
+
+    uint32_t compare = (hwtimer->getCount() + wait_ms) & 0xFFFF;
+    hwtimer->setCaptureCompare(STM32_TIME_HW_CHANNEL, compare, TICK_COMPARE_FORMAT);
+    hwtimer->attachInterrupt(STM32_TIME_HW_CHANNEL, hwtimer_int_handler);
 }
 
 // Get software revision number
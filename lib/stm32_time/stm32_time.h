@@ -9,7 +9,9 @@
  * 
  *  @details Provides alarm objects for scheduling future execution.  Alarms
  *           are added to an alarm pool, which may hold up to 'STM32_TIME_MAX_ALARMS' 
- *           (default is 16) active alarms.
+ *           (default is 16) active alarms.  The pool is tickless: alarms
+ *           waiting to call a handler are kept sorted by deadline, and a
+ *           single hardware timer compare is programmed for the earliest.
  * 
  *  See README.md file for revision history.
  */
@@ -20,15 +22,23 @@
 #include <Arduino.h>
 
 #define STM32_TIME_HW_TIMER         TIM3    ///< Hardware timer used by Alarm_Pool
+#define STM32_TIME_HW_CHANNEL       1       ///< Timer compare channel used by Alarm_Pool
 
 #define STM32_TIME_MAX_ALARMS       16      ///< Maximum number of alarms in the pool
 
+#define STM32_TIME_MAX_WAIT_MS      0x8000  ///< Longest compare interval (ms), half the 16-bit count
+
 //
 // Alarm functions for scheduling future execution
 // Supports single pool of up to STM32_TIME_MAX_ALARMS
-// Hardware timer is utilized to ensure consistent 1 ms. timebase is used
+// Alarm times are kept against millis(), and the hardware timer counts 1 ms.
+// ticks so its compare interrupt can be set for the next handler to call.
+// There are no interrupts while no handlers are waiting, and one every
+// STM32_TIME_MAX_WAIT_MS at most while waiting for a distant deadline.
 //
 
+class Alarm_Pool;
+
 /**
  *  @brief The identifier for an individual alarm within the pool
  *  @ingroup alarm
@@ -72,19 +82,10 @@ public:
     /**
      *  @brief Cancel an alarm
      *  @note Sets timer and period to zero, but alarm entry remains
-     *        in the pool.  Does not call the user handler when setting
-     *        the timer to zero.
+     *        in the pool.  Does not call the user handler.
      */
     void cancel(void);
 
-    /**
-     *  @brief Decrement timer count
-     *  @note If it a user callback handler was provided when the alarm
-     *        was created, it will be called by this method when the
-     *        timer reaches zero.
-     */
-    void dec(void);
-
     /**
      *  @brief Get time remaining before alarm is triggered
      *  @returns Current time period (ms)
@@ -100,6 +101,7 @@ public:
     /**
      *  @brief Set timer period (ms)
      *  @param period_ms: Time period (ms)
+     *  @note A zero period stops the alarm without calling the handler.
      */
     void set(uint32_t period_ms);
 
@@ -116,11 +118,22 @@ public:
     alarm_id_t get_id(void);
 
 private:
+    friend class Alarm_Pool;
+
     alarm_id_t id;                  ///< ID assigned by alarm pool
     uint32_t period;                ///< Requested time period
-    uint32_t timer;                 ///< Current time countdown
+    uint32_t start;                 ///< Time the alarm was set (millis())
     alarm_callback_t handler;       ///< Callback handler
     void *data;                     ///< Optional user data
+    Alarm_Pool *owner;              ///< Pool scheduling the handler call
+
+    /**
+     *  @brief Get the time the alarm is due
+     *  @returns Deadline (millis())
+     */
+    uint32_t deadline(void) {
+        return start + period;
+    }
 };
 
 /**
@@ -192,11 +205,17 @@ public:
     void set(alarm_id_t id, uint32_t period_ms);
 
     /**
-     *  @brief Decrement all active alarm timer counts
-     *  @note Used by the external interrupt handler to perform timer
-     *        count-down handling.
+     *  @brief Call the handlers of alarms that are due
+     *  @note Used by the external interrupt handler on a timer compare
+     *        match.  The compare is then set for the next deadline.
+     */
+    void service(void);
+
+    /**
+     *  @brief Get the number of alarms waiting to call a handler
+     *  @returns Number of alarms in the deadline queue
      */
-    void dec(void);
+    uint32_t pending(void);
 
     /**
      *  @brief Retrieve software revision date as a string.
@@ -217,18 +236,43 @@ public:
     void version(char *buffer, size_t buffer_size);
 
 private:
+    friend class Alarm;
+
     bool initialized = false;            ///< Set to true by setup() method
     uint32_t entries;                    ///< Number of alarms in the pool
     Alarm pool[STM32_TIME_MAX_ALARMS];   ///< Pool of alarms
+    uint8_t queue[STM32_TIME_MAX_ALARMS];///< Pool offsets of alarms waiting to call a handler, by deadline
+    uint32_t queued;                     ///< Number of alarms in the deadline queue
     TIM_TypeDef *hwinstance;             ///< Timer instance used by hwtimer
     HardwareTimer *hwtimer;              ///< Hardware timer object
 
     /** 
      *  @brief External alarm hardware timer interrupt handler function
-     *  @note Calls the Alarm_Pool dec() method to decrement all active
-     *        active timers.
+     *  @note Calls the Alarm_Pool service() method to call the handlers
+     *        of alarms that are due.
      */
     callback_function_t hwtimer_int_handler;
+
+    /**
+     *  @brief Start (or stop) an alarm and update the deadline queue
+     *  @param alarm: Alarm in the pool
+     *  @param start_ms: Start time (millis())
+     *  @param period_ms: Time period (ms), zero to stop the alarm
+     *  @note Must be called with interrupts disabled or from service().
+     */
+    void arm(Alarm &alarm, uint32_t start_ms, uint32_t period_ms);
+
+    /**
+     *  @brief Remove an alarm from the deadline queue, if present
+     *  @param alarm: Alarm in the pool
+     */
+    void dequeue(Alarm &alarm);
+
+    /**
+     *  @brief Set the timer compare for the earliest deadline
+     *  @note Disables the compare interrupt when no handlers are waiting.
+     */
+    void schedule(void);
 };
 
 #endif
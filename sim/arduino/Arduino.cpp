@@ -0,0 +1,467 @@
+/**
+ *  @file Arduino.cpp
+ *  @brief Host-native stand-in for the stm32duino Arduino core
+ * 
+ *  Copyright(c) 2025  John Glynn
+ * 
+ *  This code is licensed under the MIT License.
+ *  See the LICENSE file for the full license text.
+ */
+#include "Arduino.h"
+#include "Wire.h"
+
+//=============================================================================
+// Simulation clock and hardware timers
+//=============================================================================
+
+/// Simulation clock (us)
+static uint64_t clock_us = 0;
+
+/// Hardware timers that have been created
+static const int MAX_TIMERS = 8;
+static HardwareTimer *timers[MAX_TIMERS];
+static int timer_count = 0;
+
+/// Timer interrupts delivered
+static uint64_t interrupt_count = 0;
+
+TIM_TypeDef sim_tim1 = { 1 };
+TIM_TypeDef sim_tim3 = { 3 };
+TIM_TypeDef sim_tim14 = { 14 };
+TIM_TypeDef sim_tim16 = { 16 };
+TIM_TypeDef sim_tim17 = { 17 };
+
+// Get simulation clock (us)
+uint64_t sim_time_us(void) {
+    return clock_us;
+}
+
+// Get number of timer interrupts delivered
+uint64_t sim_timer_interrupts(void) {
+    return interrupt_count;
+}
+
+// Advance the simulation clock and deliver timer interrupts that fall due
+void sim_advance_us(uint64_t us) {
+    static bool in_advance = false;
+    uint64_t target = clock_us + us;
+
+    // Time spent inside an interrupt handler just moves the clock
+    if (in_advance) {
+        clock_us = target;
+        return;
+    }
+    in_advance = true;
+
+    // Step from one timer deadline to the next so interrupt handlers see
+    // the same millis() value they would on the hardware
+    do {
+        uint64_t next = target;
+        for (int i = 0; i < timer_count; i++) {
+            if (timers[i] && (timers[i]->deadline() < next)) {
+                next = timers[i]->deadline();
+            }
+        }
+        if (next > clock_us) {
+            clock_us = next;
+        }
+        for (int i = 0; i < timer_count; i++) {
+            if (timers[i]) {
+                timers[i]->service(clock_us);
+            }
+        }
+    } while (clock_us < target);
+
+    in_advance = false;
+}
+
+uint32_t millis(void) {
+    return (uint32_t)(clock_us / 1000);
+}
+
+uint32_t micros(void) {
+    return (uint32_t)clock_us;
+}
+
+void delay(uint32_t ms) {
+    sim_advance_us((uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(uint32_t us) {
+    sim_advance_us(us);
+}
+
+// Hardware timer constructor
+HardwareTimer::HardwareTimer(TIM_TypeDef *instance) {
+    HardwareTimer::instance = instance;
+    prescale = 1;
+    overflow_ticks = 0x10000;
+    origin_us = 0;
+    period_us = 0;
+    next_us = 0;
+    running = false;
+    for (int ch = 0; ch < SIM_TIMER_CHANNELS; ch++) {
+        compare[ch] = 0;
+        compare_us[ch] = UINT64_MAX;
+    }
+    if (timer_count < MAX_TIMERS) {
+        timers[timer_count++] = this;
+    }
+}
+
+// Hardware timer destructor
+HardwareTimer::~HardwareTimer() {
+    for (int i = 0; i < timer_count; i++) {
+        if (timers[i] == this) {
+            timers[i] = nullptr;
+        }
+    }
+}
+
+// Set the clock divider
+void HardwareTimer::setPrescaleFactor(uint32_t prescaler) {
+    prescale = prescaler ? prescaler : 1;
+}
+
+// Set timer overflow period
+void HardwareTimer::setOverflow(uint32_t value, TimerFormat_t format) {
+    switch (format) {
+        case MICROSEC_FORMAT:
+            period_us = value;
+            break;
+        case HERTZ_FORMAT:
+            period_us = value ? (1000000 / value) : 0;
+            break;
+        default:
+            period_us = (uint64_t)value * prescale / SIM_TIMER_CLOCK_MHZ;
+    }
+    overflow_ticks = period_us * SIM_TIMER_CLOCK_MHZ / prescale;
+    if (overflow_ticks == 0) {
+        overflow_ticks = 1;
+    }
+}
+
+// Counter ticks since the count was zero
+uint64_t HardwareTimer::ticks(uint64_t now_us) {
+    return (now_us - origin_us) * SIM_TIMER_CLOCK_MHZ / prescale;
+}
+
+// Get the counter value
+uint32_t HardwareTimer::getCount(TimerFormat_t format) {
+    uint64_t count = running ? ticks(clock_us) % overflow_ticks : 0;
+    if (format == MICROSEC_FORMAT) {
+        return (uint32_t)(count * prescale / SIM_TIMER_CLOCK_MHZ);
+    }
+    return (uint32_t)count;
+}
+
+void HardwareTimer::setMode(uint32_t channel, TimerModes_t mode) {
+    (void)channel;
+    (void)mode;
+}
+
+// Set a channel's compare value
+void HardwareTimer::setCaptureCompare(uint32_t channel, uint32_t compare_value,
+                                      TimerCompareFormat_t format) {
+    if ((channel < 1) || (channel > SIM_TIMER_CHANNELS)) {
+        return;
+    }
+    if (format == MICROSEC_COMPARE_FORMAT) {
+        compare_value = (uint64_t)compare_value * SIM_TIMER_CLOCK_MHZ / prescale;
+    }
+    compare[channel-1] = compare_value;
+    plan_compare(channel);
+}
+
+// Work out when a channel's next compare match is due
+// A match happens when the count steps onto the compare value
+void HardwareTimer::plan_compare(uint32_t channel) {
+    uint32_t ch = channel - 1;
+    if (!running || !compare_callback[ch]) {
+        compare_us[ch] = UINT64_MAX;
+        return;
+    }
+    uint64_t now_ticks = ticks(clock_us);
+    uint64_t ahead = (compare[ch] + overflow_ticks - (now_ticks % overflow_ticks)) % overflow_ticks;
+    if (ahead == 0) {
+        ahead = overflow_ticks;
+    }
+    uint64_t match = now_ticks + ahead;
+    compare_us[ch] = origin_us + (match * prescale + SIM_TIMER_CLOCK_MHZ - 1) / SIM_TIMER_CLOCK_MHZ;
+}
+
+void HardwareTimer::attachInterrupt(callback_function_t callback) {
+    HardwareTimer::callback = callback;
+}
+
+void HardwareTimer::attachInterrupt(uint32_t channel, callback_function_t callback) {
+    if ((channel < 1) || (channel > SIM_TIMER_CHANNELS)) {
+        return;
+    }
+    compare_callback[channel-1] = callback;
+    plan_compare(channel);
+}
+
+void HardwareTimer::detachInterrupt(void) {
+    callback = nullptr;
+}
+
+void HardwareTimer::detachInterrupt(uint32_t channel) {
+    if ((channel < 1) || (channel > SIM_TIMER_CHANNELS)) {
+        return;
+    }
+    compare_callback[channel-1] = nullptr;
+    compare_us[channel-1] = UINT64_MAX;
+}
+
+void HardwareTimer::resume(void) {
+    running = true;
+    origin_us = clock_us;
+    next_us = clock_us + period_us;
+    for (uint32_t ch = 1; ch <= SIM_TIMER_CHANNELS; ch++) {
+        plan_compare(ch);
+    }
+}
+
+void HardwareTimer::pause(void) {
+    running = false;
+}
+
+// Next interrupt time
+uint64_t HardwareTimer::deadline(void) {
+    uint64_t next = (running && period_us && callback) ? next_us : UINT64_MAX;
+    for (int ch = 0; ch < SIM_TIMER_CHANNELS; ch++) {
+        next = std::min(next, compare_us[ch]);
+    }
+    return next;
+}
+
+// Deliver any interrupts due by now_us
+void HardwareTimer::service(uint64_t now_us) {
+    if (!running) {
+        return;
+    }
+    if (period_us && callback) {
+        while (next_us <= now_us) {
+            next_us += period_us;
+            interrupt_count++;
+            callback();
+        }
+    }
+    for (int ch = 0; ch < SIM_TIMER_CHANNELS; ch++) {
+        // The handler may move or disable the compare
+        while (compare_us[ch] <= now_us) {
+            compare_us[ch] += overflow_ticks * prescale / SIM_TIMER_CLOCK_MHZ;
+            interrupt_count++;
+            compare_callback[ch]();
+        }
+    }
+}
+
+//=============================================================================
+// GPIO and A/D converter
+//=============================================================================
+
+static uint32_t pin_state[SIM_NUM_PINS];
+static int (*analog_hook)(uint32_t pin) = nullptr;
+static void (*digital_hook)(uint32_t pin, uint32_t value) = nullptr;
+
+void pinMode(uint32_t pin, uint32_t mode) {
+    (void)pin;
+    (void)mode;
+}
+
+void digitalWrite(uint32_t pin, uint32_t value) {
+    if (pin < SIM_NUM_PINS) {
+        pin_state[pin] = value ? HIGH : LOW;
+    }
+    if (digital_hook) {
+        digital_hook(pin, value ? HIGH : LOW);
+    }
+}
+
+int digitalRead(uint32_t pin) {
+    return (pin < SIM_NUM_PINS) ? pin_state[pin] : LOW;
+}
+
+uint32_t sim_pin_state(uint32_t pin) {
+    return (pin < SIM_NUM_PINS) ? pin_state[pin] : LOW;
+}
+
+void sim_set_digital_hook(void (*hook)(uint32_t pin, uint32_t value)) {
+    digital_hook = hook;
+}
+
+void sim_set_analog_hook(int (*hook)(uint32_t pin)) {
+    analog_hook = hook;
+}
+
+int analogRead(uint32_t pin) {
+    return analog_hook ? analog_hook(pin) : 0;
+}
+
+static int analog_bits = 10;
+
+void analogReadResolution(int bits) {
+    analog_bits = bits;
+}
+
+int sim_analog_resolution(void) {
+    return analog_bits;
+}
+
+void analogWrite(uint32_t pin, int value) {
+    (void)pin;
+    (void)value;
+}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max) {
+    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+//=============================================================================
+// Print and serial console
+//=============================================================================
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+    size_t n = 0;
+    while (size--) {
+        n += write(*buffer++);
+    }
+    return n;
+}
+
+size_t Print::printf(const char *format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (len < 0) {
+        return 0;
+    }
+    return write((const uint8_t *)buffer, std::min((size_t)len, sizeof(buffer) - 1));
+}
+
+HardwareSerial Serial;
+static bool serial_enabled = true;
+
+void sim_serial_enable(bool enable) {
+    serial_enabled = enable;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+    if (serial_enabled) {
+        fputc(c, stdout);
+    }
+    return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+    if (serial_enabled) {
+        fwrite(buffer, 1, size, stdout);
+    }
+    return size;
+}
+
+//=============================================================================
+// I2C bus
+//=============================================================================
+
+TwoWire Wire;
+
+TwoWire::TwoWire(void) {
+    clock_hz = 100000;
+    blocking = true;
+    for (int i = 0; i < 128; i++) {
+        devices[i] = nullptr;
+    }
+    tx_address = 0;
+    tx_len = 0;
+    rx_len = 0;
+    rx_pos = 0;
+    reset_stats();
+}
+
+void TwoWire::attach(uint8_t address, Sim_I2C_Device *device) {
+    devices[address & 0x7F] = device;
+}
+
+void TwoWire::reset_stats(void) {
+    counters.transactions = 0;
+    counters.bytes = 0;
+    counters.bus_time_us = 0;
+}
+
+// Bus time of one transaction carrying `bytes` data bytes
+uint32_t TwoWire::transfer_us(size_t bytes) {
+    // Start + address byte + data bytes (9 bits each with ACK) + stop
+    uint64_t bits = 1 + 9 + 9 * (uint64_t)bytes + 1;
+    return (uint32_t)((bits * 1000000 + clock_hz - 1) / clock_hz);
+}
+
+// Account for the bus time of one transaction carrying `bytes` data bytes
+void TwoWire::bus_busy(size_t bytes) {
+    uint32_t us = transfer_us(bytes);
+    counters.transactions++;
+    counters.bytes += bytes;
+    counters.bus_time_us += us;
+    if (blocking) {
+        sim_advance_us(us);
+    }
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+    tx_address = address & 0x7F;
+    tx_len = 0;
+}
+
+size_t TwoWire::write(uint8_t data) {
+    if (tx_len >= BUFFER_LENGTH) {
+        return 0;
+    }
+    tx_buffer[tx_len++] = data;
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t len) {
+    size_t n = 0;
+    while (len-- && write(*data++)) {
+        n++;
+    }
+    return n;
+}
+
+uint8_t TwoWire::endTransmission(bool sendStop) {
+    (void)sendStop;
+    Sim_I2C_Device *device = devices[tx_address];
+    bus_busy(device ? tx_len : 0);
+    if (device == nullptr) {
+        return 2;   // NACK on address
+    }
+    device->i2c_write(tx_buffer, tx_len);
+    tx_len = 0;
+    return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, size_t len, bool sendStop) {
+    (void)sendStop;
+    Sim_I2C_Device *device = devices[address & 0x7F];
+    rx_len = 0;
+    rx_pos = 0;
+    if (device == nullptr) {
+        bus_busy(0);
+        return 0;
+    }
+    rx_len = device->i2c_read(rx_buffer, std::min(len, (size_t)BUFFER_LENGTH));
+    bus_busy(rx_len);
+    return (uint8_t)rx_len;
+}
+
+int TwoWire::available(void) {
+    return (int)(rx_len - rx_pos);
+}
+
+int TwoWire::read(void) {
+    return (rx_pos < rx_len) ? rx_buffer[rx_pos++] : -1;
+}
@@ -0,0 +1,303 @@
+/**
+ *  @file Arduino.h
+ *  @brief Host-native stand-in for the stm32duino Arduino core
+ * 
+ *  Copyright(c) 2025  John Glynn
+ * 
+ *  This code is licensed under the MIT License.
+ *  See the LICENSE file for the full license text.
+ * 
+ *  @details
+ *  Provides just enough of the Arduino API used by the charger firmware and
+ *  its libraries to compile and run them on a Linux host under the
+ *  `[env:native]` PlatformIO environment.  Time is simulated rather than
+ *  real: `millis()` and `micros()` return the simulation clock, which is
+ *  advanced by the simulator main loop (and by blocking calls such as
+ *  `delay()` and I2C transfers) through `sim_advance_us()`.
+ * 
+ *  GPIO writes and A/D reads are routed to hooks installed by the simulator so
+ *  the battery/regulator plant model can observe the regulator enable pin
+ *  and supply the battery voltage A/D counts.
+ */
+#ifndef _SIM_ARDUINO_H_
+#define _SIM_ARDUINO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <sys/types.h>
+#include <algorithm>
+#include <functional>
+
+//
+// Basic Arduino types and constants
+//
+typedef uint8_t byte;                       ///< Arduino byte type
+typedef bool boolean;                       ///< Arduino boolean type
+
+#define HIGH                0x1             ///< Logic high level
+#define LOW                 0x0             ///< Logic low level
+
+#define INPUT               0x0             ///< GPIO input mode
+#define OUTPUT              0x1             ///< GPIO push-pull output mode
+#define INPUT_PULLUP        0x2             ///< GPIO input with pull-up
+#define INPUT_PULLDOWN      0x3             ///< GPIO input with pull-down
+#define OUTPUT_OPEN_DRAIN   0x4             ///< GPIO open-drain output mode
+
+//
+// Program memory helpers (flat address space on the host)
+//
+#define PROGMEM
+#define PGM_P               const char *
+#define PSTR(s)             (s)
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+
+class __FlashStringHelper;
+#define F(string_literal)   (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+//
+// STM32 pin names, numbered sequentially by port (PA0=0, PB0=16, ...)
+//
+enum {
+    PA0, PA1, PA2, PA3, PA4, PA5, PA6, PA7,
+    PA8, PA9, PA10, PA11, PA12, PA13, PA14, PA15,
+    PB0, PB1, PB2, PB3, PB4, PB5, PB6, PB7,
+    PB8, PB9, PB10, PB11, PB12, PB13, PB14, PB15,
+    PC0, PC1, PC2, PC3, PC4, PC5, PC6, PC7,
+    PC8, PC9, PC10, PC11, PC12, PC13, PC14, PC15,
+    ATEMP,                                  // Internal temperature sensor A/D input
+    SIM_NUM_PINS
+};
+
+//
+// Timing functions driven by the simulation clock
+//
+uint32_t millis(void);
+uint32_t micros(void);
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+// Interrupts are only delivered while the simulation clock advances,
+// so there is nothing to mask
+inline void noInterrupts(void) {}
+inline void interrupts(void) {}
+
+//
+// GPIO and analog functions
+//
+void pinMode(uint32_t pin, uint32_t mode);
+void digitalWrite(uint32_t pin, uint32_t value);
+int digitalRead(uint32_t pin);
+int analogRead(uint32_t pin);
+void analogReadResolution(int bits);
+void analogWrite(uint32_t pin, int value);
+
+/**
+ *  @brief Re-map a number from one range to another (Arduino semantics)
+ */
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+
+/**
+ *  @brief Limit a number to a range (Arduino macro)
+ */
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+//
+// Print class and serial console
+//
+
+/**
+ *  @brief Minimal Arduino `Print` base class with `printf()` support
+ */
+class Print {
+public:
+    virtual ~Print() {}
+
+    /// @brief Write a single byte (provided by derived classes)
+    virtual size_t write(uint8_t c) = 0;
+
+    /// @brief Write a block of bytes
+    virtual size_t write(const uint8_t *buffer, size_t size);
+
+    size_t write(const char *str) { return write((const uint8_t *)str, strlen(str)); }
+    size_t print(const char *str) { return write(str); }
+    size_t println(const char *str) { return write(str) + write("\n"); }
+    size_t println(void) { return write("\n"); }
+
+    /// @brief Formatted output (stm32duino extension)
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+/**
+ *  @brief Serial console that writes to the host's standard output
+ *  @note Output can be silenced with `sim_serial_enable(false)`.
+ */
+class HardwareSerial : public Print {
+public:
+    void begin(uint32_t baud) { (void)baud; }
+    void end(void) {}
+    void flush(void) { fflush(stdout); }
+    int available(void) { return 0; }
+    int read(void) { return -1; }
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+//
+// STM32 hardware timer stand-in
+//
+typedef std::function<void(void)> callback_function_t;  ///< Timer callback
+
+/**
+ *  @brief Opaque timer instance (e.g. TIM3)
+ */
+typedef struct {
+    int index;                              ///< Timer number
+} TIM_TypeDef;
+
+extern TIM_TypeDef sim_tim1;
+extern TIM_TypeDef sim_tim3;
+extern TIM_TypeDef sim_tim14;
+extern TIM_TypeDef sim_tim16;
+extern TIM_TypeDef sim_tim17;
+#define TIM1                (&sim_tim1)
+#define TIM3                (&sim_tim3)
+#define TIM14               (&sim_tim14)
+#define TIM16               (&sim_tim16)
+#define TIM17               (&sim_tim17)
+
+#define SIM_TIMER_CLOCK_MHZ 64              ///< Timer input clock (MHz)
+#define SIM_TIMER_CHANNELS  4               ///< Compare channels per timer
+
+/**
+ *  @brief Overflow units accepted by `HardwareTimer::setOverflow()`
+ */
+enum TimerFormat_t {
+    TICK_FORMAT,
+    MICROSEC_FORMAT,
+    HERTZ_FORMAT,
+};
+
+/**
+ *  @brief Compare units accepted by `HardwareTimer::setCaptureCompare()`
+ */
+enum TimerCompareFormat_t {
+    TICK_COMPARE_FORMAT,
+    MICROSEC_COMPARE_FORMAT,
+};
+
+/**
+ *  @brief Channel modes accepted by `HardwareTimer::setMode()`
+ */
+enum TimerModes_t {
+    TIMER_DISABLED,
+    TIMER_OUTPUT_COMPARE,
+};
+
+/**
+ *  @brief Hardware timer whose update and compare interrupts are
+ *         delivered as the simulation clock advances.
+ *  @note The counter runs from a `SIM_TIMER_CLOCK_MHZ` clock divided by
+ *        the prescale factor.
+ */
+class HardwareTimer {
+public:
+    HardwareTimer(TIM_TypeDef *instance);
+    ~HardwareTimer();
+    void setPrescaleFactor(uint32_t prescaler);
+    uint32_t getTimerClkFreq(void) { return SIM_TIMER_CLOCK_MHZ * 1000000; }
+    void setOverflow(uint32_t value, TimerFormat_t format = TICK_FORMAT);
+    uint32_t getCount(TimerFormat_t format = TICK_FORMAT);
+    void setMode(uint32_t channel, TimerModes_t mode);
+    void setCaptureCompare(uint32_t channel, uint32_t compare,
+                           TimerCompareFormat_t format = TICK_COMPARE_FORMAT);
+    void attachInterrupt(callback_function_t callback);
+    void attachInterrupt(uint32_t channel, callback_function_t callback);
+    void detachInterrupt(void);
+    void detachInterrupt(uint32_t channel);
+    void resume(void);
+    void pause(void);
+
+    /// @brief Simulation time of the next interrupt (UINT64_MAX if none)
+    uint64_t deadline(void);
+
+    /// @brief Deliver any interrupts due at simulation time `now_us`
+    void service(uint64_t now_us);
+
+private:
+    TIM_TypeDef *instance;
+    uint32_t prescale;                      ///< Clock divider
+    uint64_t overflow_ticks;                ///< Counter period (ticks)
+    uint64_t origin_us;                     ///< Time the count was zero
+    uint64_t period_us;
+    uint64_t next_us;
+    bool running;
+    callback_function_t callback;
+    uint32_t compare[SIM_TIMER_CHANNELS];
+    uint64_t compare_us[SIM_TIMER_CHANNELS];///< Time of the next compare match
+    callback_function_t compare_callback[SIM_TIMER_CHANNELS];
+
+    /// @brief Counter ticks since the count was zero
+    uint64_t ticks(uint64_t now_us);
+
+    /// @brief Work out when a channel's next compare match is due
+    void plan_compare(uint32_t channel);
+};
+
+//
+// Simulation hooks (not part of the Arduino API)
+//
+
+/**
+ *  @brief Get the simulation clock in microseconds
+ */
+uint64_t sim_time_us(void);
+
+/**
+ *  @brief Get the number of timer interrupts delivered so far
+ */
+uint64_t sim_timer_interrupts(void);
+
+/**
+ *  @brief Advance the simulation clock, delivering any timer interrupts
+ *         that fall due along the way.
+ *  @param us: Time to advance (microseconds)
+ */
+void sim_advance_us(uint64_t us);
+
+/**
+ *  @brief Get the resolution set by `analogReadResolution()`
+ *  @returns A/D resolution (bits)
+ */
+int sim_analog_resolution(void);
+
+/**
+ *  @brief Install the hook used to service `analogRead()` calls
+ *  @param hook: Function returning the A/D count for a pin
+ */
+void sim_set_analog_hook(int (*hook)(uint32_t pin));
+
+/**
+ *  @brief Install the hook notified of `digitalWrite()` calls
+ *  @param hook: Function receiving the pin and level written
+ */
+void sim_set_digital_hook(void (*hook)(uint32_t pin, uint32_t value));
+
+/**
+ *  @brief Get the level most recently written to an output pin
+ */
+uint32_t sim_pin_state(uint32_t pin);
+
+/**
+ *  @brief Enable or disable serial console output to stdout
+ */
+void sim_serial_enable(bool enable);
+
+#endif
@@ -0,0 +1,128 @@
+/**
+ *  @file Wire.h
+ *  @brief Host-native stand-in for the Arduino `TwoWire` I2C library
+ * 
+ *  Copyright(c) 2025  John Glynn
+ * 
+ *  This code is licensed under the MIT License.
+ *  See the LICENSE file for the full license text.
+ * 
+ *  @details
+ *  Transactions are routed to simulated device models attached to the bus
+ *  by I2C address.  Addresses without an attached device NACK, so bus scans
+ *  behave as they would on the real hardware.
+ * 
+ *  Every transfer advances the simulation clock by the time it would occupy
+ *  the bus at the configured clock rate (9 bit times per byte, plus start,
+ *  address and stop overhead), since `TwoWire` transfers block the CPU.
+ */
+#ifndef _SIM_WIRE_H_
+#define _SIM_WIRE_H_
+
+#include "Arduino.h"
+
+#define BUFFER_LENGTH       32              ///< TwoWire transmit/receive buffer size
+
+/**
+ *  @brief Interface implemented by simulated I2C devices
+ */
+class Sim_I2C_Device {
+public:
+    virtual ~Sim_I2C_Device() {}
+
+    /**
+     *  @brief Handle a write transaction addressed to the device
+     *  @param data: Bytes written by the controller
+     *  @param len: Number of bytes written
+     */
+    virtual void i2c_write(const uint8_t *data, size_t len) = 0;
+
+    /**
+     *  @brief Handle a read transaction addressed to the device
+     *  @param data: Buffer to receive the bytes returned by the device
+     *  @param len: Number of bytes requested
+     *  @returns Number of bytes returned
+     */
+    virtual size_t i2c_read(uint8_t *data, size_t len) = 0;
+};
+
+/**
+ *  @brief I2C bus traffic counters
+ */
+struct sim_i2c_stats_t {
+    uint32_t transactions;                  ///< Addressed transactions (incl. NACKs)
+    uint32_t bytes;                         ///< Bytes moved, excluding address bytes
+    uint64_t bus_time_us;                   ///< Time the bus was busy (us)
+};
+
+/**
+ *  @brief Simulated `TwoWire` I2C controller
+ */
+class TwoWire {
+public:
+    TwoWire(void);
+
+    void begin(void) {}
+    void end(void) {}
+    void setClock(uint32_t clock) { clock_hz = clock; }
+    void setSCL(uint32_t pin) { (void)pin; }
+    void setSDA(uint32_t pin) { (void)pin; }
+
+    void beginTransmission(uint8_t address);
+    uint8_t endTransmission(bool sendStop = true);
+    size_t write(uint8_t data);
+    size_t write(const uint8_t *data, size_t len);
+    uint8_t requestFrom(uint8_t address, size_t len, bool sendStop = true);
+    int available(void);
+    int read(void);
+
+    /**
+     *  @brief Attach a simulated device to the bus
+     *  @param address: 7-bit I2C address
+     *  @param device: Device model (nullptr to detach)
+     */
+    void attach(uint8_t address, Sim_I2C_Device *device);
+
+    /**
+     *  @brief Select whether transfers advance the simulation clock
+     *  @param timed: true=transfers block for their bus time (default),
+     *                false=bus time is only counted, for callers that
+     *                model the transfer time themselves
+     */
+    void set_timed(bool timed) { blocking = timed; }
+
+    /**
+     *  @brief Bus time of one transaction
+     *  @param bytes: Data bytes in the transaction
+     *  @returns Time in microseconds
+     */
+    uint32_t transfer_us(size_t bytes);
+
+    /**
+     *  @brief Get the bus traffic counters
+     */
+    const sim_i2c_stats_t &stats(void) { return counters; }
+
+    /**
+     *  @brief Reset the bus traffic counters
+     */
+    void reset_stats(void);
+
+private:
+    uint32_t clock_hz;
+    bool blocking;
+    Sim_I2C_Device *devices[128];
+    uint8_t tx_address;
+    uint8_t tx_buffer[BUFFER_LENGTH];
+    size_t tx_len;
+    uint8_t rx_buffer[BUFFER_LENGTH];
+    size_t rx_len;
+    size_t rx_pos;
+    sim_i2c_stats_t counters;
+
+    void bus_busy(size_t bytes);
+};
+
+extern TwoWire Wire;
+
+#endif
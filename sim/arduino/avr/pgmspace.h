@@ -0,0 +1,18 @@
+/**
+ *  @file pgmspace.h
+ *  @brief Host-native stand-in for the AVR program memory compatibility header
+ * 
+ *  Copyright(c) 2025  John Glynn
+ * 
+ *  This code is licensed under the MIT License.
+ *  See the LICENSE file for the full license text.
+ * 
+ *  @details Program memory shares the flat address space on the host, so the
+ *  `PROGMEM` helpers are defined in `Arduino.h` as plain memory accesses.
+ */
+#ifndef _SIM_AVR_PGMSPACE_H_
+#define _SIM_AVR_PGMSPACE_H_
+
+#include "../Arduino.h"
+
+#endif
@@ -0,0 +1,1343 @@
+/**
+ *  @file bench.cpp
+ *  @brief Host benchmarks for the charger simulator
+ * 
+ *  Copyright(c) 2025  John Glynn
+ * 
+ *  This code is licensed under the MIT License.
+ *  See the LICENSE file for the full license text.
+ */
+#include <Arduino.h>
+#include <stdlib.h>
+#include <time.h>
+#include <type_traits>
+#include <vector>
+
+#include <ringbuffer.h>
+#include <stm32_time.h>
+#include <mcp4726.h>
+#include <ina219.h>
+#include <i2c_busio.h>
+
+#include "bench.h"
+#include "plant.h"
+#include "devices.h"
+#include "cycle.h"
+#include "supervisor.h"
+#include "regulator.h"
+#include "battery.h"
+#include "temperature.h"
+#include "temp_trace.h"
+#include "slope.h"
+#include "settle.h"
+#include "eta.h"
+#include "telemetry.h"
+#include "decode.h"
+#include "console.h"
+
+extern I2C main_i2c_bus;
+extern Console_TX console;
+
+/// @brief Ring buffer statistics computed by scanning the entries
+struct rb_stats_t {
+    int32_t average;
+    int32_t minimum;
+    int32_t maximum;
+    uint32_t variance;
+};
+
+// Reference statistics, scanning a copy of the entries as the
+// original RingBuffer16::average() did
+template <typename RB, typename T>
+static rb_stats_t reference_stats(RB &rb, std::vector<T> &scratch) {
+    rb_stats_t r = { 0, 0, 0, 0 };
+    size_t n = rb.copy(scratch.data(), scratch.size());
+    if (n == 0) {
+        return r;
+    }
+    int64_t total = 0;
+    uint64_t total_sq = 0;
+    r.minimum = scratch[0];
+    r.maximum = scratch[0];
+    for (size_t i = 0; i < n; i++) {
+        int32_t v = scratch[i];
+        total += v;
+        total_sq += (uint64_t)((int64_t)v * v);
+        r.minimum = std::min(r.minimum, v);
+        r.maximum = std::max(r.maximum, v);
+    }
+    r.average = (int32_t)(total / (int64_t)n);
+    r.variance = (uint32_t)((total_sq - (uint64_t)total * (uint64_t)total / n) / n);
+    return r;
+}
+
+static double seconds_since(clock_t start) {
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+// Random reading, charging current-like with occasional spikes
+// (or temperature-like readings either side of zero when signed)
+template <typename T>
+static T random_entry(void) {
+    if (std::is_signed<T>::value) {
+        return (T)((rand() % 600) - 200);
+    }
+    if ((rand() % 64) == 0) {
+        return (T)(rand() % 65536);
+    }
+    return (T)(600 + (rand() % 40) - 20);
+}
+
+// Random mix of appends and gets, comparing the running statistics with
+// the reference after every operation
+template <typename T, uint N, bool EXTREMES>
+static int bench_ringbuffer(uint32_t ops) {
+    static RingBuffer<T, N, EXTREMES> rb;
+    std::vector<T> scratch(N);
+    uint32_t mismatches = 0;
+    volatile uint32_t sink = 0;
+
+    rb.clear();
+    srand(N);
+    for (uint32_t i = 0; i < ops; i++) {
+        if ((rand() % 8) == 0) {
+            rb.get();
+        } else {
+            rb.append(random_entry<T>());
+        }
+        rb_stats_t ref = reference_stats(rb, scratch);
+        if ((rb.average() != ref.average) || (rb.minimum() != ref.minimum) ||
+            (rb.maximum() != ref.maximum) || (rb.variance() != ref.variance)) {
+            if (mismatches++ < 5) {
+                printf("  mismatch at op %u: avg %d/%d min %d/%d max %d/%d var %u/%u\n", i,
+                       (int)rb.average(), ref.average, (int)rb.minimum(), ref.minimum,
+                       (int)rb.maximum(), ref.maximum, rb.variance(), ref.variance);
+            }
+        }
+    }
+
+    // Time the statistics queries on a full buffer
+    for (uint i = 0; i < N; i++) {
+        rb.append(random_entry<T>());
+    }
+    const uint32_t queries = 200000;
+    clock_t start = clock();
+    for (uint32_t i = 0; i < queries; i++) {
+        rb_stats_t ref = reference_stats(rb, scratch);
+        sink += ref.average + ref.minimum + ref.maximum + ref.variance;
+    }
+    double t_ref = seconds_since(start);
+    start = clock();
+    for (uint32_t i = 0; i < queries; i++) {
+        sink += rb.average() + rb.minimum() + rb.maximum() + rb.variance();
+    }
+    double t_run = seconds_since(start);
+
+    // Time appends to a full buffer
+    const uint32_t appends = 2000000;
+    start = clock();
+    for (uint32_t i = 0; i < appends; i++) {
+        rb.append((T)i);
+    }
+    sink += rb.peek();
+    double t_append = seconds_since(start);
+
+    printf("  %-8s x %5u, extremes %-3s: %s, scan %8.1f ns, running %5.1f ns per query, "
+           "append %4.1f ns\n",
+           std::is_signed<T>::value ? "int16_t" : "uint16_t", N, EXTREMES ? "on" : "off",
+           mismatches ? "MISMATCH" : "match", t_ref * 1e9 / queries, t_run * 1e9 / queries,
+           t_append * 1e9 / appends);
+    return mismatches ? 1 : 0;
+}
+
+/// @brief Alarm handler bookkeeping
+struct bench_alarm_t {
+    uint32_t period_ms;     ///< Alarm period
+    uint32_t due_ms;        ///< Time the next call is due
+    uint32_t calls;         ///< Handler calls
+    uint32_t max_late_ms;   ///< Largest delay after the deadline
+    int rtn;                ///< Handler return value
+};
+
+// Alarm handler recording how late it was called
+static int bench_alarm_handler(alarm_id_t id, void *user_data) {
+    (void)id;
+    bench_alarm_t *a = (bench_alarm_t *)user_data;
+    uint32_t late = millis() - a->due_ms;
+    a->max_late_ms = std::max(a->max_late_ms, late);
+    a->calls++;
+    a->due_ms = ((a->rtn < 0) ? a->due_ms : millis()) + a->period_ms;
+    return a->rtn;
+}
+
+// Periodic and long alarms on the tickless alarm pool, counting the
+// timer interrupts it takes compared with a 1 ms tick
+static int bench_alarm_pool(void) {
+    static Alarm_Pool pool;
+    const uint32_t hours = 24;
+    bench_alarm_t a[3] = {
+        { 1000, 0, 0, 0, -1 },                  // Periodic from the trigger time
+        { 250, 0, 0, 0, 1 },                    // Periodic from the handler return
+        { 7UL * 24 * 3600 * 1000, 0, 0, 0, 0 }, // One-shot, a week away
+    };
+
+    pool.setup(TIM14, []() { pool.service(); });
+    alarm_id_t ids[3];
+    for (int i = 0; i < 3; i++) {
+        a[i].due_ms = millis() + a[i].period_ms;
+        ids[i] = pool.add(a[i].period_ms, bench_alarm_handler, &a[i]);
+    }
+
+    uint64_t start_interrupts = sim_timer_interrupts();
+    sim_advance_us((uint64_t)hours * 3600 * 1000000);
+    uint64_t interrupts = sim_timer_interrupts() - start_interrupts;
+
+    // The last periodic call may fall a tick after the end of the run, and
+    // the one-shot alarm should have counted down by exactly the time simulated
+    uint32_t week_left = pool.get(ids[2]);
+    bool ok = (a[0].calls >= hours * 3600 - 1) && (a[1].calls >= hours * 3600 * 3) &&
+              (a[0].max_late_ms <= 1) && (a[1].max_late_ms <= 1) && (a[2].calls == 0) &&
+              (week_left == a[2].period_ms - hours * 3600 * 1000) &&
+              (pool.elapsed(ids[2]) == hours * 3600 * 1000);
+
+    printf("Alarm_Pool over %u hours: %s, %u + %u handler calls (max %u ms late), "
+           "%llu timer interrupts vs. %u with a 1 ms tick\n",
+           hours, ok ? "match" : "MISMATCH", a[0].calls, a[1].calls,
+           std::max(a[0].max_late_ms, a[1].max_late_ms), (unsigned long long)interrupts,
+           hours * 3600 * 1000);
+
+    for (int i = 0; i < 3; i++) {
+        pool.set(ids[i], 0);
+    }
+    return ok ? 0 : 1;
+}
+
+/// @brief Regulator algorithm under test
+enum reg_algorithm_t {
+    REG_STEPPER,                            ///< Fixed voltage_step stepping (v0.5 run() handlers)
+    REG_PID,                                ///< PI loops used by Charge_Cycle::regulate()
+};
+
+/// @brief Regulation benchmark case
+struct reg_case_t {
+    const char *name;                       ///< Case name
+    const charge_parm_t *parms;             ///< Charge cycle parameters
+    double soc;                             ///< Initial (rested) state of charge
+    bool constant_current;                  ///< Fast charging (CC) rather than topping/trickle (CV)?
+};
+
+/// @brief Regulation benchmark results
+struct reg_result_t {
+    double settle_s;                        ///< Time to settle into the band (-1=never)
+    double overshoot;                       ///< Peak beyond the setpoint (mA or mV)
+    double error;                           ///< Mean absolute error over the last minutes (mA or mV)
+    double ripple;                          ///< Peak-to-peak over the last minutes (mA or mV)
+    uint32_t writes;                        ///< Regulator voltage changes
+};
+
+/// Settling band for the regulated current (percent) or battery voltage (mV)
+static const double REG_BAND_PCT = 5.0;
+static const double REG_BAND_MV = 50.0;
+
+/// Time the regulated value must stay in the band to count as settled (s)
+static const double REG_HOLD_S = 10.0;
+
+/// Simulated time per case, and the tail used for the error and ripple (s)
+static const double REG_RUN_S = 20 * 60.0;
+static const double REG_TAIL_S = 5 * 60.0;
+
+// Reference regulator, stepping the set voltage by voltage_step (10 mV)
+// per call as the Fast/Topping/Trickle run() handlers did before the PI loops
+static voltage_mv_t reference_step(const reg_case_t &c, current_ma_t current,
+                                   voltage_mv_t voltage, voltage_mv_t set_voltage) {
+    const charge_parm_t &p = *c.parms;
+    const voltage_mv_t step = 10;
+    if (current > p.current_max) {
+        return set_voltage - step;
+    }
+    if (c.constant_current) {
+        if (current < p.current_target) {
+            return (voltage < p.voltage_target) ? set_voltage + step : set_voltage - step;
+        }
+    } else if (voltage > p.voltage_target + VOLTS_HYSTERESIS) {
+        return set_voltage - step;
+    } else if (voltage < p.voltage_target - VOLTS_HYSTERESIS) {
+        return set_voltage + step;
+    }
+    return set_voltage;
+}
+
+// Run one regulation case against the plant model at the LOOP_DELAY rate
+static reg_result_t run_regulator(const reg_case_t &c, reg_algorithm_t algorithm) {
+    const charge_parm_t &p = *c.parms;
+    plant_parm_t pp = PLANT_DEFAULTS;
+    pp.soc = c.soc;
+    Charger_Plant plant(pp);
+    reg_result_t r = { -1.0, 0.0, 0.0, 0.0, 0 };
+
+    // Regulated value is the current for fast charging, otherwise the
+    // battery voltage (as long as the current limit isn't reached)
+    double setpoint = c.constant_current ? std::min(p.current_target, p.current_max)
+                                         : p.voltage_target;
+    double band = c.constant_current ? setpoint * REG_BAND_PCT / 100.0 : REG_BAND_MV;
+
+    // Soft start 100 mV below the battery, as Charge_Cycle::start() does
+    uint64_t now_us = 0;
+    plant.set_enabled(true);
+    plant.update(now_us);
+    voltage_mv_t set_voltage = (voltage_mv_t)plant.battery_voltage_mV() - 100;
+    PID_Controller current_loop, voltage_loop;
+    current_loop.begin(p.current_gains, VREG_VOLTAGE_MIN, VREG_VOLTAGE_MAX);
+    voltage_loop.begin(p.voltage_gains, VREG_VOLTAGE_MIN, VREG_VOLTAGE_MAX);
+    current_loop.reset(set_voltage);
+    voltage_loop.reset(set_voltage);
+
+    double in_band_s = -1.0;
+    double tail_min = 1e9, tail_max = -1e9, tail_error = 0.0;
+    uint32_t tail_samples = 0;
+    for (double t = 0.0; t < REG_RUN_S; t += LOOP_DELAY / 1000.0) {
+        // Set the regulator as Vreg::set_voltage_mV() does and let it run
+        set_voltage = constrain(set_voltage, VREG_VOLTAGE_MIN, VREG_VOLTAGE_MAX);
+        plant.set_dac_level(map(set_voltage, VREG_VOLTAGE_MIN, VREG_VOLTAGE_MAX,
+                                MCP4726_DAC_MAX, MCP4726_DAC_MIN));
+        now_us += LOOP_DELAY * 1000;
+        plant.update(now_us);
+
+        // Score the true value
+        double value = c.constant_current ? plant.charging_current_mA()
+                                          : plant.battery_voltage_mV();
+        r.overshoot = std::max(r.overshoot, value - setpoint);
+        if (fabs(value - setpoint) <= band) {
+            if (in_band_s < 0) {
+                in_band_s = t;
+            }
+            if ((r.settle_s < 0) && (t - in_band_s >= REG_HOLD_S)) {
+                r.settle_s = in_band_s;
+            }
+        } else {
+            in_band_s = -1.0;
+        }
+        if (t >= REG_RUN_S - REG_TAIL_S) {
+            tail_min = std::min(tail_min, value);
+            tail_max = std::max(tail_max, value);
+            tail_error += fabs(value - setpoint);
+            tail_samples++;
+        }
+
+        // Readings as the firmware sees them
+        double measured = plant.measured_current_mA();
+        current_ma_t current = (plant.bus_voltage_mV() > plant.battery_voltage_mV() + 250) &&
+                               (measured > 0) ? (current_ma_t)(measured + 0.5) : 0;
+        voltage_mv_t voltage = (voltage_mv_t)plant.battery_adc_count(16) * 395 / 1600;
+
+        // Adjust the set voltage
+        voltage_mv_t new_voltage;
+        if (algorithm == REG_STEPPER) {
+            new_voltage = reference_step(c, current, voltage, set_voltage);
+        } else {
+            current_ma_t limit = c.constant_current ? std::min(p.current_target, p.current_max)
+                                                    : p.current_max;
+            int32_t current_out = current_loop.update((int32_t)limit - (int32_t)current,
+                                                      set_voltage);
+            int32_t voltage_out = voltage_loop.update((int32_t)p.voltage_target - (int32_t)voltage,
+                                                      set_voltage);
+            new_voltage = (voltage_mv_t)std::min(current_out, voltage_out);
+        }
+        if (new_voltage != set_voltage) {
+            set_voltage = new_voltage;
+            r.writes++;
+        }
+    }
+    r.error = tail_samples ? tail_error / tail_samples : 0.0;
+    r.ripple = tail_max - tail_min;
+    return r;
+}
+
+// Settling time, overshoot and steady-state behaviour of the PI regulator
+// loops compared with the fixed-step regulator they replaced
+static int bench_regulator(void) {
+    const reg_case_t cases[] = {
+        { "Fast",    &FAST_PARMS,  0.50, true },
+        { "Fast",    &FAST_PARMS,  0.80, true },
+        { "Topping", &TOP_PARMS,   0.88, false },
+        { "Trickle", &TRCKL_PARMS, 0.95, false },
+    };
+    int failed = 0;
+
+    printf("Regulator over %.0f minutes, settling to +/-%.0f%% of current or +/-%.0f mV, "
+           "steady state over the last %.0f minutes\n",
+           REG_RUN_S / 60, REG_BAND_PCT, REG_BAND_MV, REG_TAIL_S / 60);
+    for (const reg_case_t &c : cases) {
+        for (int a = REG_STEPPER; a <= REG_PID; a++) {
+            reg_result_t r = run_regulator(c, (reg_algorithm_t)a);
+            const char *unit = c.constant_current ? "mA" : "mV";
+            char settle_str[16];
+            if (r.settle_s >= 0) {
+                snprintf(settle_str, sizeof(settle_str), "%6.1f s", r.settle_s);
+            } else {
+                snprintf(settle_str, sizeof(settle_str), "%8s", "never");
+            }
+            printf("  %-7s SoC %2.0f%% %-7s: settle %s, overshoot %5.1f %s, "
+                   "error %5.1f %s, ripple %5.1f %s, %5u writes\n",
+                   c.name, c.soc * 100, (a == REG_PID) ? "PI" : "stepper", settle_str,
+                   r.overshoot, unit, r.error, unit, r.ripple, unit, r.writes);
+            if ((a == REG_PID) && (r.settle_s < 0)) {
+                failed = 1;
+            }
+        }
+    }
+    return failed;
+}
+
+/// Battery plant for the internal resistance measurement
+static Charger_Plant *ir_plant;
+
+// Battery A/D readings from the plant
+static int ir_analog_hook(uint32_t pin) {
+    (void)pin;
+    ir_plant->update(sim_time_us());
+    return ir_plant->battery_adc_count(sim_analog_resolution());
+}
+
+// Regulator enable pin drives the plant
+static void ir_digital_hook(uint32_t pin, uint32_t value) {
+    if (pin == GP_VREG_ENABLE) {
+        ir_plant->update(sim_time_us());
+        ir_plant->set_enabled(value);
+    }
+}
+
+// Internal resistance measured by Vreg::update_resistance() through
+// the INA219, MCP4726 and A/D models, against batteries of known resistance
+static int bench_resistance(void) {
+    const double resistances_mohm[] = { 20, 40, 80, 150 };
+    const double socs[] = { 0.50, 0.85 };
+    const current_ma_t charge_mA = 500;
+    int failed = 0;
+
+    printf("Internal resistance at %u mA, within 10%% or 2 mOhm of the battery's drop over the step\n", charge_mA);
+    for (double soc : socs) {
+        for (double r_mohm : resistances_mohm) {
+            plant_parm_t pp = PLANT_DEFAULTS;
+            pp.r_ohmic = r_mohm / 1000.0;
+            pp.soc = soc;
+            Charger_Plant plant(pp);
+            ir_plant = &plant;
+            plant.update(sim_time_us());
+
+            Sim_INA219 ina219_model(&plant);
+            Sim_MCP4726 mcp4726_model(&plant);
+            Wire.attach(INA219B_I2C_ADDRESS, &ina219_model);
+            Wire.attach(DAC_I2C_ADDRESS, &mcp4726_model);
+            sim_set_analog_hook(ir_analog_hook);
+            sim_set_digital_hook(ir_digital_hook);
+
+            INA219 sensor;
+            MCP4726 dac;
+            Vreg vreg;
+            Battery battery;
+            sensor.init(&main_i2c_bus, INA219B_I2C_ADDRESS);
+            dac.init(&main_i2c_bus, DAC_I2C_ADDRESS);
+            vreg.begin(GP_VREG_ENABLE, &sensor, &dac);
+            battery.begin(BATTERY_CHANNELS - 1);        // Last channel starts the A/D
+            vreg.set_battery(&battery);
+
+            // Hold the charging current with the current loop for a minute,
+            // as fast charging does, soft starting just below the battery
+            voltage_mv_t set_voltage = battery.get_voltage_mV() - 100;
+            PID_Controller current_loop;
+            current_loop.begin(FAST_PARMS.current_gains, VREG_VOLTAGE_MIN, VREG_VOLTAGE_MAX);
+            current_loop.reset(set_voltage);
+            vreg.set_voltage_mV(set_voltage);
+            vreg.on();
+            for (time_ms_t t = 0; t < MINUTE_MS; t += LOOP_DELAY) {
+                int32_t error = (int32_t)charge_mA - (int32_t)vreg.get_current_average_mA();
+                set_voltage = current_loop.update(error, set_voltage);
+                vreg.set_voltage_mV(set_voltage);
+                main_i2c_bus.flush();
+                delay(LOOP_DELAY);
+            }
+
+            // One measurement step per control pass, as the scheduler runs it.
+            // The battery's own voltage and current are noted as each set of
+            // readings is taken, since near full the polarization relaxes
+            // enough over the step to add to the ohmic drop
+            uint32_t measured = 0;
+            uint32_t blocked_us = 0;
+            double step_mV[2] = { 0, 0 };
+            double step_mA[2] = { 0, 0 };
+            int steps = 0;
+            bool measuring = vreg.start_resistance();
+            while (measuring) {
+                uint32_t start_us = (uint32_t)sim_time_us();
+                if (steps < 2) {
+                    plant.update(sim_time_us());
+                    step_mV[steps] = plant.battery_voltage_mV();
+                    step_mA[steps] = plant.charging_current_mA();
+                    steps++;
+                }
+                measuring = vreg.update_resistance(measured);
+                blocked_us = std::max(blocked_us, (uint32_t)sim_time_us() - start_us);
+                main_i2c_bus.flush();
+                delay(LOOP_DELAY);
+            }
+            vreg.off();
+
+            double step_mohm = (step_mV[0] - step_mV[1]) * 1000.0 / (step_mA[0] - step_mA[1]);
+            double error = measured - step_mohm;
+            bool ok = (steps == 2) && (fabs(error) <= std::max(2.0, step_mohm * 0.10));
+            printf("  SoC %2.0f%% %5.0f mOhm (%5.1f over the step): measured %4u mOhm (%+5.1f), "
+                   "%4.1f ms blocked per pass%s\n",
+                   soc * 100, r_mohm, step_mohm, measured, error, blocked_us / 1000.0, ok ? "" : " MISMATCH");
+            failed |= ok ? 0 : 1;
+
+            Wire.attach(INA219B_I2C_ADDRESS, nullptr);
+            Wire.attach(DAC_I2C_ADDRESS, nullptr);
+            sim_set_digital_hook(nullptr);
+            sim_set_analog_hook(nullptr);
+        }
+    }
+    return failed;
+}
+
+/// Largest one-write error allowed in the swept and learned ranges (mV)
+static const double CAL_ERROR_MAX_MV = 30.0;
+
+// Largest difference between the regulator output and the voltage set,
+// one DAC write after each step from low to high voltage
+static double cal_error_mV(Charger_Plant &plant, Vreg &vreg, voltage_mv_t low_mV,
+                           voltage_mv_t high_mV) {
+    double worst = 0.0;
+    for (voltage_mv_t mV = low_mV; mV <= high_mV; mV += 100) {
+        vreg.set_voltage_mV(mV);
+        main_i2c_bus.flush();
+        delay(VREG_CAL_SETTLE_MS);
+        worst = std::max(worst, fabs(plant.bus_voltage_mV() - mV));
+    }
+    return worst;
+}
+
+// Regulator output for a single DAC write, with the straight line the
+// DAC level used to be calculated from, the table swept at startup, and
+// the table learned while charging, against regulators with a bowed DAC
+// response
+static int bench_dac_calibration(void) {
+    const double bows_V[] = { 0.0, 0.20, 0.50, 1.00 };
+    const voltage_mv_t charge_low_mV = 13000;
+    const voltage_mv_t charge_high_mV = 15000;
+    int failed = 0;
+
+    printf("Regulator output one DAC write after a step, worst error below/above the battery (mV)\n");
+    for (double bow_V : bows_V) {
+        plant_parm_t pp = PLANT_DEFAULTS;
+        pp.vreg_bow_V = bow_V;
+        Charger_Plant plant(pp);
+        ir_plant = &plant;
+        plant.update(sim_time_us());
+
+        Sim_INA219 ina219_model(&plant);
+        Sim_MCP4726 mcp4726_model(&plant);
+        Wire.attach(INA219B_I2C_ADDRESS, &ina219_model);
+        Wire.attach(DAC_I2C_ADDRESS, &mcp4726_model);
+        sim_set_analog_hook(ir_analog_hook);
+        sim_set_digital_hook(ir_digital_hook);
+
+        INA219 sensor;
+        MCP4726 dac;
+        Vreg vreg;
+        Battery battery;
+        sensor.init(&main_i2c_bus, INA219B_I2C_ADDRESS);
+        dac.init(&main_i2c_bus, DAC_I2C_ADDRESS);
+        vreg.begin(GP_VREG_ENABLE, &sensor, &dac);
+        battery.begin(BATTERY_CHANNELS - 1);        // Last channel starts the A/D
+        vreg.set_battery(&battery);
+        delay(100);                                 // Fill the battery voltage average
+        voltage_mv_t battery_mV = battery.get_voltage_average_mV();
+
+        // Straight line, before calibration
+        vreg.on();
+        double linear_below = cal_error_mV(plant, vreg, VREG_VOLTAGE_MIN + 500, battery_mV);
+        double linear_above = cal_error_mV(plant, vreg, charge_low_mV, charge_high_mV);
+        vreg.off();
+
+        // Swept up to the battery voltage
+        uint8_t points = vreg.calibrate();
+        vreg.on();
+        double swept_below = cal_error_mV(plant, vreg, VREG_VOLTAGE_MIN + 500, battery_mV);
+        double swept_above = cal_error_mV(plant, vreg, charge_low_mV, charge_high_mV);
+
+        // Learned, moving around the charging range for ten minutes
+        for (time_ms_t t = 0; t < 10 * MINUTE_MS; t += LOOP_DELAY) {
+            voltage_mv_t mV = charge_low_mV + ((t / (15 * SECOND_MS)) * 700) % (charge_high_mV - charge_low_mV);
+            vreg.set_voltage_mV(mV);
+            main_i2c_bus.flush();
+            vreg.learn();
+            delay(LOOP_DELAY);
+        }
+        double learned_below = cal_error_mV(plant, vreg, VREG_VOLTAGE_MIN + 500, battery_mV);
+        double learned_above = cal_error_mV(plant, vreg, charge_low_mV, charge_high_mV);
+        vreg.off();
+
+        bool ok = (swept_below <= CAL_ERROR_MAX_MV) && (learned_below <= CAL_ERROR_MAX_MV) &&
+                  (learned_above <= CAL_ERROR_MAX_MV);
+        printf("  Bow %4.2f V: linear %3.0f/%3.0f, swept (%2u points) %3.0f/%3.0f, learned %3.0f/%3.0f%s\n",
+               bow_V, linear_below, linear_above, points, swept_below, swept_above, learned_below,
+               learned_above, ok ? "" : " MISMATCH");
+        failed |= ok ? 0 : 1;
+
+        Wire.attach(INA219B_I2C_ADDRESS, nullptr);
+        Wire.attach(DAC_I2C_ADDRESS, nullptr);
+        sim_set_digital_hook(nullptr);
+        sim_set_analog_hook(nullptr);
+    }
+    return failed;
+}
+
+// Calibration register reads with no current flowing, when the current
+// register reads zero on every reading, and how soon the calibration is
+// put back after a sensor reset while charging
+static int bench_ina219_calibration(void) {
+    const time_ms_t idle_ms = 10 * SECOND_MS;
+    uint8_t reset_config[] = { INA219_CONFIG_REG, (uint8_t)(INA219_RESET >> 8), 0 };
+    ina219_snapshot_t snapshot;
+
+    printf("INA219 calibration check, reading bus voltage and current every %u ms\n", LOOP_DELAY);
+    plant_parm_t pp = PLANT_DEFAULTS;
+    pp.current_noise_mA = 0.0;                  // So no current reads exactly zero
+    Charger_Plant plant(pp);
+    ir_plant = &plant;
+    plant.update(sim_time_us());
+
+    Sim_INA219 ina219_model(&plant);
+    Sim_MCP4726 mcp4726_model(&plant);
+    Wire.attach(INA219B_I2C_ADDRESS, &ina219_model);
+    Wire.attach(DAC_I2C_ADDRESS, &mcp4726_model);
+    sim_set_analog_hook(ir_analog_hook);
+    sim_set_digital_hook(ir_digital_hook);
+
+    INA219 sensor;
+    MCP4726 dac;
+    Vreg vreg;
+    sensor.init(&main_i2c_bus, INA219B_I2C_ADDRESS);
+    dac.init(&main_i2c_bus, DAC_I2C_ADDRESS);
+    vreg.begin(GP_VREG_ENABLE, &sensor, &dac);
+
+    // Regulator off, so every current reading is zero
+    uint32_t readings = 0, zero_readings = 0;
+    uint32_t reads_start = ina219_model.register_reads;
+    for (time_ms_t t = 0; t < idle_ms; t += LOOP_DELAY) {
+        sensor.read_all(snapshot, INA219_SNAPSHOT_BUS | INA219_SNAPSHOT_CURRENT);
+        zero_readings += (snapshot.current_raw == 0) ? 1 : 0;
+        readings++;
+        delay(LOOP_DELAY);
+    }
+    uint32_t checks = ina219_model.register_reads - reads_start - 2 * readings;
+    uint32_t checks_max = idle_ms / INA219_CAL_CHECK_MS + 1;
+
+    // Charging, then the sensor is reset and loses its calibration
+    vreg.set_voltage_mV(14400);
+    main_i2c_bus.flush();
+    vreg.on();
+    delay(SECOND_MS);
+    main_i2c_bus.writeto(INA219B_I2C_ADDRESS, reset_config, sizeof(reset_config));
+    time_ms_t reset_time = millis();
+    time_ms_t restored_ms = 0;
+    while (millis() - reset_time <= 10 * INA219_CAL_CHECK_MS) {
+        sensor.read_all(snapshot, INA219_SNAPSHOT_BUS | INA219_SNAPSHOT_CURRENT);
+        if (snapshot.current_mA > 0) {
+            restored_ms = millis() - reset_time;
+            break;
+        }
+        delay(LOOP_DELAY);
+    }
+    bool restored = (snapshot.current_mA > 0);
+    vreg.off();
+
+    bool ok = (zero_readings == readings) && (checks <= checks_max) && restored &&
+              (restored_ms <= INA219_CAL_CHECK_MS + LOOP_DELAY);
+    printf("  No current: %u readings, %u zero, %u calibration reads (at most %u)%s\n", readings,
+           zero_readings, checks, checks_max,
+           ((zero_readings == readings) && (checks <= checks_max)) ? "" : " MISMATCH");
+    printf("  Sensor reset while charging: calibration restored after %s%u ms%s\n",
+           restored ? "" : "more than ", restored ? restored_ms : 10 * INA219_CAL_CHECK_MS,
+           ok ? "" : " MISMATCH");
+
+    Wire.attach(INA219B_I2C_ADDRESS, nullptr);
+    Wire.attach(DAC_I2C_ADDRESS, nullptr);
+    sim_set_digital_hook(nullptr);
+    sim_set_analog_hook(nullptr);
+    return ok ? 0 : 1;
+}
+
+/// Largest battery voltage error allowed once calibrated (mV)
+static const double BATTERY_CAL_ERROR_MAX_MV = 25.0;
+
+// Largest difference between the battery voltage read and the plant's,
+// at rest across the state of charge range and while charging at 14.4V
+static double battery_error_mV(Battery &battery, Vreg &vreg, const plant_parm_t &pp,
+                               Sim_INA219 &ina219_model, Sim_MCP4726 &mcp4726_model) {
+    const double socs[] = { 0.0, 0.5, 1.0 };
+    double worst = 0.0;
+    for (double soc : socs) {
+        plant_parm_t battery_pp = pp;
+        battery_pp.connected = true;
+        battery_pp.soc = soc;
+        Charger_Plant plant(battery_pp);
+        ir_plant = &plant;
+        plant.update(sim_time_us());
+        ina219_model.set_plant(&plant);
+        mcp4726_model.set_plant(&plant);
+
+        for (int charging = 0; charging < 2; charging++) {
+            if (charging) {
+                vreg.set_voltage_mV(14400);
+                main_i2c_bus.flush();
+                vreg.on();
+            }
+            delay(BATTERY_CAL_SETTLE_MS);
+            plant.update(sim_time_us());
+            worst = std::max(worst, fabs(battery.get_voltage_average_mV() - plant.battery_voltage_mV()));
+            vreg.off();
+        }
+    }
+    return worst;
+}
+
+// Battery voltage readings with the divider's gain, and calibrated against
+// the regulator's bus voltage with no battery connected, against dividers
+// and A/D converters with gain and offset errors
+static int bench_battery_calibration(void) {
+    const double gains[] = { 1.0, 0.97, 1.03, 1.0 };
+    const double offsets_mV[] = { 0.0, 60.0, -40.0, 100.0 };
+    int failed = 0;
+
+    printf("Battery voltage readings, worst error at rest and charging (mV)\n");
+    for (uint8_t i = 0; i < sizeof(gains) / sizeof(gains[0]); i++) {
+        plant_parm_t pp = PLANT_DEFAULTS;
+        pp.adc_gain = gains[i];
+        pp.adc_offset_mV = offsets_mV[i];
+        pp.connected = false;
+        Charger_Plant open_plant(pp);
+        ir_plant = &open_plant;
+        open_plant.update(sim_time_us());
+
+        Sim_INA219 ina219_model(&open_plant);
+        Sim_MCP4726 mcp4726_model(&open_plant);
+        Wire.attach(INA219B_I2C_ADDRESS, &ina219_model);
+        Wire.attach(DAC_I2C_ADDRESS, &mcp4726_model);
+        sim_set_analog_hook(ir_analog_hook);
+        sim_set_digital_hook(ir_digital_hook);
+
+        INA219 sensor;
+        MCP4726 dac;
+        Vreg vreg;
+        Battery battery;
+        sensor.init(&main_i2c_bus, INA219B_I2C_ADDRESS);
+        dac.init(&main_i2c_bus, DAC_I2C_ADDRESS);
+        vreg.begin(GP_VREG_ENABLE, &sensor, &dac);
+        battery.begin(BATTERY_CHANNELS - 1);        // Last channel starts the A/D
+        vreg.set_battery(&battery);
+
+        double divider_error = battery_error_mV(battery, vreg, pp, ina219_model, mcp4726_model);
+        ir_plant = &open_plant;
+        ina219_model.set_plant(&open_plant);
+        mcp4726_model.set_plant(&open_plant);
+        delay(BATTERY_CAL_SETTLE_MS);
+        bool fitted = vreg.calibrate_battery();
+        double calibrated_error = battery_error_mV(battery, vreg, pp, ina219_model, mcp4726_model);
+
+        bool ok = fitted && (calibrated_error <= BATTERY_CAL_ERROR_MAX_MV);
+        printf("  Gain %4.2f, offset %+4.0f mV: divider %3.0f, calibrated %3.0f%s\n", gains[i],
+               offsets_mV[i], divider_error, calibrated_error, ok ? "" : " MISMATCH");
+        failed |= ok ? 0 : 1;
+
+        Wire.attach(INA219B_I2C_ADDRESS, nullptr);
+        Wire.attach(DAC_I2C_ADDRESS, nullptr);
+        sim_set_digital_hook(nullptr);
+        sim_set_analog_hook(nullptr);
+    }
+    return failed;
+}
+
+/// @brief Slope estimator test case: a noisy reading that may level off
+struct slope_case_t {
+    const char *name_str;                   ///< Case name
+    double start;                           ///< Starting reading
+    double slope_per_h;                     ///< Slope until it levels off (per hour)
+    double level_h;                         ///< Time the reading levels off (h, <0=never)
+    double noise;                           ///< Standard deviation of the readings
+    int16_t plateau_slope;                  ///< Plateau rule, as in `charge_parm_t`
+};
+
+/// Time each case is run for (h)
+static const double SLOPE_RUN_H = 3.0;
+
+/// Longest time after levelling off the plateau rule may take to fire (h)
+static const double SLOPE_DETECT_MAX_H = 0.5;
+
+// Reading with roughly normal noise of the given standard deviation
+static double noisy(double value, double noise) {
+    double sum = 0.0;
+    for (int i = 0; i < 3; i++) {
+        sum += (rand() % 2001 - 1000) / 1000.0;
+    }
+    return value + sum * noise;
+}
+
+// Slope estimates and plateau rules against readings rising or falling at
+// a known rate, with and without levelling off.  Readings that keep rising
+// or falling past the rule must never be taken for a plateau, and ones that
+// level off (or move the wrong way) must be caught within
+// `SLOPE_DETECT_MAX_H`.
+static int bench_slope(void) {
+    const slope_case_t cases[] = {
+        { "Fast, rising",       13200.0,  120.0, -1.0, 10.0,  FAST_PARMS.plateau_slope },
+        { "Fast, slow rise",    13200.0,   50.0, -1.0, 10.0,  FAST_PARMS.plateau_slope },
+        { "Fast, levels off",   13200.0,  300.0,  1.0, 10.0,  FAST_PARMS.plateau_slope },
+        { "Topping, tapering",    600.0, -100.0, -1.0,  8.0,  TOP_PARMS.plateau_slope },
+        { "Topping, levels off",  600.0, -150.0,  1.5,  8.0,  TOP_PARMS.plateau_slope },
+        { "Topping, rising",      400.0,   40.0, -1.0,  8.0,  TOP_PARMS.plateau_slope },
+    };
+    int failed = 0;
+
+    srand(1);
+    printf("Slope estimates and plateau rules, %u x %u s window\n", PLATEAU_SAMPLES,
+           (unsigned)(PLATEAU_INTERVAL_MS / SECOND_MS));
+    for (const slope_case_t &c : cases) {
+        Slope_Estimator trend;
+        trend.begin(PLATEAU_INTERVAL_MS, PLATEAU_SAMPLES);
+        time_ms_t start = millis();
+        double detect_h = -1.0;
+        double worst_sigmas = 0.0;
+
+        while (millis() - start < SLOPE_RUN_H * HOUR_MS) {
+            double t_h = (double)(millis() - start) / HOUR_MS;
+            double true_h = (c.level_h < 0) ? t_h : std::min(t_h, c.level_h);
+            double reading = noisy(c.start + c.slope_per_h * true_h, c.noise);
+            if (trend.add((int32_t)lround(reading)) && trend.ready()) {
+                // Compare with the true slope once the window has only
+                // seen the one slope
+                double window_h = (double)PLATEAU_SAMPLES * PLATEAU_INTERVAL_MS / HOUR_MS;
+                bool steady = (c.level_h < 0.0) || (t_h < c.level_h) || (t_h > c.level_h + window_h);
+                double true_slope = ((c.level_h > 0.0) && (t_h > c.level_h)) ? 0.0 : c.slope_per_h;
+                if (steady) {
+                    double error = fabs(trend.slope_per_hour() - true_slope);
+                    worst_sigmas = std::max(worst_sigmas, error / std::max<int32_t>(trend.error_per_hour(), 1));
+                }
+                bool plateau = (c.plateau_slope > 0) ? trend.slope_below(c.plateau_slope, 3)
+                                                     : trend.slope_above(c.plateau_slope, 3);
+                if (plateau && (detect_h < 0.0)) {
+                    detect_h = t_h;
+                }
+            }
+            sim_advance_us((uint64_t)LOOP_DELAY * 1000);
+        }
+
+        bool past_rule = (c.plateau_slope > 0) ? (c.slope_per_h > c.plateau_slope)
+                                               : (c.slope_per_h < c.plateau_slope);
+        double from_h = std::max(c.level_h, 0.0);
+        bool ok = (worst_sigmas <= 5.0);
+        if ((c.level_h >= 0.0) || !past_rule) {
+            ok = ok && (detect_h >= from_h) && (detect_h <= from_h + SLOPE_DETECT_MAX_H);
+        } else {
+            ok = ok && (detect_h < 0.0);
+        }
+        char detect_str[24];
+        if (detect_h < 0.0) {
+            snprintf(detect_str, sizeof(detect_str), "never");
+        } else {
+            snprintf(detect_str, sizeof(detect_str), "%+.0f min", (detect_h - from_h) * 60.0);
+        }
+        printf("  %-20s %+5.0f/h: last fit %+5d/h +/- %3d, worst %.1f sigma, plateau %s%s\n",
+               c.name_str, c.slope_per_h, (int)trend.slope_per_hour(), (int)trend.error_per_hour(),
+               worst_sigmas, detect_str, ok ? "" : " MISMATCH");
+        failed |= ok ? 0 : 1;
+    }
+    return failed;
+}
+
+/// Time the settle detector cases are run for (s)
+static const double SETTLE_RUN_S = 300.0;
+
+// Settle detector against a battery voltage falling and a charging current
+// rising exponentially to their final values, with noise.  The detector
+// must not report the readings settled while they're still moving at more
+// than twice the slope limits, and must report them settled within two
+// windows of them slowing to half the slope limits.
+static int bench_settle(void) {
+    const double taus_s[] = { 2.0, 10.0, 30.0, 60.0 };
+    const double voltage_step_mV = 800.0;
+    const double current_step_mA = 600.0;
+    const double window_s = (double)SETTLE_SAMPLES * SETTLE_INTERVAL_MS / SECOND_MS;
+    int failed = 0;
+
+    srand(1);
+    printf("Settle detector, %u x %u s window\n", SETTLE_SAMPLES,
+           (unsigned)(SETTLE_INTERVAL_MS / SECOND_MS));
+    for (double tau : taus_s) {
+        Settle_Detector detector;
+        time_ms_t start = millis();
+        double settled_s = -1.0;
+        double voltage_slope = 0.0, current_slope = 0.0;
+
+        while ((settled_s < 0.0) && (millis() - start < SETTLE_RUN_S * SECOND_MS)) {
+            double t = (double)(millis() - start) / SECOND_MS;
+            double decay = exp(-t / tau);
+            detector.add((voltage_mv_t)lround(noisy(13000.0 + voltage_step_mV * decay, 5.0)),
+                         (current_ma_t)lround(std::max(noisy(current_step_mA * (1.0 - decay), 8.0), 0.0)));
+            if (detector.settled()) {
+                settled_s = t;
+                voltage_slope = voltage_step_mV * decay * 3600.0 / tau;
+                current_slope = current_step_mA * decay * 3600.0 / tau;
+            }
+            sim_advance_us((uint64_t)LOOP_DELAY * 1000);
+        }
+
+        // Time the transient's slopes fall to half the limits
+        double flat_s = tau * std::max(log(voltage_step_mV * 3600.0 / tau / (SETTLE_VOLTAGE_SLOPE / 2.0)),
+                                       log(current_step_mA * 3600.0 / tau / (SETTLE_CURRENT_SLOPE / 2.0)));
+        bool ok = (settled_s >= 0.0) && (voltage_slope <= 2.0 * SETTLE_VOLTAGE_SLOPE) &&
+                  (current_slope <= 2.0 * SETTLE_CURRENT_SLOPE) &&
+                  (settled_s <= std::max(flat_s, 0.0) + 2.0 * window_s);
+        printf("  Time constant %3.0f s: settled after %3.0f s, moving %4.0f mV/h and %4.0f mA/h%s\n",
+               tau, settled_s, voltage_slope, current_slope, ok ? "" : " MISMATCH");
+        failed |= ok ? 0 : 1;
+    }
+    return failed;
+}
+
+/// @brief Time left prediction test case: a noisy reading heading for a target
+struct eta_case_t {
+    const char *name_str;                   ///< Case name
+    bool logarithmic;                       ///< Exponential taper (true) or straight line?
+    double start;                           ///< Starting reading
+    double rate;                            ///< Slope (per hour) or taper time constant (h)
+    double target;                          ///< Target reading
+    double noise;                           ///< Standard deviation of the readings
+};
+
+/// Largest prediction error allowed from a quarter of the way on (% of the time left)
+static const double ETA_ERROR_MAX_PCT = 10.0;
+
+// Fixed point logarithm against log2(), and time left predictions against
+// readings rising in a straight line or tapering off exponentially to a
+// target, with noise.  The predictions are compared with the true time left
+// each minute, from a quarter of the way to the target until five minutes
+// before it.
+static int bench_eta(void) {
+    const eta_case_t cases[] = {
+        { "Voltage, 300 mV/h",  false, 13500.0,  300.0, 14400.0, 10.0 },
+        { "Voltage, 1200 mV/h", false, 14000.0, 1200.0, 14400.0, 10.0 },
+        { "Current, 1 h taper",  true,   600.0,    1.0,   275.0,  8.0 },
+        { "Current, 3 h taper",  true,   450.0,    3.0,   275.0,  8.0 },
+    };
+    int failed = 0;
+
+    double worst_log = 0.0;
+    for (uint32_t value = 1; value < 4000000000u; value += value / 7 + 1) {
+        double error = fabs(log2_fixed(value) / (double)(1 << ETA_LOG_BITS) - log2((double)value));
+        worst_log = std::max(worst_log, error);
+    }
+    bool log_ok = (worst_log <= 1.0 / (1 << ETA_LOG_BITS));
+    printf("Fixed point log2 within %.5f%s\n", worst_log, log_ok ? "" : " MISMATCH");
+    failed |= log_ok ? 0 : 1;
+
+    srand(1);
+    printf("Time left predictions, error once a quarter of the way to the target\n");
+    for (const eta_case_t &c : cases) {
+        double total_h = c.logarithmic ? c.rate * log(c.start / c.target) : (c.target - c.start) / c.rate;
+        ETA_Estimator eta;
+        eta.begin(c.logarithmic, !c.logarithmic);     // Voltages rise, currents taper
+        time_ms_t start = millis();
+        double worst_pct = 0.0, worst_min = 0.0;
+        uint32_t next_check = 0;
+
+        while (true) {
+            time_ms_t elapsed = millis() - start;
+            double t_h = (double)elapsed / HOUR_MS;
+            double left_h = total_h - t_h;
+            if (left_h < 5.0 / 60) {
+                break;
+            }
+            double reading = c.logarithmic ? c.start * exp(-t_h / c.rate) : c.start + c.rate * t_h;
+            eta.add((uint32_t)lround(std::max(noisy(reading, c.noise), 0.0)));
+            if ((elapsed >= next_check) && (t_h >= total_h / 4)) {
+                next_check = elapsed + MINUTE_MS;
+                time_ms_t predicted = eta.time_to((uint32_t)c.target);
+                double error_h = (predicted == ETA_UNKNOWN) ? left_h : (double)predicted / HOUR_MS - left_h;
+                worst_pct = std::max(worst_pct, 100.0 * fabs(error_h) / left_h);
+                worst_min = std::max(worst_min, fabs(error_h) * 60.0);
+            }
+            sim_advance_us((uint64_t)LOOP_DELAY * 1000);
+        }
+
+        bool ok = (worst_pct <= ETA_ERROR_MAX_PCT);
+        printf("  %-20s %5.0f min: worst %4.1f min, %4.1f%% of the time left%s\n", c.name_str,
+               total_h * 60.0, worst_min, worst_pct, ok ? "" : " MISMATCH");
+        failed |= ok ? 0 : 1;
+    }
+    return failed;
+}
+
+// CRC check value, COBS encoding against known vectors and random blocks,
+// and status record frames: every single bit error caught, and the size
+// and time taken against formatting the CSV status line
+static int bench_telemetry(void) {
+    const uint8_t vector_in[] = { 0x11, 0x22, 0x00, 0x33 };
+    const uint8_t vector_out[] = { 0x03, 0x11, 0x22, 0x02, 0x33 };
+    const uint32_t n_blocks = 20000, n_records = 100000;
+    uint8_t data[253], encoded[256], decoded[256];
+    int failed = 0;
+
+    uint16_t crc = crc16_ccitt((const uint8_t *)"123456789", 9);
+    uint8_t length = cobs_encode(vector_in, sizeof(vector_in), encoded);
+    bool vector_ok = (length == sizeof(vector_out)) && !memcmp(encoded, vector_out, length) &&
+                     (cobs_decode(encoded, length, decoded) == sizeof(vector_in)) &&
+                     !memcmp(decoded, vector_in, sizeof(vector_in));
+    bool crc_ok = (crc == 0x29B1);
+    printf("CRC-16/CCITT check value %04X, COBS vector %s%s\n", crc, vector_ok ? "match" : "differs",
+           (crc_ok && vector_ok) ? "" : " MISMATCH");
+    failed |= (crc_ok && vector_ok) ? 0 : 1;
+
+    srand(1);
+    uint32_t bad_blocks = 0;
+    for (uint32_t i = 0; i < n_blocks; i++) {
+        uint8_t size = 1 + rand() % sizeof(data);
+        int zero_pct = rand() % 101;
+        for (uint8_t j = 0; j < size; j++) {
+            data[j] = (rand() % 100 < zero_pct) ? 0 : (uint8_t)(1 + rand() % 255);
+        }
+        length = cobs_encode(data, size, encoded);
+        bool ok = (length <= size + 1) && (memchr(encoded, 0, length) == nullptr) &&
+                  (cobs_decode(encoded, length, decoded) == size) && !memcmp(decoded, data, size);
+        bad_blocks += ok ? 0 : 1;
+    }
+    printf("COBS round trip: %u/%u blocks%s\n", n_blocks - bad_blocks, n_blocks,
+           bad_blocks ? " MISMATCH" : "");
+    failed |= bad_blocks ? 1 : 0;
+
+    // A typical status record, and every single bit error in its frame
+    telemetry_status_t record = { TELEMETRY_STATUS, 1, CHARGER_FAST, 62, 4523000, 4521000, 14350,
+                                  13912, 612, 14360, 1823, 4012000, 7612000 };
+    uint8_t frame[TELEMETRY_FRAME_MAX];
+    uint8_t frame_size = telemetry_pack(&record, sizeof(record), frame);
+    uint32_t accepted = 0, flips = 0;
+    for (uint8_t pos = 1; pos + 1 < frame_size; pos++) {
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            uint8_t damaged[TELEMETRY_FRAME_MAX];
+            telemetry_status_t received;
+            memcpy(damaged, frame, frame_size);
+            damaged[pos] ^= 1 << bit;
+            accepted += telemetry_unpack(damaged + 1, frame_size - 2, &received, sizeof(received)) ? 1 : 0;
+            flips++;
+        }
+    }
+    telemetry_status_t received;
+    bool intact = telemetry_unpack(frame + 1, frame_size - 2, &received, sizeof(received)) &&
+                  !memcmp(&received, &record, sizeof(record));
+    bool frame_ok = intact && (accepted == 0);
+    printf("Status record frame: %s, %u/%u bit errors caught%s\n", intact ? "intact" : "damaged",
+           flips - accepted, flips, frame_ok ? "" : " MISMATCH");
+    failed |= frame_ok ? 0 : 1;
+
+    // Formatting the CSV line as the firmware does, against packing the record
+    char line[128];
+    char hms_str[9], ov_str[6], bv_str[6], stage_str[10], full_str[10];
+    size_t line_size = 0;
+    clock_t start = clock();
+    for (uint32_t i = 0; i < n_records; i++) {
+        record.battery_mV = 13000 + i % 1000;
+        ms_to_hms_str(record.elapsed_ms, hms_str);
+        eta_to_string(record.stage_left_ms, stage_str);
+        eta_to_string(record.full_left_ms, full_str);
+        milliunits_to_string(record.battery_mV, 1, bv_str, sizeof(bv_str));
+        milliunits_to_string(record.bus_mV, 1, ov_str, sizeof(ov_str));
+        line_size += snprintf(line, sizeof(line), "Battery %u: %s, %s, %s, %s, %u, %u, %s, %s\n",
+                              record.battery, FAST_PARMS.name_str, hms_str, ov_str, bv_str,
+                              record.current_mA, record.soc, stage_str, full_str);
+    }
+    double csv_s = seconds_since(start);
+    size_t frame_bytes = 0;
+    start = clock();
+    for (uint32_t i = 0; i < n_records; i++) {
+        record.battery_mV = 13000 + i % 1000;
+        frame_bytes += telemetry_pack(&record, sizeof(record), frame);
+    }
+    double pack_s = seconds_since(start);
+    telemetry_to_csv(record, line, sizeof(line));
+    printf("  CSV line %5.1f bytes %6.0f ns, record frame %5.1f bytes %6.0f ns\n",
+           (double)line_size / n_records, csv_s * 1e9 / n_records,
+           (double)frame_bytes / n_records, pack_s * 1e9 / n_records);
+    printf("  Decoded: %s", line);
+    return failed;
+}
+
+/// Console output for a minute: a status line each second, and a burst
+/// larger than the buffer after 10 seconds
+static const uint32_t CONSOLE_RUN_MS = MINUTE_MS;
+static const uint32_t CONSOLE_LINE_BYTES = 70;
+static const uint32_t CONSOLE_BURST_BYTES = 800;
+
+// Console output at 115200 baud, with each overflow policy: the longest a
+// write waits, and the bytes sent and dropped.  Writing never waits once
+// past the startup policy, and every byte written is either sent or
+// counted as dropped.
+static int bench_console(void) {
+    const console_overflow_t policies[] = { CONSOLE_OVERFLOW_WAIT, CONSOLE_OVERFLOW_REPORT,
+                                            CONSOLE_OVERFLOW_DROP };
+    const char *names[] = { "wait", "report", "drop" };
+    uint8_t line[CONSOLE_BURST_BYTES];
+    int failed = 0;
+
+    memset(line, 'x', sizeof(line));
+    sim_serial_enable(false);
+    console.begin(115200);
+    printf("Console output at 115200 baud, %u byte buffer, %u byte lines and a %u byte burst\n",
+           CONSOLE_TX_SIZE, CONSOLE_LINE_BYTES, CONSOLE_BURST_BYTES);
+    for (int p = 0; p < 3; p++) {
+        console.flush();
+        uint32_t sent_start = console.sent_bytes();
+        uint32_t dropped_start = console.dropped_bytes();
+        console.set_overflow(policies[p]);
+        uint32_t written = 0, max_wait_us = 0;
+        time_ms_t start = millis();
+        while (millis() - start < CONSOLE_RUN_MS) {
+            time_ms_t elapsed = millis() - start;
+            uint32_t size = 0;
+            if (elapsed % SECOND_MS == 0) {
+                size = CONSOLE_LINE_BYTES;
+            } else if (elapsed == 10 * SECOND_MS + 1) {
+                size = CONSOLE_BURST_BYTES;
+            }
+            if (size) {
+                uint64_t write_start = sim_time_us();
+                console.write(line, size);
+                max_wait_us = std::max(max_wait_us, (uint32_t)(sim_time_us() - write_start));
+                written += size;
+            }
+            console.service();
+            sim_advance_us(1000);
+        }
+        console.flush();
+        uint32_t sent = console.sent_bytes() - sent_start;
+        uint32_t dropped = console.dropped_bytes() - dropped_start;
+        uint32_t reports = sent + dropped - written;
+        bool ok = (sent + dropped >= written) &&
+                  ((policies[p] == CONSOLE_OVERFLOW_WAIT) ? (dropped == 0)
+                                                          : (max_wait_us == 0)) &&
+                  ((policies[p] == CONSOLE_OVERFLOW_REPORT) == (reports > 0));
+        printf("  %-6s waited up to %5.1f ms, %5u bytes sent, %4u dropped, %2u in reports%s\n",
+               names[p], max_wait_us / 1000.0, sent, dropped, reports, ok ? "" : " MISMATCH");
+        failed |= ok ? 0 : 1;
+    }
+    console.set_overflow(CONSOLE_OVERFLOW_WAIT);
+    sim_serial_enable(true);
+    printf("  buffer peak %u bytes\n", console.max_used());
+    return failed;
+}
+
+/// Temperature read by the internal temperature sensor model (C)
+static double sensor_temp_C;
+
+// Temperature sensor A/D readings
+static int temp_analog_hook(uint32_t pin) {
+    return (pin == ATEMP) ? Temp_Trace::sensor_adc_count(sensor_temp_C, sim_analog_resolution()) : 0;
+}
+
+// Temperature read through the A/D model by Temp_Sensor, and the fast
+// charging voltage target compensated for it
+static int bench_temperature(void) {
+    const double temps_C[] = { -45, -10, 0, 5, 25, 40, 45, 60 };
+    int failed = 0;
+
+    printf("Temperature sensor within 0.3C, fast charging target at %u mV/C per cell\n",
+           -FAST_PARMS.temp_comp_mv);
+    sim_set_analog_hook(temp_analog_hook);
+    analogReadResolution(ADC_RESULT_BITS);
+    Temp_Sensor sensor;
+    sensor.begin();
+    for (double temp_C : temps_C) {
+        sensor_temp_C = temp_C;
+        delayMicroseconds(ADC_SAMPLES * ADC_SCAN_US);
+        temp_dc_t temp_dC = sensor.get_temperature_dC();
+        voltage_mv_t target = temp_compensate(FAST_PARMS.voltage_target, FAST_PARMS.temp_comp_mv,
+                                              temp_dC);
+
+        // Reference target, with the temperature held to the compensated
+        // range, and none outside the sensor's range
+        double comp_C = std::min(std::max(temp_C, TEMP_COMP_MIN_DC / 10.0), TEMP_COMP_MAX_DC / 10.0);
+        double expect = FAST_PARMS.voltage_target;
+        if ((temp_C >= TEMP_SENSOR_MIN_DC / 10.0) && (temp_C <= TEMP_SENSOR_MAX_DC / 10.0)) {
+            expect += FAST_PARMS.temp_comp_mv * BATTERY_CELLS * (comp_C - TEMP_COMP_REF_DC / 10.0);
+        }
+
+        double error = temp_dC / 10.0 - temp_C;
+        bool ok = (fabs(error) <= 0.3) && (fabs(target - expect) <= 6.0);
+        printf("  %5.1f C: read %5.1f C (%+4.1f), target %5u mV (%5.0f expected)%s\n",
+               temp_C, temp_dC / 10.0, error, target, expect, ok ? "" : " MISMATCH");
+        failed |= ok ? 0 : 1;
+    }
+    sim_set_analog_hook(nullptr);
+    return failed;
+}
+
+// Reference next state, following the hand-written switch in loop() that
+// the supervisor tables replaced (no handler in startup and shutdown, so
+// only CYCLE_DONE applies there), plus the shutdown at startup when no
+// battery is connected, conditioning a battery with a high internal
+// resistance after topping charging, and the load test if selected
+static charger_state_t reference_next_state(charger_state_t state, cycle_state_t result,
+                                            voltage_mv_t battery_mV, uint32_t resistance_mohm,
+                                            bool load_test) {
+    bool discharged = (battery_mV <= BATTERY_DISCHARGED_MV);
+    if ((result == CYCLE_STARTUP) || (result == CYCLE_RUNNING)) {
+        return state;
+    }
+    switch (state) {
+        case CHARGER_STARTUP:
+            if (battery_mV <= BATTERY_ABSENT_MV) {
+                return CHARGER_SHUTDOWN;
+            }
+            if (load_test && LOAD_TEST_CYCLE) {
+                return CHARGER_LOAD_TEST;
+            }
+            return discharged ? CHARGER_FAST : CHARGER_TOPPING;
+        case CHARGER_FAST:
+            return (result == CYCLE_DONE) ? CHARGER_TOPPING : CHARGER_SHUTDOWN;
+        case CHARGER_TOPPING:
+            if (result == CYCLE_DONE) {
+                bool sulfated = (resistance_mohm >= CONDITION_RESISTANCE_MOHM);
+                return (sulfated && CONDITIONING_CYCLE) ? CHARGER_CONDITION : CHARGER_TRICKLE;
+            }
+            return CHARGER_SHUTDOWN;
+        case CHARGER_CONDITION:
+            return ((result == CYCLE_DONE) || (result == CYCLE_TIMEOUT)) ? CHARGER_TRICKLE
+                                                                          : CHARGER_SHUTDOWN;
+        case CHARGER_TRICKLE:
+            return ((result == CYCLE_DONE) || (result == CYCLE_TIMEOUT)) ? CHARGER_STANDBY
+                                                                          : CHARGER_SHUTDOWN;
+        case CHARGER_STANDBY:
+            if (result == CYCLE_TIMEOUT) {
+                return discharged ? CHARGER_FAST : CHARGER_TRICKLE;
+            }
+            return CHARGER_SHUTDOWN;
+        case CHARGER_LOAD_TEST:
+            if (result == CYCLE_DONE) {
+                return discharged ? CHARGER_FAST : CHARGER_TOPPING;
+            }
+            return (result == CYCLE_TIMEOUT) ? CHARGER_TOPPING : CHARGER_SHUTDOWN;
+        default:
+            return CHARGER_SHUTDOWN;
+    }
+}
+
+// Walk every charger state, handler result, side of the battery voltage and
+// internal resistance thresholds, and load test selection through the
+// supervisor tables, checking the next state against the reference and that
+// every transition row is reachable
+static int bench_supervisor(void) {
+    const size_t n_rows = sizeof(CHARGER_TRANSITIONS) / sizeof(CHARGER_TRANSITIONS[0]);
+    const voltage_mv_t voltages[] = { 0, BATTERY_ABSENT_MV, BATTERY_ABSENT_MV + 1,
+                                      BATTERY_DISCHARGED_MV, BATTERY_DISCHARGED_MV + 1,
+                                      VREG_VOLTAGE_MAX };
+    const uint32_t resistances[] = { 0, CONDITION_RESISTANCE_MOHM - 1, CONDITION_RESISTANCE_MOHM };
+    Charge_Channel channel;
+    std::vector<bool> taken(n_rows, false);
+    uint32_t walked = 0, mismatches = 0;
+
+    for (const charger_stage_t &stage : CHARGER_STAGES) {
+        for (int r = CYCLE_INIT; r <= CYCLE_TIMEOUT; r++) {
+            cycle_state_t result = (cycle_state_t)r;
+            if ((stage.cycle == nullptr) && (result != CYCLE_DONE)) {
+                continue;
+            }
+            for (bool load_test : { false, true }) {
+#if LOAD_TEST_CYCLE
+                channel.load_test_selected = load_test;
+#endif
+                for (uint32_t mOhm : resistances) {
+                    channel.session.resistance_mohm = mOhm;
+                    for (voltage_mv_t mV : voltages) {
+                        const charger_transition_t *t =
+                            charger_transition(stage.state, result, mV, channel);
+                        charger_state_t next;
+                        if (t != nullptr) {
+                            taken[t - CHARGER_TRANSITIONS] = true;
+                            next = t->next;
+                        } else if ((result == CYCLE_STARTUP) || (result == CYCLE_RUNNING)) {
+                            next = stage.state;
+                        } else {
+                            next = CHARGER_SHUTDOWN;
+                        }
+                        charger_state_t expected =
+                            reference_next_state(stage.state, result, mV, mOhm, load_test);
+                        if ((next != expected) || (charger_stage(next) == nullptr)) {
+                            if (mismatches++ < 5) {
+                                printf("  mismatch: state %d result %d at %u mV, %u mOhm, "
+                                       "load test %d -> %d, expected %d\n", stage.state, result,
+                                       mV, mOhm, load_test, next, expected);
+                            }
+                        }
+                        walked++;
+                    }
+                }
+            }
+        }
+    }
+    for (size_t i = 0; i < n_rows; i++) {
+        if (!taken[i]) {
+            printf("  transition row %u (state %d, result %d) is never taken\n", (unsigned)i,
+                   CHARGER_TRANSITIONS[i].state, CHARGER_TRANSITIONS[i].result);
+            mismatches++;
+        }
+    }
+
+    printf("Supervisor tables: %s, %u transitions walked, %u/%u rows taken\n",
+           mismatches ? "MISMATCH" : "match", walked,
+           (unsigned)std::count(taken.begin(), taken.end(), true), (unsigned)n_rows);
+    return mismatches ? 1 : 0;
+}
+
+// Run all benchmarks
+int run_benchmarks(void) {
+    int failed = 0;
+
+    printf("RingBuffer average/minimum/maximum/variance vs. scanning the entries\n");
+    failed |= bench_ringbuffer<uint16_t, 10, false>(100000);
+    failed |= bench_ringbuffer<uint16_t, 10, true>(100000);
+    failed |= bench_ringbuffer<uint16_t, 16, true>(100000);
+    failed |= bench_ringbuffer<int16_t, 60, true>(50000);
+    failed |= bench_ringbuffer<uint16_t, 512, false>(20000);
+    failed |= bench_ringbuffer<uint16_t, 600, false>(20000);
+    failed |= bench_ringbuffer<uint16_t, 512, true>(20000);
+    failed |= bench_ringbuffer<uint16_t, 600, true>(20000);
+    failed |= bench_ringbuffer<uint16_t, 3000, true>(5000);
+
+    failed |= bench_alarm_pool();
+
+    failed |= bench_regulator();
+
+    failed |= bench_resistance();
+
+    failed |= bench_dac_calibration();
+
+    failed |= bench_battery_calibration();
+
+    failed |= bench_ina219_calibration();
+
+    failed |= bench_slope();
+
+    failed |= bench_settle();
+
+    failed |= bench_eta();
+
+    failed |= bench_telemetry();
+
+    failed |= bench_console();
+
+    failed |= bench_temperature();
+
+    failed |= bench_supervisor();
+
+    return failed;
+}
@@ -0,0 +1,24 @@
+/**
+ *  @file bench.h
+ *  @brief Host benchmarks for the charger simulator
+ * 
+ *  Copyright(c) 2025  John Glynn
+ * 
+ *  This code is licensed under the MIT License.
+ *  See the LICENSE file for the full license text.
+ * 
+ *  @details
+ *  Micro-benchmarks of firmware library routines, run on the host with
+ *  `program --bench`.  Each benchmark checks the library results against
+ *  a straightforward reference implementation while timing both.
+ */
+#ifndef _SIM_BENCH_H_
+#define _SIM_BENCH_H_
+
+/**
+ *  @brief Run all benchmarks
+ *  @returns 0=all results matched the references, 1=mismatch found
+ */
+int run_benchmarks(void);
+
+#endif
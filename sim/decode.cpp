@@ -0,0 +1,92 @@
+/**
+ *  @file decode.cpp
+ *  @brief Host decoder for the charger's binary telemetry stream
+ *
+ *  Copyright(c) 2025  John Glynn
+ *
+ *  This code is licensed under the MIT License.
+ *  See the LICENSE file for the full license text.
+ */
+#include <stdio.h>
+#include <vector>
+
+#include "decode.h"
+#include "cycle.h"
+
+// Name of the charging cycle running in a charger state
+static const char *cycle_name(uint8_t state) {
+    switch (state) {
+        case CHARGER_FAST:      return FAST_PARMS.name_str;
+        case CHARGER_TOPPING:   return TOP_PARMS.name_str;
+        case CHARGER_TRICKLE:   return TRCKL_PARMS.name_str;
+        case CHARGER_CONDITION: return COND_PARMS.name_str;
+        case CHARGER_LOAD_TEST: return LOAD_PARMS.name_str;
+        case CHARGER_STANDBY:   return STANDBY_PARMS.name_str;
+        default:                return "Unknown";
+    }
+}
+
+// Format a status record as a CSV status line
+// The columns match Charge_Cycle::status_message(), with the battery label
+void telemetry_to_csv(const telemetry_status_t &record, char *buffer, size_t size) {
+    char label[16] = "";
+    char hms_str[9], ov_str[6], bv_str[6], stage_str[10], full_str[10];
+    char set_str[7], uptime_str[10];
+
+    if (record.battery != 0) {
+        snprintf(label, sizeof(label), "Battery %u: ", record.battery);
+    }
+    ms_to_hms_str(record.elapsed_ms, hms_str);
+    milliunits_to_string(record.bus_mV, 1, ov_str, sizeof(ov_str));
+    milliunits_to_string(record.battery_mV, 1, bv_str, sizeof(bv_str));
+    eta_to_string(record.stage_left_ms, stage_str);
+    eta_to_string(record.full_left_ms, full_str);
+    milliunits_to_string(record.set_mV, 2, set_str, sizeof(set_str));
+    ms_to_hms_str(record.time_ms, uptime_str);
+
+    snprintf(buffer, size, "%s%s, %s, %s, %s, %u, %u, %s, %s, %s, %u, %s\n", label,
+             cycle_name(record.state), hms_str, ov_str, bv_str, record.current_mA, record.soc,
+             stage_str, full_str, set_str, record.dac_level, uptime_str);
+}
+
+// Decode one zero-delimited chunk of the stream
+// A chunk is either an encoded record or text, which is passed through.
+// Text never holds control characters other than line breaks, so a chunk
+// that does is a damaged record.
+static void decode_chunk(const std::vector<uint8_t> &chunk, uint32_t &records, uint32_t &dropped) {
+    telemetry_status_t record;
+    if ((chunk.size() <= TELEMETRY_FRAME_MAX) &&
+        telemetry_unpack(chunk.data(), (uint8_t)chunk.size(), &record, sizeof(record)) &&
+        (record.type == TELEMETRY_STATUS)) {
+        char line[128];
+        telemetry_to_csv(record, line, sizeof(line));
+        fputs(line, stdout);
+        records++;
+        return;
+    }
+    for (uint8_t c : chunk) {
+        if ((c < ' ') && (c != '\n') && (c != '\r') && (c != '\t')) {
+            dropped++;
+            return;
+        }
+    }
+    fwrite(chunk.data(), 1, chunk.size(), stdout);
+}
+
+// Decode a telemetry stream from standard input
+int run_decoder(void) {
+    std::vector<uint8_t> chunk;
+    uint32_t records = 0, dropped = 0;
+    int c;
+    while ((c = getchar()) != EOF) {
+        if (c == 0) {
+            decode_chunk(chunk, records, dropped);
+            chunk.clear();
+        } else {
+            chunk.push_back((uint8_t)c);
+        }
+    }
+    decode_chunk(chunk, records, dropped);
+    fprintf(stderr, "Decoded %u status records, %u dropped\n", records, dropped);
+    return dropped ? 1 : 0;
+}
@@ -0,0 +1,40 @@
+/**
+ *  @file decode.h
+ *  @brief Host decoder for the charger's binary telemetry stream
+ *
+ *  Copyright(c) 2025  John Glynn
+ *
+ *  This code is licensed under the MIT License.
+ *  See the LICENSE file for the full license text.
+ *
+ *  @details
+ *  Reads a console stream captured from a charger built with
+ *  `TELEMETRY_BINARY` (see telemetry.h) on standard input, with
+ *  `program --decode`, and writes it to standard output with each status
+ *  record turned back into the CSV status line the charger would have
+ *  printed.  The record's set voltage, DAC level and uptime follow as
+ *  extra columns.  Text messages between the records are passed through
+ *  unchanged, and records that fail their CRC are dropped and counted.
+ */
+#ifndef _SIM_DECODE_H_
+#define _SIM_DECODE_H_
+
+#include <stddef.h>
+#include "telemetry.h"
+
+/**
+ *  @brief Format a status record as a CSV status line
+ *  @param record: Status record
+ *  @param buffer: Buffer for the line, newline included
+ *  @param size: Size of the buffer (bytes)
+ *  @returns Nothing
+ */
+void telemetry_to_csv(const telemetry_status_t &record, char *buffer, size_t size);
+
+/**
+ *  @brief Decode a telemetry stream from standard input
+ *  @returns 0=stream decoded, 1=records were dropped
+ */
+int run_decoder(void);
+
+#endif
@@ -0,0 +1,250 @@
+/**
+ *  @file devices.cpp
+ *  @brief Simulated I2C devices for the charger simulator
+ * 
+ *  Copyright(c) 2025  John Glynn
+ * 
+ *  This code is licensed under the MIT License.
+ *  See the LICENSE file for the full license text.
+ */
+#include "devices.h"
+
+//== INA219 ===================================================================
+
+#define INA219_CONFIG_DEFAULT   0x399F      ///< Power-on configuration register value
+
+Sim_INA219::Sim_INA219(Charger_Plant *plant) {
+    Sim_INA219::plant = plant;
+    register_writes = 0;
+    register_reads = 0;
+    reset();
+}
+
+void Sim_INA219::set_plant(Charger_Plant *plant) {
+    Sim_INA219::plant = plant;
+}
+
+void Sim_INA219::reset(void) {
+    pointer = 0;
+    config = INA219_CONFIG_DEFAULT;
+    calibration = 0;
+}
+
+// Writes set the register pointer, optionally followed by a 16-bit value
+void Sim_INA219::i2c_write(const uint8_t *data, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    pointer = data[0] & 0x07;
+    if (len < 3) {
+        return;
+    }
+    uint16_t value = (data[1] << 8) | data[2];
+    register_writes++;
+    switch (pointer) {
+        case 0x00:
+            if (value & 0x8000) {
+                reset();
+            } else {
+                config = value;
+            }
+            break;
+        case 0x05:
+            calibration = value & 0xFFFE;
+            break;
+        default:
+            // Read-only register
+            break;
+    }
+}
+
+// Reads return the register selected by the pointer, MSB first
+size_t Sim_INA219::i2c_read(uint8_t *data, size_t len) {
+    uint16_t value = read_register(pointer);
+    register_reads++;
+    for (size_t i = 0; i < len; i++) {
+        data[i] = (i & 1) ? (value & 0xFF) : (value >> 8);
+    }
+    return len;
+}
+
+uint16_t Sim_INA219::read_register(uint8_t reg) {
+    plant->update(sim_time_us());
+
+    // Shunt voltage across 0.1 ohms, 10 uV LSB
+    double current_mA = plant->measured_current_mA();
+    int32_t shunt = (int32_t)(current_mA * 100.0 / 10.0);
+    if (shunt > 32000) {
+        shunt = 32000;
+    } else if (shunt < -32000) {
+        shunt = -32000;
+    }
+    // Bus voltage, 4 mV LSB in bits 15:3, conversion ready flag in bit 1
+    uint32_t bus = (uint32_t)(plant->bus_voltage_mV() / 4.0);
+    uint16_t current = (uint16_t)(((int32_t)shunt * calibration) / 4096);
+
+    switch (reg) {
+        case 0x00:
+            return config;
+        case 0x01:
+            return (uint16_t)(int16_t)shunt;
+        case 0x02:
+            return (uint16_t)((bus << 3) | 0x0002);
+        case 0x03:
+            return (uint16_t)(((int32_t)current * bus) / 5000);
+        case 0x04:
+            return current;
+        case 0x05:
+            return calibration;
+        default:
+            return 0;
+    }
+}
+
+//== MCP4726 ==================================================================
+
+Sim_MCP4726::Sim_MCP4726(Charger_Plant *plant) {
+    Sim_MCP4726::plant = plant;
+    level_writes = 0;
+    config_vol = 0;
+    level_vol = 0;
+    config_nvm = 0;
+    level_nvm = 0;
+}
+
+// The DAC sets the one regulator, whichever battery it feeds
+void Sim_MCP4726::set_plant(Charger_Plant *plant) {
+    Sim_MCP4726::plant = plant;
+    plant->update(sim_time_us());
+    plant->set_dac_level(level_vol);
+}
+
+void Sim_MCP4726::i2c_write(const uint8_t *data, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    plant->update(sim_time_us());
+
+    uint8_t cmd = data[0] & 0xE0;
+    if ((data[0] & 0xC0) == 0x00) {
+        // Write volatile DAC register (fast mode)
+        if (len >= 2) {
+            level_vol = ((data[0] & 0x0F) << 8) | data[1];
+            config_vol = (config_vol & ~0x06) | (data[0] & 0x30) >> 3;
+            level_writes++;
+            plant->set_dac_level(level_vol);
+        }
+    } else if (cmd == 0x40 || cmd == 0x60) {
+        // Write all volatile memory (and NVM for 0x60)
+        config_vol = data[0] & 0x1F;
+        if (len >= 3) {
+            level_vol = (data[1] << 4) | (data[2] >> 4);
+            level_writes++;
+            plant->set_dac_level(level_vol);
+        }
+        if (cmd == 0x60) {
+            config_nvm = config_vol;
+            level_nvm = level_vol;
+        }
+    } else if (cmd == 0x80) {
+        // Write volatile configuration bits
+        config_vol = data[0] & 0x1F;
+    }
+}
+
+// Reads return volatile then NVM contents
+// Bit 7 (RDY/BSY) is reported clear, which the driver's busy() treats as idle
+size_t Sim_MCP4726::i2c_read(uint8_t *data, size_t len) {
+    uint8_t mem[6] = {
+        (uint8_t)(0x40 | config_vol),
+        (uint8_t)(level_vol >> 4),
+        (uint8_t)((level_vol << 4) & 0xF0),
+        (uint8_t)(0x40 | config_nvm),
+        (uint8_t)(level_nvm >> 4),
+        (uint8_t)((level_nvm << 4) & 0xF0),
+    };
+    for (size_t i = 0; i < len; i++) {
+        data[i] = mem[i % 6];
+    }
+    return len;
+}
+
+//== SSD1306 ==================================================================
+
+Sim_SSD1306::Sim_SSD1306(void) {
+    bytes_received = 0;
+    memset(ram, 0, sizeof(ram));
+    page = 0;
+    column = 0;
+    start_line = 0;
+    pending_args = 0;
+    display_on = false;
+}
+
+// Each transaction starts with a control byte selecting commands or data
+void Sim_SSD1306::i2c_write(const uint8_t *data, size_t len) {
+    bytes_received += len;
+    if (len < 2) {
+        return;
+    }
+    bool is_data = (data[0] & 0x40);
+    for (size_t i = 1; i < len; i++) {
+        if (is_data) {
+            ram[page & 7][column & 0x7F] = data[i];
+            column = (column + 1) & 0x7F;
+        } else {
+            command(data[i]);
+        }
+    }
+}
+
+void Sim_SSD1306::command(uint8_t cmd) {
+    if (pending_args) {
+        pending_args--;
+        return;
+    }
+    if (cmd <= 0x0F) {
+        column = (column & 0xF0) | cmd;
+    } else if (cmd <= 0x1F) {
+        column = (column & 0x0F) | ((cmd & 0x0F) << 4);
+    } else if ((cmd >= 0x40) && (cmd <= 0x7F)) {
+        start_line = cmd & 0x3F;
+    } else if ((cmd >= 0xB0) && (cmd <= 0xB7)) {
+        page = cmd & 0x07;
+    } else if ((cmd == 0xAE) || (cmd == 0xAF)) {
+        display_on = (cmd == 0xAF);
+    } else {
+        // Skip the arguments of multi-byte commands
+        switch (cmd) {
+            case 0x20: case 0x81: case 0x8D: case 0xA8: case 0xAD:
+            case 0xD3: case 0xD5: case 0xD9: case 0xDA: case 0xDB:
+                pending_args = 1;
+                break;
+            case 0x21: case 0x22:
+                pending_args = 2;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+void Sim_SSD1306::print(void) {
+    if (!display_on) {
+        printf("(display off)\n");
+        return;
+    }
+    uint8_t first_page = start_line / 8;
+    for (int row = 0; row < 32; row++) {
+        uint8_t p = (first_page + row / 8) & 7;
+        for (int x = 0; x < 128; x++) {
+            putchar((ram[p][x] & (1 << (row % 8))) ? '#' : '.');
+        }
+        putchar('\n');
+    }
+}
+
+size_t Sim_SSD1306::i2c_read(uint8_t *data, size_t len) {
+    memset(data, 0, len);
+    return len;
+}
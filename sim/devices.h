@@ -0,0 +1,113 @@
+/**
+ *  @file devices.h
+ *  @brief Simulated I2C devices for the charger simulator
+ * 
+ *  Copyright(c) 2025  John Glynn
+ * 
+ *  This code is licensed under the MIT License.
+ *  See the LICENSE file for the full license text.
+ * 
+ *  @details
+ *  Register-level models of the INA219 current sensor, MCP4726 DAC and
+ *  SSD1306 OLED controller, attached to the simulated `Wire` bus so the
+ *  unmodified device drivers in `lib/` can be exercised on the host.
+ */
+#ifndef _SIM_DEVICES_H_
+#define _SIM_DEVICES_H_
+
+#include <Wire.h>
+#include "plant.h"
+
+/**
+ *  @brief INA219 current/power sensor model
+ *  @note The shunt reading is derived from the plant charging current
+ *        through a 0.1 ohm shunt; bus voltage is the regulator output.
+ */
+class Sim_INA219 : public Sim_I2C_Device {
+public:
+    Sim_INA219(Charger_Plant *plant);
+    void i2c_write(const uint8_t *data, size_t len);
+
+    /**
+     *  @brief Measure the regulator output into another battery
+     *  @param plant: Plant switched onto the regulator output
+     */
+    void set_plant(Charger_Plant *plant);
+    size_t i2c_read(uint8_t *data, size_t len);
+
+    /// @brief Register writes received (all registers)
+    uint32_t register_writes;
+    /// @brief Register reads serviced (all registers)
+    uint32_t register_reads;
+
+private:
+    Charger_Plant *plant;
+    uint8_t pointer;                        // Register pointer
+    uint16_t config;                        // Configuration register
+    uint16_t calibration;                   // Calibration register
+
+    uint16_t read_register(uint8_t reg);
+    void reset(void);
+};
+
+/**
+ *  @brief MCP4726 12-bit DAC model driving the plant regulator feedback
+ */
+class Sim_MCP4726 : public Sim_I2C_Device {
+public:
+    Sim_MCP4726(Charger_Plant *plant);
+    void i2c_write(const uint8_t *data, size_t len);
+
+    /**
+     *  @brief Drive the regulator feeding another battery
+     *  @param plant: Plant switched onto the regulator output, which is
+     *                given the current DAC level
+     */
+    void set_plant(Charger_Plant *plant);
+    size_t i2c_read(uint8_t *data, size_t len);
+
+    /// @brief Number of writes that changed the DAC output level
+    uint32_t level_writes;
+
+private:
+    Charger_Plant *plant;
+    uint8_t config_vol;                     // Volatile configuration bits
+    uint16_t level_vol;                     // Volatile DAC level
+    uint8_t config_nvm;                     // NVM configuration bits
+    uint16_t level_nvm;                     // NVM DAC level
+};
+
+/**
+ *  @brief SSD1306 OLED controller model
+ *  @note Models the 128x64 display RAM in page addressing mode, along
+ *        with the display start line used to flip between the two 32-row
+ *        frames of a double-buffered 128x32 panel.
+ */
+class Sim_SSD1306 : public Sim_I2C_Device {
+public:
+    Sim_SSD1306(void);
+    void i2c_write(const uint8_t *data, size_t len);
+    size_t i2c_read(uint8_t *data, size_t len);
+
+    /**
+     *  @brief Print the visible 128x32 frame as text
+     */
+    void print(void);
+
+    /// @brief Bytes received, including control bytes
+    uint32_t bytes_received;
+
+    /// @brief Display switched on (0xAF) rather than off (0xAE)
+    bool display_on;
+
+private:
+    uint8_t ram[8][128];                    // Display RAM (pages x columns)
+    uint8_t page;                           // Page address
+    uint8_t column;                         // Column address
+    uint8_t start_line;                     // Display start line
+    uint8_t pending_args;                   // Argument bytes still to skip
+
+    void command(uint8_t cmd);
+};
+
+#endif
@@ -0,0 +1,81 @@
+/**
+ *  @file i2c_port.cpp
+ *  @brief Simulated background I2C transport for the charger simulator
+ * 
+ *  Copyright(c) 2025  John Glynn
+ * 
+ *  This code is licensed under the MIT License.
+ *  See the LICENSE file for the full license text.
+ */
+#include "i2c_port.h"
+
+Sim_I2C_Port::Sim_I2C_Port(uint32_t latency_us, uint32_t jitter_us, uint32_t seed) {
+    latency = latency_us;
+    jitter = jitter_us;
+    rng = (seed) ? seed : 1;
+    deadline_us = 0;
+    active = false;
+    transfers = 0;
+}
+
+// xorshift32 generator for the latency jitter
+uint32_t Sim_I2C_Port::next_random(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+// Schedule completion after the bus time plus the injected latency
+bool Sim_I2C_Port::start(i2c_txn_t *txn) {
+    uint32_t bus_us = 0;
+
+    if (txn->out_len) {
+        bus_us += Wire.transfer_us(txn->out_len);
+    }
+    if (txn->in_len) {
+        bus_us += Wire.transfer_us(txn->in_len);
+    }
+    deadline_us = sim_time_us() + latency + bus_us;
+    if (jitter) {
+        deadline_us += next_random() % (jitter + 1);
+    }
+    active = true;
+    return true;
+}
+
+// The CPU is blocked until the transfer completes
+void Sim_I2C_Port::wait(i2c_txn_t *txn) {
+    (void)txn;
+    uint64_t now = sim_time_us();
+    if (now < deadline_us) {
+        sim_advance_us(deadline_us - now);
+    }
+}
+
+// Exchange the bytes with the device once the transfer time has passed
+uint8_t Sim_I2C_Port::poll(i2c_txn_t *txn) {
+    if (sim_time_us() < deadline_us) {
+        return I2C_PORT_BUSY;
+    }
+
+    bool ok = true;
+    Wire.set_timed(false);
+    if (txn->out_len) {
+        Wire.beginTransmission(txn->address);
+        Wire.write(txn->out, txn->out_len);
+        ok = (Wire.endTransmission(txn->in_len == 0) == 0);
+    }
+    if (ok && txn->in_len) {
+        uint8_t n = Wire.requestFrom(txn->address, (size_t)txn->in_len, true);
+        for (uint8_t i = 0; i < n; i++) {
+            txn->in[i] = Wire.read();
+        }
+        ok = (n == txn->in_len);
+    }
+    Wire.set_timed(true);
+
+    active = false;
+    transfers++;
+    return (ok) ? I2C_PORT_DONE : I2C_PORT_ERROR;
+}
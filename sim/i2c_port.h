@@ -0,0 +1,64 @@
+/**
+ *  @file i2c_port.h
+ *  @brief Simulated background I2C transport for the charger simulator
+ * 
+ *  Copyright(c) 2025  John Glynn
+ * 
+ *  This code is licensed under the MIT License.
+ *  See the LICENSE file for the full license text.
+ * 
+ *  @details
+ *  Stands in for the interrupt-driven HAL transport used on the target, so
+ *  the `I2C` transaction queue can be exercised on the host.  A started
+ *  transaction completes once its bus time plus an injected latency has
+ *  passed on the simulation clock; only then are the bytes exchanged with
+ *  the device models on the simulated `Wire` bus.
+ */
+#ifndef _SIM_I2C_PORT_H_
+#define _SIM_I2C_PORT_H_
+
+#include <Wire.h>
+#include <i2c_busio.h>
+
+/**
+ *  @brief I2C transport with simulated transfer time and latency
+ */
+class Sim_I2C_Port : public I2C_Port {
+public:
+    /**
+     *  @brief Create the port
+     *  @param latency_us: Fixed delay added to every transfer (us)
+     *  @param jitter_us: Maximum random delay added on top (us)
+     *  @param seed: Jitter generator seed
+     */
+    Sim_I2C_Port(uint32_t latency_us, uint32_t jitter_us = 0, uint32_t seed = 1);
+
+    bool start(i2c_txn_t *txn) override;
+    uint8_t poll(i2c_txn_t *txn) override;
+    void wait(i2c_txn_t *txn) override;
+
+    /**
+     *  @brief Check for a transfer in progress
+     *  @returns true=transfer started and not yet collected by `poll()`
+     */
+    bool busy(void) { return active; }
+
+    /**
+     *  @brief Time the transfer in progress completes on the bus (us)
+     */
+    uint64_t deadline(void) { return deadline_us; }
+
+    /// @brief Transfers completed
+    uint32_t transfers;
+
+private:
+    uint32_t latency;
+    uint32_t jitter;
+    uint32_t rng;
+    uint64_t deadline_us;
+    bool active;
+
+    uint32_t next_random(void);
+};
+
+#endif
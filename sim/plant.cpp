@@ -0,0 +1,203 @@
+/**
+ *  @file plant.cpp
+ *  @brief Lead-acid battery and XL6008 regulator plant model for the simulator
+ * 
+ *  Copyright(c) 2025  John Glynn
+ * 
+ *  This code is licensed under the MIT License.
+ *  See the LICENSE file for the full license text.
+ */
+#include "plant.h"
+#include <math.h>
+
+/// Longest integration step (s)
+static const double MAX_STEP_S = 0.1;
+
+// Default plant parameters
+// Tuned so a 5.5 Ah battery reaches 14.4V at ~600 mA around 85% SoC and
+// tapers below 5% of capacity at 14.0V in the low 90s, which is roughly
+// what the real battery does on the bench.
+const plant_parm_t PLANT_DEFAULTS = {
+    .capacity_mAh = 5500,
+    .soc = 0.50,
+    .ocv_empty_V = 11.80,
+    .ocv_full_V = 12.80,
+    .r_ohmic = 0.04,
+    .r_pol_base = 1.4,
+    .r_pol_full = 9.0,
+    .tau_pol_s = 60.0,
+    .self_discharge_per_day = 0.001,
+    .leak_mA = 0.0,
+    .temp_C = 25.0,
+    .sulfation = 0.0,
+    .desulfate_V = 14.5,
+    .desulfate_mAh = 120.0,
+    .supply_V = 5.0,
+    .vreg_min_V = 5.0,
+    .vreg_max_V = 16.0,
+    .vreg_bow_V = 0.20,
+    .vreg_current_limit_A = 1.5,
+    .diode_V = 0.30,
+    .r_path = 0.15,
+    .current_noise_mA = 8.0,
+    .adc_noise_mV = 8.0,
+    .adc_gain = 1.0,
+    .adc_offset_mV = 0.0,
+    .divider_diode_V = 0.12,
+    .connected = true,
+    .seed = 1,
+};
+
+// Constructor with initialization
+Charger_Plant::Charger_Plant(const plant_parm_t &p) {
+    parms = p;
+    time_us = 0;
+    enabled = false;
+    dac = 4095;
+    state_of_charge = p.soc;
+    v_pol = 0.0;
+    current_A = 0.0;
+    delivered = 0.0;
+    sulfate = p.sulfation;
+    rng = p.seed ? p.seed : 1;
+}
+
+void Charger_Plant::set_enabled(bool enabled) {
+    Charger_Plant::enabled = enabled;
+    solve_current();
+}
+
+void Charger_Plant::set_temperature(double temp_C) {
+    parms.temp_C = temp_C;
+}
+
+void Charger_Plant::set_dac_level(uint16_t level) {
+    dac = (level > 4095) ? 4095 : level;
+    solve_current();
+}
+
+// Regulator output voltage for the current DAC level
+// Output falls as the DAC level rises, with a bow above the straight line
+double Charger_Plant::vreg_output_V(void) {
+    if (!enabled) {
+        // Boost converter idle, supply passes through the inductor and diode
+        return parms.supply_V - parms.diode_V;
+    }
+    double x = dac / 4095.0;
+    double v = parms.vreg_max_V - x * (parms.vreg_max_V - parms.vreg_min_V);
+    v += parms.vreg_bow_V * 4.0 * x * (1.0 - x);
+    return (v < parms.supply_V) ? parms.supply_V : v;
+}
+
+// Open-circuit voltage for the current state of charge
+double Charger_Plant::ocv_V(void) {
+    return parms.ocv_empty_V + state_of_charge * (parms.ocv_full_V - parms.ocv_empty_V);
+}
+
+// Ohmic resistance, rising with sulfation
+double Charger_Plant::r_ohmic(void) {
+    return parms.r_ohmic * (1.0 + 4.0 * sulfate);
+}
+
+// Polarization resistance, rising steeply as the battery approaches full
+// charge, as the battery gets colder, and with sulfation
+double Charger_Plant::r_pol(void) {
+    return (parms.r_pol_base + parms.r_pol_full * exp((state_of_charge - 1.0) / 0.08)) *
+           (1.0 + 0.01 * (25.0 - parms.temp_C)) * (1.0 + 2.0 * sulfate);
+}
+
+// Solve the regulator/diode/battery loop for the charging current
+void Charger_Plant::solve_current(void) {
+    double headroom = vreg_output_V() - parms.diode_V - ocv_V() - v_pol;
+    double i = headroom / (r_ohmic() + parms.r_path);
+    if ((i < 0.0) || !parms.connected) {
+        i = 0.0;
+    } else if (i > parms.vreg_current_limit_A) {
+        i = parms.vreg_current_limit_A;
+    }
+    current_A = enabled ? i : 0.0;
+}
+
+// Integrate the model forward to now_us
+void Charger_Plant::update(uint64_t now_us) {
+    while (time_us < now_us) {
+        uint64_t step_us = now_us - time_us;
+        if (step_us > (uint64_t)(MAX_STEP_S * 1e6)) {
+            step_us = (uint64_t)(MAX_STEP_S * 1e6);
+        }
+        double dt = step_us / 1e6;
+
+        solve_current();
+
+        // Charge acceptance falls off as the battery fills, and with
+        // sulfation, the rest gasses
+        double efficiency = (1.0 - pow(state_of_charge, 12)) * (1.0 - 0.5 * sulfate);
+        double dq = current_A * 1000.0 * dt / 3600.0;   // mAh
+        delivered += dq;
+        state_of_charge += dq * efficiency / parms.capacity_mAh;
+        state_of_charge -= parms.self_discharge_per_day * dt / 86400.0;
+        state_of_charge -= parms.leak_mA * dt / 3600.0 / parms.capacity_mAh;
+        if (battery_voltage_mV() > parms.desulfate_V * 1000.0) {
+            sulfate *= exp(-dq / parms.desulfate_mAh);
+        }
+        if (state_of_charge > 1.0) {
+            state_of_charge = 1.0;
+        } else if (state_of_charge < 0.0) {
+            state_of_charge = 0.0;
+        }
+
+        // Polarization relaxes toward I*Rp
+        double target = current_A * r_pol();
+        v_pol = target + (v_pol - target) * exp(-dt / parms.tau_pol_s);
+
+        time_us += step_us;
+    }
+    solve_current();
+}
+
+double Charger_Plant::bus_voltage_mV(void) {
+    return vreg_output_V() * 1000.0;
+}
+
+double Charger_Plant::battery_voltage_mV(void) {
+    if (!parms.connected) {
+        return enabled ? (vreg_output_V() - parms.divider_diode_V) * 1000.0 : 0.0;
+    }
+    return (ocv_V() + v_pol + current_A * r_ohmic()) * 1000.0;
+}
+
+double Charger_Plant::charging_current_mA(void) {
+    return current_A * 1000.0;
+}
+
+double Charger_Plant::measured_current_mA(void) {
+    return current_A * 1000.0 + noise() * parms.current_noise_mA;
+}
+
+// Battery voltage through the 39K/10K divider into the 12-bit, 3.3V A/D,
+// with the divider and A/D errors
+// Oversampling averages the noise down by the square root of the
+// number of conversions, i.e. by 2^(bits-12)
+int Charger_Plant::battery_adc_count(int bits) {
+    double oversampling = (bits > 12) ? (double)(1 << (bits - 12)) : 1.0;
+    double mv = battery_voltage_mV() * parms.adc_gain + parms.adc_offset_mV +
+                noise() * parms.adc_noise_mV / oversampling;
+    double full_scale = (double)(1 << bits);
+    double count = mv * (10.0 / 49.0) / 3300.0 * full_scale;
+    if (count < 0.0) {
+        return 0;
+    }
+    return (count > full_scale - 1.0) ? (int)full_scale - 1 : (int)(count + 0.5);
+}
+
+// Gaussian noise sample (unit variance) from an xorshift32 generator
+double Charger_Plant::noise(void) {
+    double u[2];
+    for (int i = 0; i < 2; i++) {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        u[i] = (rng + 1.0) / 4294967297.0;
+    }
+    return sqrt(-2.0 * log(u[0])) * cos(2.0 * M_PI * u[1]);
+}
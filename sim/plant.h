@@ -0,0 +1,176 @@
+/**
+ *  @file plant.h
+ *  @brief Lead-acid battery and XL6008 regulator plant model for the simulator
+ * 
+ *  Copyright(c) 2025  John Glynn
+ * 
+ *  This code is licensed under the MIT License.
+ *  See the LICENSE file for the full license text.
+ * 
+ *  @details
+ *  Models the power path of the On-board Battery Charger Rev 1 hardware:
+ *  @li XL6008 boost regulator whose output is set by the MCP4726 DAC level
+ *      (inverse relationship, with a configurable bow to represent the
+ *      non-linearity of the feedback network).
+ *  @li Schottky diode and wiring between the regulator output (measured by
+ *      the INA219 bus voltage) and the battery terminal (measured by the
+ *      A/D converter through the 39K/10K divider).
+ *  @li 6-cell sealed lead-acid battery with an open-circuit voltage curve,
+ *      ohmic resistance, a first-order polarization (surface charge) term
+ *      that stiffens as the battery approaches full charge, and a charge
+ *      acceptance that falls off near full charge.  The polarization
+ *      resistance rises by 1% for every degree the battery is below 25C
+ *      (and falls above), so the voltage at a given state of charge and
+ *      current moves by about -3 mV/C per cell near full charge.
+ *  @li Sulfation (0.0-1.0), which raises the ohmic resistance by up to
+ *      five times and the polarization by up to three times, and takes up
+ *      to half the charge acceptance.  Charge delivered while the battery
+ *      is above `desulfate_V` breaks it down, by 1/e for every
+ *      `desulfate_mAh`.
+ *  @li No battery (`connected` false), leaving the divider as the only
+ *      load, so the A/D reads the regulator output less the diode's drop
+ *      at the divider's current while the regulator is on, and nothing
+ *      while it's off.
+ *  @li Divider and A/D gain and offset errors, as calibrated out by the
+ *      firmware.
+ * 
+ *  The model is integrated lazily: readers call `update()` with the current
+ *  simulation time before sampling it, so it advances at whatever rate the
+ *  firmware happens to look at it.
+ */
+#ifndef _SIM_PLANT_H_
+#define _SIM_PLANT_H_
+
+#include <stdint.h>
+
+/**
+ *  @brief Plant model parameters
+ */
+struct plant_parm_t {
+    double capacity_mAh;                    ///< Battery capacity (mAh)
+    double soc;                             ///< Initial state of charge (0.0-1.0)
+    double ocv_empty_V;                     ///< Open-circuit voltage at 0% SoC (V)
+    double ocv_full_V;                      ///< Open-circuit voltage at 100% SoC (V)
+    double r_ohmic;                         ///< Battery ohmic resistance (ohms)
+    double r_pol_base;                      ///< Polarization resistance, bulk (ohms)
+    double r_pol_full;                      ///< Polarization resistance rise at full charge (ohms)
+    double tau_pol_s;                       ///< Polarization time constant (s)
+    double self_discharge_per_day;          ///< Self-discharge (fraction of capacity per day)
+    double leak_mA;                         ///< Internal leakage current, e.g. a soft-shorted cell (mA)
+    double temp_C;                          ///< Battery temperature (C)
+    double sulfation;                       ///< Initial sulfation (0.0-1.0)
+    double desulfate_V;                     ///< Battery voltage above which sulfation breaks down (V)
+    double desulfate_mAh;                   ///< Charge above desulfate_V that breaks down 1/e of it (mAh)
+    double supply_V;                        ///< Regulator input supply voltage (V)
+    double vreg_min_V;                      ///< Regulator output at DAC full-scale (V)
+    double vreg_max_V;                      ///< Regulator output at DAC zero (V)
+    double vreg_bow_V;                      ///< Mid-scale deviation from linear DAC response (V)
+    double vreg_current_limit_A;            ///< Regulator output current limit (A)
+    double diode_V;                         ///< Schottky diode forward drop (V)
+    double r_path;                          ///< Diode dynamic + wiring resistance (ohms)
+    double current_noise_mA;                ///< INA219 current reading noise, 1 sigma (mA)
+    double adc_noise_mV;                    ///< Battery A/D reading noise, 1 sigma (mV)
+    double adc_gain;                        ///< Battery divider and A/D gain error (1.0=none)
+    double adc_offset_mV;                   ///< Battery A/D offset error (mV)
+    double divider_diode_V;                 ///< Schottky diode drop at the divider's current (V)
+    bool connected;                         ///< Battery connected?
+    uint32_t seed;                          ///< Noise generator seed
+};
+
+/**
+ *  @brief Default plant parameters (5.5 Ah SLA battery at 50% charge)
+ */
+extern const plant_parm_t PLANT_DEFAULTS;
+
+/**
+ *  @brief Battery/regulator plant model
+ */
+class Charger_Plant {
+public:
+    /**
+     *  @brief Constructor with initialization
+     *  @param p: Plant parameters
+     */
+    Charger_Plant(const plant_parm_t &p);
+
+    /**
+     *  @brief Integrate the model up to the given simulation time
+     *  @param now_us: Simulation time (us)
+     */
+    void update(uint64_t now_us);
+
+    /**
+     *  @brief Set the regulator enable input
+     */
+    void set_enabled(bool enabled);
+
+    /**
+     *  @brief Set the battery temperature
+     *  @param temp_C: Temperature (C)
+     */
+    void set_temperature(double temp_C);
+
+    /**
+     *  @brief Set the DAC output level driving the regulator feedback
+     *  @param level: 12-bit DAC level (0-4095)
+     */
+    void set_dac_level(uint16_t level);
+
+    /// @brief Current DAC level
+    uint16_t dac_level(void) { return dac; }
+
+    /// @brief Regulator output (INA219 bus) voltage (mV)
+    double bus_voltage_mV(void);
+
+    /// @brief Battery terminal voltage (mV)
+    double battery_voltage_mV(void);
+
+    /// @brief True charging current (mA)
+    double charging_current_mA(void);
+
+    /// @brief Noisy charging current as seen by the INA219 (mA)
+    double measured_current_mA(void);
+
+    /**
+     *  @brief Battery voltage A/D count, with noise
+     *  @param bits: Resolution, where more than 12 bits models the hardware
+     *               oversampler averaging 4^(bits-12) 12-bit conversions
+     */
+    int battery_adc_count(int bits = 12);
+
+    /// @brief State of charge (0.0-1.0)
+    double soc(void) { return state_of_charge; }
+
+    /// @brief Battery ohmic resistance, including sulfation (ohms)
+    double resistance_ohms(void) { return r_ohmic(); }
+
+    /// @brief Battery capacity (mAh)
+    double capacity_mAh(void) { return parms.capacity_mAh; }
+
+    /// @brief Sulfation (0.0-1.0)
+    double sulfation(void) { return sulfate; }
+
+    /// @brief Total charge delivered to the battery terminals (mAh)
+    double delivered_mAh(void) { return delivered; }
+
+private:
+    plant_parm_t parms;
+    uint64_t time_us;                       // Time the model was last integrated to
+    bool enabled;                           // Regulator enabled?
+    uint16_t dac;                           // DAC level
+    double state_of_charge;                 // 0.0-1.0
+    double v_pol;                           // Polarization voltage (V)
+    double current_A;                       // Charging current at time_us (A)
+    double delivered;                       // Charge delivered (mAh)
+    double sulfate;                         // Sulfation (0.0-1.0)
+    uint32_t rng;                           // Noise generator state
+
+    double vreg_output_V(void);
+    double ocv_V(void);
+    double r_ohmic(void);
+    double r_pol(void);
+    void solve_current(void);
+    double noise(void);
+};
+
+#endif
@@ -0,0 +1,747 @@
+/**
+ *  @file sim_main.cpp
+ *  @brief Host-native charger simulator entry point
+ * 
+ *  Copyright(c) 2025  John Glynn
+ * 
+ *  This code is licensed under the MIT License.
+ *  See the LICENSE file for the full license text.
+ * 
+ *  @details
+ *  Runs the unmodified firmware `setup()` and `loop()` functions against
+ *  the battery/regulator plant model, faster than real time, and reports
+ *  how long each charging stage took and how quickly the control loop
+ *  settled into regulation.
+ * 
+ *  Usage: `program [options]`
+ *  @li `--soc <0-1>`       Initial battery state of charge (default 0.50)
+ *  @li `--batteries <n>`   Batteries connected, 0 to `BATTERY_CHANNELS` (default 1)
+ *  @li `--soc2 <0-1>`      Initial state of charge of battery 2 (default 0.90)
+ *  @li `--sequential`      Charge each battery through trickle before the next
+ *  @li `--load-test`       Load test each battery before charging it
+ *  @li `--capacity <mAh>`  Battery capacity (default 5500)
+ *  @li `--leak <mA>`      Battery internal leakage current (default 0)
+ *  @li `--r-int <mOhm>`    Battery internal (ohmic) resistance (default 40)
+ *  @li `--sulfation <0-1>` Battery sulfation (default 0)
+ *  @li `--temp <C>`        Battery and charger temperature (default 25)
+ *  @li `--temp-trace <file>` Temperature over time, from a trace file
+ *  @li `--hours <h>`       Maximum simulated time (default 48)
+ *  @li `--step <ms>`       Simulation step between loop() calls (default 10)
+ *  @li `--bow <V>`         Regulator DAC response non-linearity (default 0.20)
+ *  @li `--adc-gain <x>`    Battery divider and A/D gain error (default 1.0)
+ *  @li `--adc-offset <mV>` Battery A/D offset error (default 0)
+ *  @li `--seed <n>`        Measurement noise seed (default 1)
+ *  @li `--no-oled`         Run without the optional OLED display
+ *  @li `--i2c-latency <us>` Latency added to background I2C transfers (default 20)
+ *  @li `--i2c-jitter <us>` Random latency added on top (default 0)
+ *  @li `--i2c-blocking`    Carry out queued I2C transfers in the foreground
+ *  @li `--continue`        Keep running through standby until `--hours`
+ *  @li `--show-oled`       Print the OLED display contents at the end
+ *  @li `--quiet`           Suppress the firmware's serial console output
+ *  @li `--bench`           Run the library benchmarks instead of a simulation
+ *  @li `--decode`          Decode a binary telemetry stream from standard input
+ */
+#include <Arduino.h>
+#include <Wire.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+#include "plant.h"
+#include "devices.h"
+#include "i2c_port.h"
+#include "bench.h"
+#include "decode.h"
+#include "temp_trace.h"
+
+#include "obcharger.h"
+#include "channel.h"
+#include "status_screen.h"
+#include "power.h"
+#include "tasks.h"
+#include "utility.h"
+#include "console.h"
+
+// Firmware entry points and state from main.cpp
+extern void setup(void);
+extern void loop(void);
+extern Charge_Channel channels[BATTERY_CHANNELS];
+extern Channel_Scheduler scheduler;
+extern I2C main_i2c_bus;
+extern Status_Screen status_screen;
+extern Low_Power low_power;
+extern Task_Scheduler tasks;
+extern Console_TX console;
+
+/// Interval between plant samples used for the stage statistics (ms)
+static const uint32_t SAMPLE_PERIOD_MS = 100;
+
+/// Time a stage must stay in regulation to count as settled (ms)
+static const uint32_t SETTLE_HOLD_MS = 10 * SECOND_MS;
+
+/// Regulation band around the limiting current (percent)
+static const uint32_t SETTLE_BAND_PCT = 5;
+
+/// Maximum number of stages recorded
+static const int MAX_STAGES = 32;
+
+/// Interval between the firmware's time left predictions recorded (ms)
+static const uint32_t PREDICT_PERIOD_MS = MINUTE_MS;
+
+/**
+ *  @brief Time left predicted by the firmware
+ */
+struct prediction_t {
+    uint32_t time_ms;                       ///< Time the prediction was made
+    time_ms_t stage_ms;                     ///< Time left in the stage (`ETA_UNKNOWN`=none)
+    time_ms_t full_ms;                      ///< Time until full (`ETA_UNKNOWN`=none)
+};
+
+/**
+ *  @brief Statistics collected for each charger stage
+ */
+struct stage_t {
+    int battery;                            ///< Battery channel for the stage
+    charger_state_t state;                  ///< Charger state for the stage
+    uint32_t start_ms;                      ///< Stage start time
+    uint32_t end_ms;                        ///< Stage end time
+    int64_t settle_ms;                      ///< Time to settle into regulation (-1=never)
+    int64_t in_band_ms;                     ///< Time regulation band was entered (-1=outside)
+    double peak_mA;                         ///< Peak charging current
+    double mAh_start;                       ///< Delivered charge at stage start
+    double mAh_end;                         ///< Delivered charge at stage end
+    double soc_end;                         ///< State of charge at stage end
+    int est_end;                            ///< Firmware state of charge estimate at stage end
+    voltage_mv_t target_end;                ///< Firmware voltage target at stage end (0=none)
+    uint32_t dac_writes;                    ///< DAC level writes during the stage
+    uint32_t i2c_bytes;                     ///< I2C bytes moved during the stage
+    uint32_t max_loop_us;                   ///< Longest time spent in one loop() call
+    std::vector<prediction_t> predictions;  ///< Time left predictions, every `PREDICT_PERIOD_MS`
+};
+
+static stage_t stages[MAX_STAGES];
+static int n_stages = 0;
+
+/// Stage open for each battery channel (-1=none)
+static int open_stage[BATTERY_CHANNELS];
+
+/// Battery plant for each channel, the first n_plants with a battery connected
+static Charger_Plant *plants[BATTERY_CHANNELS];
+static int n_plants = 1;
+
+/// Battery and charger temperature
+static Temp_Trace temp_trace;
+
+/// Regulator current sensor and DAC, following the battery switched in
+static Sim_INA219 *ina219;
+static Sim_MCP4726 *mcp4726;
+
+/// Longest Stop mode sleep (ms)
+static time_ms_t max_sleep_ms = 0;
+
+/// Sleeps entered with the regulator on or I2C transfers pending
+static uint32_t bad_sleeps = 0;
+
+// Battery A/D channels are served by the plants (a channel without a
+// battery by a plant with nothing connected) and the temperature sensor
+// by the temperature trace, everything else reads zero
+static int analog_hook(uint32_t pin) {
+    if (pin == ATEMP) {
+        return Temp_Trace::sensor_adc_count(temp_trace.at(sim_time_us()), sim_analog_resolution());
+    }
+    for (int i = 0; i < BATTERY_CHANNELS; i++) {
+        if (pin == GP_AN_BATTERY[i]) {
+            plants[i]->update(sim_time_us());
+            return plants[i]->battery_adc_count(sim_analog_resolution());
+        }
+    }
+    return 0;
+}
+
+// Battery switched onto the regulator output (-1=none)
+// Single channel builds have no battery switch
+static int selected_plant(void) {
+    if (BATTERY_CHANNELS == 1) {
+        return 0;
+    }
+    for (int i = 0; i < BATTERY_CHANNELS; i++) {
+        if (sim_pin_state(GP_BATTERY_SELECT[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Regulator enable and battery switch pins drive the plants
+static void digital_hook(uint32_t pin, uint32_t value) {
+    (void)value;
+    int selected = selected_plant();
+    bool enabled = sim_pin_state(GP_VREG_ENABLE);
+    for (int i = 0; i < BATTERY_CHANNELS; i++) {
+        plants[i]->update(sim_time_us());
+        plants[i]->set_enabled(enabled && (i == selected));
+    }
+    if ((selected >= 0) && (pin != GP_VREG_ENABLE)) {
+        ina219->set_plant(plants[selected]);
+        mcp4726->set_plant(plants[selected]);
+    }
+}
+
+// Stop mode stand-in, checking the firmware has quiesced before sleeping
+static time_ms_t sleep_hook(time_ms_t period_ms) {
+    if (sim_pin_state(GP_VREG_ENABLE) || main_i2c_bus.pending()) {
+        bad_sleeps++;
+    }
+    max_sleep_ms = std::max(max_sleep_ms, period_ms);
+    sim_advance_us((uint64_t)period_ms * 1000);
+    return period_ms;
+}
+
+// Charging parameters for an active charger state
+static const charge_parm_t *stage_parms(charger_state_t state) {
+    switch (state) {
+        case CHARGER_FAST:      return &FAST_PARMS;
+        case CHARGER_TOPPING:   return &TOP_PARMS;
+        case CHARGER_TRICKLE:   return &TRCKL_PARMS;
+        case CHARGER_CONDITION: return &COND_PARMS;
+        case CHARGER_LOAD_TEST: return &LOAD_PARMS;
+        default:                return nullptr;
+    }
+}
+
+static const char *state_name(charger_state_t state) {
+    switch (state) {
+        case CHARGER_STARTUP:   return "Startup";
+        case CHARGER_MENU:      return "Menu";
+        case CHARGER_FAST:      return "Fast";
+        case CHARGER_TOPPING:   return "Topping";
+        case CHARGER_TRICKLE:   return "Trickle";
+        case CHARGER_STANDBY:   return "Standby";
+        case CHARGER_SHUTDOWN:  return "Shutdown";
+        case CHARGER_LOAD_TEST: return "Load test";
+        case CHARGER_CONDITION: return "Condition";
+        default:                return "Unknown";
+    }
+}
+
+// Close a battery's current stage
+static void end_stage(int battery) {
+    if (open_stage[battery] >= 0) {
+        stage_t &s = stages[open_stage[battery]];
+        Charger_Plant *plant = plants[battery];
+        s.end_ms = millis();
+        s.mAh_end = plant->delivered_mAh();
+        s.soc_end = plant->soc();
+        s.dac_writes = mcp4726->level_writes - s.dac_writes;
+        s.i2c_bytes = Wire.stats().bytes - s.i2c_bytes;
+        open_stage[battery] = -1;
+    }
+}
+
+// Close a battery's current stage and open a new one
+static void begin_stage(int battery, charger_state_t state) {
+    end_stage(battery);
+    if (n_stages < MAX_STAGES) {
+        Charger_Plant *plant = plants[battery];
+        open_stage[battery] = n_stages;
+        stage_t &s = stages[n_stages++];
+        s.battery = battery;
+        s.state = state;
+        s.start_ms = millis();
+        s.end_ms = 0;
+        s.settle_ms = -1;
+        s.in_band_ms = -1;
+        s.peak_mA = 0;
+        s.mAh_start = plant->delivered_mAh();
+        s.mAh_end = s.mAh_start;
+        s.soc_end = plant->soc();
+        s.est_end = channels[battery].soc.get_soc();
+        s.target_end = 0;
+        s.max_loop_us = 0;
+        s.predictions.clear();
+        // Hold the starting counter values until the stage closes
+        s.dac_writes = mcp4726->level_writes;
+        s.i2c_bytes = Wire.stats().bytes;
+    }
+}
+
+// Track regulation of the stage of the battery on the regulator
+// In regulation means the charging current is within the band around the
+// limiting current, or the battery is within hysteresis of the target voltage.
+static void sample_stage(int battery) {
+    if ((battery < 0) || (open_stage[battery] < 0)) {
+        return;
+    }
+    stage_t &s = stages[open_stage[battery]];
+    Charger_Plant *plant = plants[battery];
+    const charge_parm_t *p = stage_parms(s.state);
+
+    // Estimate before any anchoring at the end of the stage
+    s.est_end = channels[battery].soc.get_soc();
+    if (p == nullptr) {
+        return;
+    }
+
+    // The stage ended in this loop, but hasn't been closed yet
+    if (channels[battery].state != s.state) {
+        return;
+    }
+    s.target_end = channels[battery].cycle()->get_target_voltage();
+
+    uint32_t now = millis();
+    if (s.predictions.empty() || (now - s.predictions.back().time_ms >= PREDICT_PERIOD_MS)) {
+        Charge_Cycle *cycle = channels[battery].cycle();
+        s.predictions.push_back({ now, cycle->stage_time_remaining(), cycle->full_time_remaining() });
+    }
+    double current = plant->charging_current_mA();
+    double voltage = plant->battery_voltage_mV();
+    double limit = (s.state == CHARGER_FAST) ? std::min(p->current_target, p->current_max)
+                                             : p->current_max;
+    if (current > s.peak_mA) {
+        s.peak_mA = current;
+    }
+
+    bool in_band = (fabs(current - limit) <= limit * SETTLE_BAND_PCT / 100.0) ||
+                   (fabs(voltage - (double)s.target_end) <= VOLTS_HYSTERESIS);
+    if (in_band) {
+        if (s.in_band_ms < 0) {
+            s.in_band_ms = now;
+        }
+        if ((s.settle_ms < 0) && (now - s.in_band_ms >= SETTLE_HOLD_MS)) {
+            s.settle_ms = s.in_band_ms - s.start_ms;
+        }
+    } else {
+        s.in_band_ms = -1;
+    }
+}
+
+// Next stage of the same battery (-1=none)
+static int next_stage(int i) {
+    for (int j = i + 1; j < n_stages; j++) {
+        if (stages[j].battery == stages[i].battery) {
+            return j;
+        }
+    }
+    return -1;
+}
+
+// Error of the prediction made closest to a point through a stage (min),
+// written as "+m.m", or "-" if there's no prediction or actual end
+static void prediction_error(const stage_t &s, double through, bool full, int64_t actual_ms,
+                             char *buffer, size_t size) {
+    uint32_t at_ms = s.start_ms + (uint32_t)((s.end_ms - s.start_ms) * through);
+    const prediction_t *closest = nullptr;
+    for (const prediction_t &p : s.predictions) {
+        if (!closest || (labs((long)p.time_ms - (long)at_ms) < labs((long)closest->time_ms - (long)at_ms))) {
+            closest = &p;
+        }
+    }
+    time_ms_t left_ms = closest ? (full ? closest->full_ms : closest->stage_ms) : ETA_UNKNOWN;
+    if ((actual_ms < 0) || (left_ms == ETA_UNKNOWN)) {
+        snprintf(buffer, size, "-");
+    } else {
+        snprintf(buffer, size, "%+.1f", ((double)closest->time_ms + left_ms - actual_ms) / MINUTE_MS + 0.0);
+    }
+}
+
+// Errors of the firmware's predictions of the time left in fast and topping
+// charging, and until the battery is full (the end of topping charging),
+// a quarter, half and three quarters of the way through each stage
+static void print_predictions(void) {
+    const double points[] = { 0.25, 0.5, 0.75 };
+    char error_str[3][12], full_str[3][12];
+
+    printf("\nTime left predictions, error (min) at 25%%, 50%% and 75%% through the stage\n");
+    if (n_plants > 1) {
+        printf("Bat ");
+    }
+    printf("%-9s %-9s %8s %7s %7s %8s %7s %7s\n", "Stage", "Duration", "End 25%", "50%", "75%",
+           "Full 25%", "50%", "75%");
+    for (int i = 0; i < n_stages; i++) {
+        stage_t &s = stages[i];
+        if ((s.state != CHARGER_FAST) && (s.state != CHARGER_TOPPING)) {
+            continue;
+        }
+
+        // Stages end when the next one starts.  Full is the end of topping
+        // charging, if it went on to trickle or conditioning.
+        int top = (s.state == CHARGER_TOPPING) ? i : next_stage(i);
+        if ((top >= 0) && (stages[top].state != CHARGER_TOPPING)) {
+            top = -1;
+        }
+        int after = (top >= 0) ? next_stage(top) : -1;
+        bool topped = (after >= 0) && ((stages[after].state == CHARGER_TRICKLE) ||
+                                       (stages[after].state == CHARGER_CONDITION));
+        int64_t full_ms = topped ? (int64_t)stages[top].end_ms : -1;
+
+        for (int p = 0; p < 3; p++) {
+            prediction_error(s, points[p], false, s.end_ms, error_str[p], sizeof(error_str[p]));
+            prediction_error(s, points[p], true, full_ms, full_str[p], sizeof(full_str[p]));
+        }
+        char dur_str[12];
+        ms_to_hms_str(s.end_ms - s.start_ms, dur_str);
+        if (n_plants > 1) {
+            printf("%3d ", s.battery + 1);
+        }
+        printf("%-9s %-9s %8s %7s %7s %8s %7s %7s\n", state_name(s.state), dur_str, error_str[0],
+               error_str[1], error_str[2], full_str[0], full_str[1], full_str[2]);
+    }
+}
+
+// Check each stage's peak charging current against its `current_max`
+// The loops regulate the measured current at the limit, so the true
+// current is allowed the settling band of noise above it, but no more
+static int check_current_limits(void) {
+    int failed = 0;
+    for (int i = 0; i < n_stages; i++) {
+        stage_t &s = stages[i];
+        const charge_parm_t *p = stage_parms(s.state);
+        if ((p == nullptr) || (p->current_max == 0)) {
+            continue;
+        }
+        if (s.peak_mA > p->current_max * (100.0 + SETTLE_BAND_PCT) / 100.0) {
+            printf("Current limit: %s peak %.0f mA over the %u mA maximum\n", state_name(s.state),
+                   s.peak_mA, p->current_max);
+            failed = 1;
+        }
+    }
+    if (!failed) {
+        printf("Current limit: every stage within %u%% of its maximum\n", SETTLE_BAND_PCT);
+    }
+    return failed;
+}
+
+static void print_summary(double wall_s, uint64_t standby_ms, int64_t all_standby_ms) {
+    char start_str[12], dur_str[12], settle_str[12], target_str[12];
+
+    printf("\n");
+    printf("Simulation summary\n");
+    if (n_plants > 1) {
+        printf("Bat ");
+    }
+    printf("%-9s %-9s %-9s %-9s %8s %8s %7s %6s %8s %8s %10s %9s\n",
+           "Stage", "Start", "Duration", "Settle", "Target V", "Peak mA", "In mAh", "SoC %", "Est %",
+           "DAC wr", "I2C bytes", "Loop max");
+    for (int i = 0; i < n_stages; i++) {
+        stage_t &s = stages[i];
+        if (n_plants > 1) {
+            printf("%3d ", s.battery + 1);
+        }
+        ms_to_hms_str(s.start_ms, start_str);
+        ms_to_hms_str(s.end_ms - s.start_ms, dur_str);
+        if (s.settle_ms >= 0) {
+            ms_to_hms_str((time_ms_t)s.settle_ms, settle_str);
+        } else {
+            snprintf(settle_str, sizeof(settle_str), "-");
+        }
+        if (s.target_end) {
+            snprintf(target_str, sizeof(target_str), "%.2f", s.target_end / 1000.0);
+        } else {
+            snprintf(target_str, sizeof(target_str), "-");
+        }
+        printf("%-9s %-9s %-9s %-9s %8s %8.0f %8.0f %7.1f %6d %8u %10u %6.1f ms\n",
+               state_name(s.state), start_str, dur_str, settle_str, target_str, s.peak_mA,
+               s.mAh_end - s.mAh_start, s.soc_end * 100.0, s.est_end, s.dac_writes, s.i2c_bytes,
+               s.max_loop_us / 1000.0);
+    }
+
+    print_predictions();
+
+    const i2c_queue_stats_t &q = main_i2c_bus.queue_stats();
+    printf("\nI2C queue: %u completed, %u errors, %u replaced, %u stalls, "
+           "max depth %u\n",
+           q.completed, q.errors, q.replaced, q.stalls, q.max_depth);
+    printf("I2C max latency: %.1f ms, priority (DAC) %.2f ms\n",
+           q.max_latency_us / 1000.0, q.max_priority_latency_us / 1000.0);
+
+    printf("Timer interrupts: %llu\n", (unsigned long long)sim_timer_interrupts());
+    printf("Temperature: %.1f to %.1f C\n", temp_trace.min_seen(), temp_trace.max_seen());
+
+    if (n_plants > 1) {
+        if (all_standby_ms >= 0) {
+            ms_to_hms_str((time_ms_t)all_standby_ms, start_str);
+            printf("All batteries in standby after %s\n", start_str);
+        } else {
+            printf("Batteries not all in standby\n");
+        }
+    }
+
+    for (int i = 0; i < n_plants; i++) {
+        if (n_plants > 1) {
+            printf("Battery %d ", i + 1);
+        }
+        printf("Internal resistance: %u mOhm measured, %.0f mOhm in the plant, "
+               "sulfation %.2f\n",
+               channels[i].session.resistance_mohm, plants[i]->resistance_ohms() * 1000.0,
+               plants[i]->sulfation());
+        if (channels[i].session.capacity_mAh) {
+            if (n_plants > 1) {
+                printf("Battery %d ", i + 1);
+            }
+            printf("Load test: %u mAh capacity, %u%% health, %.0f mAh in the plant\n",
+                   channels[i].session.capacity_mAh, channels[i].session.health_pct,
+                   plants[i]->capacity_mAh());
+        }
+    }
+
+    if (low_power.sleeps()) {
+        printf("Stop mode: %u sleeps, longest %.1f s, asleep %.2f%% of standby, %u bad sleeps\n",
+               low_power.sleeps(), max_sleep_ms / 1000.0,
+               standby_ms ? 100.0 * low_power.slept_ms() / standby_ms : 0.0, bad_sleeps);
+    }
+
+    if (status_screen.updates()) {
+        printf("OLED updates: %u, bytes per update: average %u, max %u\n",
+               status_screen.updates(), status_screen.total_bytes() / status_screen.updates(),
+               status_screen.max_update_bytes());
+    }
+
+    printf("Console: %u bytes sent, %u dropped, buffer peak %u of %u bytes\n",
+           console.sent_bytes(), console.dropped_bytes(), console.max_used(), CONSOLE_TX_SIZE);
+
+    // Only time the firmware spends blocked (I2C, delays) moves the
+    // simulation clock, so the task run times are those waits
+    printf("\nTask run times:\n");
+    fflush(stdout);
+    tasks.print_report();
+    console.flush();
+
+    double sim_s = sim_time_us() / 1e6;
+    printf("\nSimulated %.1f hours in %.2f seconds (%.0fx real time)\n",
+           sim_s / 3600.0, wall_s, (wall_s > 0) ? sim_s / wall_s : 0.0);
+}
+
+// Every battery in standby, or shut down
+static bool all_idle(void) {
+    for (int i = 0; i < BATTERY_CHANNELS; i++) {
+        if ((channels[i].state != CHARGER_STANDBY) && (channels[i].state != CHARGER_SHUTDOWN)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    plant_parm_t parms = PLANT_DEFAULTS;
+    double soc2 = 0.90;
+    double max_hours = 48;
+    uint32_t step_ms = 10;
+    bool oled = true;
+    bool run_through = false;
+    bool quiet = false;
+    bool show_oled = false;
+    bool sequential = false;
+    bool load_test = false;
+    uint32_t i2c_latency_us = 20;
+    uint32_t i2c_jitter_us = 0;
+    bool i2c_blocking = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool has_value = (i + 1 < argc);
+        if (!strcmp(arg, "--soc") && has_value) {
+            parms.soc = atof(argv[++i]);
+        } else if (!strcmp(arg, "--batteries") && has_value) {
+            n_plants = atoi(argv[++i]);
+        } else if (!strcmp(arg, "--soc2") && has_value) {
+            soc2 = atof(argv[++i]);
+        } else if (!strcmp(arg, "--sequential")) {
+            sequential = true;
+        } else if (!strcmp(arg, "--load-test")) {
+            load_test = true;
+        } else if(!strcmp(arg, "--capacity") && has_value) {
+            parms.capacity_mAh = atof(argv[++i]);
+        } else if (!strcmp(arg, "--leak") && has_value) {
+            parms.leak_mA = atof(argv[++i]);
+        } else if (!strcmp(arg, "--r-int") && has_value) {
+            parms.r_ohmic = atof(argv[++i]) / 1000.0;
+        } else if (!strcmp(arg, "--sulfation") && has_value) {
+            parms.sulfation = atof(argv[++i]);
+        } else if (!strcmp(arg, "--temp") && has_value) {
+            temp_trace.set_constant(atof(argv[++i]));
+        } else if (!strcmp(arg, "--temp-trace") && has_value) {
+            const char *path = argv[++i];
+            if (!temp_trace.load(path)) {
+                fprintf(stderr, "Can't read temperature trace '%s'\n", path);
+                return 2;
+            }
+        } else if (!strcmp(arg, "--hours") && has_value) {
+            max_hours = atof(argv[++i]);
+        } else if (!strcmp(arg, "--step") && has_value) {
+            step_ms = (uint32_t)atoi(argv[++i]);
+        } else if (!strcmp(arg, "--bow") && has_value) {
+            parms.vreg_bow_V = atof(argv[++i]);
+        } else if (!strcmp(arg, "--adc-gain") && has_value) {
+            parms.adc_gain = atof(argv[++i]);
+        } else if (!strcmp(arg, "--adc-offset") && has_value) {
+            parms.adc_offset_mV = atof(argv[++i]);
+        } else if (!strcmp(arg, "--seed") && has_value) {
+            parms.seed = (uint32_t)atoi(argv[++i]);
+        } else if (!strcmp(arg, "--i2c-latency") && has_value) {
+            i2c_latency_us = (uint32_t)atoi(argv[++i]);
+        } else if (!strcmp(arg, "--i2c-jitter") && has_value) {
+            i2c_jitter_us = (uint32_t)atoi(argv[++i]);
+        } else if (!strcmp(arg, "--i2c-blocking")) {
+            i2c_blocking = true;
+        } else if (!strcmp(arg, "--no-oled")) {
+            oled = false;
+        } else if (!strcmp(arg, "--continue")) {
+            run_through = true;
+        } else if (!strcmp(arg, "--show-oled")) {
+            show_oled = true;
+        } else if (!strcmp(arg, "--quiet")) {
+            quiet = true;
+        } else if (!strcmp(arg, "--bench")) {
+            return run_benchmarks();
+        } else if (!strcmp(arg, "--decode")) {
+            return run_decoder();
+        } else {
+            fprintf(stderr, "Unknown or incomplete option '%s'\n", arg);
+            return 2;
+        }
+    }
+    if (step_ms == 0) {
+        step_ms = 1;
+    }
+    if ((n_plants < 0) || (n_plants > BATTERY_CHANNELS)) {
+        fprintf(stderr, "--batteries must be 0 to %d\n", BATTERY_CHANNELS);
+        return 2;
+    }
+    if (load_test && !LOAD_TEST_CYCLE) {
+        fprintf(stderr, "--load-test needs a build with LOAD_TEST_CYCLE=1\n");
+        return 2;
+    }
+
+    // Build a plant for each battery, with its own noise, and attach the
+    // device models to the I2C bus
+    parms.temp_C = temp_trace.at(0);
+    plant_parm_t parms2 = parms;
+    parms2.soc = soc2;
+    parms2.seed = parms.seed + 1;
+    parms.connected = (n_plants > 0);
+    parms2.connected = (n_plants > 1);
+    Charger_Plant model(parms);
+    Charger_Plant model2(parms2);
+    plants[0] = &model;
+    if (BATTERY_CHANNELS > 1) {
+        plants[1] = &model2;
+    }
+    for (int i = 0; i < BATTERY_CHANNELS; i++) {
+        open_stage[i] = -1;
+    }
+    Sim_INA219 ina219_model(plants[0]);
+    Sim_MCP4726 mcp4726_model(plants[0]);
+    ina219 = &ina219_model;
+    mcp4726 = &mcp4726_model;
+    Sim_SSD1306 ssd1306;
+    Wire.attach(INA219B_I2C_ADDRESS, ina219);
+    Wire.attach(DAC_I2C_ADDRESS, mcp4726);
+    if (oled) {
+        Wire.attach(0x3C, &ssd1306);
+    }
+    sim_set_analog_hook(analog_hook);
+    sim_set_digital_hook(digital_hook);
+    sim_serial_enable(!quiet);
+    low_power.set_hook(sleep_hook);
+
+    // Queued I2C transfers run in the background, as they do on the target
+    Sim_I2C_Port i2c_port(i2c_latency_us, i2c_jitter_us, parms.seed);
+    if (!i2c_blocking) {
+        main_i2c_bus.set_port(&i2c_port);
+    }
+
+    clock_t wall_start = clock();
+
+    setup();
+    if (sequential) {
+        scheduler.set_policy(SCHEDULE_SEQUENTIAL);
+    }
+#if LOAD_TEST_CYCLE
+    for (int i = 0; i < n_plants; i++) {
+        channels[i].load_test_selected |= load_test;
+    }
+#endif
+
+    uint64_t end_us = (uint64_t)(max_hours * HOUR_MS) * 1000;
+    uint32_t sample_timer = millis();
+    charger_state_t last_state[BATTERY_CHANNELS];
+    for (int i = 0; i < n_plants; i++) {
+        last_state[i] = channels[i].state;
+        begin_stage(i, channels[i].state);
+    }
+    uint64_t standby_us = 0;
+    int64_t all_standby_ms = -1;
+
+    while (sim_time_us() < end_us) {
+        // The firmware's loop() spins continuously on the target, so it
+        // runs again as soon as a background I2C transfer finishes
+        uint64_t now_us = sim_time_us();
+        uint64_t next_us = now_us + (uint64_t)step_ms * 1000;
+        if (i2c_port.busy() && (i2c_port.deadline() < next_us)) {
+            next_us = std::max(i2c_port.deadline(), now_us);
+        }
+        sim_advance_us(next_us - now_us);
+        double temp_C = temp_trace.at(sim_time_us());
+        for (int i = 0; i < n_plants; i++) {
+            plants[i]->update(sim_time_us());
+            plants[i]->set_temperature(temp_C);
+        }
+
+        // Simulation clock only moves inside loop() while the CPU is blocked
+        // or asleep, and time asleep doesn't count
+        uint64_t loop_start_us = sim_time_us();
+        time_ms_t loop_start_slept = low_power.slept_ms();
+        bool idle = all_idle();
+        loop();
+        uint32_t loop_us = (uint32_t)(sim_time_us() - loop_start_us) -
+                           (low_power.slept_ms() - loop_start_slept) * 1000;
+        if (idle) {
+            standby_us += sim_time_us() - now_us;
+        }
+
+        // Loop time and regulation count against the battery on the regulator
+        Charge_Channel *active = scheduler.active_channel();
+        int battery = (active != nullptr) ? (int)(active - channels) : -1;
+        if ((battery >= 0) && (battery < n_plants) && (open_stage[battery] >= 0)) {
+            stage_t &s = stages[open_stage[battery]];
+            s.max_loop_us = std::max(s.max_loop_us, loop_us);
+        }
+
+        if (millis() - sample_timer >= SAMPLE_PERIOD_MS) {
+            sample_timer = millis();
+            sample_stage((battery < n_plants) ? battery : -1);
+        }
+
+        bool changed = false;
+        for (int i = 0; i < n_plants; i++) {
+            if (channels[i].state != last_state[i]) {
+                last_state[i] = channels[i].state;
+                begin_stage(i, channels[i].state);
+                changed = true;
+            }
+        }
+        if (changed && all_idle()) {
+            if (all_standby_ms < 0) {
+                all_standby_ms = millis();
+            }
+            if (!run_through) {
+                break;
+            }
+        }
+    }
+    for (int i = 0; i < n_plants; i++) {
+        end_stage(i);
+    }
+
+    console.flush();
+    fflush(stdout);
+    sim_serial_enable(true);
+    print_summary((double)(clock() - wall_start) / CLOCKS_PER_SEC, standby_us / 1000,
+                  all_standby_ms);
+    int failed = check_current_limits();
+    if (show_oled && oled) {
+        printf("\nOLED display:\n");
+        ssd1306.print();
+    }
+    return failed;
+}
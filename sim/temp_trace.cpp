@@ -0,0 +1,77 @@
+/**
+ *  @file temp_trace.cpp
+ *  @brief Ambient temperature trace for the charger simulator
+ *
+ *  Copyright(c) 2025  John Glynn
+ *
+ *  This code is licensed under the MIT License.
+ *  See the LICENSE file for the full license text.
+ */
+#include "temp_trace.h"
+#include <stdio.h>
+#include <math.h>
+
+// Constructor with a constant temperature
+Temp_Trace::Temp_Trace(double temp_C) {
+    set_constant(temp_C);
+}
+
+void Temp_Trace::set_constant(double temp_C) {
+    hours[0] = 0.0;
+    temps[0] = temp_C;
+    n_points = 1;
+    low = INFINITY;
+    high = -INFINITY;
+}
+
+// Read a trace file of "hours, temperature" lines
+bool Temp_Trace::load(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == nullptr) {
+        return false;
+    }
+    char line[128];
+    int n = 0;
+    while ((n < MAX_POINTS) && fgets(line, sizeof(line), f)) {
+        double h, t;
+        if ((line[0] != '#') && ((sscanf(line, "%lf , %lf", &h, &t) == 2) ||
+                                 (sscanf(line, "%lf %lf", &h, &t) == 2))) {
+            hours[n] = h;
+            temps[n] = t;
+            n++;
+        }
+    }
+    fclose(f);
+    if (n == 0) {
+        return false;
+    }
+    n_points = n;
+    return true;
+}
+
+// Temperature at a simulated time, interpolated between points
+double Temp_Trace::at(uint64_t now_us) {
+    double h = now_us / 3.6e9;
+    double t = temps[n_points - 1];
+    if (h <= hours[0]) {
+        t = temps[0];
+    } else {
+        for (int i = 1; i < n_points; i++) {
+            if (h < hours[i]) {
+                double f = (h - hours[i - 1]) / (hours[i] - hours[i - 1]);
+                t = temps[i - 1] + f * (temps[i] - temps[i - 1]);
+                break;
+            }
+        }
+    }
+    low = fmin(low, t);
+    high = fmax(high, t);
+    return t;
+}
+
+// Sensor voltage into the 3.3V A/D, at the oversampled resolution
+int Temp_Trace::sensor_adc_count(double temp_C, int bits) {
+    double mv = 760.0 + 2.5 * (temp_C - 30.0);
+    double count = mv / 3300.0 * (double)(1 << bits);
+    return (count < 0.0) ? 0 : (int)(count + 0.5);
+}
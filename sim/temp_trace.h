@@ -0,0 +1,78 @@
+/**
+ *  @file temp_trace.h
+ *  @brief Ambient temperature trace for the charger simulator
+ *
+ *  Copyright(c) 2025  John Glynn
+ *
+ *  This code is licensed under the MIT License.
+ *  See the LICENSE file for the full license text.
+ *
+ *  @details
+ *  Gives the temperature of the battery and charger over the simulated
+ *  time, either held constant or read from a trace file.  Each line of a
+ *  trace file holds a time in hours and a temperature in C, separated by
+ *  a comma or spaces, with the times in ascending order.  The temperature
+ *  is interpolated between points and held before the first and after
+ *  the last, and lines starting with `#` are skipped.
+ */
+#ifndef _SIM_TEMP_TRACE_H_
+#define _SIM_TEMP_TRACE_H_
+
+#include <stdint.h>
+
+/**
+ *  @brief Temperature over the simulated time
+ */
+class Temp_Trace {
+public:
+    /**
+     *  @brief Constructor with a constant temperature
+     *  @param temp_C: Temperature (C)
+     */
+    Temp_Trace(double temp_C = 25.0);
+
+    /**
+     *  @brief Hold the temperature constant
+     *  @param temp_C: Temperature (C)
+     */
+    void set_constant(double temp_C);
+
+    /**
+     *  @brief Read a trace file
+     *  @param path: Trace file
+     *  @returns true=Read, false=Not found or no points in it
+     */
+    bool load(const char *path);
+
+    /**
+     *  @brief Get the temperature at a simulated time
+     *  @param now_us: Simulation time (us)
+     *  @returns Temperature (C)
+     */
+    double at(uint64_t now_us);
+
+    /**
+     *  @brief Internal temperature sensor A/D count
+     *  @param temp_C: Die temperature (C)
+     *  @param bits: Resolution of the oversampled result
+     *  @returns A/D count for a typical sensor (760 mV at 30C, 2.5 mV/C)
+     */
+    static int sensor_adc_count(double temp_C, int bits);
+
+    /// @brief Lowest temperature seen by `at()` (C)
+    double min_seen(void) { return low; }
+
+    /// @brief Highest temperature seen by `at()` (C)
+    double max_seen(void) { return high; }
+
+private:
+    static const int MAX_POINTS = 256;
+
+    double hours[MAX_POINTS];               // Time of each point (h)
+    double temps[MAX_POINTS];               // Temperature at each point (C)
+    int n_points;
+    double low;                             // Range seen so far (C)
+    double high;
+};
+
+#endif
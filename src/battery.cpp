@@ -9,6 +9,12 @@
  */
 
 #include "battery.h"
+#include "nvstore.h"
+
+//
+// Global variables
+//
+extern NV_Store nv_store;                   ///< Calibration data in flash
 
 /**
  *  @brief Conversion from ADC counts to actual measured voltage at battery terminal
@@ -22,42 +28,312 @@
  */
 const uint32_t BATTERY_ADC_TO_MV = 395;
 
-// Default constructor (does nothing)
-Battery::Battery(void) { }
+/// @brief Divisor converting 16-bit results scaled by BATTERY_ADC_TO_MV to mV
+const uint32_t BATTERY_RESULT_DIV = 100 << (ADC_RESULT_BITS - AN_READ_BITS);
+
+/// @brief Gain from the divider, until the channel is calibrated (mV per result << BATTERY_GAIN_SHIFT)
+const uint32_t BATTERY_GAIN_DEFAULT =
+    ((BATTERY_ADC_TO_MV << BATTERY_GAIN_SHIFT) + BATTERY_RESULT_DIV / 2) / BATTERY_RESULT_DIV;
+
+/// @brief Calibration from the divider
+const battery_cal_t BATTERY_CAL_DEFAULT = { BATTERY_GAIN_DEFAULT, 0 };
+
+#ifdef ARDUINO_ARCH_STM32
+
+static ADC_HandleTypeDef hadc;              ///< A/D converter
+static DMA_HandleTypeDef hdma;              ///< DMA channel moving A/D results
+
+/// @brief Oversampled A/D results for every input, written by DMA
+static volatile uint16_t adc_buffer[ADC_SAMPLES][ADC_SCAN_SLOTS];
+
+// Start the background A/D conversions
+// Continuous conversions of the battery channels and the internal
+// temperature sensor, 256x oversampled and shifted to 16 bits, with DMA
+// filling the sample buffer in a loop.  Inputs are scanned in A/D channel
+// order, which matches the slot numbering as long as GP_AN_BATTERY lists
+// the inputs in ascending order (PA0 and PA1 are channels 0 and 1) below
+// the temperature sensor (channel 12), which takes the last slot.
+// The 5 us sampling time also covers the temperature sensor's minimum.
+static void adc_start(void) {
+    __HAL_RCC_ADC_CLK_ENABLE();
+    __HAL_RCC_DMA1_CLK_ENABLE();
+
+    hdma.Instance = DMA1_Channel1;
+    hdma.Init.Request = DMA_REQUEST_ADC1;
+    hdma.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma.Init.MemInc = DMA_MINC_ENABLE;
+    hdma.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+    hdma.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+    hdma.Init.Mode = DMA_CIRCULAR;
+    hdma.Init.Priority = DMA_PRIORITY_LOW;
+    HAL_DMA_Init(&hdma);
+    __HAL_LINKDMA(&hadc, DMA_Handle, hdma);
+
+    hadc.Instance = ADC1;
+    hadc.Init.ClockPrescaler = ADC_CLOCK_SYNC_PCLK_DIV2;
+    hadc.Init.Resolution = ADC_RESOLUTION_12B;
+    hadc.Init.DataAlign = ADC_DATAALIGN_RIGHT;
+    hadc.Init.ScanConvMode = ADC_SCAN_SEQ_FIXED;
+    hadc.Init.EOCSelection = ADC_EOC_SINGLE_CONV;
+    hadc.Init.LowPowerAutoWait = DISABLE;
+    hadc.Init.LowPowerAutoPowerOff = DISABLE;
+    hadc.Init.ContinuousConvMode = ENABLE;
+    hadc.Init.NbrOfConversion = ADC_SCAN_SLOTS;
+    hadc.Init.DiscontinuousConvMode = DISABLE;
+    hadc.Init.ExternalTrigConv = ADC_SOFTWARE_START;
+    hadc.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_NONE;
+    hadc.Init.DMAContinuousRequests = ENABLE;
+    hadc.Init.Overrun = ADC_OVR_DATA_OVERWRITTEN;
+    hadc.Init.SamplingTimeCommon1 = ADC_SAMPLETIME_160CYCLES_5;
+    hadc.Init.OversamplingMode = ENABLE;
+    hadc.Init.Oversampling.Ratio = ADC_OVERSAMPLING_RATIO_256;
+    hadc.Init.Oversampling.RightBitShift = ADC_RIGHTBITSHIFT_4;
+    hadc.Init.Oversampling.TriggeredMode = ADC_TRIGGEREDMODE_SINGLE_TRIGGER;
+    hadc.Init.TriggerFrequencyMode = ADC_TRIGGER_FREQ_LOW;
+    HAL_ADC_Init(&hadc);
+    HAL_ADCEx_Calibration_Start(&hadc);
+
+    // In fixed sequence mode each enabled channel takes its channel number
+    // as its rank, so every channel uses ADC_RANK_CHANNEL_NUMBER
+    ADC_ChannelConfTypeDef adc_channel = {};
+    adc_channel.Rank = ADC_RANK_CHANNEL_NUMBER;
+    adc_channel.SamplingTime = ADC_SAMPLINGTIME_COMMON_1;
+    for (uint8_t i = 0; i < BATTERY_CHANNELS; i++) {
+        adc_channel.Channel = __LL_ADC_DECIMAL_NB_TO_CHANNEL(
+            STM_PIN_CHANNEL(pinmap_function(analogInputToPinName(GP_AN_BATTERY[i]), PinMap_ADC)));
+        HAL_ADC_ConfigChannel(&hadc, &adc_channel);
+    }
+
+    // Configuring the temperature sensor channel also turns the sensor on
+    adc_channel.Channel = ADC_CHANNEL_TEMPSENSOR;
+    HAL_ADC_ConfigChannel(&hadc, &adc_channel);
+
+    ADC_Input::resume();
+}
+
+// Default constructor
+ADC_Input::ADC_Input(void) {
+    slot = 0;
+}
+
+// Set the input read from the buffer
+// The pin is only used by the host build
+void ADC_Input::begin(uint8_t slot, PinNumber pin) {
+    (void)pin;
+    ADC_Input::slot = slot;
+}
+
+// Stop the background A/D conversions
+void ADC_Input::suspend(void) {
+    HAL_ADC_Stop_DMA(&hadc);
+}
+
+// Restart the background A/D conversions
+// Nothing reads the DMA interrupts, so they're left disabled
+void ADC_Input::resume(void) {
+    HAL_ADC_Start_DMA(&hadc, (uint32_t *)adc_buffer, ADC_SAMPLES * ADC_SCAN_SLOTS);
+    __HAL_DMA_DISABLE_IT(&hdma, DMA_IT_TC | DMA_IT_HT | DMA_IT_TE);
+    delayMicroseconds(ADC_SAMPLES * ADC_SCAN_US);
+}
+
+// Bring the buffer up to date
+// Nothing to do, DMA keeps the buffer filled
+void ADC_Input::fill(void) {
+}
+
+// Get the buffer offset of the latest result
+// The DMA counter holds the number of transfers left before wrapping,
+// and the input's latest result is in the last row it has reached
+uint32_t ADC_Input::latest(void) {
+    uint32_t done = ADC_SAMPLES * ADC_SCAN_SLOTS - __HAL_DMA_GET_COUNTER(&hdma);
+    uint32_t row = (done + ADC_SCAN_SLOTS - 1 - slot) / ADC_SCAN_SLOTS;
+    return (row + ADC_SAMPLES - 1) % ADC_SAMPLES;
+}
+
+// Get one of the input's results from the buffer
+uint16_t ADC_Input::sample(uint32_t offset) {
+    return adc_buffer[offset][slot];
+}
+
+// Default constructor
+Battery::Battery(void) {
+    channel = 0;
+    cal = BATTERY_CAL_DEFAULT;
+    cal_saved = BATTERY_CAL_DEFAULT;
+}
+
+// Start the background A/D conversions
+void Battery::begin(uint8_t channel) {
+    Battery::channel = channel;
+    ADC_Input::begin(channel, GP_AN_BATTERY[channel]);
+    pinmap_pinout(analogInputToPinName(GP_AN_BATTERY[channel]), PinMap_ADC);
+    if (channel == BATTERY_CHANNELS - 1) {
+        adc_start();
+    }
+}
+
+#else
+
+// Host build: the continuous conversions are modelled when a reading is
+// taken, with analogRead() providing the oversampled 16-bit results
+
+// Default constructor
+ADC_Input::ADC_Input(void) {
+    slot = 0;
+    pin = 0;
+    memset(samples, 0, sizeof(samples));
+    next_sample = 0;
+    sample_us = 0;
+}
+
+// Set the input read from the buffer
+void ADC_Input::begin(uint8_t slot, PinNumber pin) {
+    ADC_Input::slot = slot;
+    ADC_Input::pin = pin;
+    sample_us = micros();
+}
+
+// Stop the background A/D conversions
+void ADC_Input::suspend(void) {
+}
+
+// Restart the background A/D conversions
+// Results missed while suspended are taken on the next reading, so only
+// the wait for fresh results is modelled
+void ADC_Input::resume(void) {
+    delayMicroseconds(ADC_SAMPLES * ADC_SCAN_US);
+}
+
+// Bring the buffer up to date
+// Takes the results the A/D converter would have produced by now
+void ADC_Input::fill(void) {
+    uint32_t due = (micros() - sample_us) / ADC_SCAN_US;
+    sample_us += due * ADC_SCAN_US;
+    for (uint32_t i = 0; (i < due) && (i < ADC_SAMPLES); i++) {
+        samples[next_sample] = analogRead(pin);
+        next_sample = (next_sample + 1) % ADC_SAMPLES;
+    }
+}
+
+// Get the buffer offset of the latest result
+uint32_t ADC_Input::latest(void) {
+    return (next_sample + ADC_SAMPLES - 1) % ADC_SAMPLES;
+}
+
+// Get one of the input's results from the buffer
+uint16_t ADC_Input::sample(uint32_t offset) {
+    return samples[offset];
+}
+
+// Default constructor
+Battery::Battery(void) {
+    channel = 0;
+    cal = BATTERY_CAL_DEFAULT;
+    cal_saved = BATTERY_CAL_DEFAULT;
+}
+
+// Start the background A/D conversions
+void Battery::begin(uint8_t channel) {
+    Battery::channel = channel;
+    ADC_Input::begin(channel, GP_AN_BATTERY[channel]);
+    if (channel == BATTERY_CHANNELS - 1) {
+        analogReadResolution(ADC_RESULT_BITS);
+        resume();
+    }
+}
+
+#endif
+
+// Get the latest oversampled A/D result
+uint16_t ADC_Input::get_result(void) {
+    fill();
+    return sample(latest());
+}
+
+// Get the average of the oversampled A/D results in the buffer
+uint16_t ADC_Input::get_result_average(void) {
+    uint32_t sum = 0;
+
+    fill();
+    for (int i=0; i < ADC_SAMPLES; i++) {
+        sum += sample(i);
+    }
+    return (uint16_t)(sum/ADC_SAMPLES);
+}
 
 // Get current battery voltage in millivolts
 voltage_mv_t Battery::get_voltage_mV(void) {
-    uint16_t adc_battery = analogRead(GP_AN_BATTERY);
-    return ((adc_battery*BATTERY_ADC_TO_MV)/100);
+    return to_mV(get_result(), cal);
 }
 
-/**
- *  @brief Number of consecutive readings to calculate an average from
- *  @note Should be a power of 2 to avoid binary division errors
- */
-#define AVG_READINGS 4
-
+// Get average battery voltage in millivolts
 voltage_mv_t Battery::get_voltage_average_mV(void) {
-    uint32_t reading[AVG_READINGS];
-    uint16_t min = 0xFFFF;
-    uint16_t max = 0;
-    uint32_t sum = 0;
+    return to_mV(get_result_average(), cal);
+}
+
+// Convert an A/D result to millivolts
+// 16-bit results and gains up to 2^16 keep the product within 32 bits
+voltage_mv_t Battery::to_mV(uint32_t result, const battery_cal_t &c) {
+    int32_t mV = (int32_t)((result * c.gain) >> BATTERY_GAIN_SHIFT) + c.offset_mV;
+    return (voltage_mv_t)std::max<int32_t>(mV, 0);
+}
 
-    // Take consecutive voltage readings
-    for (int i=0; i < AVG_READINGS; i++) {
-        reading[i] = get_voltage_mV();
-        if (reading[i] < min) {
-            min = reading[i];
-        }
-        if (reading[i] > max) {
-            max = reading[i];
-        }
-        sum += reading[i];
+// Fit the gain and offset to A/D results taken at known voltages
+// Least squares, in 64-bit integers as it's only done at startup
+bool Battery::fit_calibration(const uint16_t *results, const voltage_mv_t *reference_mV,
+                              uint8_t points) {
+    int64_t sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+    for (uint8_t i = 0; i < points; i++) {
+        sum_x += results[i];
+        sum_y += reference_mV[i];
+        sum_xx += (int64_t)results[i] * results[i];
+        sum_xy += (int64_t)results[i] * reference_mV[i];
     }
+    int64_t denominator = points * sum_xx - sum_x * sum_x;
+    if ((points < 2) || (denominator <= 0)) {
+        return false;
+    }
+    int64_t gain = ((points * sum_xy - sum_x * sum_y) << BATTERY_GAIN_SHIFT) / denominator;
+    int64_t offset_mV = (sum_y - ((gain * sum_x) >> BATTERY_GAIN_SHIFT)) / points;
 
-    // Debugging information
-    // Serial.printf("Battery mV: Avg %u, Min %u, Max %u\n", (sum/AVG_READINGS), min, max);
+    // A battery on the output, or a fault, gives a gain well away from
+    // the divider's
+    int64_t gain_tolerance = BATTERY_GAIN_DEFAULT * BATTERY_CAL_GAIN_PCT / 100;
+    if ((abs(gain - (int64_t)BATTERY_GAIN_DEFAULT) > gain_tolerance) ||
+        (abs(offset_mV) > BATTERY_CAL_OFFSET_MAX_MV)) {
+        return false;
+    }
+    cal.gain = (uint32_t)gain;
+    cal.offset_mV = (int32_t)offset_mV;
+    return true;
+}
+
+// Get the gain and offset in use
+battery_cal_t Battery::get_calibration(void) {
+    return cal;
+}
 
-    // Return calculated average
-    return (voltage_mv_t)(sum/AVG_READINGS);
+// Load the channel's calibration saved in flash
+bool Battery::load_calibration(void) {
+    battery_cal_t saved;
+    if (!nv_store.load((nv_block_t)(NV_BATTERY_CAL + channel), &saved, sizeof(saved))) {
+        return false;
+    }
+    cal = saved;
+    cal_saved = saved;
+    return true;
+}
+
+// Save the channel's calibration in flash, if it has changed enough
+// The change is judged at the top of the A/D range, where a change of
+// gain moves the reading most
+void Battery::save_calibration(void) {
+    int64_t gain_change = ((int64_t)cal.gain - (int64_t)cal_saved.gain) * UINT16_MAX;
+    int32_t change_mV = (int32_t)(abs(gain_change) >> BATTERY_GAIN_SHIFT) +
+                        abs(cal.offset_mV - cal_saved.offset_mV);
+    bool changed = (change_mV >= (int32_t)BATTERY_CAL_SAVE_MV);
+    if (changed && nv_store.save((nv_block_t)(NV_BATTERY_CAL + channel), &cal, sizeof(cal))) {
+        cal_saved = cal;
+    }
 }
@@ -12,6 +12,36 @@
 
 #include "obcharger.h"
 
+/**
+ *  @brief Oversampled A/D results kept in the circular DMA buffer
+ *  @note Should be a power of 2 to avoid binary division errors
+ */
+#define ADC_SAMPLES         8
+
+/// @brief Hardware oversampling ratio (256x) as a shift of the 12-bit sum
+#define ADC_OVERSAMPLE_BITS 8
+
+/// @brief Right shift of the oversampled sum, giving 16-bit results
+#define ADC_RESULT_SHIFT    4
+
+/// @brief A/D result resolution after oversampling
+#define ADC_RESULT_BITS     (AN_READ_BITS + ADC_OVERSAMPLE_BITS - ADC_RESULT_SHIFT)
+
+/**
+ *  @brief Time per oversampled result (us)
+ *  @details 256 conversions of 173 A/D clocks (160.5 sampling + 12.5) at 32 MHz
+ */
+#define ADC_SAMPLE_US       1384
+
+/// @brief Scan slot of the internal temperature sensor, after the batteries
+#define ADC_TEMP_SLOT       BATTERY_CHANNELS
+
+/// @brief Inputs scanned by the A/D converter (batteries and temperature)
+#define ADC_SCAN_SLOTS      (BATTERY_CHANNELS + 1)
+
+/// @brief Time between results for each input (us)
+#define ADC_SCAN_US         (ADC_SAMPLE_US * ADC_SCAN_SLOTS)
+
 /* 
  * Define constant ratio to allow conversion of battery A/D count to voltage
  * in microvolts.
@@ -25,28 +55,197 @@
  */
 
 
+/**
+ *  @brief Input scanned by the background A/D conversions
+ *  @details
+ *  The A/D converter runs continuously in the background, using the
+ *  hardware oversampler to turn 256 12-bit conversions into each 16-bit
+ *  result, and DMA to store the results in a circular buffer of
+ *  `ADC_SAMPLES` entries.  Readings are taken from the buffer, so they
+ *  don't wait for the A/D converter and cost the same every time.
+ *
+ *  The A/D converter scans every battery channel's input and then the
+ *  internal temperature sensor in turn, and the buffer holds `ADC_SAMPLES`
+ *  results for each of them.  The A/D converter is shared, so `suspend()`
+ *  and `resume()` apply to all inputs.
+ */
+class ADC_Input {
+public:
+    /// @brief Default constructor
+    ADC_Input(void);
+
+    /**
+     *  @brief Stop the background A/D conversions (e.g. for Stop mode)
+     *  @returns Nothing
+     */
+    static void suspend(void);
+
+    /**
+     *  @brief Restart the background A/D conversions after `suspend()`
+     *  @returns Nothing
+     *  @note Waits for the buffer to fill with fresh results.
+     */
+    static void resume(void);
+
+protected:
+    /**
+     *  @brief Set the input read from the buffer
+     *  @param slot: Scan slot (0 to `ADC_SCAN_SLOTS`-1)
+     *  @param pin: A/D input pin, read by `analogRead()` on the host
+     *  @returns Nothing
+     */
+    void begin(uint8_t slot, PinNumber pin);
+
+    /**
+     *  @brief Get the latest oversampled A/D result
+     *  @returns 16-bit A/D result
+     */
+    uint16_t get_result(void);
+
+    /**
+     *  @brief Get the average of the oversampled A/D results in the buffer
+     *  @returns 16-bit A/D result
+     */
+    uint16_t get_result_average(void);
+
+private:
+    uint8_t slot;                           ///< Scan slot
+#ifndef ARDUINO_ARCH_STM32
+    PinNumber pin;                          ///< A/D input pin
+    uint16_t samples[ADC_SAMPLES];          ///< Oversampled A/D results
+    uint32_t next_sample;                   ///< Buffer offset of the next result
+    uint32_t sample_us;                     ///< Time the last result was taken (micros())
+#endif
+
+    /**
+     *  @brief Bring the buffer up to date
+     *  @returns Nothing
+     *  @note DMA keeps the buffer filled on the target.  The host build
+     *        takes the results the A/D converter would have produced.
+     */
+    void fill(void);
+
+    /**
+     *  @brief Get the buffer offset of the latest result
+     *  @returns Offset of the result among the input's `ADC_SAMPLES`
+     */
+    uint32_t latest(void);
+
+    /**
+     *  @brief Get one of the input's results from the buffer
+     *  @param offset: Offset of the result (0 to `ADC_SAMPLES`-1)
+     *  @returns Oversampled A/D result
+     */
+    uint16_t sample(uint32_t offset);
+};
+
+/// @brief Fixed-point shift of the battery voltage gain (mV per A/D result)
+#define BATTERY_GAIN_SHIFT  16
+
+const uint8_t BATTERY_CAL_GAIN_PCT = 10;            ///< Furthest a fitted gain may be from the divider's (%)
+const voltage_mv_t BATTERY_CAL_OFFSET_MAX_MV = 500; ///< Largest fitted offset (mV)
+const voltage_mv_t BATTERY_CAL_SAVE_MV = 10;        ///< Change in the readings worth saving (mV)
+
+/**
+ *  @brief Battery voltage calibration, saved in flash for each channel
+ *  @details
+ *  Battery voltage (mV) = (A/D result x `gain`) >> `BATTERY_GAIN_SHIFT`
+ *  + `offset_mV`
+ */
+struct battery_cal_t {
+    uint32_t gain;                          ///< mV per A/D result, scaled by 2^`BATTERY_GAIN_SHIFT`
+    int32_t offset_mV;                      ///< Offset (mV)
+};
+
 /**
  *  @brief Battery class with methods to support voltage readings
+ *  @details
+ *  Each battery channel's voltage divider is one of the inputs scanned by
+ *  the background A/D conversions (see `ADC_Input`).
+ *
+ *  A/D results are converted to millivolts with a gain and offset, which
+ *  start out from the divider's resistor values and the A/D reference.
+ *  The resistor tolerances and A/D errors are calibrated out by fitting
+ *  the gain and offset to readings of a known voltage (see
+ *  `Vreg::calibrate_battery()`), and the fit is saved in flash for the
+ *  channel.
  */
-class Battery {
+class Battery : public ADC_Input {
 public:
     /// @brief Default constructor
     Battery(void);
 
+    /**
+     *  @brief Start the background A/D conversions
+     *  @param channel: Battery channel (0 to `BATTERY_CHANNELS`-1)
+     *  @returns Nothing
+     *  @note The conversions start when the last channel is set up.
+     */
+    void begin(uint8_t channel = 0);
+
     /**
      *  @brief Get battery voltage (mV)
      *  @returns Battery voltage in mV
+     *  @note Latest oversampled A/D result.
      */
     voltage_mv_t get_voltage_mV(void);
 
     /**
      *  @brief Get average battery voltage (mV)
      *  @returns Battery voltage in mV
-     *  @note Takes four consecutive readings and returns the average
-     *        of those readings to smooth-out fluctuations.
+     *  @note Average of the `ADC_SAMPLES` results in the buffer, covering
+     *        the last `ADC_SAMPLES * ADC_SCAN_US` to smooth-out fluctuations.
      */
     voltage_mv_t get_voltage_average_mV(void);
 
+    /**
+     *  @brief Get the average of the oversampled A/D results in the buffer
+     *  @returns 16-bit A/D result, for calibration
+     */
+    using ADC_Input::get_result_average;
+
+    /**
+     *  @brief Fit the gain and offset to A/D results taken at known voltages
+     *  @param results: Average A/D results
+     *  @param reference_mV: Voltage at the divider for each result (mV)
+     *  @param points: Number of results, 2 or more
+     *  @returns true=Fitted, false=The fit is out of range (a battery or
+     *           load on the output, or a fault), calibration left as it was
+     *  @note Least-squares straight line fit.
+     */
+    bool fit_calibration(const uint16_t *results, const voltage_mv_t *reference_mV, uint8_t points);
+
+    /**
+     *  @brief Get the gain and offset in use
+     *  @returns Calibration
+     */
+    battery_cal_t get_calibration(void);
+
+    /**
+     *  @brief Load the channel's calibration saved in flash
+     *  @returns true=Loaded, false=None saved, the divider's values are used
+     */
+    bool load_calibration(void);
+
+    /**
+     *  @brief Save the channel's calibration in flash, if it moves the
+     *         readings by `BATTERY_CAL_SAVE_MV` or more since it was saved
+     *  @returns Nothing
+     */
+    void save_calibration(void);
+
+private:
+    uint8_t channel;                        ///< Battery channel
+    battery_cal_t cal;                      ///< Gain and offset in use
+    battery_cal_t cal_saved;                ///< Gain and offset as last saved or loaded
+
+    /**
+     *  @brief Convert an A/D result to millivolts
+     *  @param result: 16-bit A/D result
+     *  @param c: Calibration to use
+     *  @returns Battery voltage (mV)
+     */
+    static voltage_mv_t to_mV(uint32_t result, const battery_cal_t &c);
 };
 
 #endif
\ No newline at end of file
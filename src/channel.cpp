@@ -0,0 +1,288 @@
+/**
+ * @file channel.cpp
+ * @brief Battery channels and the scheduler sharing the regulator between them
+ *
+ * Copyright(c) 2025  John Glynn
+ *
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ */
+
+#include "channel.h"
+#include "supervisor.h"
+#include "console.h"
+
+//
+// Global variables
+//
+extern Vreg vreg;                           ///< Voltage regulator
+extern Console_TX console;                  ///< Serial console output
+
+//== Charge_Channel ===========================================================
+
+// Default constructor
+Charge_Channel::Charge_Channel(void) {
+    state = CHARGER_STARTUP;
+    state_time = 0;
+    start_pending = false;
+#if LOAD_TEST_CYCLE
+    load_test_selected = false;
+#endif
+    session = {};
+    index = 0;
+}
+
+// Initialize the channel
+void Charge_Channel::begin(uint8_t index) {
+    Charge_Channel::index = index;
+
+    // Battery switch off, on boards that have one
+    if (BATTERY_CHANNELS > 1) {
+        digitalWrite(GP_BATTERY_SELECT[index], LOW);
+        pinMode(GP_BATTERY_SELECT[index], OUTPUT);
+    }
+
+    battery.begin(index);
+    soc.begin(BATTERY_CAPACITY);
+    trend.begin(PLATEAU_INTERVAL_MS, PLATEAU_SAMPLES);
+    fast_charger.init(FAST_PARMS, this);
+    topping_charger.init(TOP_PARMS, this);
+    trickle_charger.init(TRCKL_PARMS, this);
+    standby_charger.init(STANDBY_PARMS, this);
+#if CONDITIONING_CYCLE
+    condition_charger.init(COND_PARMS, this);
+#endif
+#if LOAD_TEST_CYCLE
+    load_tester.init(LOAD_PARMS, this);
+#endif
+
+    state = CHARGER_STARTUP;
+    state_time = millis();
+    start_pending = false;
+#if LOAD_TEST_CYCLE
+    load_test_selected = LOAD_TEST_AT_STARTUP;
+#endif
+    session = {};
+}
+
+// Switch the battery onto the regulator output
+void Charge_Channel::connect(void) {
+    vreg.set_battery(&battery);
+    soc.restart();
+    if (BATTERY_CHANNELS > 1) {
+        digitalWrite(GP_BATTERY_SELECT[index], HIGH);
+    }
+}
+
+// Turn the regulator off and switch the battery out
+void Charge_Channel::disconnect(void) {
+    vreg.off();
+    if (BATTERY_CHANNELS > 1) {
+        digitalWrite(GP_BATTERY_SELECT[index], LOW);
+    }
+}
+
+// Get the battery number shown in messages
+uint8_t Charge_Channel::number(void) {
+    return index + 1;
+}
+
+// Print the battery number ahead of a console message
+void Charge_Channel::print_label(void) {
+    if (BATTERY_CHANNELS > 1) {
+        console.printf("Battery %u: ", number());
+    }
+}
+
+// Get the charging cycle handler for the channel's state
+Charge_Cycle *Charge_Channel::cycle(void) {
+    const charger_stage_t *stage = charger_stage(state);
+    return ((stage != nullptr) && (stage->cycle != nullptr)) ? stage->cycle(*this) : nullptr;
+}
+
+// Move the channel to a new charger state
+void Charge_Channel::set_state(charger_state_t next) {
+    if ((state == CHARGER_STARTUP) || (state == CHARGER_STANDBY)) {
+        session = {};
+    }
+    state = next;
+    state_time = millis();
+    start_pending = (cycle() != nullptr);
+}
+
+//== Channel_Scheduler ========================================================
+
+// Priority of a channel's charger state
+// A channel whose standby time is up only needs a moment to move on, so
+// it's given the regulator like a channel in startup
+static stage_priority_t priority(Charge_Channel &channel) {
+    const charger_stage_t *stage = charger_stage(channel.state);
+    if (stage == nullptr) {
+        return STAGE_DONE;
+    }
+    if ((stage->priority == STAGE_IDLE) && !channel.start_pending &&
+        (channel.cycle()->charging_time_remaining() == 0)) {
+        return STAGE_SETUP;
+    }
+    return stage->priority;
+}
+
+// Default constructor
+Channel_Scheduler::Channel_Scheduler(void) {
+    channels = nullptr;
+    count = 0;
+    active = nullptr;
+    policy = SCHEDULE_SHARED;
+    slice_timer = 0;
+}
+
+// Set up the scheduler
+void Channel_Scheduler::begin(Charge_Channel *channels, uint8_t count) {
+    Channel_Scheduler::channels = channels;
+    Channel_Scheduler::count = count;
+    active = nullptr;
+    slice_timer = millis();
+}
+
+// Set how the regulator is shared
+void Channel_Scheduler::set_policy(schedule_policy_t policy) {
+    Channel_Scheduler::policy = policy;
+}
+
+// Get the channel connected to the regulator
+Charge_Channel *Channel_Scheduler::active_channel(void) {
+    return active;
+}
+
+// Connect the channel due the regulator, then run the supervisor for it
+void Channel_Scheduler::run(void) {
+    // An internal resistance measurement keeps the regulator, and holds
+    // the charging cycle, until it has finished.  Startup and shutdown
+    // have no cycle.
+    Charge_Cycle *cycle = (active != nullptr) ? active->cycle() : nullptr;
+    if ((cycle != nullptr) && !active->start_pending && cycle->resistance_pending()) {
+        return;
+    }
+
+    Charge_Channel *next = select();
+    if (next != active) {
+        switch_to(next);
+    }
+    if (active == nullptr) {
+        return;
+    }
+
+    // Run the handler for the channel's charging state, moving to the
+    // next state as set out in the supervisor transition table
+    charger_supervisor(*active);
+
+    // Start the new state's handler now if the channel keeps the
+    // regulator, or doesn't need it, otherwise once it gets it back
+    if (active->start_pending) {
+        if ((priority(*active) == STAGE_IDLE) || (select() == active)) {
+            active->start_pending = false;
+            active->cycle()->start();
+        }
+    }
+}
+
+// Update cached charging current readings, and count the charge
+// delivered to the battery on the regulator
+void Channel_Scheduler::sample(void) {
+    if (active == nullptr) {
+        return;
+    }
+    current_ma_t charging_current = vreg.get_current_average_mA();
+    active->current_history.append((uint16_t)charging_current);
+    active->soc.add_sample(charging_current, millis());
+}
+
+// Get the running charging cycle handler of the channel on the regulator
+Charge_Cycle *Channel_Scheduler::active_cycle(void) {
+    if ((active == nullptr) || active->start_pending) {
+        return nullptr;
+    }
+    return active->cycle();
+}
+
+// Pick the channel that should have the regulator
+Charge_Channel *Channel_Scheduler::select(void) {
+    // A running bulk stage isn't interrupted, nor is trickle charging
+    // when each battery goes all the way through in turn
+    if ((active != nullptr) && !active->start_pending) {
+        stage_priority_t p = priority(*active);
+        if ((p == STAGE_BULK) || ((p == STAGE_FLOAT) && (policy == SCHEDULE_SEQUENTIAL))) {
+            return active;
+        }
+    }
+
+    // Most urgent priority among the channels
+    stage_priority_t top = STAGE_DONE;
+    for (uint8_t i = 0; i < count; i++) {
+        top = std::min(top, priority(channels[i]));
+    }
+    if (top == STAGE_DONE) {
+        return active;
+    }
+
+    // Trickle charging channels take turns
+    if ((top == STAGE_FLOAT) && (active != nullptr) && !active->start_pending &&
+        (priority(*active) == STAGE_FLOAT) && (millis() - slice_timer < CHANNEL_SLICE_MS)) {
+        return active;
+    }
+
+    // Look from the channel after the active one, so channels with equal
+    // claims go in rotation
+    uint8_t first = (active != nullptr) ? (uint8_t)(active - channels + 1) : 0;
+    Charge_Channel *next = nullptr;
+    for (uint8_t i = 0; i < count; i++) {
+        Charge_Channel &c = channels[(first + i) % count];
+        if (priority(c) != top) {
+            continue;
+        }
+        if (next == nullptr) {
+            next = &c;
+        } else if ((top == STAGE_SETUP) || (top == STAGE_BULK)) {
+            // First come, first served
+            if ((int32_t)(c.state_time - next->state_time) < 0) {
+                next = &c;
+            }
+        } else if (top == STAGE_IDLE) {
+            // Least standby time left
+            if (c.cycle()->charging_time_remaining() < next->cycle()->charging_time_remaining()) {
+                next = &c;
+            }
+        }
+    }
+    return next;
+}
+
+// Hand the regulator to another channel
+void Channel_Scheduler::switch_to(Charge_Channel *next) {
+    // A charging stage stops the clock while it's switched out, so each
+    // battery gets its full stage time on the regulator.  Standby's timer
+    // carries on, as it doesn't need the regulator.
+    if (active != nullptr) {
+        stage_priority_t p = priority(*active);
+        if (((p == STAGE_BULK) || (p == STAGE_FLOAT)) && !active->start_pending) {
+            active->cycle()->pause();
+        }
+        active->disconnect();
+    }
+
+    active = next;
+    slice_timer = millis();
+    active->connect();
+
+    // Start the handler for a new state, otherwise carry on from where
+    // the channel left off
+    Charge_Cycle *cycle = active->cycle();
+    if (cycle != nullptr) {
+        if (active->start_pending) {
+            active->start_pending = false;
+            cycle->start();
+        } else {
+            cycle->resume();
+        }
+    }
+}
@@ -0,0 +1,243 @@
+/**
+ * @file channel.h
+ * @brief Battery channels and the scheduler sharing the regulator between them
+ *
+ * Copyright(c) 2025  John Glynn
+ *
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ *
+ * @details
+ * Each battery the charger looks after is a `Charge_Channel`, holding the
+ * battery's own charger state, voltage readings, charging cycle handlers
+ * (with their timers), charging current history, state of charge
+ * estimate, internal resistance, and the trend of the reading the running
+ * cycle ends on.  The charger has one
+ * regulator, so only one channel is connected to it at a time, through the
+ * channel's battery switch.
+ *
+ * The `Channel_Scheduler` picks the channel connected each `LOOP_DELAY`,
+ * using the priority of each channel's charger state from the supervisor's
+ * stage table:
+ * @li Startup runs straight away, since it only reads the battery voltage.
+ * @li Bulk stages (fast, topping) keep the regulator until they finish.
+ *     When several are waiting, the one that started first goes next.
+ * @li Float stages (trickle) take turns of `CHANNEL_SLICE_MS`, and a
+ *     waiting bulk stage takes the regulator from them.
+ * @li A charging stage's timer is paused while its channel is switched
+ *     out, so every battery gets its full stage time on the regulator.
+ * @li Standby doesn't use the regulator.  With every channel idle, the
+ *     channel with the least standby time left is run, so its timer and
+ *     Stop mode sleeps set the pace.  When a channel's standby time is
+ *     up, it's run like startup to pick its next charging stage.
+ *
+ * So one battery can be fast charged while another waits in trickle or
+ * standby, rather than each battery in turn running all the way through
+ * trickle charging (`SCHEDULE_SEQUENTIAL`, the conops automatic mode).
+ *
+ * Moving to a new charger state starts its handler once the channel holds
+ * the regulator, or straight away for states that don't need it.
+ */
+#ifndef _CHANNEL_H_
+#define _CHANNEL_H_
+
+#include "obcharger.h"
+#include "battery.h"
+#include "soc.h"
+#include "fast.h"
+#include "topping.h"
+#include "trickle.h"
+#include "standby.h"
+#include "condition.h"
+#include "loadtest.h"
+#include "slope.h"
+#include "eta.h"
+#include <ringbuffer.h>
+
+/**
+ *  @brief How the regulator is shared between battery channels
+ */
+enum schedule_policy_t {
+    SCHEDULE_SHARED = 0,                    ///< Bulk stages first, float stages take turns
+    SCHEDULE_SEQUENTIAL = 1,                ///< Each battery through trickle before the next
+};
+
+/**
+ *  @brief Battery measurements taken during a charging session
+ *  @note Cleared when a new charging session begins, see
+ *        `Charge_Channel::set_state()`.
+ */
+struct session_record_t {
+    uint32_t resistance_mohm;               ///< Internal resistance (mOhm, 0=not measured)
+    uint16_t capacity_mAh;                  ///< Capacity from the load test (mAh, 0=not tested)
+    uint8_t health_pct;                     ///< Capacity out of `BATTERY_CAPACITY` (%, 0=not tested)
+};
+
+/**
+ *  @brief Battery channel, with its own charger state and charging cycles
+ */
+class Charge_Channel {
+public:
+    /// @brief Default constructor
+    Charge_Channel(void);
+
+    /**
+     *  @brief Initialize the channel
+     *  @param index: Channel index (0 to `BATTERY_CHANNELS`-1)
+     *  @returns Nothing
+     *  @note The channel starts in `CHARGER_STARTUP`, switched out.
+     */
+    void begin(uint8_t index);
+
+    /**
+     *  @brief Switch the battery onto the regulator output
+     *  @returns Nothing
+     *  @note The regulator is left off, the charging cycle turns it on.
+     */
+    void connect(void);
+
+    /**
+     *  @brief Turn the regulator off and switch the battery out
+     *  @returns Nothing
+     */
+    void disconnect(void);
+
+    /**
+     *  @brief Get the battery number shown in messages
+     *  @returns Battery number (1 to `BATTERY_CHANNELS`)
+     */
+    uint8_t number(void);
+
+    /**
+     *  @brief Print the battery number ahead of a console message, when
+     *         there is more than one battery channel
+     *  @returns Nothing
+     */
+    void print_label(void);
+
+    /**
+     *  @brief Get the charging cycle handler for the channel's state
+     *  @returns Charging cycle handler, nullptr if the state has none
+     */
+    Charge_Cycle *cycle(void);
+
+    /**
+     *  @brief Move the channel to a new charger state
+     *  @param next: Next charger state
+     *  @returns Nothing
+     *  @note The handler for the new state is started by the scheduler.
+     *        Leaving startup or standby begins a new charging session,
+     *        so the session record is cleared and the battery's internal
+     *        resistance is measured again.
+     */
+    void set_state(charger_state_t next);
+
+    charger_state_t state;                  ///< Charger state
+    time_ms_t state_time;                   ///< millis() time the state was entered
+    bool start_pending;                     ///< State's handler still to be started?
+#if LOAD_TEST_CYCLE
+    bool load_test_selected;                ///< Load test the battery when it's connected?
+#endif
+    session_record_t session;               ///< Battery measurements this charging session
+
+    Battery battery;                        ///< Battery voltage readings
+    SoC_Estimator soc;                      ///< Battery state of charge estimate
+    Fast_Charger fast_charger;              ///< Fast charging cycle handler
+    Topping_Charger topping_charger;        ///< Topping charging cycle handler
+    Trickle_Charger trickle_charger;        ///< Trickle charging cycle handler
+    Standby_Charger standby_charger;        ///< Standby mode handler
+#if CONDITIONING_CYCLE
+    Conditioning_Charger condition_charger; ///< Conditioning cycle handler
+#endif
+#if LOAD_TEST_CYCLE
+    Load_Test_Charger load_tester;          ///< Load test handler
+#endif
+
+    /// @brief Charging current readings, averaged for status messages
+    RingBuffer16<RB_CHARGING_CURRENT_SAMPLES> current_history;
+
+    /// @brief Trend of the reading the running charging cycle ends on
+    Slope_Estimator trend;
+
+    /// @brief Prediction of the time left in the running charging cycle
+    ETA_Estimator eta;
+
+private:
+    uint8_t index;                          ///< Channel index
+};
+
+/**
+ *  @brief Shares the regulator between the battery channels
+ */
+class Channel_Scheduler {
+public:
+    /// @brief Default constructor
+    Channel_Scheduler(void);
+
+    /**
+     *  @brief Set up the scheduler
+     *  @param channels: Battery channels
+     *  @param count: Number of channels
+     *  @returns Nothing
+     */
+    void begin(Charge_Channel *channels, uint8_t count);
+
+    /**
+     *  @brief Set how the regulator is shared
+     *  @param policy: Scheduling policy
+     *  @returns Nothing
+     */
+    void set_policy(schedule_policy_t policy);
+
+    /**
+     *  @brief Connect the channel due the regulator, then run the
+     *         supervisor for it
+     *  @returns Nothing
+     *  @note Called by the control task in `loop()` every `LOOP_DELAY`.
+     */
+    void run(void);
+
+    /**
+     *  @brief Read the charging current into the active channel's history
+     *         and state of charge estimate
+     *  @returns Nothing
+     *  @note Called by the sensor task in `loop()` every `LOOP_DELAY`,
+     *        ahead of the control task.
+     */
+    void sample(void);
+
+    /**
+     *  @brief Get the channel connected to the regulator
+     *  @returns Active channel, nullptr before the first `run()`
+     */
+    Charge_Channel *active_channel(void);
+
+    /**
+     *  @brief Get the charging cycle handler running on the regulator
+     *  @returns Handler for the active channel's state, nullptr if there
+     *           isn't one or it hasn't been started yet
+     */
+    Charge_Cycle *active_cycle(void);
+
+private:
+    Charge_Channel *channels;               ///< Battery channels
+    uint8_t count;                          ///< Number of channels
+    Charge_Channel *active;                 ///< Channel connected to the regulator
+    schedule_policy_t policy;               ///< Scheduling policy
+    time_ms_t slice_timer;                  ///< millis() time the active channel was connected
+
+    /**
+     *  @brief Pick the channel that should have the regulator
+     *  @returns Channel to connect
+     */
+    Charge_Channel *select(void);
+
+    /**
+     *  @brief Hand the regulator to another channel
+     *  @param next: Channel to connect
+     *  @returns Nothing
+     */
+    void switch_to(Charge_Channel *next);
+};
+
+#endif
@@ -0,0 +1,176 @@
+/**
+ * @file condition.cpp
+ * @brief Conditioning (desulfation) cycle handler for SLA batteries
+ *
+ * Copyright(c) 2025  John Glynn
+ *
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ */
+#include "condition.h"
+#include "channel.h"
+#include "console.h"
+
+//
+// Global variables
+//
+extern Alarm_Pool timer_pool;               // Hardware timers
+extern Vreg vreg;                           // Voltage regulator
+extern Temp_Sensor temp_sensor;             // Internal temperature sensor
+extern Console_TX console;                  // Serial console output
+
+// Default constructor
+Conditioning_Charger::Conditioning_Charger() : Charge_Cycle() {
+    pulse_on = false;
+    finishing = false;
+    pulse_timer = 0;
+    rest_mV = 0;
+    response = 0;
+    trend_response = 0;
+}
+
+// Destructor (best practice)
+Conditioning_Charger::~Conditioning_Charger() {};
+
+// Constructor with initialization
+Conditioning_Charger::Conditioning_Charger(charge_parm_t &p, Charge_Channel *channel) : Charge_Cycle(p, channel) {
+    pulse_on = false;
+    finishing = false;
+    pulse_timer = 0;
+    rest_mV = 0;
+    response = 0;
+    trend_response = 0;
+}
+
+// Start a new conditioning cycle
+// The base class soft starts the regulator, but the cycle starts with a
+// rest, so the first pulse has a rest voltage to be compared with
+void Conditioning_Charger::start(void) {
+    Charge_Cycle::start();
+    stop();
+    pulse_on = false;
+    finishing = false;
+    pulse_timer = start_time;
+    response = 0;
+    trend_timer = start_time;
+    trend_sum = 0;
+    trend_count = 0;
+    trend_response = 0;
+}
+
+// Run-time handler to manage the conditioning cycle
+cycle_state_t Conditioning_Charger::run() {
+    // Are we still in startup state?
+    if (startup_time_remaining())
+        state_code = CYCLE_STARTUP;
+    else
+        state_code = CYCLE_RUNNING;
+
+    // Has conditioning cycle timed-out?
+    if (!charging_time_remaining()) {
+        // Yes, the response was still rising, but that's long enough
+        stop();
+        state_code = CYCLE_TIMEOUT;
+        return state_code;
+    }
+
+    // Get voltage and current readings
+    current_ma_t charging_current = vreg.get_current_mA();
+    voltage_mv_t battery_voltage = channel->battery.get_voltage_mV();
+
+    // Stop straight away if the battery voltage or the temperature runs
+    // past its limit
+    if ((battery_voltage > CONDITION_VOLTAGE_MAX_MV) ||
+        (temp_sensor.get_temperature_dC() > CONDITION_TEMP_MAX_DC)) {
+        stop();
+        state_code = CYCLE_ERROR;
+        return state_code;
+    }
+
+    if (pulse_on && finishing) {
+        // The resistance has been measured on the last pulse
+        stop();
+        state_code = CYCLE_DONE;
+        return state_code;
+    } else if (pulse_on) {
+        // Drive the battery towards the target voltage, without exceeding
+        // the maximum current, and take the readings once they have settled
+        regulate(charging_current, battery_voltage, max_current);
+        time_ms_t pulse_time = millis() - pulse_timer;
+        if (pulse_time >= CONDITION_SETTLE_MS) {
+            pulse_mA_sum += charging_current;
+            pulse_mV_sum += battery_voltage;
+            pulse_count++;
+        }
+
+        // End of the pulse, the cycle is complete once the response has
+        // stopped rising, otherwise rest the battery
+        if (pulse_time >= CONDITION_PULSE_ON_MS) {
+            if (end_pulse() && (state_code != CYCLE_STARTUP)) {
+                remeasure_resistance();
+                finishing = true;
+                return state_code;
+            }
+            stop();
+            pulse_on = false;
+            pulse_timer = millis();
+        }
+    } else if (millis() - pulse_timer >= CONDITION_PULSE_OFF_MS) {
+        // End of the rest, start the next pulse
+        rest_mV = channel->battery.get_voltage_average_mV();
+        soft_start();
+        pulse_on = true;
+        pulse_timer = millis();
+        pulse_mA_sum = 0;
+        pulse_mV_sum = 0;
+        pulse_count = 0;
+    }
+
+    // Normal exit
+    return state_code;
+}
+
+// Get the latest pulse response
+uint32_t Conditioning_Charger::get_response(void) {
+    return response;
+}
+
+// Take the pulse's response, and check whether it has stopped rising
+// Responses are averaged over each trend period, and compared with the
+// period before, so a pulse or two of noise doesn't end the cycle
+bool Conditioning_Charger::end_pulse(void) {
+    response = 0;
+    if (pulse_count) {
+        uint32_t pulse_mA = pulse_mA_sum / pulse_count;
+        uint32_t pulse_mV = pulse_mV_sum / pulse_count;
+        if (pulse_mV > rest_mV) {
+            response = pulse_mA * 1000 / (pulse_mV - rest_mV);
+        }
+    }
+    trend_sum += response;
+    trend_count++;
+    if (millis() - trend_timer < CONDITION_TREND_MS) {
+        return false;
+    }
+
+    uint32_t period_response = trend_sum / trend_count;
+    bool levelled = (trend_response != 0) &&
+                    (period_response * 100 < trend_response * (100 + CONDITION_RISE_MIN_PCT));
+    channel->print_label();
+    console.printf("Conditioning pulse response @ %u mA/V\n", period_response);
+
+    trend_response = period_response;
+    trend_timer = millis();
+    trend_sum = 0;
+    trend_count = 0;
+    return levelled;
+}
+
+// Measure the battery's internal resistance again
+// Taken at the end of the last pulse, while the current is still flowing,
+// and the cycle finishes once it's done
+void Conditioning_Charger::remeasure_resistance(void) {
+    channel->session.resistance_mohm = 0;
+    resistance_tried = false;
+    measure_resistance();
+}
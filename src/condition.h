@@ -0,0 +1,137 @@
+/**
+ *  @file condition.h
+ *  @brief Conditioning (desulfation) cycle handler for SLA batteries
+ *
+ *  Copyright(c) 2025  John Glynn
+ *
+ *  This code is licensed under the MIT License.
+ *  See the LICENSE file for the full license text.
+ *
+ *  @details
+ *  Called by the exec supervisor to condition a sulfated battery, once
+ *  topping charging has brought it up to full charge.  Lead sulfate that
+ *  has hardened on the plates doesn't take part in charging, so a
+ *  sulfated battery has a high internal resistance and takes less
+ *  charge.  Holding the battery at a high voltage, at a low current,
+ *  breaks some of it down again.
+ *
+ *  The voltage regulator is pulsed on for `CONDITION_PULSE_ON_MS` and off
+ *  for `CONDITION_PULSE_OFF_MS`, starting with a rest.  During each pulse
+ *  the battery is driven up towards the (high) voltage target, with the
+ *  current held at or below the (low) maximum, and rests in between, so
+ *  the battery doesn't heat up or gas as it would under a steady
+ *  overcharge.
+ *
+ *  As the sulfate breaks down, the battery takes more current for the
+ *  same rise in voltage.  The battery's response to each pulse is the
+ *  average current over the settled part of the pulse, per volt the pulse
+ *  raised the battery above its voltage at the end of the rest before it.
+ *  This works whichever limit holds the pulse: with the current at the
+ *  maximum, the voltage the battery is pushed up to falls instead.  The
+ *  cycle is complete once the average response over a
+ *  `CONDITION_TREND_MS` period rises by less than
+ *  `CONDITION_RISE_MIN_PCT` on the period before it.
+ *
+ *  Safety limits stop the cycle with the `ERROR` state if the battery
+ *  voltage goes above `CONDITION_VOLTAGE_MAX_MV`, or the charger's
+ *  temperature above `CONDITION_TEMP_MAX_DC`.  If the response is still
+ *  rising at the end of the charging timer, the cycle ends with the
+ *  `TIMEOUT` state.
+ *
+ *  A typical conditioning cycle would be as follows:
+ *  1. Create new Conditioning_Charger object with appropriate settings
+ *  2. Call start method once to begin a conditioning cycle
+ *  3. Call run method periodically (100 ms) intervals
+ *  4. Conditioning continues until the pulse current stops rising, or
+ *     until a safety limit is reached or the cycle times out
+ */
+#ifndef _CONDITION_H_
+#define _CONDITION_H_
+
+#include "obcharger.h"
+#include "cycle.h"
+#include "regulator.h"
+#include "battery.h"
+#include "utility.h"
+#include <stm32_time.h>
+
+const time_ms_t CONDITION_PULSE_ON_MS = 3*MINUTE_MS;    ///< Regulator on time for each pulse
+const time_ms_t CONDITION_PULSE_OFF_MS = 1*MINUTE_MS;    ///< Rest time between pulses
+const time_ms_t CONDITION_SETTLE_MS = 2*MINUTE_MS;      ///< Pulse time before the current is averaged
+const time_ms_t CONDITION_TREND_MS = 15*MINUTE_MS;      ///< Period the pulse responses are averaged over
+const uint32_t CONDITION_RISE_MIN_PCT = 2;              ///< Rise in response over a period to carry on (%)
+
+const voltage_mv_t CONDITION_VOLTAGE_MAX_MV = 16000;    ///< Battery voltage that aborts the cycle
+const temp_dc_t CONDITION_TEMP_MAX_DC = 400;            ///< Charger temperature that aborts the cycle (0.1C)
+
+/**
+ * @brief Conditioning cycle handler for SLA batteries
+ *
+ * @details Derived from the `Charge_Cycle` base object, with the `run()`
+ * method overriden to pulse the regulator, and end the cycle once the
+ * battery's current response levels off.
+ *
+ * These parameters are configurable and are set when the handler
+ * is initialized using the `init()` method.  See the documentation
+ * for the `charge_parm_t` structure and `COND_PARMS` for details on the
+ * configuration parameters for this handler.
+ */
+class Conditioning_Charger : public Charge_Cycle {
+
+public:
+
+    /// @brief Default constructor
+    Conditioning_Charger();
+
+    /// @brief Constructor with initialization
+    /// @note See the init() member function for details
+    Conditioning_Charger(charge_parm_t &p, Charge_Channel *channel);
+
+    /// @brief Destructor (best practice)
+    ~Conditioning_Charger();
+
+    /// @brief Start a new conditioning cycle, with the first pulse
+    /// @returns Nothing
+    void start(void);
+
+    /// @brief Run-time handler to manage the conditioning cycle
+    /// @returns Charging state
+    cycle_state_t run(void);
+
+    /**
+     *  @brief Gets the latest pulse response
+     *  @returns Average current over the settled part of the last pulse,
+     *           per volt above the rest voltage before it (mA/V, 0=none yet)
+     */
+    uint32_t get_response(void);
+
+private:
+    bool pulse_on;                          ///< Regulator pulsed on?
+    bool finishing;                         ///< Last pulse held on for the resistance measurement?
+    time_ms_t pulse_timer;                  ///< millis() time the pulse or rest began
+    voltage_mv_t rest_mV;                   ///< Battery voltage at the end of the last rest (mV)
+    uint32_t pulse_mA_sum;                  ///< Sum of the settled current readings this pulse (mA)
+    uint32_t pulse_mV_sum;                  ///< Sum of the settled battery voltage readings this pulse (mV)
+    uint32_t pulse_count;                   ///< Settled readings this pulse
+    uint32_t response;                      ///< Response to the last pulse (mA/V)
+    time_ms_t trend_timer;                  ///< millis() time the trend period began
+    uint32_t trend_sum;                     ///< Sum of the pulse responses this period (mA/V)
+    uint32_t trend_count;                   ///< Pulse responses this period
+    uint32_t trend_response;                ///< Average pulse response over the last period (mA/V, 0=none)
+
+    /**
+     *  @brief Take the pulse's response, and check whether it has stopped
+     *         rising
+     *  @returns true=Response levelled off, false=Carry on
+     */
+    bool end_pulse(void);
+
+    /**
+     *  @brief Measure the battery's internal resistance again, as the
+     *         conditioning should have brought it down
+     *  @returns Nothing
+     */
+    void remeasure_resistance(void);
+};
+
+#endif
@@ -0,0 +1,244 @@
+/**
+ * @file console.cpp
+ * @brief Buffered serial console output, sent in the background by DMA
+ *
+ * Copyright(c) 2025  John Glynn
+ *
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ */
+
+#include "console.h"
+#include <stdio.h>
+
+/// @brief Transmit ring buffer
+static uint8_t tx_buffer[CONSOLE_TX_SIZE];
+
+#ifdef ARDUINO_ARCH_STM32
+
+// Default Serial uses USART2 with PA2 (TX) and PA3 (RX).  DMA1 channel 1
+// is taken by the A/D converter (see battery.cpp).
+#define CONSOLE_USART       USART2
+#define CONSOLE_DMA_REQUEST DMA_REQUEST_USART2_TX
+
+static DMA_HandleTypeDef hdma;              ///< DMA channel feeding the UART
+
+// Set up the DMA channel feeding the UART
+// Serial.begin() has already set the UART up, so only its DMA request
+// is enabled.  Nothing reads the DMA interrupts, so they're left disabled.
+static void tx_begin(uint32_t baud) {
+    (void)baud;
+    __HAL_RCC_DMA1_CLK_ENABLE();
+
+    hdma.Instance = DMA1_Channel2;
+    hdma.Init.Request = CONSOLE_DMA_REQUEST;
+    hdma.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    hdma.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma.Init.MemInc = DMA_MINC_ENABLE;
+    hdma.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma.Init.Mode = DMA_NORMAL;
+    hdma.Init.Priority = DMA_PRIORITY_LOW;
+    HAL_DMA_Init(&hdma);
+
+    SET_BIT(CONSOLE_USART->CR3, USART_CR3_DMAT);
+}
+
+// Check whether a transfer is under way
+// Once the DMA has handed the last byte to the UART the channel is stopped,
+// which also clears its flags for the next transfer
+static bool tx_busy(void) {
+    if (HAL_DMA_GetState(&hdma) != HAL_DMA_STATE_BUSY) {
+        return false;
+    }
+    if (__HAL_DMA_GET_COUNTER(&hdma) != 0) {
+        return true;
+    }
+    HAL_DMA_Abort(&hdma);
+    return false;
+}
+
+// Check whether the UART is free for a transfer
+// The library drivers still write their rare diagnostics to Serial, which
+// sends them by interrupt.  The UART is left to Serial until it's done.
+static bool tx_ready(void) {
+    return !READ_BIT(CONSOLE_USART->CR1, USART_CR1_TXEIE_TXFNFIE);
+}
+
+// Start a transfer
+static void tx_start(const uint8_t *data, uint16_t size) {
+    HAL_DMA_Start(&hdma, (uint32_t)data, (uint32_t)&CONSOLE_USART->TDR, size);
+}
+
+// Wait for the last byte to leave the UART
+static void tx_drain(void) {
+    while (!READ_BIT(CONSOLE_USART->ISR, USART_ISR_TC)) {
+    }
+}
+
+#else
+
+static uint32_t tx_start_us;                ///< micros() time the transfer started
+static uint32_t tx_time_us;                 ///< Time the transfer takes (us)
+
+static void tx_begin(uint32_t baud) {
+    (void)baud;
+    tx_time_us = 0;
+}
+
+// The transfer takes 10 bit times a byte
+static bool tx_busy(void) {
+    return (micros() - tx_start_us) < tx_time_us;
+}
+
+static bool tx_ready(void) {
+    return true;
+}
+
+static void tx_drain(void) {
+}
+
+#endif
+
+// Default constructor
+Console_TX::Console_TX(void) {
+    overflow = CONSOLE_OVERFLOW_WAIT;
+    head = 0;
+    tail = 0;
+    sending = 0;
+    peak = 0;
+    sent = 0;
+    dropped = 0;
+    reported = 0;
+    baud = 115200;
+}
+
+// Start the UART and its transmit DMA channel
+void Console_TX::begin(uint32_t baud) {
+    Console_TX::baud = baud;
+    Serial.begin(baud);
+    tx_begin(baud);
+}
+
+// Choose what to do with messages that don't fit
+void Console_TX::set_overflow(console_overflow_t policy) {
+    overflow = policy;
+}
+
+// Queue a byte for sending
+size_t Console_TX::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+// Queue a message for sending
+size_t Console_TX::write(const uint8_t *buffer, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    if (overflow == CONSOLE_OVERFLOW_WAIT) {
+        // A message larger than the buffer is sent a buffer at a time
+        while (size > CONSOLE_TX_SIZE) {
+            write(buffer, CONSOLE_TX_SIZE);
+            buffer += CONSOLE_TX_SIZE;
+            size -= CONSOLE_TX_SIZE;
+        }
+        while (room() < size) {
+            service();
+            delayMicroseconds(CONSOLE_WAIT_US);
+        }
+    } else if (overflow == CONSOLE_OVERFLOW_REPORT) {
+        report((uint16_t)std::min<size_t>(size, CONSOLE_TX_SIZE));
+    }
+
+    if (size > room()) {
+        dropped += size;
+        return 0;
+    }
+    queue(buffer, (uint16_t)size);
+    service();
+    return size;
+}
+
+// Keep the transmit DMA moving
+void Console_TX::service(void) {
+    if (tx_busy()) {
+        return;
+    }
+    tail += sending;
+    sending = 0;
+    if ((head == tail) || !tx_ready()) {
+        return;
+    }
+
+    // Send up to the end of the buffer, the rest follows in the next transfer
+    uint16_t start = tail & (CONSOLE_TX_SIZE - 1);
+    sending = std::min<uint16_t>(head - tail, CONSOLE_TX_SIZE - start);
+    sent += sending;
+#ifdef ARDUINO_ARCH_STM32
+    tx_start(&tx_buffer[start], sending);
+#else
+    Serial.write(&tx_buffer[start], sending);
+    tx_start_us = micros();
+    tx_time_us = (uint32_t)((uint64_t)sending * 10 * 1000000 / baud);
+#endif
+}
+
+// Wait until everything queued has been sent
+// The host sends whatever is left straight away, rather than move the
+// simulation clock
+void Console_TX::flush(void) {
+#ifdef ARDUINO_ARCH_STM32
+    while ((head != tail) || (sending != 0)) {
+        service();
+    }
+#else
+    while ((head != tail) || (sending != 0)) {
+        tx_time_us = 0;
+        service();
+    }
+#endif
+    tx_drain();
+}
+
+// Get the number of bytes sent
+uint32_t Console_TX::sent_bytes(void) {
+    return sent;
+}
+
+// Get the number of bytes dropped
+uint32_t Console_TX::dropped_bytes(void) {
+    return dropped;
+}
+
+// Get the most of the buffer that has been in use
+uint16_t Console_TX::max_used(void) {
+    return peak;
+}
+
+// Get the room left in the buffer
+uint16_t Console_TX::room(void) {
+    return CONSOLE_TX_SIZE - (uint16_t)(head - tail);
+}
+
+// Copy bytes into the buffer
+void Console_TX::queue(const uint8_t *data, uint16_t size) {
+    for (uint16_t i = 0; i < size; i++) {
+        tx_buffer[(head + i) & (CONSOLE_TX_SIZE - 1)] = data[i];
+    }
+    head += size;
+    peak = std::max<uint16_t>(peak, head - tail);
+}
+
+// Queue a report of the bytes dropped since the last one
+void Console_TX::report(uint16_t size) {
+    if (dropped == reported) {
+        return;
+    }
+    char message[40];
+    int length = snprintf(message, sizeof(message), "Console: %u bytes dropped\n",
+                          (unsigned)(dropped - reported));
+    if ((length > 0) && ((uint16_t)length + size <= room())) {
+        queue((const uint8_t *)message, (uint16_t)length);
+        reported = dropped;
+    }
+}
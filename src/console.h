@@ -0,0 +1,162 @@
+/**
+ * @file console.h
+ * @brief Buffered serial console output, sent in the background by DMA
+ *
+ * Copyright(c) 2025  John Glynn
+ *
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ *
+ * @details
+ * `Serial.printf()` waits whenever the UART's small transmit buffer is
+ * full, so a burst of console messages (the status lines, or a cycle
+ * starting) held up the main loop for as long as the bytes took to send
+ * at 115200 baud, about 87 us each.
+ *
+ * `Console_TX` is a `Print` sink in front of the UART.  Messages are copied
+ * into a static ring buffer of `CONSOLE_TX_SIZE` bytes, and `service()`,
+ * run on every pass of the main loop, hands the oldest run of contiguous
+ * bytes to a DMA channel feeding the UART, and frees them once the DMA
+ * transfer is done.  Writing a message only copies it, so the main loop
+ * never waits on the serial port.
+ *
+ * When a message doesn't fit in the buffer, the overflow policy decides:
+ * @li `CONSOLE_OVERFLOW_WAIT` waits for room, as `Serial` did.  Only used
+ *     during `setup()`, so none of the startup messages are lost.
+ * @li `CONSOLE_OVERFLOW_DROP` drops the whole message, so the other lines
+ *     stay intact, and counts the bytes dropped.
+ * @li `CONSOLE_OVERFLOW_REPORT` drops and counts as well, and adds a
+ *     "Console: n bytes dropped" line ahead of the next message that fits.
+ *
+ * The DMA channel is polled rather than interrupt driven.  The host build
+ * has no DMA, so the transfer time at the baud rate is modelled instead,
+ * and the bytes written to `Serial` as each transfer starts.
+ */
+#ifndef _CONSOLE_H_
+#define _CONSOLE_H_
+
+#include "obcharger.h"
+
+const uint16_t CONSOLE_TX_SIZE = 512;       ///< Transmit ring buffer size (bytes, a power of 2)
+const uint32_t CONSOLE_WAIT_US = 100;       ///< Time between checks while waiting for room (us)
+
+static_assert((CONSOLE_TX_SIZE & (CONSOLE_TX_SIZE - 1)) == 0, "Console buffer size must be a power of 2");
+
+/**
+ *  @brief What to do with a message that doesn't fit in the buffer
+ */
+enum console_overflow_t {
+    CONSOLE_OVERFLOW_WAIT = 0,              ///< Wait for room (startup only)
+    CONSOLE_OVERFLOW_DROP = 1,              ///< Drop the message, counting the bytes
+    CONSOLE_OVERFLOW_REPORT = 2,            ///< Drop and count, and report the count once there's room
+};
+
+/**
+ *  @brief Serial console output through a ring buffer drained by DMA
+ */
+class Console_TX : public Print {
+public:
+    /// @brief Default constructor
+    Console_TX(void);
+
+    /**
+     *  @brief Start the UART and its transmit DMA channel
+     *  @param baud: Baud rate
+     *  @returns Nothing
+     */
+    void begin(uint32_t baud);
+
+    /**
+     *  @brief Choose what to do with messages that don't fit
+     *  @param policy: Overflow policy
+     *  @returns Nothing
+     */
+    void set_overflow(console_overflow_t policy);
+
+    /**
+     *  @brief Queue a byte for sending
+     *  @param c: Byte
+     *  @returns 1, or 0 if it was dropped
+     */
+    size_t write(uint8_t c);
+
+    /**
+     *  @brief Queue a message for sending
+     *  @param buffer: Message
+     *  @param size: Size of the message (bytes)
+     *  @returns Size of the message, or 0 if it was dropped
+     *  @note `printf()` formats each message and writes it in one piece,
+     *        so a message is either queued whole or dropped whole.
+     */
+    size_t write(const uint8_t *buffer, size_t size);
+
+    using Print::write;
+
+    /**
+     *  @brief Keep the transmit DMA moving
+     *  @returns Nothing
+     *  @note Called on every pass of the main loop.  Frees the bytes sent
+     *        by a finished transfer and starts the next.
+     */
+    void service(void);
+
+    /**
+     *  @brief Wait until everything queued has been sent
+     *  @returns Nothing
+     *  @note Only for use before Stop mode, which stops the DMA.
+     */
+    void flush(void);
+
+    /**
+     *  @brief Get the number of bytes sent
+     *  @returns Bytes handed to the UART
+     */
+    uint32_t sent_bytes(void);
+
+    /**
+     *  @brief Get the number of bytes dropped
+     *  @returns Bytes dropped because the buffer was full
+     */
+    uint32_t dropped_bytes(void);
+
+    /**
+     *  @brief Get the most of the buffer that has been in use
+     *  @returns Bytes
+     */
+    uint16_t max_used(void);
+
+private:
+    console_overflow_t overflow;            ///< Overflow policy
+    uint16_t head;                          ///< Where the next byte is queued (free-running)
+    uint16_t tail;                          ///< Oldest byte not yet sent (free-running)
+    uint16_t sending;                       ///< Bytes in the transfer under way, from `tail`
+    uint16_t peak;                          ///< Most of the buffer in use
+    uint32_t sent;                          ///< Bytes handed to the UART
+    uint32_t dropped;                       ///< Bytes dropped
+    uint32_t reported;                      ///< Bytes dropped at the last report
+    uint32_t baud;                          ///< Baud rate, for the host's transfer time
+
+    /**
+     *  @brief Get the room left in the buffer
+     *  @returns Bytes
+     */
+    uint16_t room(void);
+
+    /**
+     *  @brief Copy bytes into the buffer
+     *  @param data: Bytes to copy, which must fit
+     *  @param size: Number of bytes
+     *  @returns Nothing
+     */
+    void queue(const uint8_t *data, uint16_t size);
+
+    /**
+     *  @brief Queue a report of the bytes dropped since the last one
+     *  @param size: Size of the message waiting to be queued after it (bytes)
+     *  @returns Nothing
+     *  @note Only when the report and the message both fit.
+     */
+    void report(uint16_t size);
+};
+
+#endif
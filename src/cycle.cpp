@@ -10,33 +10,43 @@
 
 #include "obcharger.h"
 #include "cycle.h"
+#include "channel.h"
+#include "telemetry.h"
+#include "console.h"
 
 //
 // Global variables
 //
-extern charger_state_t charger_state;       ///< Global charging state from main.cpp
 extern Alarm_Pool timer_pool;               ///< Hardware timers
 extern Vreg vreg;                           ///< Voltage regulator
-extern Battery battery;                     ///< Battery
 extern RGB_LED rgb_led;                     ///< RGB status LED
 extern bool oled_found;                     ///< OLED display found at startup in main()?
 extern SSD1306PrintDevice oled;             ///< OLED display object
-extern RingBuffer16 rb_charging_current;    ///< Charging current readings
+extern Status_Screen status_screen;         ///< OLED status screen
+extern Temp_Sensor temp_sensor;             ///< Internal temperature sensor
+extern Settle_Detector settle_detector;     ///< Detects the readings settling at startup
+extern Console_TX console;                  ///< Serial console output
 
 // Default constructor
 Charge_Cycle::Charge_Cycle() {
 }
 
 // Constructor with initialization
-Charge_Cycle::Charge_Cycle(charge_parm_t &p) {
+Charge_Cycle::Charge_Cycle(charge_parm_t &p, Charge_Channel *channel) {
     // Initialize charging cycle handler
-    init(p);
+    init(p, channel);
 }
 
 // Initialize charging cycle handler
-void Charge_Cycle::init(const charge_parm_t &p) {
+void Charge_Cycle::init(const charge_parm_t &p, Charge_Channel *channel) {
     // Initialize charge state
     state_code = CYCLE_INIT;
+    Charge_Cycle::channel = channel;
+    paused = false;
+    paused_remaining = 0;
+    elapsed_offset = 0;
+    resistance_tried = false;
+    settled = false;
 
     // Set global voltage regulator to off
     vreg.off();
@@ -44,14 +54,21 @@ void Charge_Cycle::init(const charge_parm_t &p) {
 
     // Save charging parameters
     target_voltage = p.voltage_target;
-    step_voltage = p.voltage_step;
     target_current = p.current_target;
     max_current = p.current_max;
+    soc_target = p.soc_target;
+    plateau_slope = p.plateau_slope;
+    plateau_sigmas = p.plateau_sigmas;
+    temp_comp_mv = p.temp_comp_mv;
+
+    // Set up the regulator control loops
+    current_loop.begin(p.current_gains, VREG_VOLTAGE_MIN, VREG_VOLTAGE_MAX);
+    voltage_loop.begin(p.voltage_gains, VREG_VOLTAGE_MIN, VREG_VOLTAGE_MAX);
 
     // Allocate a hardware alarm timer from the pool
     charge_timer_id = timer_pool.add(0, nullptr);
     if (charge_timer_id < 0) {
-        Serial.printf("Error: Unable to allocate hardware timer from pool\n");
+        console.printf("Error: Unable to allocate hardware timer from pool\n");
     };
 
     // Save timer values
@@ -80,35 +97,16 @@ void Charge_Cycle::start() {
     state_code = CYCLE_STARTUP;
 
     // Setup the voltage regulator for the cycle
-    if (charger_state == CHARGER_STANDBY) {  
-        // Turn voltage regulator off
-        vreg.set_voltage_mV(VREG_VOLTAGE_MIN);
-        vreg.off();
-    } else {
-        // Set voltage regulator output at 500 mV below the current battery
-        // voltage to provide a "soft start" that avoids overloading the
-        // regulator when we turn it on!
-        uint32_t battery_voltage = battery.get_voltage_mV();
-        if (battery_voltage < VREG_VOLTAGE_MIN) {
-            // Start at minimum regulator voltage
-            set_voltage = VREG_VOLTAGE_MIN;
-        } else if (battery_voltage > VREG_VOLTAGE_MAX) {
-            // Shouldn't really happen, issue a warning
-            Serial.printf("Warning: Battery voltage above %u mV!\n", VREG_VOLTAGE_MAX);
-            set_voltage = VREG_VOLTAGE_MAX;
-        } else {
-            // Start just below battery voltage
-            set_voltage = battery_voltage - 100;
-        }
-        vreg.set_voltage_mV(set_voltage);
-        vreg.on();
-    }
+    soft_start();
 
     // Start the charging cycle hardware timer
+    paused = false;
+    resistance_tried = false;
+    elapsed_offset = 0;
     if (charge_timer_id >= 0) {
         timer_pool.set(charge_timer_id, charge_period_max);
     } else {
-        Serial.printf("Error: Invalid hardware timer found at startup\n");
+        console.printf("Error: Invalid hardware timer found at startup\n");
     };
 
     // Store the system time when charging cycle starts
@@ -118,24 +116,114 @@ void Charge_Cycle::start() {
     message_timer = start_time;
 
     // Initialize LED to the 'on' state, with the specified color for
-    // the current charge cycle.  The cycle-specific run() handlers will
-    // call the status_led() method below to control the LED state.
+    // the current charge cycle.  The LED task in loop() calls the
+    // status_led() method below to control the LED state.
     rgb_led.begin(GP_LEDR, GP_LEDG, GP_LEDB, led_color);
     led_state = true;
     led_timer = start_time;
 
     // Display startup message and field names to serial console only
-    if (charger_state == CHARGER_STANDBY) {
-        Serial.printf("Entering standby mode\n");
-        Serial.printf("Cycle, Time, \"Battery Voltage\"\n");
+    channel->print_label();
+    if (channel->state == CHARGER_STANDBY) {
+        console.printf("Entering standby mode\n");
+        console.printf("Cycle, Time, \"Battery Voltage\", \"State of Charge\"\n");
     } else {
-        Serial.printf("Starting %s charging cycle\n\n", name_str);
-        Serial.printf("Cycle, Time, \"Bus Voltage\", \"Battery Voltage\", \"Charging Current\"\n");
+        char target_str[7];
+        temp_dc_t temp_dC = temp_sensor.get_temperature_dC();
+        milliunits_to_string(get_target_voltage(), 2, target_str, sizeof(target_str));
+        console.printf("Starting %s charging cycle\n", name_str);
+        console.printf("Voltage target @ %sV for %d C\n\n", target_str,
+                      (int)((temp_dC + ((temp_dC < 0) ? -5 : 5)) / 10));
+        console.printf("Cycle, Time, \"Bus Voltage\", \"Battery Voltage\", \"Charging Current\", "
+                      "\"State of Charge\", \"Stage Remaining\", \"Time to Full\"");
+        if (TELEMETRY_BINARY) {
+            // Columns only in the binary records, added by the decoder
+            console.printf(", \"Set Voltage\", \"DAC Level\", \"Uptime\"");
+        }
+        console.printf("\n");
     };
 
-    // Clear OLED display to prepare for new charging cycle messages
+    // The OLED display is off in standby, otherwise redraw the whole
+    // status screen for new charging cycle messages
+    show_display();
+}
+
+// Pause the charging cycle
+// The remaining and elapsed times are held until the timer is set again
+void Charge_Cycle::pause(void) {
+    if (!paused) {
+        paused_remaining = charging_time_remaining();
+        elapsed_offset = charging_time_elapsed();
+        paused = true;
+    }
+}
+
+// Carry on with the charging cycle
+void Charge_Cycle::resume(void) {
+    if (paused) {
+        paused = false;
+        if (charge_timer_id >= 0) {
+            timer_pool.set(charge_timer_id, paused_remaining);
+        }
+    }
+
+    // The battery voltage has settled while it was switched out, so
+    // soft start the regulator again from there
+    soft_start();
+
+    rgb_led.color(led_color);
+    led_state = true;
+    led_timer = millis();
+    show_display();
+}
+
+// Turn the regulator on just below the battery voltage, or off in standby
+void Charge_Cycle::soft_start(void) {
+    if (channel->state == CHARGER_STANDBY) {  
+        // Turn voltage regulator off
+        vreg.set_voltage_mV(VREG_VOLTAGE_MIN);
+        vreg.off();
+    } else {
+        // Set voltage regulator output at 500 mV below the current battery
+        // voltage to provide a "soft start" that avoids overloading the
+        // regulator when we turn it on!
+        uint32_t battery_voltage = channel->battery.get_voltage_mV();
+        if (battery_voltage < VREG_VOLTAGE_MIN) {
+            // Start at minimum regulator voltage
+            set_voltage = VREG_VOLTAGE_MIN;
+        } else if (battery_voltage > VREG_VOLTAGE_MAX) {
+            // Shouldn't really happen, issue a warning
+            console.printf("Warning: Battery voltage above %u mV!\n", VREG_VOLTAGE_MAX);
+            set_voltage = VREG_VOLTAGE_MAX;
+        } else {
+            // Start just below battery voltage
+            set_voltage = battery_voltage - 100;
+        }
+        vreg.set_voltage_mV(set_voltage);
+        vreg.on();
+
+        // Control loops take over from the soft start voltage
+        current_loop.reset(set_voltage);
+        voltage_loop.reset(set_voltage);
+    }
+
+    // Readings from before the soft start don't belong to the trend, and
+    // have to settle again
+    channel->trend.reset();
+    channel->eta.reset();
+    settle_detector.reset();
+    settled = false;
+}
+
+// Switch the OLED display on for charging, or off in standby
+void Charge_Cycle::show_display(void) {
     if (oled_found) {
-        oled.clear();
+        if (channel->state == CHARGER_STANDBY) {
+            oled.off();
+        } else {
+            oled.on();
+            status_screen.invalidate();
+        }
     }
 }
 
@@ -160,7 +248,7 @@ cycle_state_t Charge_Cycle::state() {
 // Startup time must always be shorter than the charging timeout!
 uint32_t Charge_Cycle::startup_time_remaining(void) {
     uint32_t charging_elapsed = charging_time_elapsed();
-    if (charging_elapsed >= startup_period) {
+    if (settled || (charging_elapsed >= startup_period)) {
         return 0;
     } else {
         return (startup_period - charging_elapsed);
@@ -169,16 +257,132 @@ uint32_t Charge_Cycle::startup_time_remaining(void) {
 
 // Get remaining charging time
 uint32_t Charge_Cycle::charging_time_remaining(void) {
+    if (paused) {
+        return paused_remaining;
+    }
     uint32_t charging_timer = timer_pool.get(charge_timer_id);
     return charging_timer;
 }
 
 // Get elapsed charging time
 uint32_t Charge_Cycle::charging_time_elapsed(void) {
-    uint32_t elapsed_time = timer_pool.elapsed(charge_timer_id);
+    if (paused) {
+        return elapsed_offset;
+    }
+    uint32_t elapsed_time = elapsed_offset + timer_pool.elapsed(charge_timer_id);
     return elapsed_time;
 }
 
+// Get the battery voltage target, compensated for temperature
+voltage_mv_t Charge_Cycle::get_target_voltage(void) {
+    return temp_compensate(target_voltage, temp_comp_mv, temp_sensor.get_temperature_dC());
+}
+
+// Predict the time left in the cycle, from its timer
+time_ms_t Charge_Cycle::stage_time_remaining(void) {
+    return charging_time_remaining();
+}
+
+// Predict the time until the battery is fully charged
+time_ms_t Charge_Cycle::full_time_remaining(void) {
+    return ETA_UNKNOWN;
+}
+
+// Check whether the battery has reached the state of charge target
+bool Charge_Cycle::soc_target_reached(void) {
+    return (soc_target != 0) && (channel->soc.get_soc() >= soc_target);
+}
+
+// Check whether the reading the cycle ends on has levelled off
+bool Charge_Cycle::plateau_reached(int32_t reading, bool tracking) {
+    if (plateau_slope == 0) {
+        return false;
+    }
+    if (!tracking) {
+        // The regulator isn't holding the other reading yet, so this one
+        // is following the regulator rather than the battery
+        channel->trend.reset();
+        return false;
+    }
+    channel->trend.add(reading);
+    if (plateau_slope > 0) {
+        return channel->trend.slope_below(plateau_slope, plateau_sigmas);
+    } else {
+        return channel->trend.slope_above(plateau_slope, plateau_sigmas);
+    }
+}
+
+// Add the reading the cycle ends on to the time left prediction
+void Charge_Cycle::predict(uint32_t reading, bool tracking) {
+    if (tracking) {
+        channel->eta.add(reading);
+    } else {
+        channel->eta.reset();
+    }
+}
+
+// Check whether the readings have settled, ending the startup period early
+bool Charge_Cycle::readings_settled(voltage_mv_t battery_voltage, current_ma_t charging_current) {
+    if (settled || (startup_time_remaining() == 0)) {
+        return true;
+    }
+    settle_detector.add(battery_voltage, charging_current);
+    if (settle_detector.settled()) {
+        settled = true;
+        channel->print_label();
+        console.printf("Readings settled after %u s\n", (unsigned)(charging_time_elapsed() / SECOND_MS));
+    }
+    return settled;
+}
+
+// Start measuring the battery's internal resistance once per charging session
+void Charge_Cycle::measure_resistance(void) {
+    if ((channel->session.resistance_mohm != 0) || resistance_tried) {
+        return;
+    }
+    resistance_tried = true;
+    vreg.start_resistance();
+}
+
+// Carry on with an internal resistance measurement started by the cycle
+bool Charge_Cycle::resistance_pending(void) {
+    if (!vreg.measuring_resistance()) {
+        return false;
+    }
+    uint32_t resistance_mohm;
+    if (!vreg.update_resistance(resistance_mohm) && (resistance_mohm != 0)) {
+        channel->session.resistance_mohm = resistance_mohm;
+        channel->print_label();
+        console.printf("Battery internal resistance @ %u mOhm\n", resistance_mohm);
+    }
+    return true;
+}
+
+// Adjust regulator voltage to the current and voltage limits
+void Charge_Cycle::regulate(current_ma_t charging_current, voltage_mv_t battery_voltage,
+                            current_ma_t current_limit) {
+    // The battery reads higher than the voltage behind its internal
+    // resistance while charging, so allow for the drop across it.  This
+    // tapers off with the current, so the battery finishes at the target.
+    voltage_mv_t ir_drop = std::min(charging_current * channel->session.resistance_mohm / 1000,
+                                    IR_COMP_MAX_MV);
+
+    int32_t current_error = (int32_t)current_limit - (int32_t)charging_current;
+    int32_t voltage_error = (int32_t)(get_target_voltage() + ir_drop) - (int32_t)battery_voltage;
+
+    // Both loops start from the voltage applied last time, and the lower
+    // result wins, so neither winds up while the other one is in control
+    int32_t current_out = current_loop.update(current_error, set_voltage);
+    int32_t voltage_out = voltage_loop.update(voltage_error, set_voltage);
+    voltage_mv_t new_voltage = (voltage_mv_t)std::min(current_out, voltage_out);
+
+    // Only write the DAC when the setting changes
+    if (new_voltage != set_voltage) {
+        set_voltage = new_voltage;
+        vreg.set_voltage_mV(set_voltage);
+    }
+}
+
 // Update RGB LED status
 // Uses software timer 'led_timer' for managing on/off times
 void Charge_Cycle::status_led() {
@@ -201,6 +405,24 @@ void Charge_Cycle::status_led() {
     }
 }
 
+// Update any attached OLED display
+void Charge_Cycle::update_display(void) {
+    if (millis() - display_timer >= display_period) {
+        display_timer = millis();
+        if (oled_found) {
+            status_message(DISPLAY_OLED);
+        }
+    }
+}
+
+// Write a status message to the serial console
+void Charge_Cycle::update_console(void) {
+    if (millis() - message_timer >= message_period) {
+        message_timer = millis();
+        status_message(DISPLAY_CONSOLE);
+    }
+}
+
 // Calculate powers of 10 using integer math
 uint32_t pow10(uint8_t exponent) {
     // Limit the maximum exponent to prevent overflow
@@ -242,31 +464,84 @@ void milliunits_to_string(uint32_t milliunits, uint8_t places, char *buffer, uin
     snprintf(buffer, buffer_len, "%d.%0*d", whole, places, fractional);
 }
 
+// Utility: Convert a predicted time left to a string, "-" if unknown
+// and "done" once the reading has reached its target
+void eta_to_string(time_ms_t eta_ms, char *buffer) {
+    if (eta_ms == ETA_UNKNOWN) {
+        strcpy(buffer, "-");
+    } else if (eta_ms == 0) {
+        strcpy(buffer, "done");
+    } else {
+        ms_to_hms_str(eta_ms, buffer);
+    }
+}
+
 /*
  * Write status information to serial console when a charging cycle is in
  * startup and running states.
  *
  * Console message format:
  * 
- *  <title_str>, HH:MM:SS, xx.x, xx.x, xxxx
+ *  <title_str>, HH:MM:SS, xx.x, xx.x, xxxx, sss, HH:MM:SS, HH:MM:SS
  * 
  * OLED display format, which is sized to simulate a 16x2 character display:
  * 
  *  0123456789012345
  *  TTTTTT  HH:MM:SS
- *  xx.x V   xxxx mA
+ *  xx.x sss%  xxxx mA
  *
  *  TTTTTT = Charge cycle title to be displayed
+ *  sss = Estimated state of charge (%)
+ *
+ * The console messages end with the predicted time left in the cycle and
+ * until the battery is full ("-" if it can't be predicted, "done" once
+ * reached).  The OLED display swaps the elapsed time for the time to full
+ * ("-H:MM:SS", or "Full") every `ETA_DISPLAY_MS`, when it can be predicted.
+ *
+ * With more than one battery channel, console messages start with the
+ * battery number ("Battery 2: ") and the title with the battery number.
+ *
+ * Built with `TELEMETRY_BINARY`, the console message is sent as a binary
+ * `telemetry_status_t` record instead (see telemetry.h).
  */
 void Charge_Cycle::status_message(display_t device) {
     // Retrieve charging parameters
-    current_ma_t charging_current = (uint32_t)(rb_charging_current.average());
-    voltage_mv_t battery_voltage_mV = battery.get_voltage_average_mV();
+    current_ma_t charging_current = (uint32_t)(channel->current_history.average());
+    voltage_mv_t battery_voltage_mV = channel->battery.get_voltage_average_mV();
     voltage_mv_t bus_voltage_mV = vreg.get_voltage_mV();
+    uint8_t soc = channel->soc.get_soc();
+    time_ms_t stage_left = stage_time_remaining();
+    time_ms_t full_left = full_time_remaining();
+
+    // Binary telemetry replaces the console message, with no formatting
+    if ((device == DISPLAY_CONSOLE) && TELEMETRY_BINARY) {
+        telemetry_status_t record = {
+            .type = TELEMETRY_STATUS,
+            .battery = (uint8_t)((BATTERY_CHANNELS > 1) ? channel->number() : 0),
+            .state = (uint8_t)channel->state,
+            .soc = soc,
+            .time_ms = millis(),
+            .elapsed_ms = charging_time_elapsed(),
+            .bus_mV = (uint16_t)bus_voltage_mV,
+            .battery_mV = (uint16_t)battery_voltage_mV,
+            .current_mA = (uint16_t)charging_current,
+            .set_mV = (uint16_t)set_voltage,
+            .dac_level = vreg.get_dac_level(),
+            .stage_left_ms = stage_left,
+            .full_left_ms = full_left,
+        };
+        telemetry_send(&record, sizeof(record));
+        return;
+    }
     
     // Get elapsed time as a string (HH:MM:SS)
     ms_to_hms_str(charging_time_elapsed(), hms_str);
 
+    // Get the predicted times left as strings (HH:MM:SS, "-" or "done")
+    char stage_str[10], full_str[10];
+    eta_to_string(stage_left, stage_str);
+    eta_to_string(full_left, full_str);
+
     // Get battery voltage as a string (xx.x)
     milliunits_to_string(battery_voltage_mV, 1, bv_str, sizeof(bv_str));
 
@@ -277,28 +552,40 @@ void Charge_Cycle::status_message(display_t device) {
         case DISPLAY_NONE:      // No display present
             break;
         case DISPLAY_CONSOLE:   // Serial console
-            Serial.printf("%s, %s, %s, %s, %u\n", name_str, hms_str, ov_str, bv_str, charging_current);
+            channel->print_label();
+            console.printf("%s, %s, %s, %s, %u, %u, %s, %s\n", name_str, hms_str, ov_str, bv_str,
+                          charging_current, soc, stage_str, full_str);
             break;
         case DISPLAY_OLED:      // OLED display
             // Write message to OLED display if present
             // Assumes display is configured for the default 8x16 proportional font
-            // Note: OLED display is cleared at the start of charging cycle
+            // Only the changed parts of the status screen are redrawn
             if (oled_found) {
-                oled.clear();
-                oled.setCursor(0,0);
-                oled.printf("%s", title_str);
-                oled.setCursor(64,0);
-                oled.printf("%s", hms_str);
-                oled.setCursor(0,2);
-                oled.printf("%s V", bv_str);
-                oled.setCursor(64,2);
-                oled.printf("%u mA", charging_current);
-                oled.switchFrame();
+                if (BATTERY_CHANNELS > 1) {
+                    status_screen.set_field(STATUS_TITLE, "%u %s", channel->number(), title_str);
+                } else {
+                    status_screen.set_field(STATUS_TITLE, "%s", title_str);
+                }
+                if ((full_left == 0) && ((millis() / ETA_DISPLAY_MS) % 2)) {
+                    status_screen.set_field(STATUS_TIME, "%s", "Full");
+                } else if ((full_left != ETA_UNKNOWN) && ((millis() / ETA_DISPLAY_MS) % 2)) {
+                    hms_time_t hms = ms_to_hms_time(full_left);
+                    if (hms.hours < 10) {
+                        status_screen.set_field(STATUS_TIME, "-%u:%02u:%02u", hms.hours, hms.mins, hms.secs);
+                    } else {
+                        status_screen.set_field(STATUS_TIME, "-%u:%02u", hms.hours, hms.mins);
+                    }
+                } else {
+                    status_screen.set_field(STATUS_TIME, "%s", hms_str);
+                }
+                status_screen.set_field(STATUS_VOLTAGE, "%s %u%%", bv_str, soc);
+                status_screen.set_field(STATUS_CURRENT, "%u mA", charging_current);
+                status_screen.update();
             } else {
-                Serial.printf("Error: OLED status was requested, but display not present\n");
+                console.printf("Error: OLED status was requested, but display not present\n");
             }
             break;
         default:                // Unknown device
-            Serial.printf("Error: Unknown display device %d\n", int(device));
+            console.printf("Error: Unknown display device %d\n", int(device));
     }
 }
@@ -22,6 +22,11 @@
  * will stop automatically and the state will be set to the 'TIMEOUT'
  * value.
  *
+ * The RGB LED, OLED display and console status messages for the running
+ * cycle are updated by their own tasks in `loop()` (see tasks.h), through
+ * `status_led()`, `update_display()` and `update_console()`, so run()
+ * only has to manage the charging.
+ *
  * A typical charge cycle would be as follows:
  * 1. Create new charging object with appropriate settings
  * 2. Call start method once to begin a charge cycle
@@ -43,14 +48,25 @@
 #include "battery.h"
 #include "rgbled.h"
 #include "utility.h"
+#include "pid.h"
+#include "temperature.h"
+#include "settle.h"
+#include "eta.h"
 #include <stm32_time.h>
 
 // OLED display support
 #include <STM32_4kOLED.h>
+#include "status_screen.h"
 
 // Ring buffer
 #include <ringbuffer.h>
 
+const time_ms_t PLATEAU_INTERVAL_MS = MINUTE_MS;    ///< Time each average in the plateau window covers
+const uint8_t PLATEAU_SAMPLES = 20;                 ///< Averages in the plateau window (20 minutes)
+const time_ms_t ETA_DISPLAY_MS = 10*SECOND_MS;      ///< Time the OLED shows the elapsed time, then the time to full, for
+
+class Charge_Channel;
+
 /**
  *  @brief Charging parameters structure used to initialize `Charge_Cycle` objects
  *         and it's derived classes.
@@ -59,7 +75,12 @@ struct charge_parm_t {
     current_ma_t current_target;            ///< Target charging current
     current_ma_t current_max;               ///< Maximum charging current
     voltage_mv_t voltage_target;            ///< Target battery voltage
-    voltage_mv_t voltage_step;              ///< Step size for adjusting voltage
+    uint8_t soc_target;                     ///< Estimated state of charge ending the cycle (%, 0=none)
+    int16_t plateau_slope;                  ///< Slope of the reading ending the cycle once it levels off (per hour, 0=none)
+    uint8_t plateau_sigmas;                 ///< Standard errors the slope must be past `plateau_slope` by
+    int8_t temp_comp_mv;                    ///< Voltage target temperature compensation (mV/C per cell)
+    pid_gains_t current_gains;              ///< Regulator gains limiting current (mV per mA)
+    pid_gains_t voltage_gains;              ///< Regulator gains holding battery voltage (mV per mV)
     time_ms_t charge_period_max;            ///< Maximum allowable cycle time
     time_ms_t startup_period;               ///< Startup time period
     time_ms_t led_on_period;                ///< Status LED on time while charging
@@ -84,12 +105,23 @@ struct charge_parm_t {
  * bad battery that won't take a charge.  The `FAST_STARTUP_MS` time provides
  * a delay to allow any surface charge voltage to dissipate before making
  * the decision to end fast charging.
+ *
+ * A battery whose voltage stops rising at constant current within
+ * `FAST_PLATEAU_DONE_MV` of the target is full, and fast charging ends as
+ * if it had reached the target.  One that stops well short of the target
+ * (e.g. one with a soft-shorted cell) is treated as timed-out as soon as
+ * that's seen, rather than charging on to the timeout.
  */
 const charge_parm_t FAST_PARMS = { 
     .current_target = BATTERY_CAPACITY/7,   // @14% capacity
     .current_max = 600,                     // 600 mA due to regulator temp rise
     .voltage_target = 14400,
-    .voltage_step = 10,
+    .soc_target = 0,                        // Ends on voltage
+    .plateau_slope = 20,                    // Or once the voltage stops rising (mV/h)
+    .plateau_sigmas = 3,
+    .temp_comp_mv = -3,                     // -18 mV/C for 6 cells
+    .current_gains = { .kp = 13, .ki = 61, .kd = 0 },
+    .voltage_gains = { .kp = 512, .ki = 102, .kd = 0 },
     .charge_period_max = 4*HOUR_MS,
     .startup_period = 60*SECOND_MS,
     .led_on_period = 250,
@@ -106,14 +138,21 @@ const charge_parm_t FAST_PARMS = {
  * 
  * @details
  * Sets the voltage regulator to a constant voltage and maintains it until the
- * charging current drops below 5% of battery capacity.  The recommended voltage
+ * charging current drops below 5% of battery capacity, the current stops
+ * tapering, or the estimated state of charge reaches 100% (e.g. an older
+ * battery whose current doesn't taper).  The recommended voltage
  * range is 2.30V to 2.35V/cell for maximum service life.
  */
 const charge_parm_t TOP_PARMS = { 
     .current_target = BATTERY_CAPACITY/20,  // @5% capacity
     .current_max = 600,                     // 600 mA due to regulator temp rise
     .voltage_target = 14000,                // 14.0V => 2.33V/cell
-    .voltage_step = 10,
+    .soc_target = 100,                      // Or once the battery is full
+    .plateau_slope = -20,                   // Or once the current stops falling (mA/h)
+    .plateau_sigmas = 3,
+    .temp_comp_mv = -3,
+    .current_gains = { .kp = 13, .ki = 61, .kd = 0 },
+    .voltage_gains = { .kp = 512, .ki = 102, .kd = 0 },
     .charge_period_max = 8*HOUR_MS,
     .startup_period = 120*SECOND_MS,
     .led_on_period = 250,
@@ -137,7 +176,12 @@ const charge_parm_t TRCKL_PARMS = {
     .current_target = 0,                    // Not applicable for trickle charging
     .current_max = 600,                     // 600 mA due to regulator temp rise
     .voltage_target = 13500,
-    .voltage_step = 10,
+    .soc_target = 0,                        // Ends on the timer
+    .plateau_slope = 0,
+    .plateau_sigmas = 0,
+    .temp_comp_mv = -3,
+    .current_gains = { .kp = 13, .ki = 61, .kd = 0 },
+    .voltage_gains = { .kp = 512, .ki = 102, .kd = 0 },
     .charge_period_max = 8*HOUR_MS,
     .startup_period = 0,                    // Ignored for trickle charging
     .led_on_period = 250,
@@ -149,6 +193,66 @@ const charge_parm_t TRCKL_PARMS = {
     .message_period = 60000,
 };
 
+/**
+ * @brief Conditioning (desulfation) parameters
+ *
+ * @details
+ * Pulses the battery towards 2.6V/cell at no more than 10% of battery
+ * capacity, once topping charging has finished, until the battery's
+ * response to the pulses stops rising (see condition.h).  Only run for a
+ * battery whose internal resistance shows it to be sulfated
+ * (`CONDITION_RESISTANCE_MOHM`).
+ */
+const charge_parm_t COND_PARMS = {
+    .current_target = 0,                    // Ends when the pulse response levels off
+    .current_max = BATTERY_CAPACITY/10,     // @10% capacity
+    .voltage_target = 15600,                // 15.6V => 2.6V/cell
+    .soc_target = 0,
+    .plateau_slope = 0,
+    .plateau_sigmas = 0,
+    .temp_comp_mv = -3,
+    .current_gains = { .kp = 13, .ki = 61, .kd = 0 },
+    .voltage_gains = { .kp = 512, .ki = 102, .kd = 0 },
+    .charge_period_max = 8*HOUR_MS,
+    .startup_period = 0,                    // Response compared over two periods anyway
+    .led_on_period = 250,
+    .led_off_period = 750,
+    .led_color = LED_PUR,
+    .title_str = "CONDTN",
+    .name_str = "Conditioning",
+    .display_period = 1000,
+    .message_period = 10000,
+};
+
+/**
+ * @brief Load test parameters
+ *
+ * @details
+ * Charges the battery by 10% of its capacity, at no more than 10% of
+ * capacity an hour, between two rests (see loadtest.h).  The voltage
+ * target only comes into play if the battery is fuller than it looked.
+ */
+const charge_parm_t LOAD_PARMS = {
+    .current_target = 0,                    // Ends on the charge delivered
+    .current_max = BATTERY_CAPACITY/10,     // @10% capacity
+    .voltage_target = 14400,
+    .soc_target = 0,
+    .plateau_slope = 0,
+    .plateau_sigmas = 0,
+    .temp_comp_mv = -3,
+    .current_gains = { .kp = 13, .ki = 61, .kd = 0 },
+    .voltage_gains = { .kp = 512, .ki = 102, .kd = 0 },
+    .charge_period_max = 3*HOUR_MS,
+    .startup_period = 0,                    // Rests first anyway
+    .led_on_period = 500,
+    .led_off_period = 500,
+    .led_color = LED_WHT,
+    .title_str = "LDTEST",
+    .name_str = "Load test",
+    .display_period = 1000,
+    .message_period = 10000,
+};
+
 /**
  * @brief Standby mode parameters
  * 
@@ -165,7 +269,12 @@ const charge_parm_t STANDBY_PARMS = {
     .current_target = 0,                        // Regulator turned-off
     .current_max = 0,
     .voltage_target = 0,                        
-    .voltage_step = 0,
+    .soc_target = 0,
+    .plateau_slope = 0,
+    .plateau_sigmas = 0,
+    .temp_comp_mv = 0,
+    .current_gains = { .kp = 0, .ki = 0, .kd = 0 },
+    .voltage_gains = { .kp = 0, .ki = 0, .kd = 0 },
     .charge_period_max = WEEK_MS,
     .startup_period = 0,                        // Ignored in standby mode
     .led_on_period = 250,                       // Short green pulse every minute
@@ -173,7 +282,7 @@ const charge_parm_t STANDBY_PARMS = {
     .led_color = LED_GRN_DRK,
     .title_str = "STNDBY",
     .name_str = "Standby",
-    .display_period = 1000,
+    .display_period = 1000,                     // Ignored, display is off in standby
     .message_period = 60000,
 };
 
@@ -205,8 +314,9 @@ public:
     /**
      *  @brief Constructor with initialization.
      *  @param p: Parameters to configure the charging cycle.
+     *  @param channel: Battery channel the cycle charges
      */
-    Charge_Cycle(charge_parm_t &p);
+    Charge_Cycle(charge_parm_t &p, Charge_Channel *channel);
 
     /** 
      *  @brief Virtual destructor to support inheritance (best practice).
@@ -218,17 +328,47 @@ public:
     /**
      *  @brief Initialize charging cycle handler.
      *  @param p: Charging parameters structure
+     *  @param channel: Battery channel the cycle charges
      *  @note Using `init` for the method name rather than `begin` to avoid 
      *      potential confusion with the `start` method used to start a new
      *       charging cycle.
      */
-    void init(const charge_parm_t &p);
+    void init(const charge_parm_t &p, Charge_Channel *channel);
 
     /**
      *  @brief Start a new charge cycle.
      *  @returns Nothing
+     *  @note Virtual function that may be extended by handlers with state
+     *        of their own to set up, calling this one first.
      */
-    void start(void);
+    virtual void start(void);
+
+    /**
+     *  @brief Pause the charging cycle while another battery has the regulator
+     *  @returns Nothing
+     *  @note The charging timer stops counting until `resume()`.  The
+     *        regulator is left alone, as the channel switches it off.
+     */
+    void pause(void);
+
+    /**
+     *  @brief Carry on with the charging cycle after the battery has been
+     *         switched out
+     *  @returns Nothing
+     *  @note Restarts the charging timer if the cycle was paused, and
+     *        soft starts the regulator again.
+     */
+    void resume(void);
+
+    /**
+     *  @brief Carry on with an internal resistance measurement started by
+     *         the cycle
+     *  @returns true=Measuring, so skip `run()` this pass and leave the
+     *           regulator alone, false=Run the cycle as usual
+     *  @note The pass the measurement finishes on is skipped as well, as
+     *        the regulator has only just been set back.
+     */
+    bool resistance_pending(void);
 
     /**
      *  @brief Run-time handler called periodically to manage charging cycle
@@ -256,6 +396,8 @@ public:
      *  @note Startup time is allowed at the beginning of a charging
      *        cycle to allow parameters to stabilize before deciding
      *        if the target criteria for the cycle have been reached.
+     *        It ends early once the readings have settled, see
+     *        `readings_settled()`.
      */
     time_ms_t startup_time_remaining(void);
 
@@ -273,15 +415,79 @@ public:
      */
     time_ms_t charging_time_elapsed(void);
 
+    /**
+     *  @brief Gets the battery voltage target, compensated for temperature
+     *  @returns Voltage target (mV)
+     */
+    voltage_mv_t get_target_voltage(void);
+
+    /**
+     *  @brief Predict the time left in the cycle
+     *  @returns Time left (ms), or `ETA_UNKNOWN`
+     *  @note Cycles ending on a timer return the time left on it.  Cycles
+     *        ending on a reading override this to extrapolate the reading
+     *        to its target.
+     */
+    virtual time_ms_t stage_time_remaining(void);
+
+    /**
+     *  @brief Predict the time until the battery is fully charged, at the
+     *         end of topping charging
+     *  @returns Time left (ms), 0 once full, or `ETA_UNKNOWN`
+     */
+    virtual time_ms_t full_time_remaining(void);
+
+    /** 
+     *  @brief Update the status of the RGB LED, based on the color and
+     *         timing criteria specified for the current cycle.
+     *  @returns Nothing
+     *  @note Called by the LED task in `loop()` while the cycle is running.
+     *        Virtual function that may be extended by handlers that act
+     *        on the LED pulses.
+     */
+    virtual void status_led(void);
+
+    /**
+     *  @brief Update any attached OLED display, every `display_period`
+     *  @returns Nothing
+     *  @note Called by the display task in `loop()` while the cycle is
+     *        running.  Virtual function that may be overridden by handlers
+     *        that switch the display off.
+     */
+    virtual void update_display(void);
+
+    /**
+     *  @brief Write a status message to the serial console, every
+     *         `message_period`
+     *  @returns Nothing
+     *  @note Called by the console task in `loop()` while the cycle is
+     *        running.
+     */
+    void update_console(void);
+
 protected:
     // Charging settings
     voltage_mv_t target_voltage;            ///< Target battery voltage to be achieved (mV).
-    voltage_mv_t step_voltage;              ///< Step size used for adjusting regulator voltage (mV).
     current_ma_t target_current;            ///< Target current to be used for charging battery (mA).
     current_ma_t max_current;               ///< Maximum current to be used for charging battery (mA).
+    uint8_t soc_target;                     ///< Estimated state of charge ending the cycle (%, 0=none).
+    int16_t plateau_slope;                  ///< Slope of the reading ending the cycle once it levels off (per hour, 0=none).
+    uint8_t plateau_sigmas;                 ///< Standard errors the slope must be past `plateau_slope` by.
+    int8_t temp_comp_mv;                    ///< Voltage target temperature compensation (mV/C per cell).
+
+    // Regulator control loops
+    PID_Controller current_loop;            ///< Limits charging current (mA error to mV).
+    PID_Controller voltage_loop;            ///< Holds battery voltage (mV error to mV).
+
+    // Battery channel
+    Charge_Channel *channel;                ///< Battery channel the cycle charges
 
     // Hardware alarm timers
     alarm_id_t charge_timer_id;             ///< Hardware charging timer ID provided by the `Alarm_Pool`.
+    bool paused;                            ///< Charging timer stopped by `pause()`?
+    bool resistance_tried;                  ///< Internal resistance measurement tried this cycle?
+    time_ms_t paused_remaining;             ///< Charging time remaining when paused (ms).
+    time_ms_t elapsed_offset;               ///< Charging time elapsed before the timer was last set (ms).
 
     // Software timers
     time_ms_t display_timer;                ///< Timer for OLED display updates
@@ -293,6 +499,7 @@ protected:
     time_ms_t message_period;               ///< Time period between console status messages (ms).
     time_ms_t charge_period_max;            ///< Maximum time period allowed for the cycle to complete (ms).
     time_ms_t startup_period;               ///< Time period to allow at start of the cycle for things to stabilize (ms).
+    bool settled;                           ///< Readings settled before the end of the startup period?
 
     // RGB LED settings
     bool led_state;                         ///< RGB LED state (true=on, false=off)
@@ -316,12 +523,88 @@ protected:
 
     // Private functions
 
-    /** 
-     *  @brief Update the status of the RGB LED, based on the color and
-     *         timing criteria specified for the current cycle.
+    /**
+     *  @brief Check whether the battery has reached the cycle's state of
+     *         charge target
+     *  @returns true=Target reached, false=Not reached or no target
+     */
+    bool soc_target_reached(void);
+
+    /**
+     *  @brief Check whether the reading the cycle ends on has levelled off
+     *  @param reading: Battery voltage (mV) or charging current (mA)
+     *  @param tracking: true=The reading is being held by the battery
+     *         (e.g. the voltage at constant current), false=Start the
+     *         window again
+     *  @returns true=The slope of the reading is past the cycle's
+     *           `plateau_slope` by `plateau_sigmas` standard errors
+     *  @note A positive `plateau_slope` is for a rising reading, ending
+     *        the cycle once the slope falls below it, and a negative one
+     *        for a falling reading, ending the cycle once the slope rises
+     *        above it.
+     */
+    bool plateau_reached(int32_t reading, bool tracking);
+
+    /**
+     *  @brief Check whether the readings have settled during the startup
+     *         period, ending it early
+     *  @param battery_voltage: Battery voltage (mV)
+     *  @param charging_current: Charging current (mA)
+     *  @returns true=Settled, and the startup period is over
+     *  @note Called by cycles with a startup period on each `run()`.
+     */
+    bool readings_settled(voltage_mv_t battery_voltage, current_ma_t charging_current);
+
+    /**
+     *  @brief Add the reading the cycle ends on to the time left prediction
+     *  @param reading: Battery voltage (mV) or charging current (mA)
+     *  @param tracking: true=The reading is being held by the battery,
+     *         false=Start the prediction again
+     *  @returns Nothing
+     */
+    void predict(uint32_t reading, bool tracking);
+
+    /**
+     *  @brief Start measuring the battery's internal resistance, if it
+     *         hasn't been measured yet this charging session
+     *  @returns Nothing
+     *  @note Tried once per cycle, after the startup period, so a battery
+     *        whose current is too low to measure isn't stepped every loop.
+     *        The measurement runs over the next passes, instead of `run()`
+     *        (see `resistance_pending()`).
+     */
+    void measure_resistance(void);
+
+    /**
+     *  @brief Turn the regulator on just below the battery voltage, or off
+     *         in standby, and reset the control loops to match
      *  @returns Nothing
      */
-    void status_led(void);
+    void soft_start(void);
+
+    /**
+     *  @brief Switch the OLED display on, redrawing the status screen, or
+     *         off in standby
+     *  @returns Nothing
+     */
+    void show_display(void);
+
+    /**
+     *  @brief Adjust the regulator voltage to hold the charging current at
+     *         or below the limit and the battery voltage at or below the target
+     *  @param charging_current: Charging current reading (mA)
+     *  @param battery_voltage: Battery voltage reading (mV)
+     *  @param current_limit: Charging current limit (mA)
+     *  @returns Nothing
+     *  @note Constant current and constant voltage PI loops both work on the
+     *        regulator set voltage, and the lower of the two is applied, so
+     *        whichever limit is reached first takes over.  The voltage
+     *        target is compensated for temperature, and once the battery's
+     *        internal resistance is known, the voltage target is raised by
+     *        the drop across it (up to `IR_COMP_MAX_MV`).
+     */
+    void regulate(current_ma_t charging_current, voltage_mv_t battery_voltage,
+                  current_ma_t current_limit);
 
     /**
      *  @brief Write status information for the current charging cycle to the
@@ -361,4 +644,14 @@ uint32_t pow10(uint8_t exponent);
  */
 void milliunits_to_string(uint32_t milliunits, uint8_t places, char *buffer, uint8_t buffer_len);
 
+/**
+ * @brief Utility function to convert a predicted time left to a string
+ * @param eta_ms: Time left (ms), or `ETA_UNKNOWN`
+ * @param buffer: Buffer to hold the string, at least 10 characters
+ * @returns Nothing
+ * @note The time is formatted by `ms_to_hms_str()`, or "-" if unknown,
+ *       and "done" if 0.
+ */
+void eta_to_string(time_ms_t eta_ms, char *buffer);
+
 #endif
\ No newline at end of file
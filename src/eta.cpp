@@ -0,0 +1,135 @@
+/**
+ * @file eta.cpp
+ * @brief Predicts the time left in a charging cycle from its readings
+ *
+ * Copyright(c) 2025  John Glynn
+ *
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ */
+
+#include "eta.h"
+
+// Base-2 logarithm in fixed point
+// The integer part is the position of the top bit.  The value is then
+// scaled to [1, 2) with 30 fraction bits, and squared once for each bit of
+// the fraction: a square of 2 or more means that bit is set.
+int32_t log2_fixed(uint32_t value) {
+    if (value == 0) {
+        return 0;
+    }
+    int32_t whole = 31 - __builtin_clz(value);
+    uint64_t m = (whole <= 30) ? ((uint64_t)value << (30 - whole)) : ((uint64_t)value >> 1);
+    int32_t result = whole << ETA_LOG_BITS;
+    for (int32_t bit = ETA_LOG_BITS - 1; bit >= 0; bit--) {
+        m = (m * m) >> 30;
+        if (m >= (1ULL << 31)) {
+            m >>= 1;
+            result |= 1 << bit;
+        }
+    }
+    return result;
+}
+
+// Default constructor
+ETA_Estimator::ETA_Estimator(void) {
+    begin(false, true);
+}
+
+// Choose how the reading is fitted, and empty the fit
+void ETA_Estimator::begin(bool logarithmic, bool rising) {
+    ETA_Estimator::logarithmic = logarithmic;
+    ETA_Estimator::rising = rising;
+    reset();
+}
+
+// Empty the fit
+void ETA_Estimator::reset(void) {
+    count = 0;
+    origin = 0;
+    sum_w = 0;
+    sum_x = 0;
+    sum_xx = 0;
+    sum_y = 0;
+    sum_xy = 0;
+    sum = 0;
+    sum_count = 0;
+    sum_start = millis();
+}
+
+// Convert a reading to the fitted scale
+int32_t ETA_Estimator::scale(uint32_t value) {
+    return logarithmic ? log2_fixed(value) : (int32_t)value;
+}
+
+// Add a reading
+// Readings are averaged over the interval.  Each average moves the earlier
+// ones an interval further back (x - 1), fades them by the forgetting
+// factor, and joins them at x = 0.
+void ETA_Estimator::add(uint32_t value) {
+    sum += value;
+    sum_count++;
+    if (millis() - sum_start < ETA_INTERVAL_MS) {
+        return;
+    }
+    int32_t y = scale((uint32_t)(sum / sum_count));
+    sum = 0;
+    sum_count = 0;
+    sum_start = millis();
+
+    if (count == 0) {
+        origin = y;
+    }
+    y -= origin;
+
+    // Move back an interval: sum(w.(x-1)^2) = sum_xx - 2.sum_x + sum_w
+    sum_xx += sum_w - 2 * sum_x;
+    sum_x -= sum_w;
+    sum_xy -= sum_y;
+
+    // Fade by 1 - 2^-ETA_SHIFT
+    sum_w -= sum_w >> ETA_SHIFT;
+    sum_x -= sum_x / (1 << ETA_SHIFT);
+    sum_xx -= sum_xx >> ETA_SHIFT;
+    sum_y -= sum_y / (1 << ETA_SHIFT);
+    sum_xy -= sum_xy / (1 << ETA_SHIFT);
+
+    // Join at x = 0, adding nothing to the sums with x in them
+    sum_w += ETA_WEIGHT;
+    sum_y += ETA_WEIGHT * y;
+
+    if (count < ETA_MIN_AVERAGES) {
+        count++;
+    }
+}
+
+// Check whether there are enough averages for a prediction
+bool ETA_Estimator::ready(void) {
+    return count >= ETA_MIN_AVERAGES;
+}
+
+// Predict the time for the reading to reach a target
+// The weighted least-squares line has a slope (per interval, 8 fraction
+// bits) of (W.Sxy - Sx.Sy) / (W.Sxx - Sx^2) and a value at the latest
+// average of (Sy - slope.Sx) / W.  A fitted value already at or past the
+// target, in the direction the reading moves to reach it, is done.
+time_ms_t ETA_Estimator::time_to(uint32_t target) {
+    if (!ready()) {
+        return ETA_UNKNOWN;
+    }
+    int64_t den = sum_w * sum_xx - sum_x * sum_x;
+    if (den <= 0) {
+        return ETA_UNKNOWN;
+    }
+    int64_t slope_q8 = ((sum_w * sum_xy - sum_x * sum_y) * 256) / den;
+    int64_t value = (sum_y - (slope_q8 * sum_x) / 256) / sum_w;
+    int64_t distance = (int64_t)scale(target) - origin - value;
+    if (rising ? (distance <= 0) : (distance >= 0)) {
+        return 0;
+    }
+    if ((slope_q8 == 0) || ((distance < 0) != (slope_q8 < 0))) {
+        return ETA_UNKNOWN;
+    }
+    int64_t time = distance * 256 * ETA_INTERVAL_MS / slope_q8;
+    return (time >= (int64_t)ETA_UNKNOWN) ? ETA_UNKNOWN : (time_ms_t)time;
+}
@@ -0,0 +1,119 @@
+/**
+ * @file eta.h
+ * @brief Predicts the time left in a charging cycle from its readings
+ *
+ * Copyright(c) 2025  John Glynn
+ *
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ *
+ * @details
+ * Each charging cycle ends on a reading crossing its target: fast charging
+ * on the battery voltage rising to the target, and topping charging on the
+ * charging current tapering down to it.  `ETA_Estimator` fits a line to the
+ * reading and extrapolates it to the target, giving the time left.
+ *
+ * The current tapers off roughly exponentially at constant voltage, so for
+ * topping charging the line is fitted to the base-2 logarithm of the
+ * current (in fixed point, `ETA_LOG_BITS` fraction bits), making the taper
+ * a straight line.
+ *
+ * Readings are averaged over each `ETA_INTERVAL_MS`, and each average
+ * updates a recursive least-squares fit with a forgetting factor of
+ * 1 - 2^-`shift`, so older averages count for less and the fit follows the
+ * curve of the reading.  The fit keeps five weighted sums, with times
+ * measured back from the latest average so the sums stay bounded however
+ * long the cycle runs.  Each average takes a few multiplies, with no
+ * history kept or fitted again.
+ */
+#ifndef _ETA_H_
+#define _ETA_H_
+
+#include "obcharger.h"
+
+const time_ms_t ETA_INTERVAL_MS = 10*SECOND_MS;     ///< Time each average covers
+const uint8_t ETA_SHIFT = 7;                        ///< Forgetting factor 1 - 2^-ETA_SHIFT per average (about 21 minutes)
+const uint8_t ETA_MIN_AVERAGES = 6;                 ///< Averages before a prediction is made
+const uint8_t ETA_LOG_BITS = 12;                    ///< Fraction bits of the logarithm of the reading
+const int64_t ETA_WEIGHT = 64;                      ///< Weight of the latest average in the sums
+const time_ms_t ETA_UNKNOWN = UINT32_MAX;           ///< Time left that can't be predicted
+
+/**
+ *  @brief Get the base-2 logarithm of a value
+ *  @param value: Value (greater than zero)
+ *  @returns log2(value), with `ETA_LOG_BITS` fraction bits (0 for 0)
+ */
+int32_t log2_fixed(uint32_t value);
+
+/**
+ *  @brief Predicts the time for a reading to reach its target
+ */
+class ETA_Estimator {
+public:
+    /// @brief Default constructor
+    ETA_Estimator(void);
+
+    /**
+     *  @brief Choose how the reading is fitted, and empty the fit
+     *  @param logarithmic: true=Fit the logarithm of the reading, for a
+     *         reading tapering off exponentially
+     *  @param rising: true=The reading rises to its target, false=It falls
+     *  @returns Nothing
+     */
+    void begin(bool logarithmic, bool rising);
+
+    /**
+     *  @brief Empty the fit, e.g. when the reading is interrupted
+     *  @returns Nothing
+     */
+    void reset(void);
+
+    /**
+     *  @brief Add a reading
+     *  @param value: Reading
+     *  @returns Nothing
+     *  @note Called every `LOOP_DELAY`, the fit is updated once each
+     *        `ETA_INTERVAL_MS`.
+     */
+    void add(uint32_t value);
+
+    /**
+     *  @brief Check whether there are enough averages for a prediction
+     *  @returns true=Ready
+     */
+    bool ready(void);
+
+    /**
+     *  @brief Predict the time for the reading to reach a target
+     *  @param target: Target reading
+     *  @returns Time left (ms), 0 if the fitted reading has already
+     *           reached or passed the target, or `ETA_UNKNOWN` if the fit
+     *           isn't ready or is heading away from the target
+     */
+    time_ms_t time_to(uint32_t target);
+
+private:
+    bool logarithmic;                       ///< Fitting the logarithm of the reading?
+    bool rising;                            ///< Reading rises to its target?
+    uint8_t count;                          ///< Averages in the fit, up to `ETA_MIN_AVERAGES`
+    int32_t origin;                         ///< Reading the sums are measured from
+
+    int64_t sum_w;                          ///< Sum of the weights
+    int64_t sum_x;                          ///< Sum of weight x time (averages back from the latest)
+    int64_t sum_xx;                         ///< Sum of weight x time^2
+    int64_t sum_y;                          ///< Sum of weight x reading
+    int64_t sum_xy;                         ///< Sum of weight x time x reading
+
+    int64_t sum;                            ///< Sum of the readings for the next average
+    uint16_t sum_count;                     ///< Readings in the sum
+    time_ms_t sum_start;                    ///< millis() time the sum was started
+
+    /**
+     *  @brief Convert a reading to the fitted scale
+     *  @param value: Reading
+     *  @returns Reading, or its logarithm
+     */
+    int32_t scale(uint32_t value);
+};
+
+#endif
@@ -8,27 +8,35 @@
  * See the LICENSE file for the full license text.
  */
 #include "fast.h"
+#include "channel.h"
+#include "console.h"
 
 //
 // Global variables
 //
 extern Alarm_Pool timer_pool;               // Hardware timers
 extern Vreg vreg;                           // Voltage regulator
-extern Battery battery;                     // Battery
-extern bool oled_found;                     // OLED display found at startup in main()?
+extern Console_TX console;                  // Serial console output
 
 // Default constructor
 Fast_Charger::Fast_Charger() : Charge_Cycle() {
+    last_end_soc = 0;
 }
 
 // Constructor with initialization
-Fast_Charger::Fast_Charger(charge_parm_t &p) : Charge_Cycle(p) {
-    init(p);
+Fast_Charger::Fast_Charger(charge_parm_t &p, Charge_Channel *channel) : Charge_Cycle(p, channel) {
+    last_end_soc = 0;
 }
 
 // Destructor (best practice)
 Fast_Charger::~Fast_Charger() {};
 
+// Start a new fast charging cycle
+void Fast_Charger::start(void) {
+    Charge_Cycle::start();
+    channel->eta.begin(false, true);
+}
+
 // Run-time handler to manage charge cycle
 cycle_state_t Fast_Charger::run() {
     // Are we still in startup state?
@@ -47,14 +55,17 @@ cycle_state_t Fast_Charger::run() {
 
     // Get voltage and current readings
     current_ma_t charging_current = vreg.get_current_mA();
-    voltage_mv_t battery_voltage = battery.get_voltage_mV();
-
-    // Check for excessive set voltage level
-    if (set_voltage > VREG_VOLTAGE_MAX) {
-        Serial.printf("Error: Set voltage level at %u millivolts\n", set_voltage);
-        set_voltage = VREG_VOLTAGE_MAX;
-        Serial.printf("Cutting set voltage back to %u millivolts now!\n", set_voltage);
-        vreg.set_voltage_mV(set_voltage);
+    voltage_mv_t battery_voltage = channel->battery.get_voltage_mV();
+
+    // The voltage rises towards the target while the current is held at
+    // the limit
+    current_ma_t current_limit = std::min(target_current, max_current);
+    bool constant_current = (charging_current + current_limit / 10 >= current_limit);
+    predict(battery_voltage, constant_current);
+
+    // Startup ends early once the readings have settled
+    if ((state_code == CYCLE_STARTUP) && readings_settled(battery_voltage, charging_current)) {
+        state_code = CYCLE_RUNNING;
     }
 
     // Fast charging cycle is complete if:
@@ -62,57 +73,42 @@ cycle_state_t Fast_Charger::run() {
     // (2) we've passed the startup delay period
     // The startup delay prevents premature completion due to surface charge
     // present on the battery when the cycle starts.
-    if ((state_code != CYCLE_STARTUP) && (battery_voltage >= target_voltage)) {
+    if ((state_code != CYCLE_STARTUP) && (battery_voltage >= get_target_voltage())) {
         // Yes, turn regulator off and return
+        last_end_soc = channel->soc.get_soc();
         stop();
         state_code = CYCLE_DONE;
         return state_code;
     }
 
-    // Target voltage not reached, check and adjust voltage as needed
-    // Don't allow the battery voltage to exceed the target voltage, even
-    // if we're in the startup period.
-    if (charging_current > max_current) {
-        // Charging current is too high, drop voltage
-        set_voltage -= step_voltage;
-    } else {
-        // Charging current below max, keep it above the target current
-        if (charging_current < target_current) {
-            // Charging current below the target, tweak voltage up
-            // as long as we're below the target voltage
-            if (battery_voltage < target_voltage) {
-                // Voltage is ok, tweak it up
-                set_voltage += step_voltage;
-            } else {
-                // Voltage is above target, tweak it back
-                set_voltage -= step_voltage;
-            }
+    // The battery voltage has stopped rising while the current is held at
+    // the limit, so it will never reach the target.  Close to the target
+    // that's the battery filling up, and it moves on to topping charging;
+    // well short of it, something's wrong (e.g. a soft-shorted cell), so
+    // give up now rather than at the timeout.
+    if ((state_code != CYCLE_STARTUP) && plateau_reached(battery_voltage, constant_current)) {
+        char slope_str[12];
+        snprintf(slope_str, sizeof(slope_str), "%+d", (int)channel->trend.slope_per_hour());
+        channel->print_label();
+        console.printf("Battery voltage levelled off @ %s mV/h\n", slope_str);
+        stop();
+        if (battery_voltage + FAST_PLATEAU_DONE_MV >= get_target_voltage()) {
+            last_end_soc = channel->soc.get_soc();
+            state_code = CYCLE_DONE;
+        } else {
+            state_code = CYCLE_TIMEOUT;
         }
+        return state_code;
     }
 
-    // Ensure set voltage is below the maximum limit
-    if (set_voltage > VREG_VOLTAGE_MAX) {
-        set_voltage = VREG_VOLTAGE_MAX;
-    }
-
-    // Set the regulator voltage
-    vreg.set_voltage_mV(set_voltage);
+    // Target voltage not reached, hold the charging current at the target
+    // (or maximum, if lower).  Don't allow the battery voltage to exceed the
+    // target voltage, even if we're in the startup period.
+    regulate(charging_current, battery_voltage, current_limit);
 
-    // Update RGB LED status as needed
-    status_led();
-
-    // Update any attached OLED displays
-    if (millis() - display_timer >= display_period) {
-        display_timer = millis();
-        if (oled_found) {
-            status_message(DISPLAY_OLED);
-        }
-    }
-
-    // Update serial console
-    if (millis() - message_timer >= message_period) {
-        message_timer = millis();
-        status_message(DISPLAY_CONSOLE);
+    // Measure the battery's internal resistance once the current has settled
+    if (state_code != CYCLE_STARTUP) {
+        measure_resistance();
     }
 
     // Normal exit
@@ -120,3 +116,31 @@ cycle_state_t Fast_Charger::run() {
 }
 
 
+
+// Predict the time left for the battery voltage to reach the target
+time_ms_t Fast_Charger::stage_time_remaining(void) {
+    time_ms_t eta;
+    uint32_t end_soc = (last_end_soc != 0) ? last_end_soc : FAST_END_SOC_DEFAULT;
+    uint32_t end_mAh = end_soc * BATTERY_CAPACITY / 100;
+    uint32_t charge_mAh = channel->soc.get_charge_mAh();
+    if (!channel->eta.ready()) {
+        // Wait for the current to settle at the limit
+        eta = ETA_UNKNOWN;
+    } else if (charge_mAh < end_mAh) {
+        // Time to put in the rest of the charge at the current limit,
+        // allowing for the charging efficiency
+        uint64_t to_go_mAh = (uint64_t)(end_mAh - charge_mAh) * 100 / CHARGE_EFFICIENCY_PCT;
+        current_ma_t current_limit = std::min(target_current, max_current);
+        eta = (time_ms_t)std::min<uint64_t>(to_go_mAh * HOUR_MS / current_limit, ETA_UNKNOWN);
+    } else {
+        // Past the usual end, so follow the voltage's rise to the target
+        eta = channel->eta.time_to(get_target_voltage());
+    }
+    return (eta == ETA_UNKNOWN) ? ETA_UNKNOWN : std::min(eta, charging_time_remaining());
+}
+
+// Predict the time until the battery is full
+time_ms_t Fast_Charger::full_time_remaining(void) {
+    time_ms_t eta = stage_time_remaining();
+    return (eta == ETA_UNKNOWN) ? ETA_UNKNOWN : eta + channel->topping_charger.expected_duration();
+}
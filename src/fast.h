@@ -50,6 +50,16 @@
 #include "utility.h"
 #include <stm32_time.h>
 
+/// @brief Estimated state of charge fast charging ends at, until one has completed (%)
+const uint8_t FAST_END_SOC_DEFAULT = 85;
+
+/**
+ * @brief Distance below the target voltage a plateau at constant current
+ *        is taken as the battery being full, rather than a fault (mV)
+ * @note 50 mV per cell; a soft-shorted cell levels off around 2V lower.
+ */
+const voltage_mv_t FAST_PLATEAU_DONE_MV = 300;
+
 /**
  * @brief Fast charging cycle handler for SLA batteries
  * 
@@ -91,17 +101,38 @@ public:
 
     /// @brief Constructor with initialization
     /// @param p: Charging parameters structure
-    Fast_Charger(charge_parm_t &p);
+    /// @param channel: Battery channel the cycle charges
+    Fast_Charger(charge_parm_t &p, Charge_Channel *channel);
 
     /// @brief Destructor (best practice)
     ~Fast_Charger();
 
+    /// @brief Start a new fast charging cycle, predicting the time left
+    ///        from the battery voltage
+    /// @returns Nothing
+    void start(void);
+
     /// @brief Run-time handler to manage charging cycle
     /// @returns Charging state
     cycle_state_t run(void);
 
-private:
+    /// @brief Predict the time left for the battery to charge to the state
+    ///        of charge fast charging last ended at, or once past it, for
+    ///        the battery voltage to reach the target at its recent rate
+    ///        of rise
+    /// @returns Time left (ms), or `ETA_UNKNOWN`
+    /// @note The voltage rises slowly through most of the cycle, then
+    ///       quickly as the battery nears full, so it can't be extrapolated
+    ///       far ahead.
+    time_ms_t stage_time_remaining(void);
 
+    /// @brief Predict the time until the battery is full, the time left in
+    ///        fast charging followed by topping charging
+    /// @returns Time left (ms), or `ETA_UNKNOWN`
+    time_ms_t full_time_remaining(void);
+
+private:
+    uint8_t last_end_soc;                   ///< Estimated state of charge the last completed cycle ended at (%, 0=none)
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,127 @@
+/**
+ * @file loadtest.cpp
+ * @brief Battery load test (capacity estimate) handler for SLA batteries
+ *
+ * Copyright(c) 2025  John Glynn
+ *
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ */
+#include "loadtest.h"
+#include "channel.h"
+#include "console.h"
+
+//
+// Global variables
+//
+extern Alarm_Pool timer_pool;               // Hardware timers
+extern Vreg vreg;                           // Voltage regulator
+extern Console_TX console;                  // Serial console output
+
+// Default constructor
+Load_Test_Charger::Load_Test_Charger() : Charge_Cycle() {
+    phase = LOAD_TEST_REST_BEFORE;
+    phase_timer = 0;
+    rest_before_mV = 0;
+}
+
+// Destructor (best practice)
+Load_Test_Charger::~Load_Test_Charger() {};
+
+// Constructor with initialization
+Load_Test_Charger::Load_Test_Charger(charge_parm_t &p, Charge_Channel *channel) : Charge_Cycle(p, channel) {
+    phase = LOAD_TEST_REST_BEFORE;
+    phase_timer = 0;
+    rest_before_mV = 0;
+}
+
+// Start a new load test
+// The base class soft starts the regulator, but the test starts with a rest
+void Load_Test_Charger::start(void) {
+    Charge_Cycle::start();
+    stop();
+    phase = LOAD_TEST_REST_BEFORE;
+    phase_timer = start_time;
+    rest_before_mV = 0;
+}
+
+// Run-time handler to manage the load test
+cycle_state_t Load_Test_Charger::run() {
+    state_code = CYCLE_RUNNING;
+
+    // Has the load test timed-out?
+    if (!charging_time_remaining()) {
+        // Yes, the battery wouldn't take the charge
+        stop();
+        state_code = CYCLE_TIMEOUT;
+        return state_code;
+    }
+
+    // Get voltage and current readings
+    current_ma_t charging_current = vreg.get_current_mA();
+    voltage_mv_t battery_voltage = channel->battery.get_voltage_mV();
+
+    switch (phase) {
+        case LOAD_TEST_REST_BEFORE:
+            if (millis() - phase_timer >= LOAD_TEST_REST_MS) {
+                // Too full for the voltage to rise in a straight line?
+                rest_before_mV = channel->battery.get_voltage_average_mV();
+                if (rest_before_mV >= BATTERY_EMPTY_MV + (uint32_t)(BATTERY_FULL_MV - BATTERY_EMPTY_MV) *
+                                                         LOAD_TEST_SOC_MAX_PCT / 100) {
+                    channel->print_label();
+                    console.printf("Battery too full to load test\n");
+                    state_code = CYCLE_DONE;
+                    return state_code;
+                }
+
+                // Start the charge
+                stored.begin(BATTERY_CAPACITY);
+                soft_start();
+                phase = LOAD_TEST_CHARGE;
+                phase_timer = millis();
+            }
+            break;
+
+        case LOAD_TEST_CHARGE:
+            // Hold the charging current at the maximum, without exceeding
+            // the target voltage, and count the charge stored
+            regulate(charging_current, battery_voltage, max_current);
+            stored.add_sample(charging_current, millis());
+            measure_resistance();
+            if (stored.get_charge_mAh() >= LOAD_TEST_CHARGE_MAH) {
+                stop();
+                phase = LOAD_TEST_REST_AFTER;
+                phase_timer = millis();
+            }
+            break;
+
+        case LOAD_TEST_REST_AFTER:
+            if (millis() - phase_timer >= LOAD_TEST_REST_MS) {
+                state_code = finish(channel->battery.get_voltage_average_mV());
+                return state_code;
+            }
+            break;
+    }
+
+    // Normal exit
+    return state_code;
+}
+
+// Work out the capacity and health from the rise in open-circuit voltage
+cycle_state_t Load_Test_Charger::finish(voltage_mv_t rest_after_mV) {
+    channel->print_label();
+    if (rest_after_mV < rest_before_mV + LOAD_TEST_RISE_MIN_MV) {
+        console.printf("Battery voltage didn't rise enough to load test\n");
+        return CYCLE_DONE;
+    }
+
+    uint32_t capacity = stored.get_charge_mAh() * (BATTERY_FULL_MV - BATTERY_EMPTY_MV) /
+                        (rest_after_mV - rest_before_mV);
+    uint32_t health = capacity * 100 / BATTERY_CAPACITY;
+    channel->session.capacity_mAh = (uint16_t)std::min<uint32_t>(capacity, UINT16_MAX);
+    channel->session.health_pct = (uint8_t)std::min<uint32_t>(health, UINT8_MAX);
+    console.printf("Battery capacity @ %u mAh, health @ %u%%\n", channel->session.capacity_mAh,
+                  channel->session.health_pct);
+
+    return (health < LOAD_TEST_HEALTH_MIN_PCT) ? CYCLE_ERROR : CYCLE_DONE;
+}
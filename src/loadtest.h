@@ -0,0 +1,118 @@
+/**
+ *  @file loadtest.h
+ *  @brief Battery load test (capacity estimate) handler for SLA batteries
+ *
+ *  Copyright(c) 2025  John Glynn
+ *
+ *  This code is licensed under the MIT License.
+ *  See the LICENSE file for the full license text.
+ *
+ *  @details
+ *  Called by the exec supervisor to estimate the capacity of a battery,
+ *  when a load test has been selected for it, before it's charged.  The
+ *  Rev 1 hardware can only charge the battery, with no load to discharge
+ *  it through, so the capacity is found from the battery's response to a
+ *  measured charge instead:
+ *  1. The battery rests for `LOAD_TEST_REST_MS` with the regulator off,
+ *     and its open-circuit voltage is read.
+ *  2. The battery is charged until `LOAD_TEST_CHARGE_MAH` has been stored,
+ *     counted from the charging current as by the state of charge
+ *     estimator (see soc.h).
+ *  3. The battery rests again, and its open-circuit voltage is read.
+ *
+ *  The open-circuit voltage is a straight line from `BATTERY_EMPTY_MV` to
+ *  `BATTERY_FULL_MV` over the battery's capacity, so the rise in voltage
+ *  for the charge stored gives the capacity.  The capacity, and the health
+ *  as a share of `BATTERY_CAPACITY`, are written to the channel's session
+ *  record and reported on the console.
+ *
+ *  The cycle ends with the `DONE` state once the battery has been tested
+ *  (or couldn't be, as it was too full at the first rest, or its voltage
+ *  didn't rise enough to measure), and with the `ERROR` state if the
+ *  battery's health is below `LOAD_TEST_HEALTH_MIN_PCT`.  If the charge
+ *  couldn't be delivered before the charging timer ran out, the cycle ends
+ *  with the `TIMEOUT` state.
+ *
+ *  A typical load test would be as follows:
+ *  1. Create new Load_Test_Charger object with appropriate settings
+ *  2. Call start method once to begin a load test
+ *  3. Call run method periodically (100 ms) intervals
+ *  4. Load test continues until the battery has rested after its charge,
+ *     or the cycle times out
+ */
+#ifndef _LOADTEST_H_
+#define _LOADTEST_H_
+
+#include "obcharger.h"
+#include "cycle.h"
+#include "regulator.h"
+#include "battery.h"
+#include "soc.h"
+#include "utility.h"
+#include <stm32_time.h>
+
+const time_ms_t LOAD_TEST_REST_MS = 30*MINUTE_MS;               ///< Rest before and after the charge
+const uint32_t LOAD_TEST_CHARGE_MAH = BATTERY_CAPACITY/10;      ///< Charge stored by the test (mAh)
+const uint8_t LOAD_TEST_SOC_MAX_PCT = 80;                       ///< Fullest battery that can be tested (%)
+const voltage_mv_t LOAD_TEST_RISE_MIN_MV = 20;                  ///< Smallest voltage rise that gives a result
+const uint8_t LOAD_TEST_HEALTH_MIN_PCT = 60;                    ///< Health that fails the test (%)
+
+/**
+ *  @brief Load test phases
+ */
+enum load_test_phase_t {
+    LOAD_TEST_REST_BEFORE = 0,              ///< Resting before the charge
+    LOAD_TEST_CHARGE = 1,                   ///< Charging
+    LOAD_TEST_REST_AFTER = 2,               ///< Resting after the charge
+};
+
+/**
+ * @brief Load test handler for SLA batteries
+ *
+ * @details Derived from the `Charge_Cycle` base object, with the `run()`
+ * method overriden to rest, charge and rest the battery, and the `start()`
+ * method to begin with the regulator off.
+ *
+ * These parameters are configurable and are set when the handler
+ * is initialized using the `init()` method.  See the documentation
+ * for the `charge_parm_t` structure and `LOAD_PARMS` for details on the
+ * configuration parameters for this handler.
+ */
+class Load_Test_Charger : public Charge_Cycle {
+
+public:
+
+    /// @brief Default constructor
+    Load_Test_Charger();
+
+    /// @brief Constructor with initialization
+    /// @note See the init() member function for details
+    Load_Test_Charger(charge_parm_t &p, Charge_Channel *channel);
+
+    /// @brief Destructor (best practice)
+    ~Load_Test_Charger();
+
+    /// @brief Start a new load test, with the battery at rest
+    /// @returns Nothing
+    void start(void);
+
+    /// @brief Run-time handler to manage the load test
+    /// @returns Charging state
+    cycle_state_t run(void);
+
+private:
+    load_test_phase_t phase;                ///< Load test phase
+    time_ms_t phase_timer;                  ///< millis() time the phase began
+    voltage_mv_t rest_before_mV;            ///< Open-circuit voltage before the charge (mV)
+    SoC_Estimator stored;                   ///< Charge stored by the test
+
+    /**
+     *  @brief Work out the capacity and health, and write them to the
+     *         session record
+     *  @param rest_after_mV: Open-circuit voltage after the charge (mV)
+     *  @returns `CYCLE_DONE`, or `CYCLE_ERROR` if the battery failed
+     */
+    cycle_state_t finish(voltage_mv_t rest_after_mV);
+};
+
+#endif
@@ -13,10 +13,13 @@
 #include "obcharger.h"
 #include "rgbled.h"
 #include "battery.h"
-#include "fast.h"
-#include "topping.h"
-#include "trickle.h"
-#include "standby.h"
+#include "channel.h"
+#include "temperature.h"
+#include "settle.h"
+#include "power.h"
+#include "tasks.h"
+#include "nvstore.h"
+#include "console.h"
 
 // Libraries
 #include <i2c_busio.h>
@@ -25,6 +28,7 @@
 
 // OLED display support
 #include <STM32_4kOLED.h>
+#include "status_screen.h"
 
 /// I2C address for 128x32 display
 #define ADDRESS_128x32  0x3C
@@ -32,9 +36,6 @@
 /// I2C address for 128x64 display
 #define ADDRESS_128x64  0x3D    
 
-// Utility function from cycle module
-extern void milliunits_to_string(uint32_t milliunits, uint8_t places, char *buffer, uint8_t buffer_len);
-
 //=============================================================================
 // Global variables
 //=============================================================================
@@ -42,11 +43,11 @@ extern void milliunits_to_string(uint32_t milliunits, uint8_t places, char *buff
 /// Master start time (beginning of program)
 time_ms_t start_time;
 
-/// Loop timer
-time_ms_t loop_timer;
+/// Main loop tasks
+Task_Scheduler tasks;
 
-/// Master charger state
-charger_state_t charger_state;
+/// Serial console output, sent in the background
+Console_TX console;
 
 /// Timer support
 Alarm_Pool timer_pool;
@@ -55,24 +56,27 @@ Alarm_Pool timer_pool;
  *  @brief Timer pool interrupt handler used by the Alarm class
  */
 void timer_pool_handler(void) {
-    timer_pool.dec();
+    timer_pool.service();
 }
 
-/// Fast charging cycle handler, derived from the `Charge_Cycle` class
-Fast_Charger fast_charger;
-/// Topping charging cycle handler, derived from the `Charge_Cycle` class
-Topping_Charger topping_charger;
-/// Trickle charging cycle handler, derived from the `Charge_Cycle` class
-Trickle_Charger trickle_charger;
-/// Standby mode handler, derived from the `Charge_Cycle` class
-Standby_Charger standby_charger;
+/// Battery channels, each with its own charger state and charging cycles
+Charge_Channel channels[BATTERY_CHANNELS];
+
+/// Shares the regulator between the battery channels
+Channel_Scheduler scheduler;
+
+/// Internal temperature sensor, for compensating the voltage targets
+Temp_Sensor temp_sensor;
+
+/// Detects the readings settling at the start of a charging cycle
+Settle_Detector settle_detector;
+
+/// Stop mode support for standby
+Low_Power low_power;
 
 /// I2C bus object
 I2C main_i2c_bus = I2C(&Wire, I2C0_SCL_GPIO, I2C0_SDA_GPIO, I2C0_BAUDRATE);
 
-/// Battery object
-Battery battery;
-
 /// Current sensor object
 INA219 sensor;
 
@@ -82,23 +86,118 @@ MCP4726 dac;
 /// Voltage regulator object
 Vreg vreg;
 
+/// Calibration data kept in flash
+NV_Store nv_store;
+
 /// RGB LED object
 RGB_LED rgb_led;
 
 /// Indicates whether OLED display was detected
 bool oled_found = false;   
 
+/// Bytes sent to the OLED display
+uint32_t oled_bytes_sent = 0;
+
+// OLED display traffic is routed through the I2C bus transaction queue,
+// so frame updates are sent in the background
+static void oled_begin_wire(void) {
+}
+
+static bool oled_beginTransmission_wire(void) {
+    main_i2c_bus.queue_begin(ADDRESS_128x32);
+    return true;
+}
+
+static bool oled_write_wire(uint8_t byte) {
+    if (main_i2c_bus.queue_write(byte)) {
+        oled_bytes_sent++;
+        return true;
+    }
+    return false;
+}
+
+static uint8_t oled_endTransmission_wire(void) {
+    main_i2c_bus.queue_end();
+    return 0;
+}
+
 // SSD1306 display object
-// SSD1306PrintDevice oled(&tiny4koled_begin_wire, &tiny4koled_beginTransmission_wire, &datacute_write_wire, &datacute_endTransmission_wire);
-SSD1306PrintDevice oled;
+SSD1306PrintDevice oled(&oled_begin_wire, &oled_beginTransmission_wire, &oled_write_wire, &oled_endTransmission_wire);
+
+// OLED status screen, redraws only what has changed
+Status_Screen status_screen(&oled);
+
+//=============================================================================
+// Main loop tasks
+//=============================================================================
 
 /**
- * @brief Ring buffer for current readings
- * @details
- * This buffer stores historical current readings to allow calculating a
- * running average to reduce volatility of the charging current value.
+ *  @brief Keep queued I2C transactions moving
  */
-RingBuffer16 rb_charging_current(RB_CHARGING_CURRENT_SAMPLES);
+static void i2c_task(void) {
+    main_i2c_bus.service();
+}
+
+/**
+ *  @brief Keep queued console output moving
+ */
+static void serial_task(void) {
+    console.service();
+}
+
+/**
+ *  @brief Read the charging current for the battery on the regulator
+ */
+static void sensor_task(void) {
+    scheduler.sample();
+    vreg.learn();
+}
+
+/**
+ *  @brief Run the charging supervisor for the battery on the regulator
+ *  @note See supervisor.h for the charger states and transitions, and
+ *        channel.h for how the regulator is shared between batteries.
+ */
+static void control_task(void) {
+    scheduler.run();
+}
+
+/**
+ *  @brief Pulse the RGB LED for the running charging cycle
+ */
+static void led_task(void) {
+    Charge_Cycle *cycle = scheduler.active_cycle();
+    if (cycle != nullptr) {
+        cycle->status_led();
+    }
+}
+
+/**
+ *  @brief Update any attached OLED display for the running charging cycle
+ *  @note A few glyph columns are drawn a run, once the I2C queue has
+ *        drained from the last, so a full redraw doesn't hold up the
+ *        control task.
+ */
+static void display_task(void) {
+    Charge_Cycle *cycle = scheduler.active_cycle();
+    if (cycle != nullptr) {
+        cycle->update_display();
+    }
+    if (oled_found && (main_i2c_bus.pending() == 0)) {
+        status_screen.draw_next();
+    }
+}
+
+/**
+ *  @brief Write status messages for the running charging cycle to the
+ *         serial console
+ */
+static void console_task(void) {
+    Charge_Cycle *cycle = scheduler.active_cycle();
+    if (cycle != nullptr) {
+        cycle->update_console();
+    }
+}
 
 //=============================================================================
 // Utility functions
@@ -111,18 +210,18 @@ RingBuffer16 rb_charging_current(RB_CHARGING_CURRENT_SAMPLES);
  *        `true` value.  Inactive I2C addresses will be set to a `false` value.
  */
 void display_i2c_map(bool *addresses_found) {
-    Serial.printf("    0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F\n");
+    console.printf("    0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F\n");
  
     for (int addr = 0; addr < 128; ++addr) {
         if (addr % 16 == 0) {
-            Serial.printf("%02x  ", addr);
+            console.printf("%02x  ", addr);
         }
  
         if (addresses_found[addr] == 1)
-            Serial.printf("X");
+            console.printf("X");
         else
-            Serial.printf(".");
-        Serial.printf(addr % 16 == 15 ? "\n" : "  ");
+            console.printf(".");
+        console.printf(addr % 16 == 15 ? "\n" : "  ");
     }
 }
 
@@ -138,27 +237,27 @@ void display_library_versions(void) {
     // Hardware timer library
     timer_pool.version(version, sizeof(version));
     timer_pool.reldate(reldate, sizeof(reldate));
-    Serial.printf("STM32 Hardware Timer library v%s (%s)\n", version, reldate);
+    console.printf("STM32 Hardware Timer library v%s (%s)\n", version, reldate);
 
     // I2C Bus I/O library
     main_i2c_bus.version(version, sizeof(version));
     main_i2c_bus.reldate(reldate, sizeof(reldate));
-    Serial.printf("I2C Bus I/O library v%s (%s)\n", version, reldate);
+    console.printf("I2C Bus I/O library v%s (%s)\n", version, reldate);
 
     // INA219 sensor library
     sensor.version(version, sizeof(version));
     sensor.reldate(reldate, sizeof(reldate));
-    Serial.printf("INA219 current/power sensor library v%s (%s)\n", version, reldate);
+    console.printf("INA219 current/power sensor library v%s (%s)\n", version, reldate);
 
     // MCP4726 DAC library
     dac.version(version, sizeof(version));
     dac.reldate(reldate, sizeof(reldate));
-    Serial.printf("MCP4726 DAC library v%s (%s)\n", version, reldate);
+    console.printf("MCP4726 DAC library v%s (%s)\n", version, reldate);
 
     // Ring buffer library
-    rb_charging_current.version(version, sizeof(version));
-    rb_charging_current.reldate(reldate, sizeof(reldate));
-    Serial.printf("Ring buffer library v%s (%s)\n", version, reldate);
+    channels[0].current_history.version(version, sizeof(version));
+    channels[0].current_history.reldate(reldate, sizeof(reldate));
+    console.printf("Ring buffer library v%s (%s)\n", version, reldate);
 }
 
 
@@ -168,9 +267,9 @@ void display_library_versions(void) {
  */
 void setup() {
 
-    // Configure Serial port
+    // Configure Serial port, with output sent by DMA (see console.h)
     // Default Serial uses UART2 with PA2 (TX) and PA3 (RX)
-    Serial.begin(115200);
+    console.begin(115200);
     
     // Configure I2C bus
     Wire.setSCL(PA11);
@@ -178,37 +277,37 @@ void setup() {
     Wire.begin();
 
     // Greeting messages
-    Serial.printf("\n");
-    Serial.printf("On-board Battery Charger v%s (%s)\n", OBC_VERSION, OBC_RELDATE);
+    console.printf("\n");
+    console.printf("On-board Battery Charger v%s (%s)\n", OBC_VERSION, OBC_RELDATE);
     display_library_versions();
-    Serial.printf("\n");
+    console.printf("\n");
 
     // Record system start-up time
-    Serial.printf("Starting initialization now\n");
+    console.printf("Starting initialization now\n");
     start_time = millis();
 
     // Scan I2C buses
     // Use dynamic array to hold results, memory is released below
-    Serial.printf("Scanning I2C Wire bus... ");
+    console.printf("Scanning I2C Wire bus... ");
     bool *addresses_found = new bool[128];
     int number_found = main_i2c_bus.scan(addresses_found, false);
-    Serial.printf("Done!\n");
+    console.printf("Done!\n");
 
     // Display results
-    Serial.printf("Found %u devices on Wire I2C bus \n", number_found);
-    Serial.printf("\n");
-    Serial.printf("Results of the I2C scan:\n");
+    console.printf("Found %u devices on Wire I2C bus \n", number_found);
+    console.printf("\n");
+    console.printf("Results of the I2C scan:\n");
     display_i2c_map(addresses_found);
-    Serial.printf("\n");
+    console.printf("\n");
 
     // Check if the optional OLED I2C display is installed
     // Initialize it if successfully detected on the I2C bus
-    Serial.printf("Checking for OLED display on I2C bus ");
+    console.printf("Checking for OLED display on I2C bus ");
     oled_found = addresses_found[ADDRESS_128x32];
     delete [] addresses_found;  // Release memory
     if (oled_found) {
-        Serial.printf("- found at address 0x%x\n", ADDRESS_128x32);
-        Serial.printf("Initializing OLED display ");
+        console.printf("- found at address 0x%x\n", ADDRESS_128x32);
+        console.printf("Initializing OLED display ");
         oled.begin();
         oled.setRotation(1);
         oled.setInternalIref(true);     // Lower brightness
@@ -217,48 +316,99 @@ void setup() {
         oled.clear();
         oled.on();
         oled.switchRenderFrame();       // Switch to non-display page
-        Serial.printf("- Done\n");
+        console.printf("- Done\n");
     } else {
-        Serial.printf("- NOT found at address 0x%x\n", ADDRESS_128x32);
+        console.printf("- NOT found at address 0x%x\n", ADDRESS_128x32);
     };
 
     //
     // Initialize and test I/O drivers
     //
-    Serial.printf("Initializing voltage regulator (off) ");
+    console.printf("Initializing voltage regulator (off) ");
     digitalWrite(GP_VREG_ENABLE, LOW);
     pinMode(GP_VREG_ENABLE, OUTPUT);
     sensor.init(&main_i2c_bus, INA219B_I2C_ADDRESS); 
     dac.init(&main_i2c_bus, DAC_I2C_ADDRESS);
     vreg.begin(GP_VREG_ENABLE, &sensor, &dac);
-    Serial.printf("- Done\n");
+    console.printf("- Done\n");
 
-    Serial.printf("Initializing RGB LED (off) ");
+    console.printf("Initializing RGB LED (off) ");
     rgb_led.begin(GP_LEDR, GP_LEDG, GP_LEDB, LED_BLK);
-    Serial.printf("- Done\n"); 
-
-    // Initialize A/D converter support to 12-bit resolution
-    analogReadResolution(12);
+    console.printf("- Done\n"); 
 
     // Initialize the alarm pool
-    Serial.printf("Initializing the timer pool ");
+    console.printf("Initializing the timer pool ");
     timer_pool.setup(TIM3, timer_pool_handler);
-    Serial.printf("- Done\n");
-
-    // Initialize the charging cycle handlers
-    Serial.printf("Initializing charging cycle handlers ");
-    fast_charger.init(FAST_PARMS);
-    topping_charger.init(TOP_PARMS);
-    trickle_charger.init(TRCKL_PARMS);
-    standby_charger.init(STANDBY_PARMS);
-    Serial.printf("- Done\n");
-    Serial.printf("\n");
-    
-    // Initial state of charger
-    charger_state = CHARGER_STARTUP;
+    console.printf("- Done\n");
+
+    // Initialize the RTC used to wake up from Stop mode
+    console.printf("Initializing low-power support ");
+    low_power.begin();
+    console.printf("- Done\n");
+
+    // Initialize the battery channels, starting the background battery
+    // voltage and temperature A/D conversions and the charging cycle
+    // handlers.  Each channel starts in the startup state.
+    console.printf("Initializing %u battery channel(s) ", BATTERY_CHANNELS);
+    temp_sensor.begin();
+    for (uint8_t i = 0; i < BATTERY_CHANNELS; i++) {
+        channels[i].begin(i);
+    }
+    scheduler.begin(channels, BATTERY_CHANNELS);
+    console.printf("- Done\n");
+
+    // Load each channel's battery voltage calibration, and fit it again
+    // against the regulator's bus voltage if the channel has no battery
+    for (uint8_t i = 0; i < BATTERY_CHANNELS; i++) {
+        Battery &battery = channels[i].battery;
+        console.printf("Calibrating battery %u voltage ", channels[i].number());
+        bool loaded = battery.load_calibration();
+        bool fitted = false;
+        if (battery.get_voltage_average_mV() <= BATTERY_ABSENT_MV) {
+            channels[i].connect();
+            fitted = vreg.calibrate_battery();
+            channels[i].disconnect();
+        }
+        if (fitted) {
+            battery.save_calibration();
+            battery_cal_t cal = battery.get_calibration();
+            console.printf("- Fitted, gain %u/%u mV, offset %d mV\n", cal.gain, 1U << BATTERY_GAIN_SHIFT,
+                          cal.offset_mV);
+        } else {
+            console.printf("- %s\n", loaded ? "Loaded" : "Not calibrated, using the divider values");
+        }
+    }
 
-    // Initialize loop timer
-    loop_timer = millis();
+    // Load the regulator's DAC calibration table, or sweep it with the
+    // first battery switched in the first time the charger starts
+    console.printf("Calibrating voltage regulator ");
+    if (vreg.load_calibration()) {
+        console.printf("- Loaded\n");
+    } else {
+        channels[0].connect();
+        uint8_t points = vreg.calibrate();
+        channels[0].disconnect();
+        vreg.save_calibration(true);
+        console.printf("- %u of %u points measured\n", points, VREG_CAL_POINTS);
+    }
+    console.printf("\n");
+
+    // Register the main loop tasks, the charging supervisor running
+    // every LOOP_DELAY after the charging current has been read.  The
+    // status tasks only decide whether an update is due, each charging
+    // cycle sets how often.
+    tasks.begin();
+    tasks.add("i2c", i2c_task, TASK_EVERY_PASS, TASK_PRIORITY_HIGH);
+    tasks.add("serial", serial_task, TASK_EVERY_PASS, TASK_PRIORITY_HIGH);
+    tasks.add("sensor", sensor_task, LOOP_DELAY, TASK_PRIORITY_HIGH);
+    tasks.add("control", control_task, LOOP_DELAY, TASK_PRIORITY_HIGH);
+    tasks.add("led", led_task, LED_TASK_PERIOD, TASK_PRIORITY_NORMAL);
+    tasks.add("display", display_task, STATUS_TASK_PERIOD, TASK_PRIORITY_LOW);
+    tasks.add("console", console_task, STATUS_TASK_PERIOD, TASK_PRIORITY_LOW);
+
+    // From here on the main loop never waits on the serial port, console
+    // messages that don't fit are dropped and reported
+    console.set_overflow(CONSOLE_OVERFLOW_REPORT);
 }
 
 /**
@@ -266,162 +416,12 @@ void setup() {
  *  @returns Nothing
  */
 void loop() {
-    // Former charging supervisor routine moved to loop() to be consistent
-    // with the usual Arduino approach
-    if ((millis() - loop_timer) >= LOOP_DELAY) {
-        // Run charging supervisor
-        loop_timer = millis();
-
-        // Update cached charging current readings
-        rb_charging_current.append((uint16_t)(vreg.get_current_average_mA()));
-
-        switch (charger_state) {
-            case CHARGER_STARTUP: {
-                // Starting-up initialization
-                Serial.printf("Entering startup initialization state\n");
-
-                // Check initial battery voltage to determine the appropriate
-                // charging cycle. Fast if discharged heavily, topping otherwise.
-                voltage_mv_t battery_voltage = battery.get_voltage_mV();
-                if (battery_voltage <= BATTERY_DISCHARGED_MV) {
-                    Serial.printf("Battery voltage @ %u.%u volts, initiating fast charge\n\n", 
-                                   battery_voltage/1000, battery_voltage%1000);
-                    charger_state = CHARGER_FAST;
-                    fast_charger.start();
-                } else {
-                    Serial.printf("Battery voltage @ %u.%u volts, initiating topping charge\n\n", 
-                                   battery_voltage/1000, battery_voltage%1000);
-                    charger_state = CHARGER_TOPPING;
-                    topping_charger.start();
-                }
-                break;
-            }
-
-            case CHARGER_FAST: {
-                // Fast-charging is in process
-                switch (fast_charger.run()) {
-                    case CYCLE_STARTUP:
-                    case CYCLE_RUNNING:
-                        break;
-                    case CYCLE_DONE:
-                        // Charging done, move to topping charge
-                        Serial.printf("Fast charging cycle completed\n\n");
-                        charger_state = CHARGER_TOPPING;
-                        topping_charger.start();
-                        break;
-                    case CYCLE_TIMEOUT:
-                        // Charging timed-out, something's not right
-                        Serial.printf("Fast charging cycle timed-out!\n");
-                        charger_state = CHARGER_SHUTDOWN;
-                        break;
-                    case CYCLE_ERROR:
-                        // Hardware error detected
-                        Serial.printf("Fast charging cycle aborted by error condition!\n");
-                        charger_state = CHARGER_SHUTDOWN;
-                        break;
-                    default:
-                        Serial.printf("Fast charging cycle returned unknown status!\n");
-                        charger_state = CHARGER_SHUTDOWN;
-                } // switch(fast)
-                break;
-            }
-
-            case CHARGER_TOPPING: {
-                // Topping charging is in process
-                switch (topping_charger.run()) {
-                    case CYCLE_STARTUP:
-                    case CYCLE_RUNNING:
-                        break;
-                    case CYCLE_DONE:
-                        // Charge done, move to trickle charge
-                        Serial.printf("Topping charging cycle completed\n\n");
-                        charger_state = CHARGER_TRICKLE;
-                        trickle_charger.start();
-                        break;
-                    case CYCLE_TIMEOUT:
-                        // Charge timed-out, something's not right
-                        Serial.printf("Topping charging cycle timed-out!\n");
-                        charger_state = CHARGER_SHUTDOWN;
-                        break;
-                    case CYCLE_ERROR:
-                        // Hardware error detected
-                        Serial.printf("Topping charging cycle aborted by error condition!\n");
-                        charger_state = CHARGER_SHUTDOWN;
-                        break;
-                    default:
-                        Serial.printf("Topping charging cycle returned unknown status!\n");
-                        charger_state = CHARGER_SHUTDOWN;
-                } // switch(topping)
-                break;
-            }
-
-            case CHARGER_TRICKLE: {
-                // Trickle charge is in process
-                switch (trickle_charger.run()) {
-                    case CYCLE_STARTUP:
-                    case CYCLE_RUNNING:
-                        break;
-                    case CYCLE_DONE:
-                    case CYCLE_TIMEOUT:
-                        // Charge done, move to standby mode
-                        Serial.printf("Trickle charging cycle completed\n\n");
-                        charger_state = CHARGER_STANDBY;
-                        standby_charger.start();
-                        break;
-                    case CYCLE_ERROR:
-                        // Hardware error detected
-                        Serial.printf("Trickle charging cycle aborted by error condition!\n");
-                        charger_state = CHARGER_SHUTDOWN;
-                        break;
-                    default:
-                        Serial.printf("Trickle charging cycle returned unknown status!\n");
-                        charger_state = CHARGER_SHUTDOWN;
-                } // switch(trickle)
-                break;
-            }
-
-            case CHARGER_STANDBY: {
-                // Currently in standby mode
-                switch (standby_charger.run()) {
-                    case CYCLE_RUNNING:
-                        break;
-                    case CYCLE_TIMEOUT:
-                        // Standby mode is over, time to restart active charging
-                        Serial.printf("Exiting standby mode\n\n");
-                        // Check current battery voltage to determine the appropriate
-                        // charging cycle. Fast if discharged heavily, trickle otherwise.
-                        char bv_str[6];  // Temporary buffer for battery voltage
-                        milliunits_to_string(battery.get_voltage_average_mV(), 1, bv_str, sizeof(bv_str));
-                        if (battery.get_voltage_average_mV() <= BATTERY_DISCHARGED_MV) {
-                            Serial.printf("Battery voltage @ %s volts, starting fast charge\n", bv_str);
-                            charger_state = CHARGER_FAST;
-                            fast_charger.start();
-                        } else {
-                            Serial.printf("Battery voltage @ %s volts, starting trickle charge\n", bv_str);
-                            charger_state = CHARGER_TRICKLE;
-                            trickle_charger.start();
-                        };
-                        break;
-                    default:
-                        Serial.printf("Standby mode handler returned unknown status!\n");
-                        charger_state = CHARGER_SHUTDOWN;
-                } // switch(standby)
-                break;
-            }
-
-            case CHARGER_SHUTDOWN:
-                break;
-
-            case CHARGER_LOAD_TEST:
-                // Battery load test not implemented
-                Serial.printf("Battery load test not implemented\n");
-                break;
-
-            default:
-                // Fatal error - we should never get here!
-                Serial.printf("Fatal error: Invalid charger state code '%u'!", charger_state);
-                while (1);
-        } // switch(charger_state)
-    }  // charging supervisor
+    // Run the tasks that are due, see setup() for the task list
+    tasks.run();
 
+    // Nothing more to do until the next task is due, so wait for an
+    // interrupt (SysTick, I2C or serial) rather than spin
+    if (tasks.time_to_next() > 0) {
+        low_power.idle();
+    }
 }  // loop()
@@ -0,0 +1,116 @@
+/**
+ * @file nvstore.cpp
+ * @brief Calibration data kept in flash across power cycles
+ *
+ * Copyright(c) 2025  John Glynn
+ *
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ */
+
+#include "nvstore.h"
+#include "utility.h"
+
+#ifdef ARDUINO_ARCH_STM32
+
+#include <EEPROM.h>
+
+// The EEPROM emulation buffers the flash page in RAM, so a block is read
+// and written a byte at a time and the page written back once
+static void nv_fill(void) {
+    eeprom_buffer_fill();
+}
+
+static uint8_t nv_read(uint32_t pos) {
+    return eeprom_buffered_read_byte(pos);
+}
+
+static void nv_write(uint32_t pos, uint8_t value) {
+    eeprom_buffered_write_byte(pos, value);
+}
+
+static void nv_flush(void) {
+    eeprom_buffer_flush();
+}
+
+#else
+
+// Host build: the flash page is kept in RAM
+static uint8_t nv_page[NV_BLOCKS * NV_BLOCK_SIZE];
+
+static void nv_fill(void) {
+}
+
+static uint8_t nv_read(uint32_t pos) {
+    return nv_page[pos];
+}
+
+static void nv_write(uint32_t pos, uint8_t value) {
+    nv_page[pos] = value;
+}
+
+static void nv_flush(void) {
+}
+
+#endif
+
+// Default constructor
+NV_Store::NV_Store(void) {
+    write_count = 0;
+}
+
+// Load a block
+bool NV_Store::load(nv_block_t block, void *data, uint16_t size) {
+    uint32_t base = (uint32_t)block * NV_BLOCK_SIZE;
+    if (size > NV_BLOCK_SIZE - sizeof(nv_header_t)) {
+        return false;
+    }
+
+    nv_header_t header;
+    uint8_t buffer[NV_BLOCK_SIZE];
+    nv_fill();
+    for (uint16_t i = 0; i < sizeof(header); i++) {
+        ((uint8_t *)&header)[i] = nv_read(base + i);
+    }
+    if ((header.magic != NV_MAGIC) || (header.size != size)) {
+        return false;
+    }
+    for (uint16_t i = 0; i < size; i++) {
+        buffer[i] = nv_read(base + sizeof(header) + i);
+    }
+    if (crc16_ccitt(buffer, size) != header.crc) {
+        return false;
+    }
+    memcpy(data, buffer, size);
+    return true;
+}
+
+// Save a block, if it has changed
+bool NV_Store::save(nv_block_t block, const void *data, uint16_t size) {
+    uint32_t base = (uint32_t)block * NV_BLOCK_SIZE;
+    if (size > NV_BLOCK_SIZE - sizeof(nv_header_t)) {
+        return false;
+    }
+
+    nv_header_t header = { NV_MAGIC, size, crc16_ccitt((const uint8_t *)data, size) };
+    nv_fill();
+    bool changed = false;
+    for (uint16_t i = 0; i < sizeof(header) + size; i++) {
+        uint8_t value = (i < sizeof(header)) ? ((const uint8_t *)&header)[i]
+                                             : ((const uint8_t *)data)[i - sizeof(header)];
+        if (nv_read(base + i) != value) {
+            nv_write(base + i, value);
+            changed = true;
+        }
+    }
+    if (changed) {
+        nv_flush();
+        write_count++;
+    }
+    return true;
+}
+
+// Get the number of times the flash page has been written
+uint32_t NV_Store::writes(void) {
+    return write_count;
+}
@@ -0,0 +1,90 @@
+/**
+ * @file nvstore.h
+ * @brief Calibration data kept in flash across power cycles
+ *
+ * Copyright(c) 2025  John Glynn
+ *
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ *
+ * @details
+ * Calibration tables learned by the charger are saved in blocks of up to
+ * `NV_BLOCK_SIZE` bytes, each at a fixed place in the STM32duino EEPROM
+ * emulation (the last page of flash).  Each block is saved with a header
+ * holding its size and a CRC, so a block that was never saved, was saved
+ * by firmware with a different layout, or was only partly written, isn't
+ * loaded.
+ *
+ * The flash page is erased and written again for each save, so blocks are
+ * only saved when their contents have changed, and callers should only
+ * save when the charger isn't busy (e.g. at startup or entering standby).
+ *
+ * On the host simulator the blocks are kept in RAM, so they last for one
+ * run.
+ */
+#ifndef _NVSTORE_H_
+#define _NVSTORE_H_
+
+#include "obcharger.h"
+
+const uint16_t NV_BLOCK_SIZE = 128;         ///< Space for each block, header included (bytes)
+const uint16_t NV_MAGIC = 0x4F42;           ///< Header value marking a saved block ('OB')
+
+/**
+ *  @brief Blocks saved in flash
+ */
+enum nv_block_t {
+    NV_VREG_CAL = 0,                        ///< Regulator DAC calibration table
+    NV_BATTERY_CAL = 1,                     ///< Battery voltage calibration, one block per channel
+    NV_BLOCKS = 1 + BATTERY_CHANNELS,       ///< Number of blocks
+};
+
+/**
+ *  @brief Header saved ahead of each block
+ */
+struct nv_header_t {
+    uint16_t magic;                         ///< `NV_MAGIC` once saved
+    uint16_t size;                          ///< Size of the data (bytes)
+    uint16_t crc;                           ///< CRC-16 of the data
+};
+
+/**
+ *  @brief Calibration data store
+ */
+class NV_Store {
+public:
+    /// @brief Default constructor
+    NV_Store(void);
+
+    /**
+     *  @brief Load a block
+     *  @param block: Block to load
+     *  @param data: Buffer for the block's data
+     *  @param size: Size of the data (bytes)
+     *  @returns true=Loaded, false=Not saved, or saved with a different
+     *           size or a bad CRC (`data` is left alone)
+     */
+    bool load(nv_block_t block, void *data, uint16_t size);
+
+    /**
+     *  @brief Save a block, if it has changed
+     *  @param block: Block to save
+     *  @param data: Data to save
+     *  @param size: Size of the data (bytes), up to `NV_BLOCK_SIZE` less
+     *               the header
+     *  @returns true=Saved or unchanged, false=Too large
+     *  @note Blocks the loop while the flash page is written (tens of ms).
+     */
+    bool save(nv_block_t block, const void *data, uint16_t size);
+
+    /**
+     *  @brief Get the number of times the flash page has been written
+     *  @returns Number of writes since startup
+     */
+    uint32_t writes(void);
+
+private:
+    uint32_t write_count;                   ///< Flash page writes since startup
+};
+
+#endif
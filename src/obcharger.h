@@ -36,6 +36,8 @@ typedef uint32_t    voltage_mv_t;               ///< Voltage in integer format (
 typedef uint32_t    voltage_uv_t;               ///< Voltage in integer format (uV)
 typedef uint32_t    current_ma_t;               ///< Current in integer format (mA)
 
+typedef int32_t     temp_dc_t;                  ///< Temperature in tenths of a degree C
+
 //
 // A/D converter constants
 // STM32 G030 series provides a 12-bit A/D converter
@@ -48,7 +50,9 @@ const voltage_mv_t AN_REF_VOLTAGE = 3300;       ///< A/D converter reference
 // Application-specific type definitions and constants
 //
 
-const time_ms_t LOOP_DELAY = 100;           ///< Loop timer delay
+const time_ms_t LOOP_DELAY = 100;           ///< Charging supervisor task period
+const time_ms_t LED_TASK_PERIOD = 50;       ///< RGB LED task period
+const time_ms_t STATUS_TASK_PERIOD = 100;   ///< OLED display and console task period
 
 /**
  *  @brief Global charger states
@@ -61,8 +65,8 @@ enum charger_state_t {
     CHARGER_TRICKLE = 5,                    ///< Trickle charge
     CHARGER_STANDBY = 6,                    ///< Standby mode
     CHARGER_SHUTDOWN = 7,                   ///< Shutdown (error condition?)
-    CHARGER_LOAD_TEST = 8,                  ///< Battery load test (not implemented)
-    CHARGER_CONDITION = 9                   ///< Battery conditioning (not implemented)
+    CHARGER_LOAD_TEST = 8,                  ///< Battery load test (capacity estimate)
+    CHARGER_CONDITION = 9                   ///< Battery conditioning (desulfation)
 };
 
 /**
@@ -151,10 +155,25 @@ const uint16_t INA219B_CALIBRATION = 4071;  ///< Sensor calibration value
 //
 const uint8_t  DAC_I2C_ADDRESS = 0x60;      ///< MCP4726A0 DAC I2C address
 
+//
+// Battery channels
+// Rev 1 hardware charges a single battery.  Builds for two batteries
+// (-D BATTERY_CHANNELS=2) assume a MOSFET switch between the regulator and
+// each battery, with the voltage divider on the battery side of the switch
+// so a battery can be read while it's switched out.
+//
+#ifndef BATTERY_CHANNELS
+#define BATTERY_CHANNELS    1               ///< Number of batteries charged (1-2)
+#endif
+
+static_assert((BATTERY_CHANNELS >= 1) && (BATTERY_CHANNELS <= 2), "1 or 2 battery channels supported");
+
+const PinNumber GP_AN_BATTERY[] = { PA0, PA1 };     ///< Battery voltage A/D, by channel
+const PinNumber GP_BATTERY_SELECT[] = { PB0, PB1 }; ///< Battery switch (0=off, 1=on), by channel
+
 //
 // Battery parameters
 //
-const PinNumber GP_AN_BATTERY = PA0;        ///< Battery voltage A/D
 
 // Resistor divider ratio for battery voltage scaling
 // Vad = Vin * (R_BATT_LO)/(R_BATT_LO+R_BATT_HI)
@@ -164,6 +183,34 @@ const uint32_t R_BATT_HI = 39;              ///< Resistor divider upper value (K
 
 const uint16_t BATTERY_CAPACITY = 5500;     ///< Battery capacity in mA/hours.
 
+// Open-circuit (rest) voltage range for estimating the state of charge,
+// about 1.97V/cell when empty and 2.13V/cell when full
+const voltage_mv_t BATTERY_EMPTY_MV = 11800; ///< Rest voltage at 0% state of charge (mV).
+const voltage_mv_t BATTERY_FULL_MV = 12800;  ///< Rest voltage at 100% state of charge (mV).
+
+const uint8_t BATTERY_CELLS = 6;            ///< Cells in series (2V lead-acid cells).
+
+const uint32_t CHARGE_EFFICIENCY_PCT = 90;  ///< Share of the charging current stored by the battery (%).
+
+/// Most the voltage target is raised to make up for the drop across the
+/// battery's internal resistance (mV)
+const voltage_mv_t IR_COMP_MAX_MV = 100;
+
+//
+// Temperature compensation of the voltage targets
+// The charging parameters' voltage targets are for 25C, and are moved by
+// each cycle's `temp_comp_mv` slope for every degree away from that.  The
+// charger's own temperature sensor stands in for the battery's, so the
+// compensation stops at the limits of a sensible battery temperature.
+//
+const temp_dc_t TEMP_COMP_REF_DC = 250;     ///< Temperature the voltage targets are set for (0.1C).
+const temp_dc_t TEMP_COMP_MIN_DC = 0;       ///< Lowest temperature compensated for (0.1C).
+const temp_dc_t TEMP_COMP_MAX_DC = 450;     ///< Highest temperature compensated for (0.1C).
+
+/// Temperature rise of the charger's sensor over the battery (0.1C),
+/// from the regulator and processor warming the board
+const temp_dc_t TEMP_SENSOR_OFFSET_DC = 0;
+
 //
 // Voltage regulator parameters
 //
@@ -179,6 +226,50 @@ const voltage_mv_t VREG_VOLTAGE_MAX = 16000; ///< Voltage regulator maximum allo
  */
 const voltage_mv_t BATTERY_DISCHARGED_MV = 13000;
 
+/**
+ *  @brief Battery voltage (mV) at or below which no battery is taken to be
+ *  connected to a channel (or it's too far gone to charge)
+ */
+const voltage_mv_t BATTERY_ABSENT_MV = 5000;
+
+/**
+ *  @brief Battery internal resistance (mOhm) at or above which the battery
+ *  is taken to be sulfated, and is conditioned after topping charging.
+ *  About two and a half times that of a new 5.5Ah battery.
+ */
+const uint32_t CONDITION_RESISTANCE_MOHM = 100;
+
+/**
+ *  @brief Include the conditioning cycle for sulfated batteries
+ *  @note Leave it out with a build flag (-D CONDITIONING_CYCLE=0) to save
+ *        flash; sulfated batteries then go on to trickle charging.
+ */
+#ifndef CONDITIONING_CYCLE
+#define CONDITIONING_CYCLE  1               ///< Conditioning cycle (0=left out, 1=included)
+#endif
+
+/**
+ *  @brief Load test each battery when the charger starts up, before
+ *  charging it.  Until there is a menu to select it, this sets
+ *  `Charge_Channel::load_test_selected`.
+ */
+const bool LOAD_TEST_AT_STARTUP = false;
+
+/**
+ *  @brief Include the battery load test
+ *  @note Leave it out with a build flag (-D LOAD_TEST_CYCLE=0) to save
+ *        flash; `LOAD_TEST_AT_STARTUP` is then ignored.
+ */
+#ifndef LOAD_TEST_CYCLE
+#define LOAD_TEST_CYCLE     1               ///< Battery load test (0=left out, 1=included)
+#endif
+
+/**
+ *  @brief Time each battery gets on the regulator when more than one is
+ *  trickle charging (ms)
+ */
+const time_ms_t CHANNEL_SLICE_MS = 300000;
+
 /**
  *  @brief Voltage hystersis limits (mV) for charging cycles.
  *  Used to adjust upper/lower limits to reduce dithering in the output
@@ -0,0 +1,72 @@
+/**
+ * @file pid.cpp
+ * @brief Fixed-point PI(D) controller
+ *
+ * Copyright(c) 2025  John Glynn
+ *
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ */
+
+#include "pid.h"
+
+// Default constructor
+PID_Controller::PID_Controller() {
+    gains = { 0, 0, 0 };
+    out_min = 0;
+    out_max = 0;
+    reset(0);
+}
+
+// Set the gains and output limits
+void PID_Controller::begin(const pid_gains_t &gains, int32_t out_min, int32_t out_max) {
+    PID_Controller::gains = gains;
+    PID_Controller::out_min = out_min;
+    PID_Controller::out_max = out_max;
+    reset(out_min);
+}
+
+// Restart the controller from a given output
+void PID_Controller::reset(int32_t output) {
+    output = constrain(output, out_min, out_max);
+    out_q = output << PID_GAIN_BITS;
+    error_1 = 0;
+    error_2 = 0;
+    primed = false;
+}
+
+// Update the controller with a new error reading
+int32_t PID_Controller::update(int32_t error, int32_t applied) {
+    // Another loop (or the caller) set the output, carry on from there
+    if (applied != output()) {
+        out_q = constrain(applied, out_min, out_max) << PID_GAIN_BITS;
+    }
+
+    // No history yet, so no proportional or derivative kick
+    if (!primed) {
+        error_1 = error;
+        error_2 = error;
+        primed = true;
+    }
+
+    // Change in output, 64-bit as the error terms can be large before
+    // the loop has settled
+    int64_t du = (int64_t)gains.kp * (error - error_1) +
+                 (int64_t)gains.ki * error +
+                 (int64_t)gains.kd * (error - 2 * error_1 + error_2);
+    error_2 = error_1;
+    error_1 = error;
+
+    // Apply and clamp, which also stops the integral action winding up
+    int64_t out = (int64_t)out_q + du;
+    int64_t lo = (int64_t)out_min << PID_GAIN_BITS;
+    int64_t hi = (int64_t)out_max << PID_GAIN_BITS;
+    out_q = (int32_t)constrain(out, lo, hi);
+
+    return output();
+}
+
+// Get the current output
+int32_t PID_Controller::output(void) {
+    return (out_q + (PID_GAIN_SCALE / 2)) >> PID_GAIN_BITS;
+}
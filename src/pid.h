@@ -0,0 +1,100 @@
+/**
+ * @file pid.h
+ * @brief Fixed-point PI(D) controller
+ *
+ * Copyright(c) 2025  John Glynn
+ *
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ *
+ * @details
+ * Incremental (velocity form) PID controller using integer math only.
+ * Each call to `update()` works out the change in output from the
+ * current and previous errors:
+ *
+ *     du = Kp*(e[n] - e[n-1]) + Ki*e[n] + Kd*(e[n] - 2*e[n-1] + e[n-2])
+ *
+ * and adds it to the output, which is clamped to the configured limits.
+ * The integral action lives in the clamped output rather than a separate
+ * integrator, so it can't wind up while the output sits at a limit.
+ *
+ * Gains are in units of 1/`PID_GAIN_SCALE` output units per unit of
+ * error per update, and the output is kept with the same fractional
+ * resolution, so small corrections accumulate rather than being lost to
+ * rounding.
+ *
+ * Several controllers can share one output, with the caller applying
+ * the lowest (or highest) of their outputs.  Each `update()` is given
+ * the output actually applied, and a controller whose own output wasn't
+ * used restarts from it, so the loops hand over without a bump (e.g.
+ * constant current and constant voltage limits on a charger).
+ */
+#ifndef _PID_H_
+#define _PID_H_
+
+#include <Arduino.h>
+
+#define PID_GAIN_BITS   10                  ///< Fractional bits in gains and output
+#define PID_GAIN_SCALE  (1 << PID_GAIN_BITS) ///< Gain value representing 1.0
+
+/**
+ *  @brief Controller gains, in units of 1/`PID_GAIN_SCALE`
+ */
+struct pid_gains_t {
+    int16_t kp;                             ///< Proportional gain
+    int16_t ki;                             ///< Integral gain (per update)
+    int16_t kd;                             ///< Derivative gain (per update)
+};
+
+/// @brief Fixed-point PI(D) controller class
+class PID_Controller {
+public:
+    /**
+     * @brief Default constructor
+     */
+    PID_Controller();
+
+    /**
+     * @brief Set the gains and output limits
+     * @param gains: Controller gains
+     * @param out_min: Lowest output allowed
+     * @param out_max: Highest output allowed
+     * @returns Nothing
+     */
+    void begin(const pid_gains_t &gains, int32_t out_min, int32_t out_max);
+
+    /**
+     * @brief Restart the controller from a given output
+     * @param output: Starting output, clamped to the limits
+     * @returns Nothing
+     * @note Clears the error history, so the first update has no
+     *       proportional or derivative kick.
+     */
+    void reset(int32_t output);
+
+    /**
+     * @brief Update the controller with a new error reading
+     * @param error: Setpoint minus measured value
+     * @param applied: Output currently applied, restarting the controller
+     *                 from it if it differs from the controller's output
+     * @returns New output
+     */
+    int32_t update(int32_t error, int32_t applied);
+
+    /**
+     * @brief Get the current output
+     * @returns Output, rounded to whole units
+     */
+    int32_t output(void);
+
+private:
+    pid_gains_t gains;                      ///< Controller gains
+    int32_t out_min;                        ///< Output lower limit
+    int32_t out_max;                        ///< Output upper limit
+    int32_t out_q;                          ///< Output with PID_GAIN_BITS fraction bits
+    int32_t error_1;                        ///< Previous error
+    int32_t error_2;                        ///< Error before the previous one
+    bool primed;                            ///< Error history valid?
+};
+
+#endif
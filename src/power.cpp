@@ -0,0 +1,107 @@
+/**
+ * @file power.cpp
+ * @brief Low-power Stop mode support
+ * 
+ * Copyright(c) 2025  John Glynn
+ * 
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ */
+
+#include "power.h"
+#include "battery.h"
+#include "console.h"
+
+#include <i2c_busio.h>
+#include <stm32_time.h>
+
+#ifdef ARDUINO_ARCH_STM32
+#include <STM32LowPower.h>
+#include <STM32RTC.h>
+#endif
+
+//
+// Global variables
+//
+extern I2C main_i2c_bus;                    ///< Main I2C bus
+extern Alarm_Pool timer_pool;               ///< Hardware timers
+extern Console_TX console;                  ///< Serial console output
+
+// Default constructor
+Low_Power::Low_Power() {
+    hook = nullptr;
+    sleep_count = 0;
+    sleep_total_ms = 0;
+}
+
+// Configure the RTC used to wake up from Stop mode
+void Low_Power::begin(void) {
+#ifdef ARDUINO_ARCH_STM32
+    STM32RTC::getInstance().setClockSource(STM32RTC::LSI_CLOCK);
+    STM32RTC::getInstance().begin();
+    LowPower.begin();
+#endif
+}
+
+// Enter Stop mode until the period has passed
+time_ms_t Low_Power::sleep(time_ms_t period_ms) {
+    time_ms_t slept = 0;
+
+    // Alarm handlers need the pool's hardware timer running
+    if ((period_ms == 0) || timer_pool.pending()) {
+        return 0;
+    }
+
+    // Finish transfers that would otherwise stop part-way through,
+    // and stop the battery voltage conversions
+    main_i2c_bus.flush();
+    console.flush();
+    Battery::suspend();
+
+    if (hook != nullptr) {
+        slept = hook(period_ms);
+    } else {
+#ifdef ARDUINO_ARCH_STM32
+        // Measure the time asleep with the RTC, since the SysTick
+        // interrupt behind millis() stops in Stop mode
+        STM32RTC &rtc = STM32RTC::getInstance();
+        uint32_t sub_before, sub_after;
+        uint32_t epoch_before = rtc.getEpoch(&sub_before);
+        LowPower.deepSleep(period_ms);
+        uint32_t epoch_after = rtc.getEpoch(&sub_after);
+        slept = (epoch_after - epoch_before) * 1000 + sub_after - sub_before;
+        uwTick += slept;
+#else
+        delay(period_ms);
+        slept = period_ms;
+#endif
+    }
+
+    Battery::resume();
+
+    sleep_count++;
+    sleep_total_ms += slept;
+    return slept;
+}
+
+// Wait in Sleep mode for the next interrupt
+void Low_Power::idle(void) {
+#ifdef ARDUINO_ARCH_STM32
+    HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+#endif
+}
+
+// Install a hook to be called in place of entering Stop mode
+void Low_Power::set_hook(sleep_hook_t sleep_hook) {
+    hook = sleep_hook;
+}
+
+// Get the number of times Stop mode was entered
+uint32_t Low_Power::sleeps(void) {
+    return sleep_count;
+}
+
+// Get the total time spent in Stop mode
+time_ms_t Low_Power::slept_ms(void) {
+    return sleep_total_ms;
+}
@@ -0,0 +1,96 @@
+/**
+ * @file power.h
+ * @brief Low-power Stop mode support
+ * 
+ * Copyright(c) 2025  John Glynn
+ * 
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ * 
+ * @details
+ * Puts the STM32G030 into Stop mode for a given time, with an RTC alarm
+ * to wake it up again.  The SysTick interrupt behind `millis()` stops along
+ * with the other clocks, so the time spent asleep is measured with the RTC
+ * and added to the HAL tick count on waking.  Software timers based on
+ * `millis()`, including the `Alarm_Pool` countdowns, then carry on as if
+ * the processor had been running.
+ * 
+ * GPIO outputs hold their levels in Stop mode, but timer-driven PWM and
+ * the interrupt-driven I2C and serial transfers stop, so callers should
+ * only sleep with the RGB LED off.  Pending I2C transactions and serial
+ * output are flushed before sleeping.
+ * 
+ * On the host simulator a hook replaces Stop mode, so the sleep scheduling
+ * can be exercised without the hardware.
+ */
+#ifndef _POWER_H_
+#define _POWER_H_
+
+#include "obcharger.h"
+
+/**
+ * @brief Sleep hook replacing Stop mode (e.g. on the host simulator)
+ * @param period_ms: Requested sleep period (ms)
+ * @returns Time actually spent asleep (ms)
+ */
+typedef time_ms_t (*sleep_hook_t)(time_ms_t period_ms);
+
+/// @brief Low-power Stop mode class
+class Low_Power {
+public:
+    /**
+     * @brief Default constructor
+     */
+    Low_Power();
+
+    /**
+     * @brief Configure the RTC used to wake up from Stop mode
+     * @returns Nothing
+     */
+    void begin(void);
+
+    /**
+     * @brief Enter Stop mode until the period has passed
+     * @param period_ms: Sleep period (ms)
+     * @returns Time spent asleep (ms), 0 if sleeping wasn't possible
+     * @note Doesn't sleep while alarms in the `Alarm_Pool` are waiting
+     *       to call a handler, as the pool's hardware timer is stopped
+     *       along with everything else.
+     */
+    time_ms_t sleep(time_ms_t period_ms);
+
+    /**
+     * @brief Wait in Sleep mode for the next interrupt
+     * @returns Nothing
+     * @note Only the processor clock stops, so peripherals, PWM and the
+     *       SysTick interrupt behind `millis()` carry on, and the
+     *       processor wakes within a millisecond.
+     */
+    void idle(void);
+
+    /**
+     * @brief Install a hook to be called in place of entering Stop mode
+     * @param hook: Sleep hook (nullptr to restore Stop mode)
+     * @returns Nothing
+     */
+    void set_hook(sleep_hook_t hook);
+
+    /**
+     * @brief Get the number of times Stop mode was entered
+     * @returns Number of sleeps
+     */
+    uint32_t sleeps(void);
+
+    /**
+     * @brief Get the total time spent in Stop mode
+     * @returns Time asleep (ms)
+     */
+    time_ms_t slept_ms(void);
+
+private:
+    sleep_hook_t hook;                      ///< Replaces Stop mode if set
+    uint32_t sleep_count;                   ///< Number of sleeps
+    time_ms_t sleep_total_ms;               ///< Total time asleep
+};
+
+#endif
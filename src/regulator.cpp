@@ -10,16 +10,27 @@
 
 #include "regulator.h"
 #include "battery.h"
+#include "nvstore.h"
+#include "console.h"
 
+//
 // Global variables
-extern Battery battery;
+//
+extern NV_Store nv_store;                   ///< Calibration data in flash
+extern Console_TX console;                  ///< Serial console output
 
 // Default constructor
+// The calibration table starts out as a straight line
 Vreg::Vreg(void) {
+    for (uint8_t i = 0; i < VREG_CAL_POINTS; i++) {
+        cal_mV[i] = map(cal_level(i), MCP4726_DAC_MAX, MCP4726_DAC_MIN, VREG_VOLTAGE_MIN,
+                        VREG_VOLTAGE_MAX);
+        cal_saved_mV[i] = cal_mV[i];
+    }
 }
 
 // Constructor with initialization
-Vreg::Vreg(PinNumber control_pin, INA219 *sensor, MCP4726 *dac) {
+Vreg::Vreg(PinNumber control_pin, INA219 *sensor, MCP4726 *dac) : Vreg() {
     // Initialize regulator, saves the interface objects
     begin(control_pin, sensor, dac);
 }
@@ -49,7 +60,7 @@ void Vreg::begin(PinNumber control_pin, INA219 *sensor, MCP4726 *dac) {
         sensor->set_operation_mode(SANDBVOLT_CONTINUOUS);
     } else {
         // Fatal error
-        Serial.printf("Error: INA219B sensor is not responding!\n");
+        console.printf("Error: INA219B sensor is not responding!\n");
         while (1);
     }
 
@@ -57,13 +68,19 @@ void Vreg::begin(PinNumber control_pin, INA219 *sensor, MCP4726 *dac) {
     if (dac->connected()) {
         dac->begin(MCP4726_AWAKE | MCP4726_VREF_VDD | MCP4726_GAIN_1X);
         dac->set_level(4095);  // Minimum voltage level
+        dac_level = 4095;
     } else {
         // Fatal error
-        Serial.printf("Error: MCP4726 DAC is not responding!\n");
+        console.printf("Error: MCP4726 DAC is not responding!\n");
         while (1);
     }
 }
 
+// Set the battery connected to the regulator output
+void Vreg::set_battery(Battery *battery) {
+    Vreg::battery = battery;
+}
+
 // Get output voltage level
 voltage_mv_t Vreg::get_voltage_mV(void) {
     // Output voltage is only meaningful if the voltage regulator is on.
@@ -87,24 +104,27 @@ void Vreg::set_voltage_mV(voltage_mv_t voltage) {
         sv = voltage;
     };
 
-    // Set DAC level to achieve requested voltage
-    // USING CALCULATION SINCE LINEAR RELATIONSHIP EXISTS
+    // Set DAC level to achieve requested voltage, from the calibration
+    // table.  Update is queued so the control loop doesn't wait on the
+    // I2C bus, and skipped if the DAC level is unchanged
+    set_mV = sv;
     uint16_t dac_setting = calc_dac(sv);
-    dac->set_level(dac_setting);
+    if (dac_setting != dac_level) {
+        if (dac->queue_level(dac_setting)) {
+            dac_level = dac_setting;
+            dac_time = millis();
+        }
+    }
+}
+
+// Get the DAC level last written
+uint16_t Vreg::get_dac_level(void) {
+    return dac_level;
 }
 
 // Get output current
 current_ma_t Vreg::get_current_mA(void) {
-    if (sensor->get_bus_voltage_mV() > (battery.get_voltage_average_mV() + 250)) {
-        // Normal condition
-        return sensor->get_current_mA();
-    } else {
-        // If the regulator output voltage is not 300-400 mV or more above the
-        // battery voltage (i.e. the drop across the schottky diode), the 
-        // charging current will be zero.  Force that result to avoid returning
-        // spurious current readings caused by noise at the INA219 inputs.
-        return 0;
-    }
+    return sample_current_mA(battery ? battery->get_voltage_average_mV() : 0);
 }
 
 /**
@@ -120,9 +140,12 @@ current_ma_t Vreg::get_current_average_mA(void) {
     uint32_t max = 0;
     uint32_t sum = 0;
 
-    // Take consecutive voltage readings
+    // Battery voltage changes slowly, so one reading serves all samples
+    voltage_mv_t battery_mV = battery ? battery->get_voltage_average_mV() : 0;
+
+    // Take consecutive current readings
     for (int i=0; i < AVG_READINGS; i++) {
-        reading[i] = get_current_mA();
+        reading[i] = sample_current_mA(battery_mV);
         if (reading[i] < min) {
             min = reading[i];
         }
@@ -133,14 +156,119 @@ current_ma_t Vreg::get_current_average_mA(void) {
     }
 
     // Debugging information
-    // Serial.printf("Charging mA: Avg %u, Min %u, Max %u\n", (sum/AVG_READINGS), min, max);
+    // console.printf("Charging mA: Avg %u, Min %u, Max %u\n", (sum/AVG_READINGS), min, max);
 
     // Return calculated average
     return (current_ma_t)(sum/AVG_READINGS);
 }
 
+// Take a single output current reading
+current_ma_t Vreg::sample_current_mA(voltage_mv_t battery_mV) {
+    ina219_snapshot_t snapshot;
+
+    // Bus voltage and current are read together in one pass
+    sensor->read_all(snapshot, INA219_SNAPSHOT_BUS | INA219_SNAPSHOT_CURRENT);
+
+    if (snapshot.bus_voltage_mV > (battery_mV + 250)) {
+        // Normal condition
+        return snapshot.current_mA;
+    } else {
+        // If the regulator output voltage is not 300-400 mV or more above the
+        // battery voltage (i.e. the drop across the schottky diode), the 
+        // charging current will be zero.  Force that result to avoid returning
+        // spurious current readings caused by noise at the INA219 inputs.
+        return 0;
+    }
+}
+
+// Take a single output current and bus voltage reading
+// The current register is signed, so readings either side of zero are
+// kept apart
+int32_t Vreg::sample_output(voltage_mv_t &bus_mV) {
+    ina219_snapshot_t snapshot;
+
+    sensor->read_all(snapshot, INA219_SNAPSHOT_BUS | INA219_SNAPSHOT_CURRENT);
+    bus_mV = snapshot.bus_voltage_mV;
+    return (int32_t)(int16_t)snapshot.current_raw * INA219_ILSB / 1000;
+}
+
+// Start measuring the internal resistance of the battery being charged
+// There's no room to step down once the DAC is at the lowest voltage
+bool Vreg::start_resistance(void) {
+    if ((battery == nullptr) || !is_on() || (dac_level >= MCP4726_DAC_MAX)) {
+        return false;
+    }
+    ir_state = IR_START;
+    return true;
+}
+
+// Carry on with the internal resistance measurement
+// The step and the restore are queued in the I2C priority slot, and each
+// set of readings is taken a control pass after the DAC last changed, so
+// the step has settled and the A/D results in the buffer are all from it
+bool Vreg::update_resistance(uint32_t &resistance_mohm) {
+    resistance_mohm = 0;
+    if (ir_state == IR_IDLE) {
+        return false;
+    }
+    if (!is_on()) {
+        ir_state = IR_IDLE;
+        return false;
+    }
+
+    if (ir_state == IR_START) {
+        // Readings at the present charging current, then step the regulator
+        // down (the DAC level is inverse to the voltage)
+        sample_step(ir_before_mV, ir_before_mA);
+        voltage_mv_t step_mV = std::max<voltage_mv_t>(set_mV, VREG_VOLTAGE_MIN + IR_STEP_MV) - IR_STEP_MV;
+        uint16_t step_level = std::min<uint16_t>(std::max<uint16_t>(calc_dac(step_mV), dac_level + 1),
+                                                 MCP4726_DAC_MAX);
+        if (!dac->queue_level(step_level)) {
+            ir_state = IR_IDLE;
+            return false;
+        }
+        ir_state = IR_STEPPED;
+        return true;
+    }
+
+    // Readings during the step, then set the regulator back
+    voltage_mv_t after_mV;
+    current_ma_t after_mA;
+    sample_step(after_mV, after_mA);
+    dac->queue_level(dac_level);
+    dac_time = millis();
+    ir_state = IR_IDLE;
+
+    // The current has to change enough for a meaningful result
+    if ((ir_before_mA >= after_mA + IR_MIN_STEP_MA) && (ir_before_mV >= after_mV)) {
+        resistance_mohm = (ir_before_mV - after_mV) * 1000 / (ir_before_mA - after_mA);
+    }
+    return false;
+}
+
+// Check if an internal resistance measurement is running
+bool Vreg::measuring_resistance(void) {
+    return ir_state != IR_IDLE;
+}
+
+// Average battery voltage and current readings
+// The A/D buffer covers the last few ms, and the current readings are
+// taken back to back
+void Vreg::sample_step(voltage_mv_t &battery_mV, current_ma_t &current_mA) {
+    uint32_t mA_sum = 0;
+
+    battery_mV = battery->get_voltage_average_mV();
+    for (int i = 0; i < IR_SAMPLES; i++) {
+        mA_sum += sample_current_mA(battery_mV);
+    }
+    current_mA = mA_sum / IR_SAMPLES;
+}
+
 // Turn voltage regulator on
+// A queued DAC level goes out first, so the regulator never comes up at
+// an earlier, higher setting
 void Vreg::on(void) {
+    dac->flush_level();
     digitalWrite(enable_port, HIGH);
 }
 
@@ -159,7 +287,158 @@ bool Vreg::is_on(void) {
 }
 
 // Get DAC value to achieve targeted voltage output
+// The table falls as the DAC level rises, so find the points either side
+// of the voltage and interpolate between them
 uint16_t Vreg::calc_dac(voltage_mv_t voltage) {
-    // Inverse linear relationship between voltage and DAC value
-    return map(voltage, VREG_VOLTAGE_MIN, VREG_VOLTAGE_MAX, MCP4726_DAC_MAX, MCP4726_DAC_MIN);
+    if (voltage >= cal_mV[0]) {
+        return cal_level(0);
+    }
+    for (uint8_t i = 1; i < VREG_CAL_POINTS; i++) {
+        if (voltage >= cal_mV[i]) {
+            return map(voltage, cal_mV[i - 1], cal_mV[i], cal_level(i - 1), cal_level(i));
+        }
+    }
+    return cal_level(VREG_CAL_POINTS - 1);
+}
+
+// Get the output voltage the calibration table gives for a DAC level
+voltage_mv_t Vreg::calibrated_mV(uint16_t level) {
+    uint8_t i = std::min<uint8_t>(level / VREG_CAL_STEP, VREG_CAL_POINTS - 2);
+    return map(level, cal_level(i), cal_level(i + 1), cal_mV[i], cal_mV[i + 1]);
+}
+
+// Get a point in the calibration table
+voltage_mv_t Vreg::calibration_point_mV(uint8_t point) {
+    return cal_mV[point];
+}
+
+// Get the DAC level of a calibration point
+// The last point is the top of the DAC's range
+uint16_t Vreg::cal_level(uint8_t point) {
+    return std::min<uint16_t>(point * VREG_CAL_STEP, MCP4726_DAC_MAX);
+}
+
+// Keep the calibration table falling as the DAC level rises
+// Working up from the lowest voltage, each point is kept above the one after
+void Vreg::cal_make_monotonic(void) {
+    for (int8_t i = VREG_CAL_POINTS - 2; i >= 0; i--) {
+        cal_mV[i] = std::max<uint16_t>(cal_mV[i], cal_mV[i + 1] + 1);
+    }
+}
+
+// Load the DAC calibration table saved in flash
+bool Vreg::load_calibration(void) {
+    uint16_t table[VREG_CAL_POINTS];
+    if (!nv_store.load(NV_VREG_CAL, table, sizeof(table))) {
+        return false;
+    }
+    memcpy(cal_mV, table, sizeof(cal_mV));
+    memcpy(cal_saved_mV, table, sizeof(cal_saved_mV));
+    cal_make_monotonic();
+    return true;
+}
+
+// Save the DAC calibration table in flash, if it has changed enough
+void Vreg::save_calibration(bool force) {
+    bool changed = force;
+    for (uint8_t i = 0; i < VREG_CAL_POINTS; i++) {
+        if (abs((int32_t)cal_mV[i] - (int32_t)cal_saved_mV[i]) >= VREG_LEARN_SAVE_MV) {
+            changed = true;
+        }
+    }
+    if (changed && nv_store.save(NV_VREG_CAL, cal_mV, sizeof(cal_mV))) {
+        memcpy(cal_saved_mV, cal_mV, sizeof(cal_saved_mV));
+    }
+}
+
+// Sweep the DAC to measure the regulator output at each calibration point
+// The DAC is written directly, and the readings taken once the regulator
+// output has settled.  Above the battery voltage the battery would take
+// an unknown current, so the sweep stops once it starts to.
+uint8_t Vreg::calibrate(void) {
+    int8_t i;
+    int32_t error_mV = 0;
+
+    on();
+    for (i = VREG_CAL_POINTS - 1; i >= 0; i--) {
+        dac->set_level(cal_level(i));
+        delay(VREG_CAL_SETTLE_MS);
+        voltage_mv_t measured;
+        if (sample_output(measured) >= (int32_t)VREG_CAL_CURRENT_MAX_MA) {
+            break;
+        }
+        error_mV = (int32_t)measured - (int32_t)cal_mV[i];
+        cal_mV[i] = measured;
+    }
+
+    // Move the points that couldn't be measured by a share of the last
+    // error, falling to none at the top of the range, so the table carries
+    // on from the last point measured towards `VREG_VOLTAGE_MAX`
+    for (int8_t j = i; j > 0; j--) {
+        cal_mV[j] = (uint16_t)constrain((int32_t)cal_mV[j] + error_mV * j / (i + 1), 0, UINT16_MAX);
+    }
+    cal_make_monotonic();
+
+    off();
+    dac->set_level(dac_level);
+    dac_time = millis();
+    return VREG_CAL_POINTS - 1 - i;
+}
+
+// Calibrate the battery voltage readings against the INA219 bus voltage
+// With no battery, the divider's current through the diode is the only
+// load, so the battery side of the diode sits a small, steady drop below
+// the bus voltage
+bool Vreg::calibrate_battery(void) {
+    if ((battery == nullptr) || (battery->get_voltage_average_mV() > BATTERY_ABSENT_MV)) {
+        return false;
+    }
+
+    uint16_t results[BATTERY_CAL_POINTS];
+    voltage_mv_t reference_mV[BATTERY_CAL_POINTS];
+    bool idle = true;
+    on();
+    for (uint8_t i = 0; (i < BATTERY_CAL_POINTS) && idle; i++) {
+        dac->set_level(calc_dac(BATTERY_CAL_LOW_MV + i * BATTERY_CAL_STEP_MV));
+        delay(BATTERY_CAL_SETTLE_MS);
+
+        uint32_t sum_mV = 0;
+        int32_t sum_mA = 0;
+        for (uint8_t j = 0; j < BATTERY_CAL_SAMPLES; j++) {
+            voltage_mv_t bus_mV;
+            sum_mA += sample_output(bus_mV);
+            sum_mV += bus_mV;
+        }
+        idle = (abs(sum_mA / BATTERY_CAL_SAMPLES) <= (int32_t)BATTERY_CAL_CURRENT_MAX_MA);
+        reference_mV[i] = sum_mV / BATTERY_CAL_SAMPLES - BATTERY_CAL_DIODE_MV;
+        results[i] = battery->get_result_average();
+    }
+    off();
+    dac->set_level(dac_level);
+    dac_time = millis();
+
+    return idle && battery->fit_calibration(results, reference_mV, BATTERY_CAL_POINTS);
+}
+
+// Learn from the regulator output at the present DAC level
+// The error at the DAC level is shared between the points either side,
+// in proportion to how close the level is to each of them
+void Vreg::learn(void) {
+    if (!is_on() || (ir_state != IR_IDLE) || (millis() - dac_time < VREG_CAL_SETTLE_MS) ||
+        (millis() - learn_time < VREG_LEARN_PERIOD_MS)) {
+        return;
+    }
+    learn_time = millis();
+
+    uint8_t i = std::min<uint8_t>(dac_level / VREG_CAL_STEP, VREG_CAL_POINTS - 2);
+    int32_t span = cal_level(i + 1) - cal_level(i);
+    int32_t weight = dac_level - cal_level(i);      // Towards point i+1, out of span
+    int32_t error_mV = (int32_t)sensor->get_bus_voltage_mV() - (int32_t)calibrated_mV(dac_level);
+    int32_t step_mV = error_mV / (1 << VREG_LEARN_SHIFT);
+
+    cal_mV[i] = (uint16_t)constrain((int32_t)cal_mV[i] + step_mV * (span - weight) / span, 0,
+                                    UINT16_MAX);
+    cal_mV[i + 1] = (uint16_t)constrain((int32_t)cal_mV[i + 1] + step_mV * weight / span, 0,
+                                        UINT16_MAX);
+    cal_make_monotonic();
 }
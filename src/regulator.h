@@ -13,8 +13,28 @@
  *  @li Current and bus voltage measurement provided by INA219x sensor
  *  @li Battery/output voltage read directly via A/D channel
  *  
- *  The voltage setting is adjusted by the MCP4726 DAC output level, with a linear
- *  relationship between the DAC count and the resulting regulator output voltage.
+ *  The voltage setting is adjusted by the MCP4726 DAC output level, which
+ *  drives the XL6008 feedback network.  The output voltage falls as the DAC
+ *  level rises, but not in a straight line, so the DAC level for a voltage
+ *  is found from a calibration table of the output voltage measured at
+ *  `VREG_CAL_POINTS` DAC levels, `VREG_CAL_STEP` apart, interpolating
+ *  between them.  The regulator then lands on a new setting in one write,
+ *  rather than the control loops having to work their way there.
+ *
+ *  The table starts out as the straight line between `VREG_VOLTAGE_MIN`
+ *  and `VREG_VOLTAGE_MAX`, and is filled in two ways:
+ *  @li `calibrate()` sweeps the DAC up from the lowest voltage, reading the
+ *      INA219 bus voltage at each point, until the battery starts taking
+ *      current.  This covers the range the regulator soft starts in.
+ *  @li `learn()` compares the bus voltage with the table while charging,
+ *      once the DAC has settled, and moves the two points either side a
+ *      share of the way towards the reading.  This fills in the range
+ *      above the battery voltage, which can't be swept without charging
+ *      the battery at an unknown current.
+ *
+ *  The table is saved in flash (see nvstore.h), so it's only swept the
+ *  first time the charger starts, and learning carries on from where it
+ *  left off.
  */
 #ifndef _REGULATOR_H_
 #define _REGULATOR_H_
@@ -24,6 +44,40 @@
 #include <ina219.h>
 #include <mcp4726.h>
 
+class Battery;
+
+/**
+ *  @brief Readings averaged on each side of the internal resistance step
+ *  @note Should be a power of 2 to avoid binary division errors
+ */
+#define IR_SAMPLES          8
+
+const voltage_mv_t IR_STEP_MV = 200;        ///< Regulator step down for measuring internal resistance (mV)
+const current_ma_t IR_MIN_STEP_MA = 100;    ///< Smallest current change giving a usable measurement (mA)
+
+/// @brief Internal resistance measurement steps, one per control pass
+enum ir_state_t {
+    IR_IDLE,                    ///< No measurement running
+    IR_START,                   ///< Take the readings before the step, and step down
+    IR_STEPPED                  ///< Step settled, take the readings and set the regulator back
+};
+
+const uint8_t VREG_CAL_POINTS = 17;                 ///< DAC calibration table points
+const uint16_t VREG_CAL_STEP = 256;                 ///< DAC levels between calibration points
+const time_ms_t VREG_CAL_SETTLE_MS = 20;            ///< Settling time at each calibration sweep point
+const current_ma_t VREG_CAL_CURRENT_MAX_MA = 50;    ///< Charging current that ends the sweep (mA)
+const time_ms_t VREG_LEARN_PERIOD_MS = 1000;        ///< Time between learning readings
+const uint8_t VREG_LEARN_SHIFT = 2;                 ///< Share of the error learned each reading (1/2^n)
+const voltage_mv_t VREG_LEARN_SAVE_MV = 20;         ///< Change in any point worth saving (mV)
+
+const uint8_t BATTERY_CAL_POINTS = 5;               ///< Regulator voltages the battery A/D is calibrated at
+const voltage_mv_t BATTERY_CAL_LOW_MV = 11000;      ///< Lowest battery calibration voltage (mV)
+const voltage_mv_t BATTERY_CAL_STEP_MV = 1000;      ///< Step between battery calibration voltages (mV)
+const time_ms_t BATTERY_CAL_SETTLE_MS = 50;         ///< Settling time, covering the A/D results averaged
+const uint8_t BATTERY_CAL_SAMPLES = 8;              ///< Bus voltage readings averaged at each voltage
+const current_ma_t BATTERY_CAL_CURRENT_MAX_MA = 20; ///< Largest average output current for calibrating (mA)
+const voltage_mv_t BATTERY_CAL_DIODE_MV = 120;      ///< Schottky diode drop at the divider's 0.3 mA (mV)
+
 /// @brief Adjustable voltage regulator class
 class Vreg {
 public:
@@ -47,6 +101,14 @@ public:
      */
     void begin(PinNumber control_pin, INA219 *sensor, MCP4726 *dac);
 
+    /**
+     * @brief Set the battery the regulator output is connected to
+     * @param battery: Battery object, whose voltage is used to tell when
+     *                 the regulator isn't delivering current
+     * @returns Nothing
+     */
+    void set_battery(Battery *battery);
+
     /**
      * @brief Get output voltage level
      * @returns Voltage in millivolts
@@ -60,6 +122,12 @@ public:
      */
     void set_voltage_mV(voltage_mv_t voltage);
 
+    /**
+     * @brief Get the DAC level last written
+     * @returns DAC level
+     */
+    uint16_t get_dac_level(void);
+
     /**
      * @brief Get output current
      * @returns Output current in milliamps
@@ -72,9 +140,108 @@ public:
      */
     current_ma_t get_current_average_mA(void);
 
+    /**
+     * @brief Start measuring the internal resistance of the battery being
+     *        charged
+     * @returns true=Started, false=No battery, the regulator is off, or
+     *          the DAC is already at the lowest voltage
+     * @note The measurement is carried out by `update_resistance()`.
+     */
+    bool start_resistance(void);
+
+    /**
+     * @brief Carry on with the internal resistance measurement
+     * @param resistance_mohm: Internal resistance (milliohms), returned once
+     *                         finished, 0 if it couldn't be measured
+     * @returns true=Still measuring, false=Finished
+     * @note Called once per `LOOP_DELAY`.  The first pass averages the
+     *       battery voltage and `IR_SAMPLES` current readings and queues a
+     *       step down by `IR_STEP_MV`, the next takes the readings again
+     *       and queues the DAC level back.  The change in battery voltage
+     *       over the change in charging current is the battery's ohmic
+     *       resistance, as polarization has little time to change.  The
+     *       caller holds the regulator setting until it has finished.
+     */
+    bool update_resistance(uint32_t &resistance_mohm);
+
+    /**
+     * @brief Check if an internal resistance measurement is running
+     * @returns true=Measuring, false=Idle
+     */
+    bool measuring_resistance(void);
+
+    /**
+     * @brief Load the DAC calibration table saved in flash
+     * @returns true=Loaded, false=None saved, the table is left as it was
+     */
+    bool load_calibration(void);
+
+    /**
+     * @brief Save the DAC calibration table in flash, if it has changed by
+     *        `VREG_LEARN_SAVE_MV` or more at any point since it was saved
+     * @param force: true=Save even if unchanged, as after `calibrate()`,
+     *               so a measured table is always kept
+     * @returns Nothing
+     * @note Blocks while the flash page is written, so only call it while
+     *       the charger isn't busy.
+     */
+    void save_calibration(bool force = false);
+
+    /**
+     * @brief Sweep the DAC to measure the regulator output at each
+     *        calibration point, from the lowest voltage up
+     * @returns Number of points measured
+     * @note The regulator is turned on for the sweep, and off again at the
+     *       end.  The sweep stops once the charging current reaches
+     *       `VREG_CAL_CURRENT_MAX_MA`, and the points above are moved by
+     *       the error found at the last point measured.  Blocks for up to
+     *       `VREG_CAL_POINTS` x `VREG_CAL_SETTLE_MS`.
+     */
+    uint8_t calibrate(void);
+
+    /**
+     * @brief Calibrate the battery voltage readings against the INA219 bus
+     *        voltage, with no battery on the output
+     * @returns true=Calibrated, false=A battery or load on the output, or
+     *          the fit is out of range, the calibration is left as it was
+     * @note The regulator is stepped through `BATTERY_CAL_POINTS` voltages
+     *       from `BATTERY_CAL_LOW_MV`, with only the battery channel's
+     *       voltage divider as a load, and the gain and offset are fitted
+     *       to the bus voltage less the diode drop.  Turns the regulator on
+     *       for the steps, and off again at the end.  Blocks for
+     *       `BATTERY_CAL_POINTS` x `BATTERY_CAL_SETTLE_MS`.
+     */
+    bool calibrate_battery(void);
+
+    /**
+     * @brief Learn from the regulator output at the present DAC level
+     * @returns Nothing
+     * @note Called every `LOOP_DELAY`, reading the bus voltage at most
+     *       every `VREG_LEARN_PERIOD_MS`, with the regulator on and the DAC
+     *       level unchanged for at least `VREG_CAL_SETTLE_MS`.  Skipped
+     *       while an internal resistance measurement has the DAC stepped.
+     */
+    void learn(void);
+
+    /**
+     * @brief Get the output voltage the calibration table gives for a DAC
+     *        level
+     * @param level: DAC level
+     * @returns Output voltage (mV)
+     */
+    voltage_mv_t calibrated_mV(uint16_t level);
+
+    /**
+     * @brief Get a point in the calibration table
+     * @param point: Calibration point (0 to `VREG_CAL_POINTS`-1)
+     * @returns Output voltage at the point's DAC level (mV)
+     */
+    voltage_mv_t calibration_point_mV(uint8_t point);
+
     /**
      * @brief Turn voltage regulator on
      * @returns Nothing
+     * @note Waits for any queued DAC level update to be written first.
      */
     void on(void);
 
@@ -94,15 +261,69 @@ protected:
     PinNumber enable_port;          ///< Voltage regulator enable GPIO pin (low=disabled, high=enabled)
     INA219 *sensor = nullptr;       ///< INA219x sensor object associated with the regulator
     MCP4726 *dac = nullptr;         ///< MCP4726 DAC object associated with the regulator
+    uint16_t dac_level = 0;         ///< DAC level last written
+    time_ms_t dac_time = 0;         ///< millis() time the DAC level was last written
+    time_ms_t learn_time = 0;       ///< millis() time of the last learning reading
+    voltage_mv_t set_mV = 0;        ///< Output voltage last set (mV)
+    ir_state_t ir_state = IR_IDLE;  ///< Internal resistance measurement step
+    voltage_mv_t ir_before_mV = 0;  ///< Battery voltage before the resistance step (mV)
+    current_ma_t ir_before_mA = 0;  ///< Charging current before the resistance step (mA)
+    Battery *battery = nullptr;     ///< Battery connected to the regulator output
+
+    /// @brief Output voltage at each calibration point (mV), falling as the DAC level rises
+    uint16_t cal_mV[VREG_CAL_POINTS];
+
+    /// @brief Calibration table as last saved or loaded (mV)
+    uint16_t cal_saved_mV[VREG_CAL_POINTS];
 
     /**
      * @brief Calculate the DAC value to achieve a targeted voltage output
      * @param voltage: Target voltage setting in millivolts
      * @returns DAC value to achieve target voltage setting
-     * @note Assumes a linear relationship between the DAC value and
-     *       the resulting output voltage.
+     * @note Interpolates between the points in the calibration table.
      */ 
     uint16_t calc_dac(voltage_mv_t voltage);
+
+    /**
+     * @brief Get the DAC level of a calibration point
+     * @param point: Calibration point (0 to `VREG_CAL_POINTS`-1)
+     * @returns DAC level
+     */
+    uint16_t cal_level(uint8_t point);
+
+    /**
+     * @brief Keep the calibration table falling as the DAC level rises, so
+     *        every voltage has one DAC level
+     * @returns Nothing
+     */
+    void cal_make_monotonic(void);
+
+    /**
+     * @brief Take a single output current and bus voltage reading
+     * @param bus_mV: Bus (regulator output) voltage (mV)
+     * @returns Output current (mA), negative readings included
+     * @note For calibrating, where the current is near zero and noise
+     *       takes readings either side of it.
+     */
+    int32_t sample_output(voltage_mv_t &bus_mV);
+
+    /**
+     * @brief Take a single output current reading
+     * @param battery_mV: Battery voltage in millivolts
+     * @returns Output current in milliamps
+     * @note Bus voltage and current are read from the INA219 in one pass.
+     */
+    current_ma_t sample_current_mA(voltage_mv_t battery_mV);
+
+    /**
+     * @brief Average battery voltage and current readings
+     * @param battery_mV: Average battery voltage (mV), returned
+     * @param current_mA: Average output current (mA), returned
+     * @returns Nothing
+     * @note The voltage is the average of the A/D results in the buffer,
+     *       and the current of `IR_SAMPLES` readings.
+     */
+    void sample_step(voltage_mv_t &battery_mV, current_ma_t &current_mA);
 };
 
 #endif
\ No newline at end of file
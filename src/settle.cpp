@@ -0,0 +1,43 @@
+/**
+ * @file settle.cpp
+ * @brief Detects when the readings have settled at the start of a cycle
+ *
+ * Copyright(c) 2025  John Glynn
+ *
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ */
+
+#include "settle.h"
+
+// Default constructor
+Settle_Detector::Settle_Detector(void) {
+    begin();
+}
+
+// Set the windows and empty them
+void Settle_Detector::begin(void) {
+    voltage.begin(SETTLE_INTERVAL_MS, SETTLE_SAMPLES);
+    current.begin(SETTLE_INTERVAL_MS, SETTLE_SAMPLES);
+}
+
+// Empty the windows
+void Settle_Detector::reset(void) {
+    voltage.reset();
+    current.reset();
+}
+
+// Add a pair of readings
+void Settle_Detector::add(voltage_mv_t voltage_mV, current_ma_t current_mA) {
+    voltage.add((int32_t)voltage_mV);
+    current.add((int32_t)current_mA);
+}
+
+// Check whether the readings have settled
+bool Settle_Detector::settled(void) {
+    return voltage.ready() && current.ready() &&
+           (abs(voltage.slope_per_hour()) <= SETTLE_VOLTAGE_SLOPE) &&
+           (voltage.deviation() <= SETTLE_VOLTAGE_DEVIATION_MV) &&
+           (abs(current.slope_per_hour()) <= SETTLE_CURRENT_SLOPE) &&
+           (current.deviation() <= SETTLE_CURRENT_DEVIATION_MA);
+}
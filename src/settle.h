@@ -0,0 +1,78 @@
+/**
+ * @file settle.h
+ * @brief Detects when the readings have settled at the start of a cycle
+ *
+ * Copyright(c) 2025  John Glynn
+ *
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ *
+ * @details
+ * Fast and topping charging hold off their termination checks for a
+ * startup period, while the regulator ramps up from its soft start and
+ * any surface charge on the battery dissipates.  The period is set for
+ * the worst case, so most cycles spend much of it waiting on readings that
+ * have already settled.
+ *
+ * `Settle_Detector` fits a line to the battery voltage and charging current
+ * over a short window, and reports the readings settled once both lines
+ * are close to flat and the readings close to their lines.  The cycles end
+ * their startup period then, with the configured period as an upper bound.
+ *
+ * Only the channel connected to the regulator is running a cycle, so the
+ * charger has a single detector, started again by each soft start.
+ */
+#ifndef _SETTLE_H_
+#define _SETTLE_H_
+
+#include "obcharger.h"
+#include "slope.h"
+
+const time_ms_t SETTLE_INTERVAL_MS = SECOND_MS;     ///< Time each average in the settling window covers
+const uint8_t SETTLE_SAMPLES = 20;                  ///< Averages in the settling window (20 seconds)
+const int32_t SETTLE_VOLTAGE_SLOPE = 3000;          ///< Largest battery voltage slope once settled (mV/h)
+const int32_t SETTLE_VOLTAGE_DEVIATION_MV = 15;     ///< Largest battery voltage scatter once settled (mV)
+const int32_t SETTLE_CURRENT_SLOPE = 3000;          ///< Largest charging current slope once settled (mA/h)
+const int32_t SETTLE_CURRENT_DEVIATION_MA = 15;     ///< Largest charging current scatter once settled (mA)
+
+/**
+ *  @brief Detects when the battery voltage and charging current settle
+ */
+class Settle_Detector {
+public:
+    /// @brief Default constructor
+    Settle_Detector(void);
+
+    /**
+     *  @brief Set the windows and empty them
+     *  @returns Nothing
+     */
+    void begin(void);
+
+    /**
+     *  @brief Empty the windows, e.g. when the regulator soft starts
+     *  @returns Nothing
+     */
+    void reset(void);
+
+    /**
+     *  @brief Add a pair of readings
+     *  @param voltage_mV: Battery voltage (mV)
+     *  @param current_mA: Charging current (mA)
+     *  @returns Nothing
+     */
+    void add(voltage_mv_t voltage_mV, current_ma_t current_mA);
+
+    /**
+     *  @brief Check whether the readings have settled
+     *  @returns true=Both windows full, with the slopes and scatter of the
+     *           readings within their limits
+     */
+    bool settled(void);
+
+private:
+    Slope_Estimator voltage;                ///< Battery voltage trend
+    Slope_Estimator current;                ///< Charging current trend
+};
+
+#endif
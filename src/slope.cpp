@@ -0,0 +1,153 @@
+/**
+ * @file slope.cpp
+ * @brief Least-squares slope of a reading over a sliding window
+ *
+ * Copyright(c) 2025  John Glynn
+ *
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ */
+
+#include "slope.h"
+
+// Integer square root, rounded down
+static uint64_t isqrt64(uint64_t n) {
+    uint64_t root = 0;
+    uint64_t bit = 1ULL << 62;
+    while (bit > n) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (n >= root + bit) {
+            n -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+// Default constructor
+Slope_Estimator::Slope_Estimator(void) {
+    begin(SECOND_MS, SLOPE_SAMPLES_MAX);
+}
+
+// Set the window and empty it
+void Slope_Estimator::begin(time_ms_t interval, uint8_t samples) {
+    Slope_Estimator::interval = interval;
+    size = constrain(samples, 3, SLOPE_SAMPLES_MAX);
+    reset();
+}
+
+// Empty the window
+void Slope_Estimator::reset(void) {
+    count = 0;
+    next = 0;
+    sum = 0;
+    sum_count = 0;
+    sum_start = millis();
+    fit_value = 0;
+    fit_slope = 0;
+    fit_error = 0;
+    fit_deviation = 0;
+}
+
+// Add a reading
+// Readings are averaged over the interval, and the average added to the
+// window in place of the oldest
+bool Slope_Estimator::add(int32_t value) {
+    sum += value;
+    sum_count++;
+    if (millis() - sum_start < interval) {
+        return false;
+    }
+
+    times[next] = millis();
+    values[next] = sum / sum_count;
+    next = (next + 1) % size;
+    count = std::min<uint8_t>(count + 1, size);
+    sum = 0;
+    sum_count = 0;
+    sum_start = millis();
+
+    fit();
+    return true;
+}
+
+// Check whether the window is full
+bool Slope_Estimator::ready(void) {
+    return count == size;
+}
+
+// Get the fitted line's value at the latest average
+int32_t Slope_Estimator::value(void) {
+    return fit_value;
+}
+
+// Get the fitted slope
+int32_t Slope_Estimator::slope_per_hour(void) {
+    return fit_slope;
+}
+
+// Get the standard error of the fitted slope
+int32_t Slope_Estimator::error_per_hour(void) {
+    return fit_error;
+}
+
+// Get the standard deviation of the averages about the line
+int32_t Slope_Estimator::deviation(void) {
+    return fit_deviation;
+}
+
+// Check whether the slope is below a limit with confidence
+bool Slope_Estimator::slope_below(int32_t limit_per_h, uint8_t sigmas) {
+    return ready() && (fit_slope + (int32_t)sigmas * fit_error < limit_per_h);
+}
+
+// Check whether the slope is above a limit with confidence
+bool Slope_Estimator::slope_above(int32_t limit_per_h, uint8_t sigmas) {
+    return ready() && (fit_slope - (int32_t)sigmas * fit_error > limit_per_h);
+}
+
+// Fit a line to the averages in the window
+// With x the time (s) and y the reading, both from the oldest average:
+//   slope = Dxy / Dxx, where Dxy = n.Sxy - Sx.Sy and Dxx = n.Sxx - Sx^2
+//   standard error^2 = (Dyy.Dxx - Dxy^2) / ((n - 2).Dxx^2)
+//   standard deviation^2 = (Dyy.Dxx - Dxy^2) / ((n - 2).n.Dxx)
+void Slope_Estimator::fit(void) {
+    uint8_t oldest = (count == size) ? next : 0;
+    int64_t n = count;
+    int64_t sx = 0, sy = 0, sxx = 0, sxy = 0, syy = 0;
+    int64_t x_last = 0;
+
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t slot = (oldest + i) % size;
+        int64_t x = (times[slot] - times[oldest]) / SECOND_MS;
+        int64_t y = values[slot] - values[oldest];
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+        syy += y * y;
+        x_last = x;
+    }
+
+    int64_t dxx = n * sxx - sx * sx;
+    if ((count < 3) || (dxx <= 0)) {
+        fit_value = values[(next + size - 1) % size];
+        fit_slope = 0;
+        fit_error = 0;
+        fit_deviation = 0;
+        return;
+    }
+    int64_t dxy = n * sxy - sx * sy;
+    int64_t dyy = n * syy - sy * sy;
+
+    fit_slope = (int32_t)(dxy * HOUR_MS / SECOND_MS / dxx);
+    fit_value = values[oldest] + (int32_t)((sy * dxx + dxy * (n * x_last - sx)) / (n * dxx));
+    int64_t scatter = std::max<int64_t>(dyy * dxx - dxy * dxy, 0) / (n - 2);
+    fit_error = (int32_t)((int64_t)isqrt64((uint64_t)scatter) * HOUR_MS / SECOND_MS / dxx);
+    fit_deviation = (int32_t)isqrt64((uint64_t)(scatter / (n * dxx)));
+}
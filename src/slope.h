@@ -0,0 +1,138 @@
+/**
+ * @file slope.h
+ * @brief Least-squares slope of a reading over a sliding window
+ *
+ * Copyright(c) 2025  John Glynn
+ *
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ *
+ * @details
+ * The charging cycles end on their readings levelling off as well as on a
+ * threshold being crossed: a battery that stops rising in voltage at
+ * constant current, or stops tapering in current at constant voltage, is
+ * as full as the cycle can make it.  A single reading against the one
+ * before is swamped by noise, so `Slope_Estimator` fits a straight line
+ * to the readings over a sliding window.
+ *
+ * Readings are averaged over each `interval`, and the averages kept with
+ * their millis() times in a window of up to `SLOPE_SAMPLES_MAX`.  Each
+ * time an average is added, a least-squares line is fitted to the window,
+ * giving:
+ * @li The slope, in reading units per hour.
+ * @li The standard error of the slope, from the scatter (standard
+ *     deviation) of the averages about the line, so a slope can be tested with a given confidence
+ *     (e.g. 3 standard errors) rather than taken at face value.
+ * @li The line's value at the latest average, a smoothed reading that
+ *     doesn't lag behind a steady trend as a plain average would.
+ *
+ * The fit uses 64-bit integer math, with times in seconds and readings
+ * relative to the window's first average to keep the sums in range.
+ */
+#ifndef _SLOPE_H_
+#define _SLOPE_H_
+
+#include "obcharger.h"
+
+const uint8_t SLOPE_SAMPLES_MAX = 20;       ///< Largest window (averages)
+
+/**
+ *  @brief Least-squares slope estimator
+ */
+class Slope_Estimator {
+public:
+    /// @brief Default constructor
+    Slope_Estimator(void);
+
+    /**
+     *  @brief Set the window and empty it
+     *  @param interval: Time each average covers (ms)
+     *  @param samples: Averages in the window (3 to `SLOPE_SAMPLES_MAX`)
+     *  @returns Nothing
+     */
+    void begin(time_ms_t interval, uint8_t samples);
+
+    /**
+     *  @brief Empty the window, e.g. when the readings are interrupted
+     *  @returns Nothing
+     */
+    void reset(void);
+
+    /**
+     *  @brief Add a reading
+     *  @param value: Reading
+     *  @returns true=An average was added and the line fitted again
+     */
+    bool add(int32_t value);
+
+    /**
+     *  @brief Check whether the window is full
+     *  @returns true=Full, and the fit covers the whole window
+     */
+    bool ready(void);
+
+    /**
+     *  @brief Get the fitted line's value at the latest average
+     *  @returns Smoothed reading
+     */
+    int32_t value(void);
+
+    /**
+     *  @brief Get the fitted slope
+     *  @returns Slope (reading units per hour)
+     */
+    int32_t slope_per_hour(void);
+
+    /**
+     *  @brief Get the standard error of the fitted slope
+     *  @returns Standard error (reading units per hour)
+     */
+    int32_t error_per_hour(void);
+
+    /**
+     *  @brief Get the standard deviation of the averages about the line
+     *  @returns Standard deviation (reading units)
+     */
+    int32_t deviation(void);
+
+    /**
+     *  @brief Check whether the slope is below a limit with confidence
+     *  @param limit_per_h: Limit (reading units per hour)
+     *  @param sigmas: Standard errors the slope must be below the limit by
+     *  @returns true=Window full and slope below the limit
+     */
+    bool slope_below(int32_t limit_per_h, uint8_t sigmas);
+
+    /**
+     *  @brief Check whether the slope is above a limit with confidence
+     *  @param limit_per_h: Limit (reading units per hour)
+     *  @param sigmas: Standard errors the slope must be above the limit by
+     *  @returns true=Window full and slope above the limit
+     */
+    bool slope_above(int32_t limit_per_h, uint8_t sigmas);
+
+private:
+    time_ms_t interval;                     ///< Time each average covers (ms)
+    uint8_t size;                           ///< Averages in a full window
+    uint8_t count;                          ///< Averages in the window
+    uint8_t next;                           ///< Slot for the next average
+    time_ms_t times[SLOPE_SAMPLES_MAX];     ///< millis() time of each average
+    int32_t values[SLOPE_SAMPLES_MAX];      ///< Averages
+
+    int32_t sum;                            ///< Sum of the readings for the next average
+    uint16_t sum_count;                     ///< Readings in the sum
+    time_ms_t sum_start;                    ///< millis() time the sum was started
+
+    int32_t fit_value;                      ///< Fitted value at the latest average
+    int32_t fit_slope;                      ///< Fitted slope (per hour)
+    int32_t fit_error;                      ///< Standard error of the slope (per hour)
+    int32_t fit_deviation;                  ///< Standard deviation about the line
+
+    /**
+     *  @brief Fit a line to the averages in the window
+     *  @returns Nothing
+     */
+    void fit(void);
+};
+
+#endif
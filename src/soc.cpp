@@ -0,0 +1,93 @@
+/**
+ * @file soc.cpp
+ * @brief Coulomb-counting battery state of charge estimator
+ *
+ * Copyright(c) 2025  John Glynn
+ *
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ */
+
+#include "soc.h"
+
+/// Charge added by two readings of 1 mA, 1 ms apart, times 100%
+/// (two readings for the trapezoid rule, ms per hour, efficiency percent)
+static const uint64_t SOC_DIVISOR = 2ULL * HOUR_MS * 100;
+
+// Default constructor
+SoC_Estimator::SoC_Estimator(void) {
+    begin(0);
+}
+
+// Set the battery capacity, with the battery taken to be empty
+void SoC_Estimator::begin(uint16_t capacity_mAh) {
+    capacity_q = (uint32_t)capacity_mAh << SOC_CHARGE_BITS;
+    charge_q = 0;
+    remainder = 0;
+    restart();
+}
+
+// Add a charging current reading
+void SoC_Estimator::add_sample(current_ma_t current_mA, time_ms_t now) {
+    time_ms_t period = now - last_time;
+    if (primed && (period <= SOC_SAMPLE_GAP_MS)) {
+        // Trapezoid between this reading and the last one, with the
+        // remainder carried so the fraction of a count isn't lost
+        uint64_t charge = ((uint64_t)(last_mA + current_mA) * period * CHARGE_EFFICIENCY_PCT
+                           << SOC_CHARGE_BITS) + remainder;
+        uint64_t added = charge / SOC_DIVISOR;
+        remainder = (uint32_t)(charge % SOC_DIVISOR);
+        charge_q = (uint32_t)std::min((uint64_t)charge_q + added, (uint64_t)capacity_q);
+    }
+    last_mA = current_mA;
+    last_time = now;
+    primed = true;
+}
+
+// Forget the last reading
+void SoC_Estimator::restart(void) {
+    last_mA = 0;
+    last_time = 0;
+    primed = false;
+}
+
+// Anchor the estimate
+void SoC_Estimator::anchor(soc_anchor_t anchor, voltage_mv_t rest_mV) {
+    switch (anchor) {
+        case SOC_REST:
+            set_rest_voltage(rest_mV);
+            break;
+        case SOC_FULL:
+            set_full();
+            break;
+        default:
+            break;
+    }
+}
+
+// Set the estimate from the battery's open-circuit voltage
+void SoC_Estimator::set_rest_voltage(voltage_mv_t rest_mV) {
+    voltage_mv_t mV = constrain(rest_mV, BATTERY_EMPTY_MV, BATTERY_FULL_MV);
+    charge_q = (uint32_t)((uint64_t)capacity_q * (mV - BATTERY_EMPTY_MV) /
+                          (BATTERY_FULL_MV - BATTERY_EMPTY_MV));
+    remainder = 0;
+}
+
+// Set the estimate to full charge
+void SoC_Estimator::set_full(void) {
+    charge_q = capacity_q;
+    remainder = 0;
+}
+
+// Get the estimated charge held by the battery
+uint32_t SoC_Estimator::get_charge_mAh(void) {
+    return (charge_q + (1 << (SOC_CHARGE_BITS - 1))) >> SOC_CHARGE_BITS;
+}
+
+// Get the estimated state of charge, rounded to the nearest percent
+uint8_t SoC_Estimator::get_soc(void) {
+    if (capacity_q == 0) {
+        return 0;
+    }
+    return (uint8_t)(((uint64_t)charge_q * 100 + capacity_q / 2) / capacity_q);
+}
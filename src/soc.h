@@ -0,0 +1,124 @@
+/**
+ * @file soc.h
+ * @brief Coulomb-counting battery state of charge estimator
+ *
+ * Copyright(c) 2025  John Glynn
+ *
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ *
+ * @details
+ * Estimates the charge held by the battery, in mAh out of
+ * `BATTERY_CAPACITY`, by integrating the charging current readings over
+ * time.  Each reading is taken with its `millis()` time, and the charge
+ * between consecutive readings is added using the trapezoid rule.
+ *
+ * The charge is kept in fixed point, with `SOC_CHARGE_BITS` fraction bits
+ * of a mAh, and the remainder of each division is carried into the next
+ * reading, so rounding doesn't build up over a long charge.  Only
+ * `CHARGE_EFFICIENCY_PCT` of the charge delivered is counted, as the rest
+ * goes into heat and gassing rather than being stored.
+ *
+ * Counting only tracks changes, so the estimate is anchored at points
+ * where the state of charge is known:
+ * @li With the battery at rest (at startup, or at the end of standby), the
+ *     open-circuit voltage gives the state of charge, in a straight line
+ *     from `BATTERY_EMPTY_MV` to `BATTERY_FULL_MV`.
+ * @li At the end of trickle charging, the battery is full.
+ *
+ * Readings more than `SOC_SAMPLE_GAP_MS` apart (e.g. after the battery was
+ * switched out, or a Stop mode sleep with the regulator off) start a new
+ * run of readings rather than being joined up.
+ */
+#ifndef _SOC_H_
+#define _SOC_H_
+
+#include "obcharger.h"
+
+#define SOC_CHARGE_BITS     16              ///< Fractional bits in the charge (mAh)
+
+/// @brief Longest time between readings that are joined up (ms)
+const time_ms_t SOC_SAMPLE_GAP_MS = 1000;
+
+/**
+ *  @brief How a charger state transition anchors the state of charge estimate
+ */
+enum soc_anchor_t {
+    SOC_KEEP = 0,                           ///< Carry on counting
+    SOC_REST = 1,                           ///< Battery at rest, set from its open-circuit voltage
+    SOC_FULL = 2,                           ///< Battery fully charged
+};
+
+/// @brief Coulomb-counting state of charge estimator class
+class SoC_Estimator {
+public:
+    /**
+     *  @brief Default constructor
+     */
+    SoC_Estimator(void);
+
+    /**
+     *  @brief Set the battery capacity, with the battery taken to be empty
+     *  @param capacity_mAh: Battery capacity (mAh)
+     *  @returns Nothing
+     */
+    void begin(uint16_t capacity_mAh);
+
+    /**
+     *  @brief Add a charging current reading
+     *  @param current_mA: Charging current (mA)
+     *  @param now: millis() time the reading was taken
+     *  @returns Nothing
+     */
+    void add_sample(current_ma_t current_mA, time_ms_t now);
+
+    /**
+     *  @brief Forget the last reading, so the next one isn't joined to it
+     *  @returns Nothing
+     *  @note Called when the battery is switched onto the regulator.
+     */
+    void restart(void);
+
+    /**
+     *  @brief Anchor the estimate
+     *  @param anchor: How the estimate is anchored
+     *  @param rest_mV: Battery voltage (mV), used by `SOC_REST`
+     *  @returns Nothing
+     */
+    void anchor(soc_anchor_t anchor, voltage_mv_t rest_mV);
+
+    /**
+     *  @brief Set the estimate from the battery's open-circuit voltage
+     *  @param rest_mV: Battery voltage at rest (mV)
+     *  @returns Nothing
+     */
+    void set_rest_voltage(voltage_mv_t rest_mV);
+
+    /**
+     *  @brief Set the estimate to full charge
+     *  @returns Nothing
+     */
+    void set_full(void);
+
+    /**
+     *  @brief Get the estimated charge held by the battery
+     *  @returns Charge (mAh)
+     */
+    uint32_t get_charge_mAh(void);
+
+    /**
+     *  @brief Get the estimated state of charge
+     *  @returns State of charge (0-100%)
+     */
+    uint8_t get_soc(void);
+
+private:
+    uint32_t capacity_q;                    ///< Battery capacity (mAh, SOC_CHARGE_BITS fraction bits)
+    uint32_t charge_q;                      ///< Charge held (mAh, SOC_CHARGE_BITS fraction bits)
+    uint32_t remainder;                     ///< Division remainder carried to the next reading
+    current_ma_t last_mA;                   ///< Last charging current reading (mA)
+    time_ms_t last_time;                    ///< millis() time of the last reading
+    bool primed;                            ///< Last reading valid?
+};
+
+#endif
@@ -8,29 +8,50 @@
  *  See the LICENSE file for the full license text.
  */
 #include "standby.h"
+#include "channel.h"
+#include "console.h"
 
 //
 // Global variables
 //
 extern Alarm_Pool timer_pool;               ///< Hardware timers
 extern Vreg vreg;                           ///< Voltage regulator
-extern Battery battery;                     ///< Battery
 extern SSD1306PrintDevice oled;             ///< OLED display object
+extern Status_Screen status_screen;         ///< OLED status screen
 extern bool oled_found;                     ///< OLED display found at startup in main()?
+extern Low_Power low_power;                 ///< Stop mode support
+extern Task_Scheduler tasks;                ///< Main loop tasks
+extern Console_TX console;                  ///< Serial console output
+
+// Print the task run times to the console
+static void report_tasks(void) {
+    tasks.print_report();
+}
 
 // Default constructor
 Standby_Charger::Standby_Charger() : Charge_Cycle() {
+    battery_voltage_mV = 0;
 }
 
 // Constructor with initialization
-Standby_Charger::Standby_Charger(charge_parm_t &p) : Charge_Cycle(p) {
-    init(p);
+Standby_Charger::Standby_Charger(charge_parm_t &p, Charge_Channel *channel) : Charge_Cycle(p, channel) {
+    battery_voltage_mV = 0;
 }
 
 // Destructor (best practice)
 Standby_Charger::~Standby_Charger() {
 }
 
+// Start standby mode
+// The regulator calibration learned while charging is saved, and the task
+// run times reported once the start has been handled, as there's nothing
+// else going on in standby
+void Standby_Charger::start(void) {
+    Charge_Cycle::start();
+    vreg.save_calibration();
+    tasks.add_once("report", report_tasks, 0, TASK_PRIORITY_LOW);
+}
+
 // Run-time handler to manage charge cycle
 cycle_state_t Standby_Charger::run() {
     // No startup time
@@ -43,29 +64,47 @@ cycle_state_t Standby_Charger::run() {
     if (!charging_time_remaining()) {
         // Yes, terminate charging cycle
         stop();
+        battery_voltage_mV = 0;
         state_code = CYCLE_TIMEOUT;
         return state_code;
     }
 
-    // Update RGB LED status as needed
-    status_led();
+    // Stop mode until there's something to do
+    low_power.sleep(sleep_period());
+
+    // Normal exit
+    return state_code;
+}
 
-    // Update any attached OLED displays
-    if (millis() - display_timer >= display_period) {
-        display_timer = millis();
-        if (oled_found) {
-            status_message(DISPLAY_OLED);
-        }
+// Update the RGB LED, sampling the battery voltage each time it pulses on
+void Standby_Charger::status_led(void) {
+    bool led_was_on = led_state;
+    Charge_Cycle::status_led();
+    if ((led_state && !led_was_on) || !battery_voltage_mV) {
+        battery_voltage_mV = channel->battery.get_voltage_mV();
     }
+}
+
+// The display is off in standby
+void Standby_Charger::update_display(void) {
+}
 
-    // Update serial console
-    if (millis() - message_timer >= message_period) {
-        message_timer = millis();
-        status_message(DISPLAY_CONSOLE);
+// Time until the next LED pulse, console message or the end of standby
+time_ms_t Standby_Charger::sleep_period(void) {
+    // Stay awake while the LED is on, since PWM stops in Stop mode
+    if (led_state) {
+        return 0;
     }
 
-    // Normal exit
-    return state_code;
+    time_ms_t now = millis();
+    time_ms_t period = charging_time_remaining();
+    time_ms_t led_elapsed = now - led_timer;
+    time_ms_t message_elapsed = now - message_timer;
+    period = std::min(period, (led_elapsed < led_off_period) ? led_off_period - led_elapsed : 0);
+    period = std::min(period, (message_elapsed < message_period) ? message_period - message_elapsed : 0);
+
+    // Not worth sleeping for less than a loop period
+    return (period >= LOOP_DELAY) ? period : 0;
 }
 
 /*
@@ -75,19 +114,19 @@ cycle_state_t Standby_Charger::run() {
  *
  * Console message format:
  *
- *  <name_str>, HH:MM:SS, xx.x
+ *  <name_str>, HH:MM:SS, xx.x, sss
  *
  * OLED display message format, sized to simulate a 16x2 character display:
  * 
  *  0123456789012345
  *  TTTTTT  HH:MM:SS
- *  xx.x V
+ *  xx.x sss%
  *
  *  TTTTTT = Charge cycle title to be displayed
+ *  sss = Estimated state of charge (%)
  */
 void Standby_Charger::status_message(display_t device) {
-    // Retrieve battery voltage
-    voltage_mv_t battery_voltage_mV = battery.get_voltage_average_mV();
+    // Battery voltage was sampled at the last LED pulse
     
     // Get elapsed time as a string (HH:MM:SS)
     ms_to_hms_str(charging_time_elapsed(), hms_str);
@@ -99,27 +138,29 @@ void Standby_Charger::status_message(display_t device) {
         case DISPLAY_NONE:      // No display present
             break;
         case DISPLAY_CONSOLE:   // Serial console
-            Serial.printf("%s, %s, %s\n", name_str, hms_str, bv_str);
+            channel->print_label();
+            console.printf("%s, %s, %s, %u\n", name_str, hms_str, bv_str, channel->soc.get_soc());
             break;
         case DISPLAY_OLED:      // OLED display
             // Write message to OLED display if present
             // Assumes display is configured for the default 8x16 proportional font
-            // Note: OLED display is cleared at the start of charging cycle
+            // Only the changed parts of the status screen are redrawn
             if (oled_found) {
-                oled.clear();
-                oled.setCursor(0,0);
-                oled.printf("%s", title_str);
-                oled.setCursor(64,0);
-                oled.printf("%s", hms_str);
-                oled.setCursor(0,2);
-                oled.printf("%s V", bv_str);
-                oled.switchFrame();
+                if (BATTERY_CHANNELS > 1) {
+                    status_screen.set_field(STATUS_TITLE, "%u %s", channel->number(), title_str);
+                } else {
+                    status_screen.set_field(STATUS_TITLE, "%s", title_str);
+                }
+                status_screen.set_field(STATUS_TIME, "%s", hms_str);
+                status_screen.set_field(STATUS_VOLTAGE, "%s %u%%", bv_str, channel->soc.get_soc());
+                status_screen.set_field(STATUS_CURRENT, "");
+                status_screen.update();
             } else {
-                Serial.printf("Error: OLED status was requested, but display not present\n");
+                console.printf("Error: OLED status was requested, but display not present\n");
             }
             break;
         default:                // Unknown device
-            Serial.printf("Error: Unknown display device %d\n", int(device));
+            console.printf("Error: Unknown display device %d\n", int(device));
     }
 }
 
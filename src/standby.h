@@ -9,13 +9,19 @@
  * 
  * @details
  * Called by the exec supervisor to maintain a standby mode charging cycle
- * from start to finish.  In the standby mode, the voltage regulator is
- * turned-off, and the handler simply:
+ * from start to finish.  In the standby mode, the voltage regulator and
+ * OLED display are turned-off, and the handler simply:
  * - Maintains the count-down until active charging should be resumed,
  * - Updates the RGB LED to indicate the current charging status,
+ * - Samples the battery voltage each time the LED pulses on,
+ * - Reports the task run times (see tasks.h) to the console,
  * - Selects the appropriate charging cycle to be run once it's time
  *   for active charging to resume.
  * 
+ * Between LED pulses and console messages the processor is put into
+ * Stop mode (see `Low_Power`), so the standby draw on the battery is
+ * mostly the regulator and current sensor quiescent currents.
+ * 
  * The global `Vreg` voltage regulator instance is used to control the
  * state of the hardware voltage regulator.
  * 
@@ -29,7 +35,8 @@
  * Typical standby cycle would be as follows:
  * 1. Create new `Standby` instance with appropriate settings
  * 2. Call the `start()` method once to begin a charge cycle
- * 3. Call `run()` method periodically (100 ms) intervals
+ * 3. Call `run()` method periodically (100 ms) intervals, which sleeps
+ *    in Stop mode until the next LED pulse or console message is due
  * 4. Standby cycle continues until the `TIMEOUT` condition is detected.
  * 
  * Hardware timer resources:
@@ -46,6 +53,8 @@
 #include "regulator.h"
 #include "battery.h"
 #include "utility.h"
+#include "power.h"
+#include "tasks.h"
 #include <stm32_time.h>
 
 // OLED display support
@@ -58,9 +67,9 @@
  * method overriden to support a standby period to allow the battery
  * to "rest" between active charging cycles.
  * 
- * The voltage regulator is turned-off during standby mode, with updates
- * to the RGB LED and display devices continuing periodically to provide
- * the user with a "keep-alive" indication.
+ * The voltage regulator and display are turned-off during standby mode,
+ * with the RGB LED pulsing periodically to provide the user with a
+ * "keep-alive" indication.
  * 
  * The LED and update parameters are configurable and are set when the handler
  * is initialized using the `init()` method.  See the documentation for the
@@ -83,19 +92,49 @@ public:
     /**
      * @brief Constructor with initialization
      * @param p: Charging parameters structure
+     * @param channel: Battery channel the cycle charges
      */
-    Standby_Charger(charge_parm_t &p);
+    Standby_Charger(charge_parm_t &p, Charge_Channel *channel);
 
     /**
      *  @brief Destructor (best practice)
      */
     ~Standby_Charger();
 
+    /**
+     * @brief Start standby mode, and report the task run times to the
+     *        console
+     * @returns Nothing
+     */
+    void start(void);
+
     /**
      * @brief Run-time handler to manage charging cycle
      * @returns Charging state
      */
     cycle_state_t run(void);
+
+    /**
+     * @brief Update the RGB LED, sampling the battery voltage each time
+     *        it pulses on
+     * @returns Nothing
+     */
+    void status_led(void);
+
+    /**
+     * @brief Leave the OLED display off in standby
+     * @returns Nothing
+     */
+    void update_display(void);
+
+    /**
+     * @brief Get the time that can be spent in Stop mode
+     * @returns Time until the next LED pulse, console message or the end
+     *          of standby (ms), or 0 if the processor should stay awake
+     * @note Stays awake while the LED is on, since its PWM output stops
+     *       in Stop mode, and for periods shorter than `LOOP_DELAY`.
+     */
+    time_ms_t sleep_period(void);
  
     /**
      *  @brief Write status information for standby mode to the targeted
@@ -107,7 +146,7 @@ public:
     void status_message(display_t device);
 
 private:
-
+    voltage_mv_t battery_voltage_mV;        ///< Battery voltage sampled at the last LED pulse
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,223 @@
+/**
+ * @file status_screen.cpp
+ * @brief Retained-mode OLED status screen
+ * 
+ * Copyright(c) 2025  John Glynn
+ * 
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ */
+
+#include "status_screen.h"
+#include <stdarg.h>
+
+//
+// Global variables
+//
+extern uint32_t oled_bytes_sent;            ///< Bytes sent to the OLED display
+
+/// @brief Field position and size (x in pixels, y in pages)
+struct field_layout_t {
+    uint8_t x;
+    uint8_t y;
+    uint8_t width;
+};
+
+/// @brief Layout of the 16x2 status screen fields
+static const field_layout_t FIELD_LAYOUT[STATUS_FIELDS] = {
+    {  0, 0, 64 },      // STATUS_TITLE
+    { 64, 0, 64 },      // STATUS_TIME
+    {  0, 2, 64 },      // STATUS_VOLTAGE
+    { 64, 2, 64 },      // STATUS_CURRENT
+};
+
+/// @brief Font height in pages (8x16 proportional font)
+#define FIELD_PAGES     2
+
+// Constructor
+Status_Screen::Status_Screen(SSD1306PrintDevice *display) {
+    oled = display;
+    memset(text, 0, sizeof(text));
+    update_count = 0;
+    last_bytes = 0;
+    max_bytes = 0;
+    bytes_total = 0;
+    drawing = false;
+    invalidate();
+}
+
+// Set the text of a field
+void Status_Screen::set_field(status_field_t field, const char *format, ...) {
+    va_list args;
+
+    if (field >= STATUS_FIELDS) {
+        return;
+    }
+    va_start(args, format);
+    vsnprintf(text[field], STATUS_FIELD_SIZE, format, args);
+    va_end(args);
+}
+
+// Forget what is on the display
+// A frame being drawn starts again, as it was drawn over the old contents
+void Status_Screen::invalidate(void) {
+    valid[0] = false;
+    valid[1] = false;
+    next_field = 0;
+    field_started = false;
+    frame_bytes = 0;
+}
+
+// Start drawing the changed parts of the fields on a new frame
+// A frame already being drawn picks up the new text for the fields it
+// hasn't reached yet
+void Status_Screen::update(void) {
+    if (!drawing) {
+        drawing = true;
+        next_field = 0;
+        field_started = false;
+        frame_bytes = 0;
+    }
+}
+
+// Draw the next changed glyph columns, showing the new frame once every
+// field is drawn
+// Unchanged fields take none of the columns, so several can be passed
+// over in one call
+bool Status_Screen::draw_next(void) {
+    if (!drawing) {
+        return false;
+    }
+
+    uint8_t frame = oled->currentRenderFrame();
+    uint32_t bytes_start = oled_bytes_sent;
+    uint16_t columns = STATUS_DRAW_COLUMNS;
+    while ((columns > 0) && (next_field < STATUS_FIELDS)) {
+        // The text is kept as it was when the field was started, so a
+        // field drawn over several calls is drawn from the same text
+        if (!field_started) {
+            start_field(next_field, (valid[frame]) ? shown[frame][next_field] : nullptr);
+            strcpy(shown[frame][next_field], text[next_field]);
+            field_started = true;
+        }
+        columns -= draw_columns(shown[frame][next_field], columns);
+        if ((text_start >= text_end) && (blank_start >= blank_end)) {
+            field_started = false;
+            next_field++;
+        }
+    }
+    frame_bytes += oled_bytes_sent - bytes_start;
+    if (next_field < STATUS_FIELDS) {
+        return true;
+    }
+
+    valid[frame] = true;
+    oled->switchFrame();
+    drawing = false;
+
+    // Update statistics
+    last_bytes = frame_bytes;
+    bytes_total += last_bytes;
+    if (last_bytes > max_bytes) {
+        max_bytes = last_bytes;
+    }
+    update_count++;
+    return false;
+}
+
+// Work out which glyph columns of a field need drawing
+// The unchanged leading characters are skipped, as are unchanged trailing
+// characters when the text width is the same (e.g. the " mA" units).
+// Anything beyond the end of the new text that was previously drawn is
+// blanked, or the rest of the field if its contents are unknown.
+void Status_Screen::start_field(uint8_t field, const char *old_text) {
+    const field_layout_t &f = FIELD_LAYOUT[field];
+    const char *new_text = text[field];
+    size_t new_len = strlen(new_text);
+    uint16_t new_width = text_width(new_text, new_len);
+    uint16_t old_width = f.width;
+    uint16_t start = 0;
+    uint16_t end = new_width;
+
+    if (new_width > f.width) {
+        new_width = f.width;
+        end = new_width;
+    }
+
+    if (old_text) {
+        size_t old_len = strlen(old_text);
+        if ((old_len == new_len) && (strcmp(old_text, new_text) == 0)) {
+            text_start = text_end = blank_start = blank_end = 0;
+            return;
+        }
+
+        old_width = text_width(old_text, old_len);
+        if (old_width > f.width) {
+            old_width = f.width;
+        }
+
+        // Skip the common leading characters
+        size_t prefix = 0;
+        while ((prefix < new_len) && (new_text[prefix] == old_text[prefix])) {
+            prefix++;
+        }
+        start = text_width(new_text, prefix);
+
+        // Skip the common trailing characters if they line up
+        if (text_width(old_text, old_len) == text_width(new_text, new_len)) {
+            size_t suffix = 0;
+            while ((suffix < new_len - prefix) && (suffix < old_len - prefix) &&
+                   (new_text[new_len - 1 - suffix] == old_text[old_len - 1 - suffix])) {
+                suffix++;
+            }
+            end = text_width(new_text, new_len - suffix);
+            if (end > new_width) {
+                end = new_width;
+            }
+        }
+    }
+
+    text_start = start;
+    text_end = end;
+    blank_start = new_width;
+    blank_end = old_width;
+}
+
+// Draw the next changed glyph columns of the field being drawn
+// The changed text columns are rewritten first, then what is left of the
+// old text is blanked
+uint16_t Status_Screen::draw_columns(const char *new_text, uint16_t columns) {
+    const field_layout_t &f = FIELD_LAYOUT[next_field];
+    uint16_t drawn = 0;
+
+    if (text_start < text_end) {
+        uint16_t width = std::min<uint16_t>(text_end - text_start, columns);
+        oled->setCursor(f.x + text_start, f.y);
+        oled->clipTextP(text_start, width, reinterpret_cast<DATACUTE_F_MACRO_T *>(new_text));
+        text_start += width;
+        drawn += width;
+    }
+
+    if ((drawn < columns) && (blank_start < blank_end)) {
+        uint16_t width = std::min<uint16_t>(blank_end - blank_start, columns - drawn);
+        for (uint8_t page = 0; page < FIELD_PAGES; page++) {
+            oled->setCursor(f.x + blank_start, f.y + page);
+            oled->fillLength(0, width);
+        }
+        blank_start += width;
+        drawn += width;
+    }
+    return drawn;
+}
+
+// Width in pixels of the first characters of a string
+uint16_t Status_Screen::text_width(const char *str, size_t len) {
+    char buffer[STATUS_FIELD_SIZE];
+
+    if (len >= sizeof(buffer)) {
+        len = sizeof(buffer) - 1;
+    }
+    memcpy(buffer, str, len);
+    buffer[len] = '\0';
+    return oled->getTextWidth(reinterpret_cast<DATACUTE_F_MACRO_T *>(buffer));
+}
@@ -0,0 +1,153 @@
+/**
+ * @file status_screen.h
+ * @brief Retained-mode OLED status screen
+ * 
+ * Copyright(c) 2025  John Glynn
+ * 
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ * 
+ * @details
+ * The status screen is laid out as four 64-pixel fields, sized to
+ * simulate a 16x2 character display with the 8x16 proportional font:
+ * 
+ *  0123456789012345
+ *  TTTTTT  HH:MM:SS
+ *  xx.x sss%  xxxx mA
+ * 
+ * The text last drawn in each field is remembered for both frames of the
+ * double-buffered display.  An update only sends the glyph columns that
+ * differ from what the frame being rendered already shows, so a typical
+ * once-a-second update rewrites a few characters of the elapsed time
+ * rather than the whole screen.
+ *
+ * A frame is drawn `STATUS_DRAW_COLUMNS` glyph columns at a time by
+ * `draw_next()`, called from the display task, and shown once every field
+ * is drawn.  A full redraw is several hundred bytes, which would otherwise
+ * hold up the main loop while the I2C queue drains.
+ */
+#ifndef _STATUS_SCREEN_H_
+#define _STATUS_SCREEN_H_
+
+#include "obcharger.h"
+
+// OLED display support
+#include <STM32_4kOLED.h>
+
+/// @brief Status screen fields
+enum status_field_t {
+    STATUS_TITLE = 0,                       ///< Charge cycle title (top left)
+    STATUS_TIME,                            ///< Elapsed time (top right)
+    STATUS_VOLTAGE,                         ///< Battery voltage and state of charge (bottom left)
+    STATUS_CURRENT,                         ///< Charging current (bottom right)
+    STATUS_FIELDS                           ///< Number of fields
+};
+
+#define STATUS_FIELD_SIZE   12              ///< Maximum field text length, including '\0'
+#define STATUS_DRAW_COLUMNS 16              ///< Most glyph columns drawn by one `draw_next()`
+
+/// @brief Retained-mode OLED status screen class
+class Status_Screen {
+public:
+    /**
+     * @brief Constructor
+     * @param display: OLED display to draw on
+     */
+    Status_Screen(SSD1306PrintDevice *display);
+
+    /**
+     * @brief Set the text of a field
+     * @param field: Field to set
+     * @param format: printf-style format string, followed by its arguments
+     * @returns Nothing
+     * @note Text is only stored; it is drawn by the next `update()`.
+     */
+    void set_field(status_field_t field, const char *format, ...);
+
+    /**
+     * @brief Start drawing the changed parts of the fields on a new frame
+     * @returns Nothing
+     * @note The frame is drawn by `draw_next()`.
+     */
+    void update(void);
+
+    /**
+     * @brief Draw the next `STATUS_DRAW_COLUMNS` changed glyph columns,
+     *        showing the new frame once every field is drawn
+     * @returns true=Frame still being drawn, false=Nothing left to draw
+     */
+    bool draw_next(void);
+
+    /**
+     * @brief Forget what is on the display, so the next updates redraw
+     *        every field in full
+     * @returns Nothing
+     */
+    void invalidate(void);
+
+    /**
+     * @brief Number of updates drawn
+     */
+    uint32_t updates(void) { return update_count; }
+
+    /**
+     * @brief Bytes sent to the display by the last update
+     * @note An update is a whole frame, drawn over several `draw_next()` calls.
+     */
+    uint32_t last_update_bytes(void) { return last_bytes; }
+
+    /**
+     * @brief Most bytes sent to the display by a single update
+     */
+    uint32_t max_update_bytes(void) { return max_bytes; }
+
+    /**
+     * @brief Total bytes sent to the display by all updates
+     */
+    uint32_t total_bytes(void) { return bytes_total; }
+
+protected:
+    SSD1306PrintDevice *oled;                               ///< Display object
+    char text[STATUS_FIELDS][STATUS_FIELD_SIZE];            ///< Text to be shown
+    char shown[2][STATUS_FIELDS][STATUS_FIELD_SIZE];        ///< Text drawn on each frame
+    bool valid[2];                                          ///< Frame contents are known
+    bool drawing;                                           ///< Frame being drawn?
+    uint8_t next_field;                                     ///< Next field to draw on the frame
+    bool field_started;                                     ///< Next field's columns worked out?
+    uint16_t text_start;                                    ///< Next changed text column of the field
+    uint16_t text_end;                                      ///< End of the changed text columns
+    uint16_t blank_start;                                   ///< Next column of old text to blank
+    uint16_t blank_end;                                     ///< End of the old text to blank
+    uint32_t frame_bytes;                                   ///< Bytes sent for the frame so far
+    uint32_t update_count;                                  ///< Updates drawn
+    uint32_t last_bytes;                                    ///< Bytes sent by the last update
+    uint32_t max_bytes;                                     ///< Most bytes sent by one update
+    uint32_t bytes_total;                                   ///< Bytes sent by all updates
+
+    /**
+     * @brief Work out which glyph columns of a field need drawing
+     * @param field: Field to draw
+     * @param old_text: Text currently shown in the field (nullptr=unknown)
+     * @returns Nothing
+     * @note Sets `text_start`, `text_end`, `blank_start` and `blank_end`.
+     */
+    void start_field(uint8_t field, const char *old_text);
+
+    /**
+     * @brief Draw the next changed glyph columns of the field being drawn
+     * @param new_text: Text being drawn in the field
+     * @param columns: Most columns to draw
+     * @returns Number of columns drawn
+     */
+    uint16_t draw_columns(const char *new_text, uint16_t columns);
+
+    /**
+     * @brief Width in pixels of the first characters of a string
+     * @param str: String to measure
+     * @param len: Number of characters to measure
+     * @returns Width in pixels, including inter-character spacing
+     */
+    uint16_t text_width(const char *str, size_t len);
+};
+
+#endif
@@ -0,0 +1,81 @@
+/**
+ * @file supervisor.cpp
+ * @brief Table-driven charging supervisor
+ *
+ * Copyright(c) 2025  John Glynn
+ *
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ */
+
+#include "supervisor.h"
+#include "console.h"
+
+//
+// Global variables
+//
+extern Console_TX console;                  ///< Serial console output
+
+// Look up the handler for a charger state
+const charger_stage_t *charger_stage(charger_state_t state) {
+    for (const charger_stage_t &stage : CHARGER_STAGES) {
+        if (stage.state == state) {
+            return &stage;
+        }
+    }
+    return nullptr;
+}
+
+// Look up the transition taken for a handler result
+const charger_transition_t *charger_transition(charger_state_t state, cycle_state_t result,
+                                               voltage_mv_t battery_mV,
+                                               const Charge_Channel &channel) {
+    for (const charger_transition_t &t : CHARGER_TRANSITIONS) {
+        if ((t.state == state) && (t.result == result) && (battery_mV <= t.battery_max_mV) &&
+            ((t.guard == nullptr) || t.guard(channel))) {
+            return &t;
+        }
+    }
+    return nullptr;
+}
+
+// Run the channel's handler and move to the next state when it finishes
+void charger_supervisor(Charge_Channel &channel) {
+    const charger_stage_t *stage = charger_stage(channel.state);
+    if (stage == nullptr) {
+        // Fatal error - we should never get here!
+        console.printf("Fatal error: Invalid charger state code '%u'!", channel.state);
+        while (1);
+    }
+
+    // States without a handler move on straight away
+    cycle_state_t result = stage->cycle ? stage->cycle(channel)->run() : CYCLE_DONE;
+    if ((result == CYCLE_STARTUP) || (result == CYCLE_RUNNING)) {
+        return;
+    }
+
+    voltage_mv_t battery_voltage = channel.battery.get_voltage_average_mV();
+    const charger_transition_t *t = charger_transition(channel.state, result, battery_voltage,
+                                                         channel);
+    if (t == nullptr) {
+        channel.print_label();
+        console.printf("%s returned unknown status!\n", stage->name_str);
+        channel.set_state(CHARGER_SHUTDOWN);
+        return;
+    }
+
+    if (t->message_str) {
+        char bv_str[6];  // Temporary buffer for battery voltage
+        milliunits_to_string(battery_voltage, 1, bv_str, sizeof(bv_str));
+        channel.print_label();
+        console.printf(t->message_str, bv_str);
+    }
+
+    // Battery at rest or fully charged, anchor the state of charge estimate
+    channel.soc.anchor(t->soc, battery_voltage);
+
+    // The scheduler starts the new state's handler
+    if (t->next != channel.state) {
+        channel.set_state(t->next);
+    }
+}
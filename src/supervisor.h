@@ -0,0 +1,255 @@
+/**
+ * @file supervisor.h
+ * @brief Table-driven charging supervisor
+ *
+ * Copyright(c) 2025  John Glynn
+ *
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ *
+ * @details
+ * Moves the charger between its states (fast, topping, trickle, standby,
+ * etc.) using two constant tables rather than hand-written branches:
+ * @li `CHARGER_STAGES` gives the `Charge_Cycle` handler run in each
+ *     charger state, and the state's priority when the regulator is
+ *     shared between battery channels (see channel.h).  States without a
+ *     handler (e.g. startup) behave as if the handler returned `CYCLE_DONE`
+ *     straight away.
+ * @li `CHARGER_TRANSITIONS` gives the next state for each result a
+ *     handler can return, optionally depending on the battery voltage
+ *     and a condition on the channel (e.g. its measured internal
+ *     resistance), along with a console message.
+ *     The first matching row is taken.
+ *     Transitions out of a state where the battery is at rest, or fully
+ *     charged, also anchor the channel's state of charge estimate (see
+ *     soc.h).
+ *
+ * While the handler returns `CYCLE_STARTUP` or `CYCLE_RUNNING`, the
+ * charger stays in the same state.  Any other result without a matching
+ * row shuts the charger down.  When a transition is taken, the handler
+ * for the new state is started by the channel scheduler.
+ *
+ * Each battery channel has its own charger state and handlers, so the
+ * tables give the handler as a function returning the channel's object.
+ *
+ * Adding a charging stage means adding its handler to `CHARGER_STAGES`
+ * and its exits to `CHARGER_TRANSITIONS`.  Both tables are `constexpr`,
+ * so they are placed in flash.
+ */
+#ifndef _SUPERVISOR_H_
+#define _SUPERVISOR_H_
+
+#include "obcharger.h"
+#include "channel.h"
+
+/// Battery voltage limit for transitions that don't depend on it
+const voltage_mv_t ANY_BATTERY_MV = 0xFFFFFFFF;
+
+/**
+ *  @brief Priority of a charger state when channels share the regulator
+ *  @note Lower values are more urgent.
+ */
+enum stage_priority_t {
+    STAGE_SETUP = 0,                        ///< Runs straight away, without the regulator
+    STAGE_BULK = 1,                         ///< Keeps the regulator until it finishes
+    STAGE_FLOAT = 2,                        ///< Takes turns on the regulator
+    STAGE_IDLE = 3,                         ///< Waits with the regulator off
+    STAGE_DONE = 4,                         ///< Nothing left to run
+};
+
+/// Handler accessor, returning a channel's handler for a charger state
+typedef Charge_Cycle *(*stage_cycle_t)(Charge_Channel &channel);
+
+/// Condition on a channel for a transition to be taken
+typedef bool (*transition_guard_t)(const Charge_Channel &channel);
+
+/**
+ *  @brief Charging cycle handler run in a charger state
+ */
+struct charger_stage_t {
+    charger_state_t state;                  ///< Charger state
+    stage_priority_t priority;              ///< Priority for the regulator
+    stage_cycle_t cycle;                    ///< Handler run in this state (nullptr=none)
+    const char *name_str;                   ///< Handler name for console messages
+};
+
+/**
+ *  @brief Charger state transition
+ */
+struct charger_transition_t {
+    charger_state_t state;                  ///< Current charger state
+    cycle_state_t result;                   ///< Result returned by the state's handler
+    voltage_mv_t battery_max_mV;            ///< Only taken at or below this battery voltage
+    transition_guard_t guard;               ///< Only taken when this returns true (nullptr=always)
+    charger_state_t next;                   ///< Next charger state
+    soc_anchor_t soc;                       ///< Anchors the state of charge estimate
+    const char *message_str;                ///< Console message, `%s` is the battery voltage (nullptr=none)
+};
+
+/**
+ *  @brief Charging cycle handler for each charger state
+ */
+inline constexpr charger_stage_t CHARGER_STAGES[] = {
+    { CHARGER_STARTUP, STAGE_SETUP, nullptr, "Startup initialization" },
+    { CHARGER_FAST, STAGE_BULK,
+      [](Charge_Channel &c) -> Charge_Cycle * { return &c.fast_charger; },
+      "Fast charging cycle" },
+    { CHARGER_TOPPING, STAGE_BULK,
+      [](Charge_Channel &c) -> Charge_Cycle * { return &c.topping_charger; },
+      "Topping charging cycle" },
+    { CHARGER_TRICKLE, STAGE_FLOAT,
+      [](Charge_Channel &c) -> Charge_Cycle * { return &c.trickle_charger; },
+      "Trickle charging cycle" },
+    { CHARGER_STANDBY, STAGE_IDLE,
+      [](Charge_Channel &c) -> Charge_Cycle * { return &c.standby_charger; },
+      "Standby mode handler" },
+#if CONDITIONING_CYCLE
+    { CHARGER_CONDITION, STAGE_BULK,
+      [](Charge_Channel &c) -> Charge_Cycle * { return &c.condition_charger; },
+      "Conditioning cycle" },
+#endif
+    { CHARGER_SHUTDOWN, STAGE_DONE, nullptr, "Shutdown" },
+#if LOAD_TEST_CYCLE
+    { CHARGER_LOAD_TEST, STAGE_BULK,
+      [](Charge_Channel &c) -> Charge_Cycle * { return &c.load_tester; },
+      "Battery load test" },
+#endif
+};
+
+/**
+ *  @brief Battery's internal resistance shows it to be sulfated
+ *  @param channel: Battery channel
+ *  @returns true=Sulfated, false=Not, or not measured
+ */
+inline bool battery_sulfated(const Charge_Channel &channel) {
+    return channel.session.resistance_mohm >= CONDITION_RESISTANCE_MOHM;
+}
+
+#if LOAD_TEST_CYCLE
+/**
+ *  @brief Load test selected for the battery
+ *  @param channel: Battery channel
+ *  @returns true=Selected, false=Not
+ */
+inline bool load_test_selected(const Charge_Channel &channel) {
+    return channel.load_test_selected;
+}
+#endif
+
+/**
+ *  @brief Charger state transitions
+ *  @note Rows for the same state and result are checked in order, so a
+ *        row limited by battery voltage or a guard must come before the
+ *        catch-all.
+ */
+inline constexpr charger_transition_t CHARGER_TRANSITIONS[] = {
+    // Nothing connected, load test if selected, fast if discharged heavily,
+    // topping otherwise
+    { CHARGER_STARTUP, CYCLE_DONE, BATTERY_ABSENT_MV, nullptr, CHARGER_SHUTDOWN, SOC_KEEP,
+      "Entering startup initialization state\n"
+      "Battery voltage @ %s volts, no battery connected\n\n" },
+#if LOAD_TEST_CYCLE
+    { CHARGER_STARTUP, CYCLE_DONE, ANY_BATTERY_MV, load_test_selected, CHARGER_LOAD_TEST, SOC_REST,
+      "Entering startup initialization state\n"
+      "Battery voltage @ %s volts, starting load test\n\n" },
+#endif
+    { CHARGER_STARTUP, CYCLE_DONE, BATTERY_DISCHARGED_MV, nullptr, CHARGER_FAST, SOC_REST,
+      "Entering startup initialization state\n"
+      "Battery voltage @ %s volts, initiating fast charge\n\n" },
+    { CHARGER_STARTUP, CYCLE_DONE, ANY_BATTERY_MV, nullptr, CHARGER_TOPPING, SOC_REST,
+      "Entering startup initialization state\n"
+      "Battery voltage @ %s volts, initiating topping charge\n\n" },
+
+    { CHARGER_FAST, CYCLE_DONE, ANY_BATTERY_MV, nullptr, CHARGER_TOPPING, SOC_KEEP,
+      "Fast charging cycle completed\n\n" },
+    { CHARGER_FAST, CYCLE_TIMEOUT, ANY_BATTERY_MV, nullptr, CHARGER_SHUTDOWN, SOC_KEEP,
+      "Fast charging cycle timed-out!\n" },
+    { CHARGER_FAST, CYCLE_ERROR, ANY_BATTERY_MV, nullptr, CHARGER_SHUTDOWN, SOC_KEEP,
+      "Fast charging cycle aborted by error condition!\n" },
+
+    // Topping charging done, conditioning first if the battery is sulfated
+#if CONDITIONING_CYCLE
+    { CHARGER_TOPPING, CYCLE_DONE, ANY_BATTERY_MV, battery_sulfated, CHARGER_CONDITION, SOC_KEEP,
+      "Topping charging cycle completed\n\n"
+      "Battery internal resistance high, starting conditioning\n" },
+#endif
+    { CHARGER_TOPPING, CYCLE_DONE, ANY_BATTERY_MV, nullptr, CHARGER_TRICKLE, SOC_KEEP,
+      "Topping charging cycle completed\n\n" },
+    { CHARGER_TOPPING, CYCLE_TIMEOUT, ANY_BATTERY_MV, nullptr, CHARGER_SHUTDOWN, SOC_KEEP,
+      "Topping charging cycle timed-out!\n" },
+    { CHARGER_TOPPING, CYCLE_ERROR, ANY_BATTERY_MV, nullptr, CHARGER_SHUTDOWN, SOC_KEEP,
+      "Topping charging cycle aborted by error condition!\n" },
+
+    // Trickle charging ends on the timer
+    { CHARGER_TRICKLE, CYCLE_DONE, ANY_BATTERY_MV, nullptr, CHARGER_STANDBY, SOC_FULL,
+      "Trickle charging cycle completed\n\n" },
+    { CHARGER_TRICKLE, CYCLE_TIMEOUT, ANY_BATTERY_MV, nullptr, CHARGER_STANDBY, SOC_FULL,
+      "Trickle charging cycle completed\n\n" },
+    { CHARGER_TRICKLE, CYCLE_ERROR, ANY_BATTERY_MV, nullptr, CHARGER_SHUTDOWN, SOC_KEEP,
+      "Trickle charging cycle aborted by error condition!\n" },
+
+#if CONDITIONING_CYCLE
+    // Conditioning ends once the pulse current levels off, or on the timer
+    { CHARGER_CONDITION, CYCLE_DONE, ANY_BATTERY_MV, nullptr, CHARGER_TRICKLE, SOC_KEEP,
+      "Conditioning cycle completed\n\n" },
+    { CHARGER_CONDITION, CYCLE_TIMEOUT, ANY_BATTERY_MV, nullptr, CHARGER_TRICKLE, SOC_KEEP,
+      "Conditioning cycle timed-out, starting trickle charge\n\n" },
+    { CHARGER_CONDITION, CYCLE_ERROR, ANY_BATTERY_MV, nullptr, CHARGER_SHUTDOWN, SOC_KEEP,
+      "Conditioning cycle aborted by safety limit!\n" },
+#endif
+
+    // Standby ends on the timer, fast if discharged heavily, trickle otherwise
+    { CHARGER_STANDBY, CYCLE_TIMEOUT, BATTERY_DISCHARGED_MV, nullptr, CHARGER_FAST, SOC_REST,
+      "Exiting standby mode\n\n"
+      "Battery voltage @ %s volts, starting fast charge\n" },
+    { CHARGER_STANDBY, CYCLE_TIMEOUT, ANY_BATTERY_MV, nullptr, CHARGER_TRICKLE, SOC_REST,
+      "Exiting standby mode\n\n"
+      "Battery voltage @ %s volts, starting trickle charge\n" },
+
+    { CHARGER_SHUTDOWN, CYCLE_DONE, ANY_BATTERY_MV, nullptr, CHARGER_SHUTDOWN, SOC_KEEP, nullptr },
+
+#if LOAD_TEST_CYCLE
+    // Load test ends after the rest following its charge, and fails a worn
+    // battery, which is then left alone rather than charged
+    { CHARGER_LOAD_TEST, CYCLE_DONE, BATTERY_DISCHARGED_MV, nullptr, CHARGER_FAST, SOC_REST,
+      "Battery load test completed\n"
+      "Battery voltage @ %s volts, starting fast charge\n\n" },
+    { CHARGER_LOAD_TEST, CYCLE_DONE, ANY_BATTERY_MV, nullptr, CHARGER_TOPPING, SOC_REST,
+      "Battery load test completed\n"
+      "Battery voltage @ %s volts, starting topping charge\n\n" },
+    { CHARGER_LOAD_TEST, CYCLE_TIMEOUT, ANY_BATTERY_MV, nullptr, CHARGER_TOPPING, SOC_KEEP,
+      "Battery load test timed-out, starting topping charge\n\n" },
+    { CHARGER_LOAD_TEST, CYCLE_ERROR, ANY_BATTERY_MV, nullptr, CHARGER_SHUTDOWN, SOC_KEEP,
+      "Battery failed load test, replace battery!\n" },
+#endif
+};
+
+/**
+ *  @brief Look up the handler for a charger state
+ *  @param state: Charger state
+ *  @returns Stage table entry, nullptr if the state has no entry
+ */
+const charger_stage_t *charger_stage(charger_state_t state);
+
+/**
+ *  @brief Look up the transition taken for a handler result
+ *  @param state: Charger state
+ *  @param result: Result returned by the state's handler
+ *  @param battery_mV: Battery voltage (mV)
+ *  @param channel: Battery channel, for the transition guards
+ *  @returns Transition table entry, nullptr if there is no match
+ */
+const charger_transition_t *charger_transition(charger_state_t state, cycle_state_t result,
+                                               voltage_mv_t battery_mV,
+                                               const Charge_Channel &channel);
+
+/**
+ *  @brief Run the handler for a channel's charger state and move to the
+ *         next state when it finishes
+ *  @param channel: Battery channel connected to the regulator
+ *  @returns Nothing
+ *  @note Called by the channel scheduler every `LOOP_DELAY`.
+ */
+void charger_supervisor(Charge_Channel &channel);
+
+#endif
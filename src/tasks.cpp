@@ -0,0 +1,170 @@
+/**
+ * @file tasks.cpp
+ * @brief Cooperative task scheduler for the main loop
+ *
+ * Copyright(c) 2025  John Glynn
+ *
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ */
+
+#include "tasks.h"
+#include "power.h"
+#include "console.h"
+
+//
+// Global variables
+//
+extern Low_Power low_power;                 ///< Stop mode support
+extern Console_TX console;                  ///< Serial console output
+
+// Default constructor
+Task_Scheduler::Task_Scheduler(void) {
+    begin_time = 0;
+    for (task_t &t : tasks) {
+        t = {};
+    }
+}
+
+// Clear the task table and start the run-time accounting
+void Task_Scheduler::begin(void) {
+    for (task_t &t : tasks) {
+        t = {};
+    }
+    begin_time = millis();
+}
+
+// Add a periodic task
+task_id_t Task_Scheduler::add(const char *name_str, task_fn_t fn, time_ms_t period,
+                              task_priority_t priority) {
+    return add_task(name_str, fn, period, period, priority, false);
+}
+
+// Add a one-shot task
+task_id_t Task_Scheduler::add_once(const char *name_str, task_fn_t fn, time_ms_t delay_ms,
+                                   task_priority_t priority) {
+    return add_task(name_str, fn, 0, delay_ms, priority, true);
+}
+
+// Add a task to the first free slot
+task_id_t Task_Scheduler::add_task(const char *name_str, task_fn_t fn, time_ms_t period,
+                                   time_ms_t delay_ms, task_priority_t priority, bool once) {
+    for (task_id_t id = 0; id < (task_id_t)TASKS_MAX; id++) {
+        if (tasks[id].fn == nullptr) {
+            tasks[id] = {};
+            tasks[id].name_str = name_str;
+            tasks[id].fn = fn;
+            tasks[id].period = period;
+            tasks[id].due = millis() + delay_ms;
+            tasks[id].priority = priority;
+            tasks[id].once = once;
+            return id;
+        }
+    }
+    console.printf("Error: Unable to add task '%s', task table full\n", name_str);
+    return -1;
+}
+
+// Remove a task, freeing its slot
+void Task_Scheduler::cancel(task_id_t id) {
+    if ((id >= 0) && (id < (task_id_t)TASKS_MAX)) {
+        tasks[id].fn = nullptr;
+    }
+}
+
+// Run every task that's due, most urgent priority first
+// The table is searched again after each task, since a long task can
+// make others due, and each task runs at most once a pass
+void Task_Scheduler::run(void) {
+    uint32_t ran = 0;   // Tasks run this pass, one bit per slot
+
+    while (true) {
+        time_ms_t now = millis();
+        task_id_t next = -1;
+        for (task_id_t id = 0; id < (task_id_t)TASKS_MAX; id++) {
+            const task_t &t = tasks[id];
+            if ((t.fn == nullptr) || (ran & (1UL << id)) || ((int32_t)(now - t.due) < 0)) {
+                continue;
+            }
+            if ((next < 0) || (t.priority < tasks[next].priority)) {
+                next = id;
+            }
+        }
+        if (next < 0) {
+            return;
+        }
+        ran |= 1UL << next;
+        execute(next, now);
+    }
+}
+
+// Run a task, set when it's next due and account for its time
+void Task_Scheduler::execute(task_id_t id, time_ms_t now) {
+    task_t &t = tasks[id];
+
+    // Due a period after it was last due, unless it has fallen a whole
+    // period behind
+    if (!t.once) {
+        t.due += t.period;
+        if ((int32_t)(now - t.due) >= (int32_t)t.period) {
+            t.due = now + t.period;
+        }
+    }
+
+    // One-shot tasks free their slot first, so they can add another
+    task_fn_t fn = t.fn;
+    if (t.once) {
+        t.fn = nullptr;
+    }
+
+#if TASK_ACCOUNTING
+    // Time spent in Stop mode (standby) isn't the task's own
+    uint32_t start_us = micros();
+    time_ms_t start_slept = low_power.slept_ms();
+    fn();
+    uint32_t run_us = (micros() - start_us) - (low_power.slept_ms() - start_slept) * 1000;
+
+    // Leave the accounting alone if a new task has taken the slot
+    if (t.once && (t.fn != nullptr)) {
+        return;
+    }
+    t.runs++;
+    t.total_us += run_us;
+    t.max_us = std::max(t.max_us, run_us);
+#else
+    fn();
+#endif
+}
+
+// Get the time until the next task is due
+time_ms_t Task_Scheduler::time_to_next(void) {
+    time_ms_t now = millis();
+    time_ms_t next = UINT32_MAX;
+    for (const task_t &t : tasks) {
+        if ((t.fn == nullptr) || (!t.once && (t.period == TASK_EVERY_PASS))) {
+            continue;
+        }
+        int32_t remaining = (int32_t)(t.due - now);
+        next = std::min(next, (time_ms_t)std::max<int32_t>(remaining, 0));
+    }
+    return next;
+}
+
+// Print the run-time accounting for each task to the console
+// Shares are of the time awake, as nothing runs in Stop mode
+void Task_Scheduler::print_report(void) {
+#if TASK_ACCOUNTING
+    uint64_t awake_us = (uint64_t)(millis() - begin_time - low_power.slept_ms()) * 1000;
+
+    console.printf("Task, Runs, \"Average (us)\", \"Max (us)\", \"Busy (%%)\"\n");
+    for (const task_t &t : tasks) {
+        if (t.fn == nullptr) {
+            continue;
+        }
+        uint32_t average_us = t.runs ? (uint32_t)(t.total_us / t.runs) : 0;
+        uint32_t busy = awake_us ? (uint32_t)(t.total_us * 1000 / awake_us) : 0;
+        console.printf("%s, %u, %u, %u, %u.%u\n", t.name_str, t.runs, average_us, t.max_us,
+                      busy / 10, busy % 10);
+    }
+#endif
+}
@@ -0,0 +1,173 @@
+/**
+ * @file tasks.h
+ * @brief Cooperative task scheduler for the main loop
+ *
+ * Copyright(c) 2025  John Glynn
+ *
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ *
+ * @details
+ * The work done by `loop()` is split into tasks, each a function registered
+ * with the `Task_Scheduler` along with a period and a priority.  Each pass
+ * of `loop()` runs every task that's due, most urgent priority first (and in
+ * the order they were added within a priority), so the charging supervisor
+ * isn't held up behind console messages or OLED updates.  Tasks are
+ * cooperative: each runs to completion, and should return quickly.
+ *
+ * Periodic tasks are due again a period after they were last due, rather
+ * than after they last ran, so the charging supervisor runs at a steady
+ * `LOOP_DELAY` however long the other tasks take.  A task that falls more
+ * than a period behind skips the runs it missed.  Tasks with a period of
+ * `TASK_EVERY_PASS` run on every pass, to keep background transfers moving.
+ * One-shot tasks run once, after a delay, and free their slot.
+ *
+ * Between passes, `time_to_next()` gives the time until the next task is
+ * due, so the processor can wait for an interrupt rather than spin.
+ *
+ * The time each task takes is measured with `micros()`, leaving out time
+ * spent in Stop mode, so `print_report()` shows where the time goes.  Built
+ * with `-D TASK_ACCOUNTING=0`, the measurement and report are left out.
+ *
+ * The task table is a fixed array of `TASKS_MAX` slots, with no dynamic
+ * memory allocation.
+ */
+#ifndef _TASKS_H_
+#define _TASKS_H_
+
+#include "obcharger.h"
+
+/**
+ *  @brief Measure the time each task takes, for `print_report()`
+ *  @note Leave it out with a build flag (-D TASK_ACCOUNTING=0)
+ */
+#ifndef TASK_ACCOUNTING
+#define TASK_ACCOUNTING     1               ///< Task run-time accounting (0=off, 1=on)
+#endif
+
+const uint8_t TASKS_MAX = 8;                ///< Task table slots
+const time_ms_t TASK_EVERY_PASS = 0;        ///< Period for a task run on every pass of `loop()`
+
+/**
+ *  @brief Task function, called when the task is due
+ */
+typedef void (*task_fn_t)(void);
+
+/**
+ *  @brief Task identifier, the slot in the task table (-1=none)
+ */
+typedef int8_t task_id_t;
+
+/**
+ *  @brief Task priorities, most urgent first
+ */
+enum task_priority_t {
+    TASK_PRIORITY_HIGH = 0,                 ///< Charging control and the I/O it depends on
+    TASK_PRIORITY_NORMAL = 1,               ///< Status indicators
+    TASK_PRIORITY_LOW = 2,                  ///< Console messages and displays
+};
+
+/**
+ *  @brief Task table entry, with its run-time accounting
+ */
+struct task_t {
+    const char *name_str;                   ///< Task name for the report
+    task_fn_t fn;                           ///< Task function, nullptr if the slot is free
+    time_ms_t period;                       ///< Time between runs (ms)
+    time_ms_t due;                          ///< millis() time the task is next due
+    task_priority_t priority;               ///< Task priority
+    bool once;                              ///< One-shot task?
+#if TASK_ACCOUNTING
+    uint32_t runs;                          ///< Number of times the task has run
+    uint64_t total_us;                      ///< Total time spent in the task (us)
+    uint32_t max_us;                        ///< Longest single run (us)
+#endif
+};
+
+/**
+ *  @brief Cooperative task scheduler
+ */
+class Task_Scheduler {
+public:
+    /// @brief Default constructor
+    Task_Scheduler(void);
+
+    /**
+     *  @brief Clear the task table and start the run-time accounting
+     *  @returns Nothing
+     */
+    void begin(void);
+
+    /**
+     *  @brief Add a periodic task
+     *  @param name_str: Task name for the report
+     *  @param fn: Task function
+     *  @param period: Time between runs (ms), or `TASK_EVERY_PASS`
+     *  @param priority: Task priority
+     *  @returns Task identifier, -1 if the task table is full
+     *  @note The task first runs a period after it's added.
+     */
+    task_id_t add(const char *name_str, task_fn_t fn, time_ms_t period, task_priority_t priority);
+
+    /**
+     *  @brief Add a one-shot task
+     *  @param name_str: Task name for the report
+     *  @param fn: Task function
+     *  @param delay_ms: Time until the task runs (ms)
+     *  @param priority: Task priority
+     *  @returns Task identifier, -1 if the task table is full
+     */
+    task_id_t add_once(const char *name_str, task_fn_t fn, time_ms_t delay_ms,
+                       task_priority_t priority);
+
+    /**
+     *  @brief Remove a task, freeing its slot
+     *  @param id: Task identifier
+     *  @returns Nothing
+     */
+    void cancel(task_id_t id);
+
+    /**
+     *  @brief Run every task that's due, most urgent priority first
+     *  @returns Nothing
+     *  @note Called from `loop()`.  Each task runs at most once a pass.
+     */
+    void run(void);
+
+    /**
+     *  @brief Get the time until the next task is due
+     *  @returns Time until the next periodic or one-shot task (ms), 0 if
+     *           one is due now
+     *  @note Tasks run on every pass aren't counted, as they're waiting on
+     *        interrupts rather than the clock.
+     */
+    time_ms_t time_to_next(void);
+
+    /**
+     *  @brief Print the run-time accounting for each task to the console
+     *  @returns Nothing
+     *  @note Prints nothing without `TASK_ACCOUNTING`.
+     */
+    void print_report(void);
+
+private:
+    task_t tasks[TASKS_MAX];                ///< Task table
+    time_ms_t begin_time;                   ///< millis() time the accounting started
+
+    /**
+     *  @brief Add a task to the first free slot
+     *  @returns Task identifier, -1 if the task table is full
+     */
+    task_id_t add_task(const char *name_str, task_fn_t fn, time_ms_t period, time_ms_t delay_ms,
+                       task_priority_t priority, bool once);
+
+    /**
+     *  @brief Run a task, set when it's next due and account for its time
+     *  @param id: Task identifier
+     *  @param now: millis() time of the pass
+     *  @returns Nothing
+     */
+    void execute(task_id_t id, time_ms_t now);
+};
+
+#endif
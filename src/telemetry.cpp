@@ -0,0 +1,109 @@
+/**
+ * @file telemetry.cpp
+ * @brief Binary telemetry records for the serial console
+ *
+ * Copyright(c) 2025  John Glynn
+ *
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ */
+
+#include "telemetry.h"
+#include "utility.h"
+#include "console.h"
+
+//
+// Global variables
+//
+extern Console_TX console;                  ///< Serial console output
+
+// COBS encode a block of data
+// Each run of up to 254 non-zero bytes is preceded by a code byte, one more
+// than the length of the run.  A code below 0xFF stands for a zero byte
+// after the run as well, except at the end of the data.
+uint8_t cobs_encode(const uint8_t *data, uint8_t size, uint8_t *buffer) {
+    uint8_t code_pos = 0;
+    uint8_t code = 1;
+    uint8_t out = 1;
+    for (uint8_t i = 0; i < size; i++) {
+        if (data[i] != 0) {
+            buffer[out++] = data[i];
+            code++;
+        }
+        if ((data[i] == 0) || (code == 0xFF)) {
+            buffer[code_pos] = code;
+            code_pos = out++;
+            code = 1;
+        }
+    }
+    buffer[code_pos] = code;
+    return out;
+}
+
+// Decode a block of COBS encoded data
+uint8_t cobs_decode(const uint8_t *data, uint8_t size, uint8_t *buffer) {
+    uint8_t in = 0;
+    uint8_t out = 0;
+    while (in < size) {
+        uint8_t code = data[in++];
+        if ((code == 0) || (in + code - 1 > size)) {
+            return 0;
+        }
+        for (uint8_t i = 1; i < code; i++) {
+            if (data[in] == 0) {
+                return 0;
+            }
+            buffer[out++] = data[in++];
+        }
+        if ((code < 0xFF) && (in < size)) {
+            buffer[out++] = 0;
+        }
+    }
+    return out;
+}
+
+// Pack a record into a frame for sending
+uint8_t telemetry_pack(const void *record, uint8_t size, uint8_t *frame) {
+    uint8_t packet[TELEMETRY_FRAME_MAX];
+    if (size + 2 + 1 + 2 > TELEMETRY_FRAME_MAX) {
+        return 0;
+    }
+
+    // Record and its CRC (little-endian)
+    memcpy(packet, record, size);
+    uint16_t crc = crc16_ccitt(packet, size);
+    packet[size] = (uint8_t)crc;
+    packet[size + 1] = (uint8_t)(crc >> 8);
+
+    // Encoded between zero delimiters
+    frame[0] = 0;
+    uint8_t length = cobs_encode(packet, size + 2, frame + 1);
+    frame[length + 1] = 0;
+    return length + 2;
+}
+
+// Send a record to the serial console
+void telemetry_send(const void *record, uint8_t size) {
+    uint8_t frame[TELEMETRY_FRAME_MAX];
+    uint8_t length = telemetry_pack(record, size, frame);
+    if (length > 0) {
+        console.write(frame, length);
+    }
+}
+
+// Unpack a record received from the serial console
+bool telemetry_unpack(const uint8_t *frame, uint8_t size, void *record, uint8_t record_size) {
+    uint8_t packet[TELEMETRY_FRAME_MAX];
+    if ((size > TELEMETRY_FRAME_MAX) || (record_size + 2 > TELEMETRY_FRAME_MAX)) {
+        return false;
+    }
+    if (cobs_decode(frame, size, packet) != record_size + 2) {
+        return false;
+    }
+    uint16_t crc = packet[record_size] | ((uint16_t)packet[record_size + 1] << 8);
+    if (crc16_ccitt(packet, record_size) != crc) {
+        return false;
+    }
+    memcpy(record, packet, record_size);
+    return true;
+}
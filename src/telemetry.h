@@ -0,0 +1,114 @@
+/**
+ * @file telemetry.h
+ * @brief Binary telemetry records for the serial console
+ *
+ * Copyright(c) 2025  John Glynn
+ *
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ *
+ * @details
+ * The charging cycles write a CSV status line to the serial console every
+ * `message_period`, formatting each reading as text with `printf`.
+ * Built with `-D TELEMETRY_BINARY=1`, they send the readings as a binary
+ * record instead, with no formatting.
+ *
+ * Each record has a fixed layout (`telemetry_status_t`, little-endian) and
+ * is followed by its CRC-16/CCITT.  The record and CRC are COBS encoded
+ * (Consistent Overhead Byte Stuffing), which removes every zero byte at
+ * the cost of one byte in 254, and sent with a zero byte on either side.
+ * A receiver can then find the start of each record in the stream, even
+ * mid-record, and tell records from the other console messages, which are
+ * still text and never contain a zero byte.
+ *
+ * The simulator's `--decode` option turns a captured stream back into the
+ * CSV status lines (see `sim/README.md`).
+ */
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+#include "obcharger.h"
+
+/**
+ *  @brief Send binary telemetry records in place of the CSV status lines
+ *  @note Select with a build flag (-D TELEMETRY_BINARY=1)
+ */
+#ifndef TELEMETRY_BINARY
+#define TELEMETRY_BINARY    0               ///< Binary telemetry records (0=off, 1=on)
+#endif
+
+const uint8_t TELEMETRY_STATUS = 1;         ///< Record type of a charging cycle status record
+const uint8_t TELEMETRY_FRAME_MAX = 64;     ///< Largest encoded record, delimiters included (bytes)
+
+/**
+ *  @brief Charging cycle status record
+ *  @note Times left are `ETA_UNKNOWN` when they can't be predicted.
+ */
+typedef struct __attribute__((packed)) {
+    uint8_t type;                           ///< Record type (`TELEMETRY_STATUS`)
+    uint8_t battery;                        ///< Battery number, 0 with a single channel
+    uint8_t state;                          ///< Charger state (`charger_state_t`)
+    uint8_t soc;                            ///< Estimated state of charge (%)
+    uint32_t time_ms;                       ///< millis() time of the record
+    uint32_t elapsed_ms;                    ///< Time elapsed in the charging cycle (ms)
+    uint16_t bus_mV;                        ///< Regulator output voltage (mV)
+    uint16_t battery_mV;                    ///< Battery voltage (mV)
+    uint16_t current_mA;                    ///< Charging current (mA)
+    uint16_t set_mV;                        ///< Regulator set voltage (mV)
+    uint16_t dac_level;                     ///< Regulator DAC level
+    uint32_t stage_left_ms;                 ///< Predicted time left in the cycle (ms)
+    uint32_t full_left_ms;                  ///< Predicted time until the battery is full (ms)
+} telemetry_status_t;
+
+// Record, CRC, COBS overhead and delimiters
+static_assert(sizeof(telemetry_status_t) + 2 + 1 + 2 <= TELEMETRY_FRAME_MAX, "Status record too large");
+
+/**
+ *  @brief COBS encode a block of data
+ *  @param data: Data to encode (up to 253 bytes)
+ *  @param size: Size of the data (bytes)
+ *  @param buffer: Buffer for the encoded data, at least size + 1 bytes
+ *  @returns Size of the encoded data (bytes), with no zero bytes in it
+ */
+uint8_t cobs_encode(const uint8_t *data, uint8_t size, uint8_t *buffer);
+
+/**
+ *  @brief Decode a block of COBS encoded data
+ *  @param data: Encoded data, without the zero delimiters
+ *  @param size: Size of the encoded data (bytes)
+ *  @param buffer: Buffer for the decoded data, at least size bytes
+ *  @returns Size of the decoded data (bytes), 0 if it isn't valid COBS
+ */
+uint8_t cobs_decode(const uint8_t *data, uint8_t size, uint8_t *buffer);
+
+/**
+ *  @brief Pack a record into a frame for sending
+ *  @param record: Record to pack
+ *  @param size: Size of the record (bytes)
+ *  @param frame: Buffer for the frame, `TELEMETRY_FRAME_MAX` bytes
+ *  @returns Size of the frame (bytes), 0 if the record is too large
+ *  @note The CRC is added and the record and CRC encoded, between zero
+ *        delimiters.
+ */
+uint8_t telemetry_pack(const void *record, uint8_t size, uint8_t *frame);
+
+/**
+ *  @brief Send a record to the serial console
+ *  @param record: Record to send
+ *  @param size: Size of the record (bytes)
+ *  @returns Nothing
+ *  @note The frame is sent in a single write.
+ */
+void telemetry_send(const void *record, uint8_t size);
+
+/**
+ *  @brief Unpack a record received from the serial console
+ *  @param frame: Encoded record, without the zero delimiters
+ *  @param size: Size of the encoded record (bytes)
+ *  @param record: Buffer for the record
+ *  @param record_size: Size of the record expected (bytes)
+ *  @returns true=Valid record of the expected size, with a matching CRC
+ */
+bool telemetry_unpack(const uint8_t *frame, uint8_t size, void *record, uint8_t record_size);
+
+#endif
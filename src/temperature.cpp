@@ -0,0 +1,60 @@
+/**
+ * @file temperature.cpp
+ * @brief Internal temperature sensor readings and voltage target compensation
+ *
+ * Copyright(c) 2025  John Glynn
+ *
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ */
+
+#include "temperature.h"
+
+#ifdef ARDUINO_ARCH_STM32
+
+/// @brief Factory calibration reading (12-bit, at TEMP_CAL_REF_MV and TEMP_CAL_DC)
+#define TEMP_CAL_COUNT      (*TEMPSENSOR_CAL1_ADDR)
+
+/// @brief A/D reference voltage for the calibration reading (mV)
+#define TEMP_CAL_REF_MV     TEMPSENSOR_CAL_VREFANALOG
+
+/// @brief Temperature of the calibration reading (0.1C)
+#define TEMP_CAL_DC         (TEMPSENSOR_CAL1_TEMP * 10)
+
+#else
+
+// Host build: a typical part, 760 mV at 30C
+#define TEMP_CAL_COUNT      1038
+#define TEMP_CAL_REF_MV     3000
+#define TEMP_CAL_DC         300
+
+#endif
+
+// Default constructor
+Temp_Sensor::Temp_Sensor(void) {
+}
+
+// Read the internal temperature sensor from the A/D scan
+void Temp_Sensor::begin(void) {
+    ADC_Input::begin(ADC_TEMP_SLOT, ATEMP);
+}
+
+// Get the temperature
+// The sensor voltage is compared with the calibration reading in uV, and
+// every TEMP_SENSOR_SLOPE_UV/10 uV is a tenth of a degree
+temp_dc_t Temp_Sensor::get_temperature_dC(void) {
+    int32_t sensor_uV = (int32_t)(((uint64_t)get_result_average() * AN_REF_VOLTAGE * 1000)
+                                  >> ADC_RESULT_BITS);
+    int32_t cal_uV = (int32_t)(((uint32_t)TEMP_CAL_COUNT * TEMP_CAL_REF_MV * 1000) >> AN_READ_BITS);
+    return TEMP_CAL_DC + (sensor_uV - cal_uV) / (TEMP_SENSOR_SLOPE_UV / 10) - TEMP_SENSOR_OFFSET_DC;
+}
+
+// Move a voltage target for the temperature
+voltage_mv_t temp_compensate(voltage_mv_t target_mV, int8_t slope_mV, temp_dc_t temp_dC) {
+    if ((temp_dC < TEMP_SENSOR_MIN_DC) || (temp_dC > TEMP_SENSOR_MAX_DC)) {
+        return target_mV;
+    }
+    temp_dC = constrain(temp_dC, TEMP_COMP_MIN_DC, TEMP_COMP_MAX_DC);
+    return (voltage_mv_t)((int32_t)target_mV +
+                          slope_mV * BATTERY_CELLS * (temp_dC - TEMP_COMP_REF_DC) / 10);
+}
@@ -0,0 +1,70 @@
+/**
+ * @file temperature.h
+ * @brief Internal temperature sensor readings and voltage target compensation
+ *
+ * Copyright(c) 2025  John Glynn
+ *
+ * This code is licensed under the MIT License.
+ * See the LICENSE file for the full license text.
+ *
+ * @details
+ * The STM32G030's internal temperature sensor is the last input scanned by
+ * the background A/D conversions, so its readings are oversampled and
+ * averaged like the battery voltages, and cost nothing to take.  The
+ * sensor voltage is converted using the factory calibration reading taken
+ * at 30C and the sensor's typical slope of 2.5 mV/C.
+ *
+ * Lead-acid charging voltages fall by about 3 mV/C per cell as the battery
+ * warms up, so each charging cycle's voltage target, set for 25C, is moved
+ * by `temp_compensate()`.  Without it, a cold battery ends up undercharged
+ * and a hot one gassing.
+ */
+#ifndef _TEMPERATURE_H_
+#define _TEMPERATURE_H_
+
+#include "obcharger.h"
+#include "battery.h"
+
+/// @brief Temperature sensor slope (uV/C)
+const int32_t TEMP_SENSOR_SLOPE_UV = 2500;
+
+/// @brief Lowest temperature the sensor reads, anything lower is a fault (0.1C)
+const temp_dc_t TEMP_SENSOR_MIN_DC = -400;
+
+/// @brief Highest temperature the sensor reads, anything higher is a fault (0.1C)
+const temp_dc_t TEMP_SENSOR_MAX_DC = 1250;
+
+/// @brief Internal temperature sensor class
+class Temp_Sensor : public ADC_Input {
+public:
+    /// @brief Default constructor
+    Temp_Sensor(void);
+
+    /**
+     *  @brief Read the internal temperature sensor from the A/D scan
+     *  @returns Nothing
+     *  @note The A/D conversions are started by the last battery channel.
+     */
+    void begin(void);
+
+    /**
+     *  @brief Get the temperature
+     *  @returns Temperature (0.1C), less `TEMP_SENSOR_OFFSET_DC`
+     *  @note Average of the `ADC_SAMPLES` results in the buffer.
+     */
+    temp_dc_t get_temperature_dC(void);
+};
+
+/**
+ *  @brief Move a voltage target for the temperature
+ *  @param target_mV: Voltage target at `TEMP_COMP_REF_DC` (mV)
+ *  @param slope_mV: Compensation slope (mV/C per cell)
+ *  @param temp_dC: Temperature (0.1C)
+ *  @returns Voltage target at the temperature (mV)
+ *  @note The temperature is held to `TEMP_COMP_MIN_DC` to `TEMP_COMP_MAX_DC`,
+ *        and a temperature the sensor can't read (e.g. before the A/D
+ *        conversions start) leaves the target alone.
+ */
+voltage_mv_t temp_compensate(voltage_mv_t target_mV, int8_t slope_mV, temp_dc_t temp_dC);
+
+#endif
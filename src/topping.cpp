@@ -8,25 +8,33 @@
  * See the LICENSE file for the full license text.
  */
 #include "topping.h"
+#include "channel.h"
+#include "console.h"
 
 //
 // Global variables
 //
 extern Alarm_Pool timer_pool;               // Hardware timers
 extern Vreg vreg;                           // Voltage regulator
-extern Battery battery;                     // Battery
-extern bool oled_found;                     // OLED display found at startup in main()?
+extern Console_TX console;                  // Serial console output
 
 // Default constructor
 Topping_Charger::Topping_Charger() : Charge_Cycle() {
+    last_duration = 0;
 }
 
 // Destructor (best practice)
 Topping_Charger::~Topping_Charger() {};
 
 // Constructor with initialization
-Topping_Charger::Topping_Charger(charge_parm_t &p) : Charge_Cycle(p) {
-    init(p);
+Topping_Charger::Topping_Charger(charge_parm_t &p, Charge_Channel *channel) : Charge_Cycle(p, channel) {
+    last_duration = 0;
+}
+
+// Start a new topping charging cycle
+void Topping_Charger::start(void) {
+    Charge_Cycle::start();
+    channel->eta.begin(true, false);
 }
 
 //  Run-time handler to manage charging cycle
@@ -47,49 +55,50 @@ cycle_state_t Topping_Charger::run() {
 
     // Get voltage and current readings
     current_ma_t charging_current = vreg.get_current_mA();
-    voltage_mv_t battery_voltage = battery.get_voltage_mV();
+    voltage_mv_t battery_voltage = channel->battery.get_voltage_mV();
+
+    // The current tapers off while the battery is held at the target
+    bool constant_voltage = (battery_voltage + VOLTS_HYSTERESIS >= get_target_voltage());
+    predict(charging_current, constant_voltage);
 
-    // Has target been reached?
-    if ((state_code != CYCLE_STARTUP) && (charging_current <= target_current)) {
+    // Startup ends early once the readings have settled
+    if ((state_code == CYCLE_STARTUP) && readings_settled(battery_voltage, charging_current)) {
+        state_code = CYCLE_RUNNING;
+    }
+
+    // Has target been reached?  The current tapers off as the battery
+    // fills, but may not drop below the target for an older battery, so
+    // the cycle also ends once the battery is estimated to be full.
+    if ((state_code != CYCLE_STARTUP) &&
+        ((charging_current <= target_current) || soc_target_reached())) {
         // Yes, turn regulator off and return
+        last_duration = charging_time_elapsed();
         stop();
         state_code = CYCLE_DONE;
         return state_code;
     }
 
-    // Target voltage not reached, check and adjust voltage as needed
-    if (charging_current > max_current) {
-        // Avoid excess current
-        set_voltage -= step_voltage;
-        vreg.set_voltage_mV(set_voltage);
-    } else {
-        // Normal regulation to keep voltage stable
-        if (battery_voltage > target_voltage + VOLTS_HYSTERESIS) {
-            set_voltage -= step_voltage;
-            vreg.set_voltage_mV(set_voltage);
-        } else {
-            if (battery_voltage < target_voltage - VOLTS_HYSTERESIS) {
-                set_voltage += step_voltage;
-                vreg.set_voltage_mV(set_voltage);
-            }
-        }
+    // Topping charging is also complete if the current has stopped
+    // tapering while the battery is held at the target voltage, as
+    // charging on only gasses the battery
+    if ((state_code != CYCLE_STARTUP) && plateau_reached(charging_current, constant_voltage)) {
+        char slope_str[12];
+        snprintf(slope_str, sizeof(slope_str), "%+d", (int)channel->trend.slope_per_hour());
+        channel->print_label();
+        console.printf("Charging current levelled off @ %s mA/h\n", slope_str);
+        last_duration = charging_time_elapsed();
+        stop();
+        state_code = CYCLE_DONE;
+        return state_code;
     }
 
-    // Update RGB LED status as needed
-    status_led();
+    // Hold the battery at the target voltage, without exceeding the
+    // maximum charging current
+    regulate(charging_current, battery_voltage, max_current);
 
-    // Update any attached OLED displays
-    if (millis() - display_timer >= display_period) {
-        display_timer = millis();
-        if (oled_found) {
-            status_message(DISPLAY_OLED);
-        }
-    }
-
-    // Update serial console
-    if (millis() - message_timer >= message_period) {
-        message_timer = millis();
-        status_message(DISPLAY_CONSOLE);
+    // Measure the battery's internal resistance once the current has settled
+    if (state_code != CYCLE_STARTUP) {
+        measure_resistance();
     }
 
     // Normal exit
@@ -97,3 +106,19 @@ cycle_state_t Topping_Charger::run() {
 }
 
 
+
+// Predict the time left for the charging current to taper off to the target
+time_ms_t Topping_Charger::stage_time_remaining(void) {
+    time_ms_t eta = channel->eta.time_to(target_current);
+    return (eta == ETA_UNKNOWN) ? ETA_UNKNOWN : std::min(eta, charging_time_remaining());
+}
+
+// Predict the time until the battery is full
+time_ms_t Topping_Charger::full_time_remaining(void) {
+    return stage_time_remaining();
+}
+
+// Get the time topping charging is expected to take
+time_ms_t Topping_Charger::expected_duration(void) {
+    return (last_duration != 0) ? last_duration : TOP_DURATION_DEFAULT_MS;
+}
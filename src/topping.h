@@ -30,8 +30,9 @@
  *  1. Create new Topping_Charger object with appropriate settings
  *  2. Call start method once to begin a charge cycle
  *  3. Call run method periodically (100 ms) intervals
- *  4. Charge cycle continues until current drops below CURRENT_TARGET, or 
- *    until an error condition or timeout is detected
+ *  4. Charge cycle continues until current drops below CURRENT_TARGET, or
+ *    the estimated state of charge reaches the target, or until an error
+ *    condition or timeout is detected
  */
 #ifndef _TOPPING_CHARGE_H_
 #define _TOPPING_CHARGE_H_
@@ -43,6 +44,9 @@
 #include "utility.h"
 #include <stm32_time.h>
 
+/// @brief Time topping charging is expected to take, until one has completed (ms)
+const time_ms_t TOP_DURATION_DEFAULT_MS = HOUR_MS;
+
 /**
  * @brief Topping charging cycle handler for SLA batteries
  * 
@@ -84,16 +88,38 @@ public:
 
     /// @brief Constructor with initialization
     /// @note See the init() member function for details
-    Topping_Charger(charge_parm_t &p);
+    Topping_Charger(charge_parm_t &p, Charge_Channel *channel);
 
     /// @brief Destructor (best practice)
     ~Topping_Charger();
 
+    /// @brief Start a new topping charging cycle, predicting the time left
+    ///        from the charging current's taper
+    /// @returns Nothing
+    void start(void);
+
     /// @brief Run-time handler to manage charging cycle
     /// @returns Charging state
     cycle_state_t run(void);
 
+    /// @brief Predict the time left for the charging current to taper off
+    ///        to the target, extrapolating its exponential decay
+    /// @returns Time left (ms), or `ETA_UNKNOWN`
+    time_ms_t stage_time_remaining(void);
+
+    /// @brief Predict the time until the battery is full, at the end of
+    ///        topping charging
+    /// @returns Time left (ms), or `ETA_UNKNOWN`
+    time_ms_t full_time_remaining(void);
+
+    /// @brief Get the time topping charging is expected to take, for
+    ///        predictions made before it starts
+    /// @returns Duration of the last topping charging cycle to complete
+    ///          on the channel, or `TOP_DURATION_DEFAULT_MS` (ms)
+    time_ms_t expected_duration(void);
+
 private:
+    time_ms_t last_duration;                ///< Duration of the last completed cycle (ms, 0=none)
 
 };
 
@@ -8,22 +8,20 @@
  *  See the LICENSE file for the full license text.
  */
 #include "trickle.h"
+#include "channel.h"
 
 //
 // Global variables
 //
 extern Alarm_Pool timer_pool;               // Hardware timers
 extern Vreg vreg;                           // Voltage regulator
-extern Battery battery;                     // Battery
-extern bool oled_found;                     // OLED display found at startup in main()?
 
 // Default constructor
 Trickle_Charger::Trickle_Charger() : Charge_Cycle() {
 }
 
 // Constructor with initialization
-Trickle_Charger::Trickle_Charger(charge_parm_t &p) : Charge_Cycle(p) {
-    init(p);
+Trickle_Charger::Trickle_Charger(charge_parm_t &p, Charge_Channel *channel) : Charge_Cycle(p, channel) {
 }
 
 // Destructor (best practice)
@@ -49,43 +47,17 @@ cycle_state_t Trickle_Charger::run() {
 
     // Get voltage and current readings
     current_ma_t charging_current = vreg.get_current_mA();
-    voltage_mv_t battery_voltage = battery.get_voltage_mV();
+    voltage_mv_t battery_voltage = channel->battery.get_voltage_mV();
 
-    // Check and adjust voltage as needed
-    if (charging_current > max_current) {
-        // Avoid excess current
-        set_voltage -= step_voltage;
-        vreg.set_voltage_mV(set_voltage);
-    } else {
-        // Normal regulation to keep voltage stable
-        if (battery_voltage > target_voltage + VOLTS_HYSTERESIS) {
-            set_voltage -= step_voltage;
-            vreg.set_voltage_mV(set_voltage);
-        } else {
-            if (battery_voltage < target_voltage - VOLTS_HYSTERESIS) {
-                set_voltage += step_voltage;
-                vreg.set_voltage_mV(set_voltage);
-            }
-        }
-    }
-
-    // Update RGB LED status as needed
-    status_led();
-
-    // Update any attached OLED displays
-    if (millis() - display_timer >= display_period) {
-        display_timer = millis();
-        if (oled_found) {
-            status_message(DISPLAY_OLED);
-        }
-    }
-
-    // Update serial console
-    if (millis() - message_timer >= message_period) {
-        message_timer = millis();
-        status_message(DISPLAY_CONSOLE);
-    }
+    // Hold the battery at the target voltage, without exceeding the
+    // maximum charging current
+    regulate(charging_current, battery_voltage, max_current);
 
     // Normal exit
     return state_code;
 }
+
+// Predict the time until the battery is full
+time_ms_t Trickle_Charger::full_time_remaining(void) {
+    return 0;
+}
@@ -93,8 +93,9 @@ public:
     /**
      * @brief Constructor with initialization
      * @param p: Charging parameters structure
+     * @param channel: Battery channel the cycle charges
      */
-    Trickle_Charger(charge_parm_t &p);
+    Trickle_Charger(charge_parm_t &p, Charge_Channel *channel);
 
     /// @brief Destructor (best practice)
     ~Trickle_Charger();
@@ -109,6 +110,12 @@ public:
      * a "completed" condition (i.e. returning `CYCLE_DONE` state).
      */
     cycle_state_t run(void);
+
+    /**
+     * @brief Predict the time until the battery is full
+     * @returns 0, as trickle charging holds a full battery
+     */
+    time_ms_t full_time_remaining(void);
  
 private:
 
@@ -1,6 +1,6 @@
 /** 
  *  @file utility.cpp
- *  @brief Utility functions for time period representation
+ *  @brief Utility functions for time period representation and checksums
  * 
  *  Copyright(c) 2025  John Glynn
  * 
@@ -31,3 +31,14 @@ void ms_to_hms_str(time_ms_t period_ms, char *buffer) {
     }
 }
 
+// CRC-16/CCITT (polynomial 0x1021, starting from 0xFFFF)
+uint16_t crc16_ccitt(const uint8_t *data, uint16_t size) {
+    uint16_t crc = 0xFFFF;
+    for (uint16_t i = 0; i < size; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
@@ -1,6 +1,6 @@
 /** 
  *  @file utility.h
- *  @brief Utility functions for time period representation
+ *  @brief Utility functions for time period representation and checksums
  * 
  *  Copyright(c) 2025  John Glynn
  * 
@@ -44,4 +44,12 @@ hms_time_t ms_to_hms_time(time_ms_t period_ms);
  */
 void ms_to_hms_str(time_ms_t period_ms, char *buffer);
 
+/**
+ *  @brief Calculate the CRC-16/CCITT of a block of data
+ *  @param data: Data to check
+ *  @param size: Size of the data (bytes)
+ *  @returns CRC (polynomial 0x1021, starting from 0xFFFF)
+ */
+uint16_t crc16_ccitt(const uint8_t *data, uint16_t size);
+
 #endif
\ No newline at end of file